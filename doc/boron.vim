@@ -118,7 +118,7 @@ syn keyword     boronType	word! set-word! get-word! lit-word!
 syn keyword     boronType	char! int! bignum! decimal! coord! vec3! vector!
 syn keyword     boronType	binary! bitset! string! file!
 syn keyword     boronType	block! paren! path! set-path!
-syn keyword     boronType	date! time! context! func! cfunc!
+syn keyword     boronType	date! time! context! map! func! cfunc!
 "syn keyword     boronTypeFunction type?
 
 " Control statements
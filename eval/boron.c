@@ -59,6 +59,9 @@ enum BoronEvalCells
 
 
 extern UPortDevice port_file;
+#ifndef _WIN32
+extern UPortDevice port_waitset;
+#endif
 #ifdef CONFIG_SOCKET
 extern UPortDevice port_socket;
 #endif
@@ -69,44 +72,60 @@ extern UPortDevice port_ssl;
 extern UPortDevice port_thread;
 #endif
 
+#ifdef CONFIG_PREDECODE
+static void boron_preInit( UThread* );
+static void boron_preFree( UThread* );
+static void boron_preSweep( UThread* );
+#endif
+#ifdef CONFIG_PROFILE
+static void prof_free( UThread* );
+#endif
+
 #include "boron_types.c"
 
 
+/*
+  Return the most recent frame of the function with body funcBuf, or zero
+  if it is not on the frame stack.
+
+  Frames are chained by funcBuf hash, so recursive calls and the current
+  function are found immediately rather than by scanning the whole stack.
+  Words of outer functions (e.g. in a nested func body) still resolve to
+  the most recent call of that function.
+*/
+static LocalFrame* boron_findFrame( UThread* ut, UIndex funcBuf )
+{
+    LocalFrame* frame = BT->frameHash[ FRAME_HASH(funcBuf) ];
+    while( frame )
+    {
+        if( frame->funcBuf == funcBuf )
+            break;
+        frame = frame->nextHash;
+    }
+    return frame;
+}
+
+
 static const UCell* boron_wordCell( UThread* ut, const UCell* cell )
 {
+    LocalFrame* frame;
+
     switch( ur_binding(cell) )
     {
         case UR_BIND_FUNC:
-        {
-            LocalFrame* bottom = BT->bof;
-            LocalFrame* top = BT->tof;
-            while( top != bottom )
-            {
-                --top;
-                if( top->funcBuf == cell->word.ctx )
-                    return top->args + cell->word.index;
-            }
-        }
+            if( (frame = boron_findFrame( ut, cell->word.ctx )) )
+                return frame->args + cell->word.index;
             ur_error( ut, UR_ERR_SCRIPT, "local word is out of scope" );
             break;
 
         case UR_BIND_OPTION:
-        {
-            LocalFrame* bottom = BT->bof;
-            LocalFrame* top = BT->tof;
-            while( top != bottom )
+            if( (frame = boron_findFrame( ut, cell->word.ctx )) )
             {
-                --top;
-                if( top->funcBuf == cell->word.ctx )
-                {
-                    // Return option logic! value.
-                    UCell* opt = top->args - 1;
-                    ur_int(opt) = (OPT_BITS(opt) & (1 << cell->word.index))
-                                  ? 1 : 0;
-                    return opt;
-                }
+                // Return option logic! value.
+                UCell* opt = frame->args - 1;
+                ur_int(opt) = (OPT_BITS(opt) & (1 << cell->word.index)) ? 1 : 0;
+                return opt;
             }
-        }
             ur_error( ut, UR_ERR_SCRIPT, "local option is out of scope" );
             break;
 
@@ -120,19 +139,13 @@ static const UCell* boron_wordCell( UThread* ut, const UCell* cell )
 
 static UCell* boron_wordCellM( UThread* ut, const UCell* cell )
 {
+    LocalFrame* frame;
+
     switch( ur_binding(cell) )
     {
         case UR_BIND_FUNC:
-        {
-            LocalFrame* bottom = BT->bof;
-            LocalFrame* top = BT->tof;
-            while( top != bottom )
-            {
-                --top;
-                if( top->funcBuf == cell->word.ctx )
-                    return top->args + cell->word.index;
-            }
-        }
+            if( (frame = boron_findFrame( ut, cell->word.ctx )) )
+                return frame->args + cell->word.index;
             ur_error( ut, UR_ERR_SCRIPT, "local word is out of scope" );
             break;
 
@@ -208,6 +221,7 @@ static void boron_threadInit( UThread* ut )
     // method will sync. the fstackN block used value.
     BT->tof = BT->bof = ur_ptr(LocalFrame, buf);
     BT->eof = BT->tof + ur_avail(buf);
+    memSet( BT->frameHash, 0, sizeof(BT->frameHash) );
 
 
     // Temporary binary
@@ -216,6 +230,13 @@ static void boron_threadInit( UThread* ut )
     ++ed;
     ur_setId( ed, UT_BINARY );
     ur_setSeries( ed, bufN[3], 0 );
+
+#ifdef CONFIG_PREDECODE
+    boron_preInit( ut );
+#endif
+#ifdef CONFIG_PROFILE
+    BT->prof = BT->profState = 0;
+#endif
 }
 
 
@@ -229,9 +250,15 @@ static void boron_threadMethod( UThread* ut, enum UThreadMethod op )
 
         case UR_THREAD_FREE:
             // All data is stored in dataStore, so there is nothing to free.
+#ifdef CONFIG_PREDECODE
+            boron_preFree( ut );
+#endif
 #ifdef CONFIG_ASSEMBLE
             if( BT->jit )
                 jit_context_destroy( BT->jit );
+#endif
+#ifdef CONFIG_PROFILE
+            prof_free( ut );
 #endif
             break;
 
@@ -240,6 +267,13 @@ static void boron_threadMethod( UThread* ut, enum UThreadMethod op )
             ur_buffer(BT->fstackN)->used = 0;
             ur_release( BT->holdData );
             BT->dstackN = 0;    // Disables cfunc_recycle2.
+#ifdef CONFIG_PREDECODE
+            // Buffer ids change, and UR_THREAD_INIT will make a new cache.
+            boron_preFree( ut );
+#endif
+#ifdef CONFIG_PROFILE
+            prof_free( ut );
+#endif
             break;
     }
 }
@@ -260,6 +294,7 @@ void boron_reset( UThread* ut )
     // Clear frame stack.
     buf = ur_buffer( BT->fstackN );
     BT->tof = ur_ptr(LocalFrame, buf);
+    memSet( BT->frameHash, 0, sizeof(BT->frameHash) );
 
     // Clear exceptions.
     buf = ur_errorBlock(ut);
@@ -388,16 +423,24 @@ UCell* boron_stackPushN( UThread* ut, int n )
 
 int boron_framePush( UThread* ut, UCell* args, UIndex funcBuf )
 {
+    LocalFrame** head;
     LocalFrame* frame = BT->tof;
     if( frame == BT->eof )
         return ur_error( ut, UR_ERR_INTERNAL, "frame stack overflow" );
     frame->args = args;
     frame->funcBuf = funcBuf;
+    head = BT->frameHash + FRAME_HASH(funcBuf);
+    frame->nextHash = *head;
+    *head = frame;
     ++BT->tof;
     return UR_OK;
 }
 
-#define boron_framePop(ut)      --BT->tof
+static void boron_framePop( UThread* ut )
+{
+    LocalFrame* frame = --BT->tof;
+    BT->frameHash[ FRAME_HASH(frame->funcBuf) ] = frame->nextHash;
+}
 
 
 /*
@@ -440,10 +483,14 @@ UIndex boron_seriesEnd( UThread* ut, const UCell* cell )
 #include "compress.c"
 #endif
 
+#include "serial.c"
 #include "construct.c"
 #include "encode.c"
 #include "sort.c"
 #include "cfunc.c"
+#ifdef CONFIG_PROFILE
+#include "profile.c"
+#endif
 
 #ifdef CONFIG_THREAD
 #include "thread.c"
@@ -830,115 +877,17 @@ UThread* boron_makeEnv( const UDatatype** dtTable, unsigned int dtCount )
 }
 
 
-/**
-  Make Boron environment and initial thread.
-
-  \param par        Environment parameters.
+/*
+  Call add for each built-in C function.  This is used to make a new
+  environment and to find the functions of an environment image without
+  parsing their signatures.
 */
-UThread* boron_makeEnvP( UEnvParameters* par )
+static void _builtinCFuncs( void* user,
+                            void (*add)( void*, BoronCFunc, const char* ) )
 {
-    UAtom atoms[ 9 ];
-    UThread* ut;
-    unsigned int dtCount;
+#define addCFunc(func,spec)    add(user, func, spec)
 
-//#define TIME_MAKEENV
-#ifdef TIME_MAKEENV
-    uint64_t timeA, timeB, timeC, timeD, timeE;
-#define COUNTER(t)  t = cpuCounter()
-    COUNTER( timeA );
-#else
-#define COUNTER(t)
-#endif
-
-    {
-    const UDatatype* table[ UT_MAX - UT_BI_COUNT ];
-    const UDatatype** tt;
-    unsigned int i;
-
-    for( i = 0; i < (sizeof(boron_types) / sizeof(UDatatype)); ++i )
-        table[i] = boron_types + i;
-    dtCount = i + par->dtCount;
-
-    tt = par->dtTable;
-    for( ; i < dtCount; ++i )
-        table[i] = *tt++;
-    par->dtTable = table;
-    par->dtCount = dtCount;
-
-    ut = ur_makeEnvP( par );
-    }
-    if( ! ut )
-        return 0;
-
-    COUNTER( timeB );
-
-    // Need to override some Urlan methods.
-    dt_context.make = context_make_override;
-
-
-    ur_internAtoms( ut, "none true false file udp tcp thread"
-#ifdef CONFIG_SSL
-        " udps tcps"
-#endif
-        , atoms );
-
-
-    // Register ports.
-    ur_ctxInit( &BENV->ports, 4 );
-    boron_addPortDevice( ut, &port_file,   atoms[3] );
-#ifdef CONFIG_SOCKET
-    boron_addPortDevice( ut, &port_socket, atoms[4] );
-    boron_addPortDevice( ut, &port_socket, atoms[5] );
-#endif
-#ifdef CONFIG_THREAD
-    boron_addPortDevice( ut, &port_thread, atoms[6] );
-
-    // thread_queue() stores buffers in cells.
-    assert( sizeof(UBuffer) <= sizeof(UCell) );
-#endif
-#ifdef CONFIG_SSL
-    boron_addPortDevice( ut, &port_ssl,    atoms[7] );
-    boron_addPortDevice( ut, &port_ssl,    atoms[8] );
-#endif
-
-
-    // Add some useful words.
-    {
-    UBuffer* ctx;
-    UCell* cell;
-
-    ctx = ur_threadContext( ut );
-    ur_ctxReserve( ctx, 512 );
-
-    cell = ur_ctxAddWord( ctx, atoms[0] );
-    ur_setId(cell, UT_NONE);
-
-    cell = ur_ctxAddWord( ctx, atoms[1] );
-    ur_setId(cell, UT_LOGIC);
-    ur_int(cell) = 1;
-
-    cell = ur_ctxAddWord( ctx, atoms[2] );
-    ur_setId(cell, UT_LOGIC);
-    ur_int(cell) = 0;
-    }
-
-    _addDatatypeWords( ut, UT_BI_COUNT + dtCount );
-    ur_ctxSort( ur_threadContext( ut ) );
-
-
-    // Add C functions.
-
-#define addCFunc(func,spec)    boron_addCFunc(ut, func, spec)
-
-    COUNTER( timeC );
-#ifdef CFUNC_TABLE
-    // 1124363 / 1597020 = ~30% fewer cycles.
-    if( ! boron_addCFuncS( ut, _cfuncTable, _cfuncSigs, sizeof(_cfuncSigs) ) )
-    {
-        ur_freeEnv( ut );
-        return 0;
-    }
-#else
+#ifndef CFUNC_TABLE
     // CFUNC_TABLE_START
     addCFunc( cfunc_nop,     "nop" );
     addCFunc( cfunc_quit,    "quit /return val" );
@@ -950,6 +899,8 @@ UThread* boron_makeEnvP( UEnvParameters* par )
     addCFunc( cfunc_catch,   "catch val /name w" );
     addCFunc( cfunc_try,     "try val" );
     addCFunc( cfunc_recycle, "recycle" );
+    addCFunc( cfunc_gcStats, "gc-stats /types" );
+    addCFunc( cfunc_gcPolicy,"gc-policy spec" );
     addCFunc( cfunc_do,      "do" );            // val (eval-control)
     addCFunc( cfunc_set,     "set w val" );
     addCFunc( cfunc_get,     "get w" );
@@ -976,6 +927,9 @@ UThread* boron_makeEnvP( UEnvParameters* par )
     addCFunc( cfunc_cos,     "cos n" );
     addCFunc( cfunc_sin,     "sin n" );
     addCFunc( cfunc_atan,    "atan n" );
+    addCFunc( cfunc_fold,    "fold vec op" );
+    addCFunc( cfunc_dot,     "dot a b" );
+    addCFunc( cfunc_mask,    "mask vec op val" );
     addCFunc( cfunc_make,    "make type spec" );
     addCFunc( cfunc_copy,    "copy val /deep" );
     addCFunc( cfunc_reserve, "reserve ser size" );
@@ -1016,7 +970,7 @@ UThread* boron_makeEnvP( UEnvParameters* par )
     addCFunc( cfunc_append,  "append ser val /block /repeat a int!" );
     addCFunc( cfunc_insert,  "insert ser val /block /part n /repeat a int!" );
     addCFunc( cfunc_change,  "change ser val /slice /part n" );
-    addCFunc( cfunc_remove,  "remove ser /slice /part n" );
+    addCFunc( cfunc_remove,  "remove ser /slice /part n /key k" );
     addCFunc( cfunc_reverse, "reverse ser /part n" );
     addCFunc( cfunc_find,    "find ser val /last /case /part n" );
     addCFunc( cfunc_clear,   "clear ser" );
@@ -1034,7 +988,7 @@ UThread* boron_makeEnvP( UEnvParameters* par )
     addCFunc( cfunc_difference, "difference a b" );
     addCFunc( cfunc_union,      "union a b" );
     addCFunc( cfunc_sort,       "sort ser /case /group size int!"
-                                " /field b block!" );
+                                " /field b block! /parallel" );
     addCFunc( cfunc_foreach,    "foreach 'w s body 0 /ghost" );
     addCFunc( cfunc_foreach,    "remove-each 'w s body 1 /ghost" );
     addCFunc( cfunc_forall,     "forall 'w body /ghost" );
@@ -1048,7 +1002,7 @@ UThread* boron_makeEnvP( UEnvParameters* par )
     addCFunc( cfunc_getenv,     "getenv val" );
     addCFunc( cfunc_open,       "open from /read /write /new /nowait" );
     addCFunc( cfunc_read,       "read from /text /into b /append a"
-                                " /part size int!" );
+                                " /part size int! /mmap" );
     addCFunc( cfunc_write,      "write to data /append /text" );
     addCFunc( cfunc_delete,     "delete file" );
     addCFunc( cfunc_rename,     "rename a b" );
@@ -1094,7 +1048,7 @@ UThread* boron_makeEnvP( UEnvParameters* par )
 #endif
 #ifdef CONFIG_CHECKSUM
     addCFunc( cfunc_hash,       "hash val" );
-    addCFunc( cfunc_checksum,   "checksum val /sha1 /crc16 /crc32" );
+    addCFunc( cfunc_checksum,   "checksum val /sha1 /crc16 /crc32 /crc32c" );
 #endif
 #ifdef CONFIG_COMPRESS
     addCFunc( cfunc_compress,   "compress s" );
@@ -1110,6 +1064,157 @@ UThread* boron_makeEnvP( UEnvParameters* par )
 #ifdef CONFIG_ASSEMBLE
     addCFunc( cfunc_assemble,   "assemble s block! body block!" );
 #endif
+#ifdef CONFIG_PROFILE
+    addCFunc( cfunc_profile,    "profile what /collapsed" );
+#endif
+}
+
+
+static void _addCFuncUT( void* ut, BoronCFunc func, const char* sig )
+{
+    boron_addCFunc( (UThread*) ut, func, sig );
+}
+
+
+/*
+  Make environment with the Boron datatypes and port devices.
+
+  \param atoms  Set to the atoms of none, true, false and the devices.
+*/
+static UThread* _makeEnvBase( UEnvParameters* par, UAtom* atoms )
+{
+    UThread* ut;
+    unsigned int dtCount;
+
+    {
+    const UDatatype* table[ UT_MAX - UT_BI_COUNT ];
+    const UDatatype** tt;
+    unsigned int i;
+
+    for( i = 0; i < (sizeof(boron_types) / sizeof(UDatatype)); ++i )
+        table[i] = boron_types + i;
+    dtCount = i + par->dtCount;
+
+    tt = par->dtTable;
+    for( ; i < dtCount; ++i )
+        table[i] = *tt++;
+    par->dtTable = table;
+    par->dtCount = dtCount;
+
+    ut = ur_makeEnvP( par );
+    }
+    if( ! ut )
+        return 0;
+
+    // Need to override some Urlan methods.
+    dt_context.make = context_make_override;
+
+
+    ur_internAtoms( ut, "none true false file udp tcp thread"
+        " deflate inflate checksum serialize unserialize waitset"
+#ifdef CONFIG_SSL
+        " udps tcps"
+#endif
+        , atoms );
+
+
+    // Register ports.
+    ur_ctxInit( &BENV->ports, 4 );
+    boron_addPortDevice( ut, &port_file,   atoms[3] );
+    boron_addPortDevice( ut, &port_serialize,   atoms[10] );
+    boron_addPortDevice( ut, &port_unserialize, atoms[11] );
+#ifndef _WIN32
+    boron_addPortDevice( ut, &port_waitset, atoms[12] );
+#endif
+#ifdef CONFIG_SOCKET
+    boron_addPortDevice( ut, &port_socket, atoms[4] );
+    boron_addPortDevice( ut, &port_socket, atoms[5] );
+#endif
+#ifdef CONFIG_THREAD
+    boron_addPortDevice( ut, &port_thread, atoms[6] );
+
+    // thread_queue() stores buffers in cells.
+    assert( sizeof(UBuffer) <= sizeof(UCell) );
+#endif
+#ifdef CONFIG_COMPRESS
+    boron_addPortDevice( ut, &port_deflate, atoms[7] );
+    boron_addPortDevice( ut, &port_inflate, atoms[8] );
+#endif
+#ifdef CONFIG_CHECKSUM
+    checksum_init();
+    boron_addPortDevice( ut, &port_checksum, atoms[9] );
+#endif
+#ifdef CONFIG_SSL
+    boron_addPortDevice( ut, &port_ssl,    atoms[13] );
+    boron_addPortDevice( ut, &port_ssl,    atoms[14] );
+#endif
+
+    return ut;
+}
+
+
+/**
+  Make Boron environment and initial thread.
+
+  \param par        Environment parameters.
+*/
+UThread* boron_makeEnvP( UEnvParameters* par )
+{
+    UAtom atoms[ 15 ];
+    UThread* ut;
+
+//#define TIME_MAKEENV
+#ifdef TIME_MAKEENV
+    uint64_t timeA, timeB, timeC, timeD, timeE;
+#define COUNTER(t)  t = cpuCounter()
+    COUNTER( timeA );
+#else
+#define COUNTER(t)
+#endif
+
+    ut = _makeEnvBase( par, atoms );
+    if( ! ut )
+        return 0;
+
+    COUNTER( timeB );
+
+
+    // Add some useful words.
+    {
+    UBuffer* ctx;
+    UCell* cell;
+
+    ctx = ur_threadContext( ut );
+    ur_ctxReserve( ctx, 512 );
+
+    cell = ur_ctxAddWord( ctx, atoms[0] );
+    ur_setId(cell, UT_NONE);
+
+    cell = ur_ctxAddWord( ctx, atoms[1] );
+    ur_setId(cell, UT_LOGIC);
+    ur_int(cell) = 1;
+
+    cell = ur_ctxAddWord( ctx, atoms[2] );
+    ur_setId(cell, UT_LOGIC);
+    ur_int(cell) = 0;
+    }
+
+    _addDatatypeWords( ut, UT_BI_COUNT + par->dtCount );
+    ur_ctxSort( ur_threadContext( ut ) );
+
+
+    // Add C functions.
+
+    COUNTER( timeC );
+#ifdef CFUNC_TABLE
+    // 1124363 / 1597020 = ~30% fewer cycles.
+    if( ! boron_addCFuncS( ut, _cfuncTable, _cfuncSigs, sizeof(_cfuncSigs) ) )
+    {
+        ur_freeEnv( ut );
+        return 0;
+    }
+#endif
+    _builtinCFuncs( ut, _addCFuncUT );
 
 
     COUNTER( timeD );
@@ -1131,6 +1236,190 @@ UThread* boron_makeEnvP( UEnvParameters* par )
 }
 
 
+typedef struct
+{
+    UBuffer  funcs;         // BoronCFunc pointers.
+    const BoronCFunc* extFuncs;
+    int      extCount;
+    uint32_t hash;
+}
+CFuncIndex;
+
+
+static void _indexCFunc( void* user, BoronCFunc func, const char* sig )
+{
+    CFuncIndex* ci = (CFuncIndex*) user;
+    BoronCFunc* fp;
+
+    // FNV-1a hash of the signatures.
+    while( *sig )
+        ci->hash = (ci->hash ^ (uint8_t) *sig++) * 16777619;
+
+    ur_arrExpand1( BoronCFunc, (&ci->funcs), fp );
+    *fp = func;
+}
+
+
+/*
+  Make table of all C functions which can be held in an environment image.
+  The functions added by boron_makeEnvP() come first, followed by those
+  of the application.
+*/
+static void _cfuncIndexInit( CFuncIndex* ci, const BoronCFunc* extFuncs,
+                             int extCount )
+{
+    ur_arrInit( &ci->funcs, sizeof(BoronCFunc), 256 );
+    ci->hash = 2166136261u;
+
+    _indexCFunc( ci, cfunc_datatypeQ, "datatype?" );
+    _indexCFunc( ci, cfunc_to_type,   "to-type" );
+#ifdef CFUNC_TABLE
+    {
+    int i;
+    for( i = 0; i < (int) (sizeof(_cfuncTable) / sizeof(BoronCFunc)); ++i )
+        _indexCFunc( ci, _cfuncTable[i], "" );
+    }
+#endif
+    _builtinCFuncs( ci, _indexCFunc );
+
+    for( ; extCount > 0; --extCount )
+        _indexCFunc( ci, *extFuncs++, "ext" );
+}
+
+
+static int _imageFuncBuffer( void* user, const UBuffer* buf, uint8_t* dest,
+                             int* fwd )
+{
+    int size;
+    (void) user;
+
+    if( buf->type != UT_FUNC )
+        return -1;
+    size = buf->form + buf->elemSize * sizeof(FuncOption);
+    *fwd = 0;
+    if( dest )
+        memCpy( dest, buf->ptr.v, size );
+    return size;
+}
+
+
+/*
+  Convert C function pointers to and from an index in the CFuncIndex.
+*/
+static int _imageFuncCell( void* user, UCell* cell, int load )
+{
+    const CFuncIndex* ci = (const CFuncIndex*) user;
+    const BoronCFunc* funcs = ur_ptr(BoronCFunc, &ci->funcs);
+    uintptr_t n;
+
+    if( ! ur_is(cell, UT_CFUNC) )
+        return ur_type(cell) == UT_FUNC;
+
+    if( load )
+    {
+        n = (uintptr_t) ur_funcFunc(cell);
+        if( n >= (uintptr_t) ci->funcs.used )
+            return 0;
+        ur_funcFunc(cell) = funcs[ n ];
+    }
+    else
+    {
+        for( n = 0; n < (uintptr_t) ci->funcs.used; ++n )
+        {
+            if( funcs[ n ] == ur_funcFunc(cell) )
+            {
+                ur_funcFunc(cell) = (BoronCFunc) n;
+                return 1;
+            }
+        }
+        return 0;
+    }
+    return 1;
+}
+
+
+static void _imageMethods( UEnvImageMethods* im, CFuncIndex* ci )
+{
+    im->user        = ci;
+    im->check       = ci->hash ^ ci->funcs.used;
+    im->bufferImage = _imageFuncBuffer;
+    im->cellImage   = _imageFuncCell;
+}
+
+
+/**
+  Save the shared environment to an image file which can be loaded with
+  boron_makeEnvImage().  This must be called after ur_freezeEnv().
+
+  Any C functions added to the environment by the application (with
+  boron_addCFunc() or boron_overrideCFunc()) must be listed in extFuncs.
+  The image can only be loaded by the same program build.
+
+  \param file       Image file name.
+  \param extFuncs   Application C functions.  This may be zero if
+                    extCount is zero.
+  \param extCount   Number of functions in extFuncs.
+
+  \return UR_OK/UR_THROW
+*/
+int boron_saveEnvImage( UThread* ut, const char* file,
+                        const BoronCFunc* extFuncs, int extCount )
+{
+    UEnvImageMethods im;
+    CFuncIndex ci;
+    int ok;
+
+    _cfuncIndexInit( &ci, extFuncs, extCount );
+    _imageMethods( &im, &ci );
+    ok = ur_saveEnvImage( ut, file, &im );
+    ur_arrFree( &ci.funcs );
+    return ok;
+}
+
+
+/**
+  Make Boron environment and initial thread from an image file written by
+  boron_saveEnvImage().  The shared environment is mapped from the file
+  rather than being made and evaluated, so this is much faster than
+  boron_makeEnvP() followed by ur_freezeEnv().
+
+  The parameters & extFuncs must be the same as those used by the program
+  which saved the image.
+
+  \param par        Environment parameters.
+  \param file       Image file name.
+  \param extFuncs   Application C functions.
+  \param extCount   Number of functions in extFuncs.
+
+  \return Initial thread or zero if the environment could not be made or
+          the image is invalid.  The shared environment is already frozen.
+*/
+UThread* boron_makeEnvImage( UEnvParameters* par, const char* file,
+                             const BoronCFunc* extFuncs, int extCount )
+{
+    UEnvImageMethods im;
+    CFuncIndex ci;
+    UAtom atoms[ 15 ];
+    UThread* ut;
+    int ok;
+
+    ut = _makeEnvBase( par, atoms );
+    if( ! ut )
+        return 0;
+
+    _cfuncIndexInit( &ci, extFuncs, extCount );
+    _imageMethods( &im, &ci );
+    ok = ur_loadEnvImage( ut, file, &im );
+    ur_arrFree( &ci.funcs );
+    if( ! ok )
+    {
+        boron_freeEnv( ut );
+        return 0;
+    }
+    return ut;
+}
+
+
 /**
   Destroy Boron environment.
 
@@ -1146,6 +1435,16 @@ void boron_freeEnv( UThread* ut )
 }
 
 
+#ifdef CONFIG_PROFILE
+#define PROF_ENTER(cfunc,bodyN,blkN,site) \
+    if( BT->prof ) prof_enter( ut, cfunc, bodyN, blkN, site )
+#define PROF_LEAVE  if( BT->prof ) prof_leave( ut )
+#else
+#define PROF_ENTER(cfunc,bodyN,blkN,site)
+#define PROF_LEAVE
+#endif
+
+
 /*
   Evaluate arguments and invoke function.
   blkC->series.it is advanced.
@@ -1160,6 +1459,10 @@ void boron_freeEnv( UThread* ut )
 static int boron_call( UThread* ut, const UCellFunc* fcell, UCell* blkC,
                        UCell* res )
 {
+#ifdef CONFIG_PROFILE
+    UIndex site = blkC->series.it - 1;
+#endif
+
     if( fcell->argBufN )
     {
         UCellFunc fcopy;
@@ -1286,7 +1589,9 @@ prog_done:
 
         if( fcopy.id.type == UT_CFUNC )
         {
+            PROF_ENTER( fcopy.m.func, 0, blkC->series.buf, site );
             ok = fcopy.m.func( ut, args, res );
+            PROF_LEAVE;
             if( ! ok && ! (fcopy.id.flags & FUNC_FLAG_GHOST) )
                 goto cleanup_trace;
         }
@@ -1298,7 +1603,9 @@ prog_done:
 
             if( (ok = boron_framePush( ut, args, fcopy.m.f.bodyN )) )
             {
+                PROF_ENTER( 0, fcopy.m.f.bodyN, blkC->series.buf, site );
                 ok = boron_doBlock( ut, &tmp, res );
+                PROF_LEAVE;
                 boron_framePop( ut );
                 if( ! ok && ! (fcopy.id.flags & FUNC_FLAG_GHOST) )
                 {
@@ -1328,17 +1635,26 @@ cleanup_trace:
     {
         if( fcell->id.type == UT_CFUNC )
         {
+            int ok;
+
             // Pass blkC so 'eval-control' cfuncs can do custom evaluation.
-            if( ! fcell->m.func( ut, blkC, res ) )
+            PROF_ENTER( fcell->m.func, 0, blkC->series.buf, site );
+            ok = fcell->m.func( ut, blkC, res );
+            PROF_LEAVE;
+            if( ! ok )
                 goto traceError;
         }
         else
         {
             UCell tmp;
+            int ok;
             ur_setId(&tmp, UT_BLOCK);
             ur_setSeries(&tmp, fcell->m.f.bodyN, 0);
 
-            if( ! boron_doBlock( ut, &tmp, res ) )
+            PROF_ENTER( 0, fcell->m.f.bodyN, blkC->series.buf, site );
+            ok = boron_doBlock( ut, &tmp, res );
+            PROF_LEAVE;
+            if( ! ok )
             {
                 if( ! _catchThrownWord( ut, UR_ATOM_RETURN ) )
                     goto traceError;
@@ -1511,6 +1827,11 @@ traceError:
 }
 
 
+#ifdef CONFIG_PREDECODE
+#include "predecode.c"
+#endif
+
+
 static void _bindDefaultB( UThread* ut, UIndex blkN )
 {
     UBlockIterM bi;
@@ -1611,6 +1932,11 @@ int boron_doBlock( UThread* ut, const UCell* blkC, UCell* res )
 {
     UCell bc2;
 
+#ifdef CONFIG_PROFILE
+    if( BT->prof && prof_cfuncEval( ut ) )
+        return prof_doBlock( ut, blkC, res );
+#endif
+
     //ur_blkSlice( ut, &bi, blkC );
     {
         const UBuffer* buf = ur_bufferSer(blkC);
@@ -1628,6 +1954,24 @@ int boron_doBlock( UThread* ut, const UCell* blkC, UCell* res )
 
     ur_setId( res, UT_UNSET );
 
+#ifdef CONFIG_PREDECODE
+    if( bc2.series.it < bc2.series.end )
+    {
+        const PreOp* ops = boron_preOps( ut, bc2.series.buf,
+                                         ur_bufferSer(&bc2) );
+        if( ops )
+        {
+            do
+            {
+                if( ! boron_evalPre( ut, &bc2, ops, res ) )
+                    return UR_THROW;
+            }
+            while( bc2.series.it < bc2.series.end );
+            return UR_OK;
+        }
+    }
+#endif
+
     while( bc2.series.it < bc2.series.end )
     {
         if( ! boron_eval1( ut, &bc2, res ) )
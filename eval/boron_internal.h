@@ -22,13 +22,17 @@
         (pbuf->ptr.v ? *((UPortDevice**) pbuf->ptr.v) : 0)
 
 
-typedef struct
+typedef struct LocalFrame
 {
     UCell* args;
     UIndex funcBuf;
+    struct LocalFrame* nextHash;    // Lower frame in the same frameHash slot.
 }
 LocalFrame;
 
+#define FRAME_HASH_SIZE     64
+#define FRAME_HASH(n)       ((n) & (FRAME_HASH_SIZE - 1))
+
 
 // UCellFuncOpt is stored on the data stack just before function arguments.
 typedef struct
@@ -63,11 +67,16 @@ typedef struct BoronThread
     LocalFrame* bof;
     LocalFrame* tof;
     LocalFrame* eof;
+    LocalFrame* frameHash[ FRAME_HASH_SIZE ];  // Top frame of each funcBuf hash.
     UIndex  holdData;
     UIndex  dstackN;
     UIndex  fstackN;
     UIndex  tempN;
     UCellFuncOpt fo;
+#ifdef CONFIG_PREDECODE
+    UBuffer preCache;
+    UBuffer preRuns;
+#endif
 #ifdef CONFIG_RANDOM
     Well512 rand;
 #endif
@@ -75,6 +84,10 @@ typedef struct BoronThread
     jit_context_t jit;
     UAtomEntry* insTable;
 #endif
+#ifdef CONFIG_PROFILE
+    struct ProfState* prof;         // Non-zero when profiling is on.
+    struct ProfState* profState;
+#endif
 }
 BoronThread;
 
@@ -501,6 +501,7 @@ void func_bind( UThread* ut, UCell* cell, const UBindTarget* bt )
     if( n > UR_INVALID_BUF )
     {
         UBuffer* buf = ur_buffer(n);
+        ur_gcWrite( n );
         ur_bindCells( ut, buf->ptr.cell, buf->ptr.cell + buf->used, bt );
     }
 }
@@ -528,8 +529,31 @@ int cfunc_compare( UThread* ut, const UCell* a, const UCell* b, int test )
 }
 
 
+/*
+  Flag buffers referenced by cells for the generational collector.
+*/
+static void _gcWriteRefs( UThread* ut, const UCell* it, const UCell* end )
+{
+    UIndex n;
+    for( ; it != end; ++it )
+    {
+        if( ur_is(it, UT_FUNC) )
+            n = ur_funcBody(it);
+        else if( ur_type(it) >= UT_REFERENCE_BUF )
+            n = it->series.buf;
+        else
+            continue;
+        if( n > UR_INVALID_BUF )
+            ur_gcWrite( n );
+    }
+}
+
+
 /*
   Updates used member of stack blocks before every recycle.
+  The series and function bodies referenced by the evaluator stacks may be
+  changed in place so they are flagged for the generational collector.
+  With CONFIG_PREDECODE this also drops decoded blocks which will be swept.
 */
 void cfunc_recycle2( UThread* ut, int phase )
 {
@@ -539,10 +563,21 @@ void cfunc_recycle2( UThread* ut, int phase )
         UBuffer* buf = ur_buffer(BT->dstackN);
         buf->used = BT->tos - buf->ptr.cell;
 
+        if( ut->gcOldState.used )
+        {
+            ur_gcWrite( BT->dstackN );
+            _gcWriteRefs( ut, BT->evalData, BT->evalData + BT_CELL_COUNT );
+            _gcWriteRefs( ut, buf->ptr.cell, BT->tos );
+        }
+
         // Sync frame stack used with tof.
         buf = ur_buffer(BT->fstackN);
         buf->used = BT->tof - ur_ptr(LocalFrame, buf);
     }
+#ifdef CONFIG_PREDECODE
+    else if( phase == UR_RECYCLE_SWEEP )
+        boron_preSweep( ut );
+#endif
 }
 
 
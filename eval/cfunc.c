@@ -259,13 +259,14 @@ CFUNC(cfunc_try)
     return: NA
     group: storage
 
-    Run the garbage collector.
+    Run the garbage collector.  All unreferenced buffers are freed, even
+    when the generational collector is used.
 */
 CFUNC(cfunc_recycle)
 {
     (void) a1;
     (void) res;
-    ur_recycle( ut );
+    ur_recycleFull( ut );
     return UR_OK;
 }
 
@@ -640,15 +641,15 @@ extern void _contextWords( UThread* ut, const UBuffer* ctx, UIndex ctxN,
 
 /*-cf-
     words-of
-        context     context!
-    return: Block of words defined in context.
+        context     context!/map!
+    return: Block of words defined in context or keys of map.
     group: data
     see: values-of
 */
 /*-cf-
     values-of
-        context     context!
-    return: Block of values defined in context.
+        context     context!/map!
+    return: Block of values defined in context or map.
     group: data
     see: words-of
 */
@@ -656,8 +657,26 @@ CFUNC(cfunc_words_of)
 {
     const UBuffer* ctx;
 
+    if( ur_is(a1, UT_MAP) )
+    {
+        UBuffer* blk;
+        const UCell* it;
+        const UCell* end;
+        UCell* dst;
+        int used = ur_mapSize( ur_bufferSer(a1) );
+
+        blk = ur_makeBlockCell( ut, UT_BLOCK, used, res );
+        ctx = ur_bufferSer(a1);     // Re-aquire.
+        it  = ctx->ptr.cell + ur_int(a2);
+        end = ctx->ptr.cell + ctx->used;
+        dst = blk->ptr.cell;
+        for( ; it < end; it += 2 )
+            *dst++ = *it;
+        blk->used = used;
+        return UR_OK;
+    }
     if( ! ur_is(a1, UT_CONTEXT) )
-        return errorType( "words-of expected context!" );
+        return errorType( "words-of expected context!/map!" );
 
     if( ur_int(a2) )
     {
@@ -1046,6 +1065,99 @@ CFUNC(cfunc_sin)  { return _mathFunc( ut, a1, res, sin ); }
 CFUNC(cfunc_atan) { return _mathFunc( ut, a1, res, atan ); }
 
 
+/*-cf-
+    fold
+        vec     vector!
+        op      word!  (sum, min, max, mean)
+    return: Number or none!
+    group: math
+    see: dot, mask
+
+    Reduce the elements of a vector to a single number.
+    The sum of an integer vector is an int!, and the mean is always a
+    decimal!.  The min, max, and mean of an empty vector is none.
+
+        fold #[2 4 9] 'sum
+        == 15
+*/
+CFUNC(cfunc_fold)
+{
+    static const char* opNames[] = { "sum", "min", "max", "", "mean" };
+    const char* name;
+    int op;
+
+    if( ! ur_is(a1, UT_VECTOR) )
+        return errorType( "fold expected vector!" );
+    if( ur_isWordType( ur_type(a2) ) )
+    {
+        name = ur_atomCStr( ut, ur_atom(a2) );
+        for( op = UR_VFOLD_SUM; op <= UR_VFOLD_MEAN; ++op )
+        {
+            if( op != UR_VFOLD_DOT && ! strcmp( name, opNames[ op ] ) )
+                return ur_vecFold( ut, op, a1, 0, res );
+        }
+    }
+    return ur_error( ut, UR_ERR_SCRIPT, "fold expected sum/min/max/mean" );
+}
+
+
+/*-cf-
+    dot
+        a   vector!
+        b   vector!
+    return: Dot product of two vectors.
+    group: math
+    see: fold
+
+    If the vectors have different lengths only the elements of the
+    shorter one are used.
+*/
+CFUNC(cfunc_dot)
+{
+    if( ur_is(a1, UT_VECTOR) && ur_is(a2, UT_VECTOR) )
+        return ur_vecFold( ut, UR_VFOLD_DOT, a1, a2, res );
+    return errorType( "dot expected vector!" );
+}
+
+
+/*-cf-
+    mask
+        vec     vector!
+        op      word!  (=, <, >, <=, >=)
+        val     char!/int!/decimal!/vector!
+    return: bitset! with the bits set where the comparison is true.
+    group: math
+    see: fold
+
+    Compare each element of vec with val, or with the corresponding
+    element if val is another vector.
+
+        mask #[1 5 3 8] '> 2
+        == make bitset! #{0E}
+*/
+CFUNC(cfunc_mask)
+{
+    int cmp;
+
+    if( ! ur_is(a1, UT_VECTOR) )
+        return errorType( "mask expected vector!" );
+    if( ur_isWordType( ur_type(a2) ) )
+    {
+        switch( ur_atom(a2) )
+        {
+            case UR_ATOM_EQUAL: cmp = UR_VCMP_EQ; goto compare;
+            case UR_ATOM_LT:    cmp = UR_VCMP_LT; goto compare;
+            case UR_ATOM_GT:    cmp = UR_VCMP_GT; goto compare;
+            case UR_ATOM_LTE:   cmp = UR_VCMP_LE; goto compare;
+            case UR_ATOM_GTE:   cmp = UR_VCMP_GE;
+compare:
+                return ur_vecMask( ut, cmp, a1, a3, res );
+        }
+    }
+    return ur_error( ut, UR_ERR_SCRIPT, "mask expected =, <, >, <=, or >=" );
+}
+
+
 extern int context_make( UThread* ut, const UCell* from, UCell* res );
 extern UDatatype dt_context;
 
@@ -1493,12 +1605,15 @@ CFUNC(cfunc_loop)
 
 /*-cf-
     select
-        series
+        series      series or map!
         match
         /last   Search from end of series.
         /case   Case of characters in strings must match
     return: Value after match or none! if match not found.
     group: data
+
+    If series is a map! then the value of the match key is returned.
+    The options are ignored for maps.
 */
 CFUNC(cfunc_select)
 {
@@ -1509,8 +1624,17 @@ CFUNC(cfunc_select)
     int type = ur_type(a1);
     int n = 0;
 
+    if( type == UT_MAP )
+    {
+        const UBuffer* map = ur_bufferSer(a1);
+        if( (n = ur_mapLookup( ut, map, a2 )) > -1 )
+            *res = *ur_mapValue( map, n );
+        else
+            ur_setId(res, UT_NONE);
+        return UR_OK;
+    }
     if( ! ur_isSeriesType( type ) )
-        return errorType( "select expected series" );
+        return errorType( "select expected series or map!" );
 
     if( CFUNC_OPTIONS & OPT_SELECT_LAST )
         n |= UR_FIND_LAST;
@@ -1980,14 +2104,17 @@ CFUNC(cfunc_tail)
 
 /*-cf-
     pick
-        series      Series or coord!/vec3!
-        position    int!/logic!
+        series      Series or coord!/vec3!/map!
+        position    int!/logic! or map! key
     return: Value at position or none! if position is out of range.
     group: series
     see: index?, poke
 
     Note that series use one-based indexing.
 
+    If series is a map! then the value of the position key is returned
+    (or none! if the map does not contain the key).
+
     If position is a logic! value, then true will return the first series
     value, and false the second.
 */
@@ -1996,6 +2123,16 @@ CFUNC(cfunc_pick)
     UIndex n;
     int type;
 
+    if( ur_is(a1, UT_MAP) )
+    {
+        const UBuffer* map = ur_bufferSer(a1);
+        if( (n = ur_mapLookup( ut, map, a2 )) > -1 )
+            *res = *ur_mapValue( map, n );
+        else
+            ur_setId(res, UT_NONE);
+        return UR_OK;
+    }
+
     if( ur_is(a2, UT_INT) )
     {
         n = ur_int(a2);
@@ -2030,8 +2167,8 @@ extern int vec3_poke ( UThread*, UCell* cell, int index, const UCell* src );
 
 /*-cf-
     poke
-        series      series/coord!/vec3!
-        position    int!/logic!
+        series      series/coord!/vec3!/map!
+        position    int!/logic! or map! key
         value
     return: series.
     group: series
@@ -2039,6 +2176,9 @@ extern int vec3_poke ( UThread*, UCell* cell, int index, const UCell* src );
 
     Note that series use one-based indexing.
 
+    If series is a map! then the value of the position key is set, adding
+    the key if it is not already in the map.
+
     If position is a logic! value, then true will set the first series
     value, and false the second.
 */
@@ -2048,6 +2188,14 @@ CFUNC(cfunc_poke)
     UIndex n;
     int type;
 
+    if( ur_is(a1, UT_MAP) )
+    {
+        if( ! (buf = ur_bufferSerM(a1)) )
+            return UR_THROW;
+        *res = *a1;
+        return ur_mapInsert( ut, buf, a2, a3 );
+    }
+
     if( ur_is(a2, UT_INT) )
     {
         n = ur_int(a2);
@@ -2396,10 +2544,12 @@ CFUNC(cfunc_change)
 
 /*-cf-
     remove
-        series      series or none!
+        series      series/map! or none!
         /slice      Remove to end of slice.
         /part       Remove more than one element.
             number  int!
+        /key        Remove key and its value from map!.
+            key
     return: series or none!
     group: series
     see: append, clear, remove-each
@@ -2410,11 +2560,23 @@ CFUNC(cfunc_remove)
 {
 #define OPT_REMOVE_SLICE    0x01
 #define OPT_REMOVE_PART     0x02
+#define OPT_REMOVE_KEY      0x04
     USeriesIterM si;
     uint32_t opt = CFUNC_OPTIONS;
     int part = 0;
     int type = ur_type(a1);
 
+    if( type == UT_MAP )
+    {
+        UBuffer* buf;
+        if( ! (opt & OPT_REMOVE_KEY) )
+            return errorType( "remove expected /key for map!" );
+        if( ! (buf = ur_bufferSerM(a1)) )
+            return UR_THROW;
+        ur_mapRemove( ut, buf, a3 );
+        *res = *a1;
+        return UR_OK;
+    }
     if( ! ur_isSeriesType( type ) )
     {
         if( ur_is(a1, UT_NONE) )
@@ -2549,17 +2711,25 @@ set_none:
 
 /*-cf-
     clear
-        series  series or none!
+        series  series/map! or none!
     return: Empty series or none!.
     group: series
     see: remove
 
-    Erase to end of series.
+    Erase to end of series.  All entries are removed from a map!.
 */
 CFUNC(cfunc_clear)
 {
     UBuffer* buf;
 
+    if( ur_is(a1, UT_MAP) )
+    {
+        if( ! (buf = ur_bufferSerM(a1)) )
+            return UR_THROW;
+        ur_mapClear( buf );
+        *res = *a1;
+        return UR_OK;
+    }
     if( ! ur_isSeriesType( ur_type(a1) ) )
     {
         if( ur_is(a1, UT_NONE) )
@@ -2701,7 +2871,7 @@ bad_limit:
 
 /*-cf-
     empty?
-        value       series or none!
+        value       series/map! or none!
     return: logic!
     group: series
 
@@ -2719,6 +2889,11 @@ CFUNC(cfunc_emptyQ)
             si.it = 1;
             goto set_logic;
         }
+        if( ur_is(a1, UT_MAP) )
+        {
+            si.it = ur_bufferSer(a1)->used ? 0 : 1;
+            goto set_logic;
+        }
         return ur_error( ut, UR_ERR_TYPE, "empty? expected series or none!" );
     }
 
@@ -2754,12 +2929,13 @@ CFUNC(cfunc_headQ)
 
 /*-cf-
     size?
-        series
+        series      series/coord!/map!
     return: int!
     group: series
     see: index?
 
     Length of series from current position to end.
+    For a map! this is the number of keys.
 */
 CFUNC(cfunc_sizeQ)
 {
@@ -2772,8 +2948,11 @@ CFUNC(cfunc_sizeQ)
     }
     else if( ur_is(a1, UT_COORD) )
         len = a1->coord.len;
+    else if( ur_is(a1, UT_MAP) )
+        len = ur_mapSize( ur_bufferSer(a1) );
     else
-        return ur_error( ut, UR_ERR_TYPE, "size? expected series or coord!" );
+        return ur_error( ut, UR_ERR_TYPE,
+                         "size? expected series/coord!/map!" );
 
     ur_setId( res, UT_INT );
     ur_int(res) = len;
@@ -2968,90 +3147,474 @@ enum SetOperation
 };
 
 
-static int set_relation( UThread* ut, const UCell* a1, UCell* res,
-                         enum SetOperation op )
+/*
+  Open addressed hash set used by the set operations on large series.
+  A slot holds a pointer to a block cell or vector element; a null pointer
+  marks an empty slot.
+*/
+typedef struct
 {
-    USeriesIter si;
-    const USeriesType* dt;
-    const UCell* argB = a2;
-    int type = ur_type(a1);
+    uint32_t key;
+    const void* elem;
+}
+HashSlot;
 
-    if( type != ur_type(argB) )
-        return ur_error( ut, UR_ERR_TYPE,
-                 "intersect/difference expected series of the same type" );
+typedef struct
+{
+    HashSlot* slots;
+    uint32_t mask;
+}
+HashSet;
 
-    dt = SERIES_DT( type );
+#define SET_HASH_MIN    16
 
-    if( ur_isBlockType(type) )
+
+static void _hashSetInit( HashSet* set, int count )
+{
+    uint32_t size = 16;
+    while( size < (uint32_t) count * 2 )
+        size <<= 1;
+    set->slots = (HashSlot*) memAlloc( size * sizeof(HashSlot) );
+    memSet( set->slots, 0, size * sizeof(HashSlot) );
+    set->mask = size - 1;
+}
+
+
+static void _hashSetAdd( HashSet* set, const void* elem, uint32_t key )
+{
+    HashSlot* slots = set->slots;
+    uint32_t i = key & set->mask;
+    while( slots[i].elem )
+        i = (i + 1) & set->mask;
+    slots[i].key  = key;
+    slots[i].elem = elem;
+}
+
+
+/*
+  Return non-zero if a cell equal to the cell is in the set.
+  The keys are those returned by ur_hashCell().
+*/
+static int _hashSetHasCell( UThread* ut, const HashSet* set,
+                            const UCell* cell, const uint32_t* keys, int nk )
+{
+    const HashSlot* slots = set->slots;
+    uint32_t i;
+    int k;
+
+    for( k = 0; k < nk; ++k )
     {
-        UBlockIter bi;
-        UBuffer* blk = ur_makeBlockCell( ut, type, 0, res );
+        for( i = keys[k] & set->mask; slots[i].elem; i = (i + 1) & set->mask )
+        {
+            if( slots[i].key == keys[k] &&
+                ur_equal( ut, cell, (const UCell*) slots[i].elem ) )
+                return 1;
+        }
+    }
+    return 0;
+}
 
-        ur_blkSlice( ut, &bi, a1 );
 
-        switch( op )
+static int _hashSetHasElem( const HashSet* set, const void* elem, int size,
+                            uint32_t key )
+{
+    const HashSlot* slots = set->slots;
+    uint32_t i;
+
+    for( i = key & set->mask; slots[i].elem; i = (i + 1) & set->mask )
+    {
+        if( slots[i].key == key && memcmp( elem, slots[i].elem, size ) == 0 )
+            return 1;
+    }
+    return 0;
+}
+
+
+/*
+  Hashed set operation for blocks.  Elements are pushed onto blk in the same
+  order as the linear search.
+
+  Return zero if a cell which cannot be hashed is found.
+*/
+static int _blockRelationHashed( UThread* ut, const UBlockIter* ai,
+                                 const UBlockIter* bi, UBuffer* blk,
+                                 enum SetOperation op )
+{
+    HashSet setB, setR;
+    const UCell* it;
+    uint32_t keys[2];
+    int nk;
+    int ok = 0;
+
+    setB.slots = setR.slots = NULL;
+    setB.mask  = setR.mask  = 0;
+
+    if( op == SET_OP_UNION )
+    {
+        const UBlockIter* si = ai;
+
+        _hashSetInit( &setR, (ai->end - ai->it) + (bi->end - bi->it) );
+union_loop:
+        for( it = si->it; it != si->end; ++it )
         {
-            case SET_OP_INTERSECT:
+            if( ! (nk = ur_hashCell( ut, it, keys )) )
+                goto cleanup;
+            if( ! _hashSetHasCell( ut, &setR, it, keys, nk ) )
             {
-                USeriesIter ri;
+                ur_blkPush( blk, it );
+                _hashSetAdd( &setR, it, keys[0] );
+            }
+        }
+        if( si == ai )
+        {
+            si = bi;
+            goto union_loop;
+        }
+    }
+    else
+    {
+        _hashSetInit( &setB, bi->end - bi->it );
+        for( it = bi->it; it != bi->end; ++it )
+        {
+            if( ! ur_hashCell( ut, it, keys ) )
+                goto cleanup;
+            _hashSetAdd( &setB, it, keys[0] );
+        }
 
-                ur_seriesSlice( ut, &si, argB );
+        if( op == SET_OP_INTERSECT )
+            _hashSetInit( &setR, ai->end - ai->it );
 
-                ri.buf = blk;
-                ri.it = ri.end = 0;
+        for( it = ai->it; it != ai->end; ++it )
+        {
+            if( ! (nk = ur_hashCell( ut, it, keys )) )
+                goto cleanup;
+            if( op == SET_OP_DIFF )
+            {
+                if( ! _hashSetHasCell( ut, &setB, it, keys, nk ) )
+                    ur_blkPush( blk, it );
+            }
+            else if( _hashSetHasCell( ut, &setB, it, keys, nk ) &&
+                     ! _hashSetHasCell( ut, &setR, it, keys, nk ) )
+            {
+                ur_blkPush( blk, it );
+                _hashSetAdd( &setR, it, keys[0] );
+            }
+        }
+    }
+    ok = 1;
 
-                ur_foreach( bi )
+cleanup:
+    memFree( setB.slots );
+    memFree( setR.slots );
+    return ok;
+}
+
+
+static void _blockRelation( UThread* ut, const UCell* a1, UCell* res,
+                            enum SetOperation op )
+{
+    UBlockIter ai, bi;
+    USeriesIter si;
+    const USeriesType* dt = SERIES_DT( ur_type(a1) );
+    const UCell* argB = a2;
+    UBuffer* blk = ur_makeBlockCell( ut, ur_type(a1), 0, res );
+
+    ur_blkSlice( ut, &ai, a1 );
+    ur_blkSlice( ut, &bi, argB );
+
+    if( (ai.end - ai.it) + (bi.end - bi.it) > SET_HASH_MIN )
+    {
+        if( _blockRelationHashed( ut, &ai, &bi, blk, op ) )
+            return;
+        blk->used = 0;
+    }
+
+    switch( op )
+    {
+        case SET_OP_INTERSECT:
+        {
+            USeriesIter ri;
+
+            ur_seriesSlice( ut, &si, argB );
+
+            ri.buf = blk;
+            ri.it = ri.end = 0;
+
+            ur_foreach( ai )
+            {
+                if( (dt->find( ut, &si, ai.it, 0 ) > -1) &&
+                    (dt->find( ut, &ri, ai.it, 0 ) == -1) )
                 {
-                    if( (dt->find( ut, &si, bi.it, 0 ) > -1) &&
-                        (dt->find( ut, &ri, bi.it, 0 ) == -1) )
-                    {
-                        ur_blkPush( blk, bi.it );
-                        ++ri.end;
-                    }
+                    ur_blkPush( blk, ai.it );
+                    ++ri.end;
                 }
             }
+        }
             break;
 
-            case SET_OP_DIFF:
-                ur_seriesSlice( ut, &si, argB );
+        case SET_OP_DIFF:
+            ur_seriesSlice( ut, &si, argB );
 
-                ur_foreach( bi )
-                {
-                    if( dt->find( ut, &si, bi.it, 0 ) < 0 )
-                        ur_blkPush( blk, bi.it );
-                }
-                break;
+            ur_foreach( ai )
+            {
+                if( dt->find( ut, &si, ai.it, 0 ) < 0 )
+                    ur_blkPush( blk, ai.it );
+            }
+            break;
+
+        case SET_OP_UNION:
+            si.buf = blk;
+            si.it = si.end = 0;
 
-            case SET_OP_UNION:
+            ur_foreach( ai )
             {
-                si.buf = blk;
-                si.it = si.end = 0;
-union_loop:
-                ur_foreach( bi )
+                if( dt->find( ut, &si, ai.it, 0 ) < 0 )
                 {
-                    if( dt->find( ut, &si, bi.it, 0 ) < 0 )
-                    {
-                        ur_blkPush( blk, bi.it );
-                        ++si.end;
-                    }
+                    ur_blkPush( blk, ai.it );
+                    ++si.end;
                 }
-
-                if( type )
+            }
+            ur_foreach( bi )
+            {
+                if( dt->find( ut, &si, bi.it, 0 ) < 0 )
                 {
-                    type = 0;
-                    ur_blkSlice( ut, &bi, argB );
-                    goto union_loop;
+                    ur_blkPush( blk, bi.it );
+                    ++si.end;
                 }
             }
-                break;
+            break;
+    }
+}
+
+
+#define BIT_SET(bits,n)     bits[(n) >> 3] |= 1 << ((n) & 7)
+#define BIT_IS_SET(bits,n)  (bits[(n) >> 3] & (1 << ((n) & 7)))
+
+static inline int _charAt( const UBuffer* buf, UIndex i )
+{
+    return (buf->elemSize == 2) ? buf->ptr.u16[ i ] : buf->ptr.b[ i ];
+}
+
+
+static inline void _appendChar( UBuffer* buf, int c )
+{
+    if( buf->type == UT_BINARY )
+    {
+        ur_binReserve( buf, buf->used + 1 );
+        buf->ptr.b[ buf->used++ ] = c;
+    }
+    else
+        ur_strAppendChar( buf, c );
+}
+
+
+/*
+  Set operation for string! and binary! using bitmaps of the character
+  (or byte) values.  Strings compare without case like ur_equal().
+*/
+static void _charRelation( UThread* ut, const UCell* a1, UCell* res,
+                           enum SetOperation op )
+{
+    USeriesIter ai, bi;
+    UBuffer* out;
+    uint8_t* inB;
+    uint8_t* inR;
+    const UCell* argB = a2;
+    int type = ur_type(a1);
+    int fold = (type != UT_BINARY);
+    int c, key;
+
+    if( fold )
+    {
+        int enc = ur_bufferSer(a1)->form;
+        if( op == SET_OP_UNION && ur_strIsUcs2( ur_bufferSer(argB) ) )
+            enc = UR_ENC_UCS2;
+        out = ur_makeStringCell( ut, enc, 0, res );
+        ur_type(res) = type;
+    }
+    else
+        out = ur_makeBinaryCell( ut, 0, res );
+
+    ur_seriesSlice( ut, &ai, a1 );
+    ur_seriesSlice( ut, &bi, argB );
+
+    inB = (uint8_t*) memAlloc( 2 * 8192 );
+    memSet( inB, 0, 2 * 8192 );
+    inR = inB + 8192;
+
+    if( op == SET_OP_UNION )
+    {
+        USeriesIter* si = &ai;
+union_loop:
+        for( ; si->it < si->end; ++si->it )
+        {
+            c = _charAt( si->buf, si->it );
+            key = fold ? ur_charLowercase( c ) : c;
+            if( ! BIT_IS_SET( inR, key ) )
+            {
+                BIT_SET( inR, key );
+                _appendChar( out, c );
+            }
+        }
+        if( si == &ai )
+        {
+            si = &bi;
+            goto union_loop;
         }
     }
     else
     {
-        return ur_error( ut, UR_ERR_INTERNAL,
-                         "FIXME: set_relation only supports block!" );
+        for( ; bi.it < bi.end; ++bi.it )
+        {
+            c = _charAt( bi.buf, bi.it );
+            key = fold ? ur_charLowercase( c ) : c;
+            BIT_SET( inB, key );
+        }
+        for( ; ai.it < ai.end; ++ai.it )
+        {
+            c = _charAt( ai.buf, ai.it );
+            key = fold ? ur_charLowercase( c ) : c;
+            if( op == SET_OP_DIFF )
+            {
+                if( BIT_IS_SET( inB, key ) )
+                    continue;
+            }
+            else
+            {
+                if( ! BIT_IS_SET( inB, key ) || BIT_IS_SET( inR, key ) )
+                    continue;
+                BIT_SET( inR, key );
+            }
+            _appendChar( out, c );
+        }
     }
 
+    memFree( inB );
+}
+
+
+static inline uint32_t _elemHash( const uint8_t* elem, int size )
+{
+    uint64_t n = 0;
+    memCpy( &n, elem, size );
+    return (uint32_t) ((n * 0x9E3779B97F4A7C15ULL) >> 32);
+}
+
+
+/*
+  Set operation for vector!.  Elements are compared bitwise like
+  vector_compare() so both vectors must have the same form.
+*/
+static int _vectorRelation( UThread* ut, const UCell* a1, UCell* res,
+                            enum SetOperation op )
+{
+    USeriesIter ai, bi;
+    HashSet setB, setR;
+    UBuffer* out;
+    const UCell* argB = a2;
+    const uint8_t* elem;
+    uint32_t key;
+    int size;
+    int form = ur_bufferSer(a1)->form;
+
+    if( ur_bufferSer(argB)->form != form )
+        return ur_error( ut, UR_ERR_TYPE,
+                 "intersect/difference/union expected vectors of same form" );
+
+    out = ur_makeVectorCell( ut, (enum UrlanVectorType) form, 0, res );
+
+    ur_seriesSlice( ut, &ai, a1 );
+    ur_seriesSlice( ut, &bi, argB );
+    size = ai.buf->elemSize;
+
+#define APPEND_ELEM \
+    ur_arrReserve( out, out->used + 1 ); \
+    memCpy( out->ptr.b + out->used * size, elem, size ); \
+    ++out->used
+
+    if( op == SET_OP_UNION )
+    {
+        USeriesIter* si = &ai;
+
+        setB.slots = NULL;
+        setB.mask  = 0;
+        _hashSetInit( &setR, (ai.end - ai.it) + (bi.end - bi.it) );
+union_loop:
+        for( ; si->it < si->end; ++si->it )
+        {
+            elem = si->buf->ptr.b + si->it * size;
+            key = _elemHash( elem, size );
+            if( ! _hashSetHasElem( &setR, elem, size, key ) )
+            {
+                APPEND_ELEM;
+                _hashSetAdd( &setR, elem, key );
+            }
+        }
+        if( si == &ai )
+        {
+            si = &bi;
+            goto union_loop;
+        }
+    }
+    else
+    {
+        setR.slots = NULL;
+        setR.mask  = 0;
+        _hashSetInit( &setB, bi.end - bi.it );
+        for( ; bi.it < bi.end; ++bi.it )
+        {
+            elem = bi.buf->ptr.b + bi.it * size;
+            _hashSetAdd( &setB, elem, _elemHash( elem, size ) );
+        }
+
+        if( op == SET_OP_INTERSECT )
+            _hashSetInit( &setR, ai.end - ai.it );
+
+        for( ; ai.it < ai.end; ++ai.it )
+        {
+            elem = ai.buf->ptr.b + ai.it * size;
+            key = _elemHash( elem, size );
+            if( op == SET_OP_DIFF )
+            {
+                if( _hashSetHasElem( &setB, elem, size, key ) )
+                    continue;
+            }
+            else
+            {
+                if( ! _hashSetHasElem( &setB, elem, size, key ) ||
+                    _hashSetHasElem( &setR, elem, size, key ) )
+                    continue;
+                _hashSetAdd( &setR, elem, key );
+            }
+            APPEND_ELEM;
+        }
+    }
+
+    memFree( setB.slots );
+    memFree( setR.slots );
+    return UR_OK;
+}
+
+
+static int set_relation( UThread* ut, const UCell* a1, UCell* res,
+                         enum SetOperation op )
+{
+    int type = ur_type(a1);
+
+    if( type != ur_type(a2) )
+        return ur_error( ut, UR_ERR_TYPE,
+                 "intersect/difference/union expected series of the same type" );
+
+    if( ur_isBlockType(type) )
+        _blockRelation( ut, a1, res, op );
+    else if( ur_isStringType(type) || type == UT_BINARY )
+        _charRelation( ut, a1, res, op );
+    else if( type == UT_VECTOR )
+        return _vectorRelation( ut, a1, res, op );
+    else
+        return ur_error( ut, UR_ERR_TYPE,
+              "intersect/difference/union expected block!/string!/binary!/vector!" );
+
     return UR_OK;
 }
 
@@ -3063,6 +3626,9 @@ union_loop:
     return: New series that contains only the elements common to both sets.
     group: series
     see: difference, union
+
+    The sets may be a block!, string!, binary!, or vector!.  String characters
+    are compared without case and vectors must have the same element type.
 */
 CFUNC(cfunc_intersect)
 {
@@ -3112,13 +3678,14 @@ static inline UIndex _sliceEnd( const UBuffer* buf, const UCell* cell )
 /*-cf-
     foreach
         'words  word!/block!  Value of element(s).
-        series
+        series  series or map!
         body    block!  Code to evaluate for each element.
     return: Result of body.
     group: control
     see: forall
 
     Iterate over each element of a series.
+    A map! is iterated as alternating keys and values.
 */
 /*-cf-
     remove-each
@@ -3151,8 +3718,13 @@ CFUNC(cfunc_foreach)
 
 
     // TODO: Handle custom series type.
-    if( ! ur_isSeriesType( ur_type(a2) ) )
-        return errorType( "foreach expected series" );
+    if( ur_is(a2, UT_MAP) )
+    {
+        if( remove )
+            return errorType( "remove-each does not handle map!" );
+    }
+    else if( ! ur_isSeriesType( ur_type(a2) ) )
+        return errorType( "foreach expected series or map!" );
     if( ! ur_is(body, UT_BLOCK) )
         return errorType( "foreach expected block! body" );
 
@@ -3200,7 +3772,8 @@ CFUNC(cfunc_foreach)
 
 loop:
 
-    dt = SERIES_DT( ur_type(sarg) );
+    // The map! entry cells are iterated like a block.
+    dt = SERIES_DT( ur_is(sarg, UT_MAP) ? UT_BLOCK : ur_type(sarg) );
     if( remove )
     {
         remove = wi.end - words;
@@ -3740,6 +4313,177 @@ set_logic:
 }
 
 
+static void _setDecimal( UCell* cell, double n )
+{
+    ur_setId(cell, UT_DECIMAL);
+    ur_decimal(cell) = n;
+}
+
+
+/*-cf-
+    gc-stats
+        /types  Include bytes used by each datatype.
+    return: block! of set-word! and value pairs.
+    group: storage
+    see: gc-policy, recycle
+
+    Get garbage collector statistics for the current thread.  The values
+    returned are the collections done, full collections, total, maximum, &
+    last pause in seconds, buffers which survived and were freed by the last
+    collection, total buffers freed, dataStore size, free list length, and
+    the old generation size.
+
+    With the /types option the dataStore is scanned and a bytes: block of
+    datatype! and byte count pairs is added.  Only the memory of series and
+    contexts is counted.
+*/
+CFUNC(cfunc_gcStats)
+{
+#define GC_STAT_COUNT   11
+    static const char* _statNames =
+        "collections full pause max-pause last-pause marked swept\n"
+        "swept-total buffers free old bytes";
+    UAtom atoms[ GC_STAT_COUNT + 1 ];
+    uint64_t typeBytes[ UT_MAX ];
+    const UGCStats* st;
+    UBuffer* blk;
+    UCell* cell;
+    int i;
+    (void) a1;
+
+    st = ur_gcStats( ut, (CFUNC_OPTIONS & 1) ? typeBytes : NULL );
+    ur_internAtoms( ut, _statNames, atoms );
+
+    blk = ur_makeBlockCell( ut, UT_BLOCK, (GC_STAT_COUNT + 1) * 2, res );
+    blk->used = GC_STAT_COUNT * 2;
+    cell = blk->ptr.cell;
+    for( i = 0; i < GC_STAT_COUNT; ++i, cell += 2 )
+    {
+        ur_setId(cell, UT_SETWORD);
+        ur_setWordUnbound( cell, atoms[ i ] );
+    }
+
+    cell = blk->ptr.cell + 1;   // Value of each pair.
+    ur_setCellI64( cell, st->minorCount + st->majorCount );
+    ur_setCellI64( cell + 2, st->majorCount );
+    _setDecimal( cell + 4, st->minorPause + st->majorPause );
+    _setDecimal( cell + 6, st->maxPause );
+    _setDecimal( cell + 8, st->lastPause );
+    ur_setCellI64( cell + 10, st->markedCount );
+    ur_setCellI64( cell + 12, st->sweptCount );
+    ur_setCellI64( cell + 14, st->sweptTotal );
+    ur_setCellI64( cell + 16, st->bufferCount );
+    ur_setCellI64( cell + 18, st->freeCount );
+    ur_setCellI64( cell + 20, st->oldCount );
+
+    if( CFUNC_OPTIONS & 1 )
+    {
+        int count = 0;
+
+        cell = ur_blkAppendNew( blk, UT_SETWORD );
+        ur_setWordUnbound( cell, atoms[ GC_STAT_COUNT ] );
+        cell = ur_blkAppendNew( blk, UT_UNSET );
+
+        for( i = 0; i < UT_MAX; ++i )
+        {
+            if( typeBytes[ i ] )
+                ++count;
+        }
+        blk = ur_makeBlockCell( ut, UT_BLOCK, count * 2, cell );
+        for( i = 0; i < UT_MAX; ++i )
+        {
+            if( typeBytes[ i ] )
+            {
+                cell = blk->ptr.cell + blk->used;
+                blk->used += 2;
+                ur_makeDatatype( cell, i );
+                ur_setCellI64( cell + 1, typeBytes[ i ] );
+            }
+        }
+    }
+    return UR_OK;
+}
+
+
+/*-cf-
+    gc-policy
+        spec    block!
+    return: block! of current policy settings.
+    group: storage
+    see: gc-stats, recycle
+
+    Set when the garbage collector grows the buffer store of the current
+    thread.  The spec block may contain these set-word! and int! pairs:
+
+        free-min:   Grow if a recycle frees less than this percentage.
+        growth:     Percentage of the buffer count to grow by (0 disables).
+        heap-limit: Stop growing once buffer data uses this many bytes
+                    (0 is no limit).
+
+    Pass an empty block to get the settings without changing them.
+*/
+CFUNC(cfunc_gcPolicy)
+{
+    UAtom atoms[ 3 ];
+    UGCPolicy* pol = &ut->gcPolicy;
+    UBlockIter bi;
+    const UCell* val;
+    UBuffer* blk;
+    UCell* cell;
+    int64_t n;
+    UAtom atom;
+    int i;
+
+    ur_internAtoms( ut, "free-min growth heap-limit", atoms );
+
+    if( ! ur_is(a1, UT_BLOCK) )
+        return errorType( "gc-policy expected block!" );
+    ur_blkSlice( ut, &bi, a1 );
+    for( ; bi.it != bi.end; bi.it += 2 )
+    {
+        if( ! ur_is(bi.it, UT_SETWORD) || (bi.it + 1) == bi.end )
+            goto bad_spec;
+        val = bi.it + 1;
+        if( ur_is(val, UT_INT) )
+            n = ur_int(val);
+        else if( ur_is(val, UT_BIGNUM) )
+            n = bignum_l(val);
+        else
+            goto bad_spec;
+        if( n < 0 )
+            goto bad_spec;
+
+        atom = ur_atom(bi.it);
+        if( atom == atoms[0] )
+            pol->freeMin = (n > 100) ? 100 : (uint32_t) n;
+        else if( atom == atoms[1] )
+            pol->growth = (n > 1000) ? 1000 : (uint32_t) n;
+        else if( atom == atoms[2] )
+            pol->heapLimit = (uint64_t) n;
+        else
+            goto bad_spec;
+    }
+
+    blk = ur_makeBlockCell( ut, UT_BLOCK, 6, res );
+    blk->used = 6;
+    cell = blk->ptr.cell;
+    for( i = 0; i < 3; ++i, cell += 2 )
+    {
+        ur_setId(cell, UT_SETWORD);
+        ur_setWordUnbound( cell, atoms[ i ] );
+    }
+    cell = blk->ptr.cell;
+    ur_setCellI64( cell + 1, pol->freeMin );
+    ur_setCellI64( cell + 3, pol->growth );
+    ur_setCellI64( cell + 5, pol->heapLimit );
+    return UR_OK;
+
+bad_spec:
+    return errorScript(
+            "gc-policy expected free-min:/growth:/heap-limit: int! pairs" );
+}
+
+
 extern int ur_makeDir( UThread* ut, const char* path );
 
 static int _makeDirParents( UThread* ut, char* path, char* end )
@@ -3949,6 +4693,7 @@ CFUNC(cfunc_close)
 #define OPT_READ_INTO   0x02
 #define OPT_READ_APPEND 0x04
 #define OPT_READ_PART   0x08
+#define OPT_READ_MMAP   0x10
 
 /*
   \param len   Default length.
@@ -4048,6 +4793,7 @@ extern int ur_readDir( UThread*, const char* filename, UCell* res );
             abuf    binary!/string!
         /part       Read a specific number of bytes.
             size    int!
+        /mmap       Map file into memory as a read-only binary!.
     return: binary!/string!/block!/none!
     group: io
     see: load, write
@@ -4058,6 +4804,13 @@ extern int ur_readDir( UThread*, const char* filename, UCell* res );
     When source is a file name the entire file will be read into memory
     unless /part is used.
 
+    The /mmap option maps the file rather than copying it, so data is only
+    loaded as it is accessed.  The binary cannot be modified, and the file
+    must not be truncated while the binary is in use.  It cannot be
+    combined with /text, /into, or /append.  Files of 2 gigabytes or more
+    cannot be mapped.  On systems without mapping support the file is read
+    normally.
+
     If the /text option is used or the /into buffer is a string! then the
     file is read as UTF-8 data and carriage returns are filtered on Windows.
 
@@ -4102,6 +4855,33 @@ CFUNC(cfunc_read)
     if( info.type == FI_Dir )
         return ur_readDir( ut, filename, res );
 
+    if( opt & OPT_READ_MMAP )
+    {
+        int ok;
+
+        if( opt & (OPT_READ_TEXT | OPT_READ_INTO | OPT_READ_APPEND) )
+            return errorScript( "read/mmap cannot use /text /into /append" );
+        if( info.size > 0x7fffffff )
+            return ur_error( ut, UR_ERR_ACCESS,
+                             "file %s is too large to map", filename );
+        len = (int) info.size;
+        if( (opt & OPT_READ_PART) && ur_int(a1 + 3) < len )
+            len = (ur_int(a1 + 3) > 0) ? ur_int(a1 + 3) : 0;
+        if( len == 0 )
+        {
+            ur_setId(res, UT_NONE);
+            return UR_OK;
+        }
+
+        ok = ur_binMapFile( ur_makeBinaryCell( ut, 0, res ), filename, len );
+        if( ok > 0 )
+            return UR_OK;
+        if( ok == 0 )
+            return ur_error( ut, UR_ERR_ACCESS,
+                             "could not map file %s", filename );
+        opt &= ~OPT_READ_MMAP;  // Not supported; read normally.
+    }
+
     len = _readBuffer( ut, opt, a1, res, (int) info.size ); // gc!
     if( len > 0 )
     {
@@ -4341,6 +5121,10 @@ CFUNC( cfunc_serialize )
     return: Re-materialized block!.
     group: data
     see: serialize
+
+    If data is an entire mapped binary (see read/mmap) then the strings,
+    binaries, and vectors of the result use the file data until they are
+    modified, so the file must not be changed while they are in use.
 */
 CFUNC( cfunc_unserialize )
 {
@@ -4348,12 +5132,90 @@ CFUNC( cfunc_unserialize )
     if( ! ur_is(a1, UT_BINARY) )
         return ur_error( ut, UR_ERR_TYPE, "unserialize expected binary!" );
     ur_binSlice( ut, &bi, a1 );
+    if( bi.it == bi.buf->ptr.b && bi.end == bi.it + bi.buf->used )
+        return ur_unserializeBin( ut, a1->series.buf, res );
     return ur_unserialize( ut, bi.it, bi.end, res );
 }
 
 
 extern int ur_serializedHeader( const uint8_t* data, int len );
 
+#define LOAD_CHUNK  0x10000
+
+/*
+  Tokenize a text file as it is read so that the whole file is never held
+  in memory.
+
+  Returns UR_OK, UR_THROW, or -1 if the file is not script text and must
+  be read entirely.
+*/
+static int _loadFile( UThread* ut, const char* filename, UCell* res )
+{
+    UTokenizer tok;
+    char* buf;
+    const char* cp;
+    FILE* fp;
+    size_t n;
+    int ok = -1;
+
+    fp = fopen( filename, "rb" );
+    if( ! fp )
+        return -1;
+    buf = (char*) memAlloc( LOAD_CHUNK );
+
+    n = fread( buf, 1, LOAD_CHUNK, fp );
+    if( ! n )
+    {
+        if( ! ferror( fp ) )
+        {
+            ur_setId(res, UT_NONE);
+            ok = UR_OK;
+        }
+        goto cleanup;
+    }
+
+    cp = buf;
+    if( ur_serializedHeader( (uint8_t*) cp, n ) )
+        goto cleanup;
+#if CONFIG_COMPRESS == 2
+    if( n > 3 && cp[0] == 'B' && cp[1] == 'Z' && cp[2] == 'h' )
+        goto cleanup;
+#endif
+    if( cp[0] == '#' && cp[1] == '!' )
+    {
+        // Skip any Unix shell interpreter line.
+        cp = (const char*) find_uint8_t( (uint8_t*) cp, (uint8_t*) buf + n,
+                                         '\n' );
+        if( ! cp )
+            goto cleanup;
+    }
+
+    ur_makeBlockCell( ut, UT_BLOCK, 0, res );
+    ur_tokenizerInit( &tok, UR_ENC_UTF8, res->series.buf );
+    ok = UR_THROW;
+    do
+    {
+        if( ur_tokenizerFeed( ut, &tok, cp, buf + n ) < 0 )
+            goto cleanup_tok;
+        cp = buf;
+    }
+    while( (n = fread( buf, 1, LOAD_CHUNK, fp )) );
+
+    if( ur_tokenizerEnd( ut, &tok ) >= 0 )
+    {
+        boron_bindDefault( ut, res->series.buf );
+        ok = UR_OK;
+    }
+
+cleanup_tok:
+    ur_tokenizerFree( &tok );
+cleanup:
+    memFree( buf );
+    fclose( fp );
+    return ok;
+}
+
+
 /*-cf-
     load
         file    file!/string!/binary!
@@ -4362,6 +5224,10 @@ extern int ur_serializedHeader( const uint8_t* data, int len );
     see: read, save
 
     Load file or serialized data with default bindings.
+
+    Script files are tokenized as they are read, so the file text is not
+    held in memory in its entirety.  Serialized and compressed files are
+    mapped into memory (see read/mmap) rather than copied.
 */
 CFUNC(cfunc_load)
 {
@@ -4378,8 +5244,16 @@ bind_sb:
     {
         UCell args[3];
 
+        if( ur_isStringType( ur_type(a1) ) )
+        {
+            int ok = _loadFile( ut, boron_cpath( ut, a1, 0 ), res );
+            if( ok >= 0 )
+                return ok;
+        }
+
+        // Serialized & compressed files are mapped rather than copied.
         ur_setId(args, UT_LOGIC);
-        OPT_BITS(args) = 0;             // Clear options.
+        OPT_BITS(args) = OPT_READ_MMAP;
 
         args[1] = *a1;
 
@@ -4419,7 +5293,7 @@ check_str:
             else if( bin->used > (12 + 8) )
             {
                 const uint8_t* pat = (const uint8_t*) "BZh";
-                cp = find_pattern_uint8_t( cp, cp + 12, pat, pat + 3 );
+                cp = find_pattern_8( cp, cp + 12, pat, pat + 3 );
                 if( cp && (cp[3] >= '1') && (cp[3] <= '9') )
                 {
                     *args = *res;
@@ -4513,7 +5387,12 @@ CFUNC(cfunc_parse)
         UIndex pos;
         int ok = 0;
 
-        if( ! ur_seriesSliceM( ut, &si, a1 ) )
+        // Mapped binaries are read-only but the parsers never change the
+        // input themselves.
+        if( ur_is(a1, UT_BINARY) &&
+            (ur_bufferSer(a1)->flags & UR_BIN_MAPPED) )
+            ur_seriesSlice( ut, (USeriesIter*) &si, a1 );
+        else if( ! ur_seriesSliceM( ut, &si, a1 ) )
             return UR_THROW;
 
         if( ! (rules = ur_bufferSer(a2)) )
@@ -4549,11 +5428,8 @@ CFUNC(cfunc_parse)
         }
         else
         {
-            // Re-aquire.
-            if( ! (si.buf = ur_bufferSerM(a1)) )
-                return UR_THROW;
             // Pos can be greater than used if input was erased.
-            pos = (pos >= si.buf->used);
+            pos = (pos >= ur_bufferSer(a1)->used);
         }
 
         ur_setId(res, UT_LOGIC);
@@ -21,6 +21,13 @@
 #define SHA1HANDSOFF    1
 #include <sha1.c>
 
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <cpuid.h>
+#include <immintrin.h>
+#define CHECKSUM_X86
+#define TARGET(isa)     __attribute__((target(isa)))
+#endif
+
 
 /*
   CRC-16 Checksum - DDCMP and IBM Bisync
@@ -31,12 +38,12 @@
 #define CRC16_POLYNOMIAL    0xa001
 #define CRC16_INITIAL       0
 
-uint16_t checksum_crc16( uint8_t* data, int byteCount )
+static uint16_t crc16_update( uint16_t crc, const uint8_t* data,
+                              size_t byteCount )
 {
-    uint16_t crc, bit;
+    uint16_t bit;
     int i;
 
-    crc = CRC16_INITIAL;
     while( byteCount-- > 0 )
     {
         for( i = 1; i <= 0x80; i <<= 1 )
@@ -54,109 +61,378 @@ uint16_t checksum_crc16( uint8_t* data, int byteCount )
 }
 
 
+uint16_t checksum_crc16( uint8_t* data, int byteCount )
+{
+    return crc16_update( CRC16_INITIAL, data, byteCount );
+}
+
+
 /*
-  crc32_next and checksum_crc32 generated with universal_crc by Danjel McGougan
-  and tweaked by hand.  See http://mcgougan.se/universal_crc/
+  CRC-32/MPEG-2 (polynomial 0x04c11db7, initial value 0xffffffff, not
+  reflected).  CRC of the string "123456789" is 0x0376e6e7.
+
+  CRC-32C/Castagnoli (reflected polynomial 0x82f63b78, initial and final
+  value 0xffffffff).  CRC of the string "123456789" is 0xe3069283.
 
-  universal_crc -b 32 -p 0x04c11db7 -i 0xffffffff
-  CRC of the string "123456789" is 0x0376e6e7
+  Both use slicing-by-8 tables, with 8 bytes consumed per step.  When the
+  CPU supports them, CRC-32 folds 64 bytes at a time using carry-less
+  multiplication (PCLMULQDQ) and CRC-32C uses the SSE4.2 crc32 instruction.
 */
-static inline uint32_t crc32_next( uint32_t crc, uint8_t data )
+
+#define CRC32_POLYNOMIAL    0x04c11db7
+#define CRC32C_POLYNOMIAL   0x82f63b78
+#define CRC_FOLD_MIN        128
+
+static uint32_t _crc32Table[8][256];
+static uint32_t _crc32cTable[8][256];
+static int _checksumReady = 0;
+#ifdef CHECKSUM_X86
+static uint32_t (*_crc32Fold)( uint32_t, const uint8_t*, size_t ) = 0;
+static uint32_t (*_crc32cHw)( uint32_t, const uint8_t*, size_t ) = 0;
+static uint64_t _crc32FoldK[4];
+#endif
+
+
+#define LOAD_BE32(p)    (((uint32_t) (p)[0] << 24) | ((uint32_t) (p)[1] << 16) |\
+                         ((uint32_t) (p)[2] << 8) | (p)[3])
+#define LOAD_LE32(p)    (((uint32_t) (p)[3] << 24) | ((uint32_t) (p)[2] << 16) |\
+                         ((uint32_t) (p)[1] << 8) | (p)[0])
+
+static uint32_t crc32_sliced( uint32_t crc, const uint8_t* data, size_t len )
 {
-    uint32_t eor;
-    unsigned int i = 8;
+    const uint32_t (*T)[256] = (const uint32_t (*)[256]) _crc32Table;
+    uint32_t a, b;
+
+    for( ; len >= 8; len -= 8, data += 8 )
+    {
+        a = crc ^ LOAD_BE32( data );
+        b = LOAD_BE32( data + 4 );
+        crc = T[7][a >> 24] ^ T[6][(a >> 16) & 255] ^
+              T[5][(a >> 8) & 255] ^ T[4][a & 255] ^
+              T[3][b >> 24] ^ T[2][(b >> 16) & 255] ^
+              T[1][(b >> 8) & 255] ^ T[0][b & 255];
+    }
+    while( len-- )
+        crc = (crc << 8) ^ T[0][(crc >> 24) ^ *data++];
+    return crc;
+}
 
-    crc ^= (uint32_t)data << 24;
-    do {
-        /* This might produce branchless code */
-        eor = crc & 0x80000000 ? 0x4c11db7 : 0;
-        crc <<= 1;
-        crc ^= eor;
-    } while (--i);
 
+static uint32_t crc32c_sliced( uint32_t crc, const uint8_t* data, size_t len )
+{
+    const uint32_t (*T)[256] = (const uint32_t (*)[256]) _crc32cTable;
+    uint32_t a, b;
+
+    for( ; len >= 8; len -= 8, data += 8 )
+    {
+        a = crc ^ LOAD_LE32( data );
+        b = LOAD_LE32( data + 4 );
+        crc = T[7][a & 255] ^ T[6][(a >> 8) & 255] ^
+              T[5][(a >> 16) & 255] ^ T[4][a >> 24] ^
+              T[3][b & 255] ^ T[2][(b >> 8) & 255] ^
+              T[1][(b >> 16) & 255] ^ T[0][b >> 24];
+    }
+    while( len-- )
+        crc = (crc >> 8) ^ T[0][(crc ^ *data++) & 255];
     return crc;
 }
 
 
-uint32_t checksum_crc32( uint8_t* data, int byteCount )
+#ifdef CHECKSUM_X86
+/*
+  Fold 16 byte blocks with carry-less multiplication.  Each 128-bit block
+  is loaded with the first byte as the highest order coefficient, so
+  advancing n bits is a multiply by (x^n mod P).  The final 128-bit
+  remainder is reduced with the table code.
+*/
+#define FOLD(x,k,next) \
+    _mm_xor_si128( _mm_xor_si128( _mm_clmulepi64_si128(x, k, 0x11), \
+                                  _mm_clmulepi64_si128(x, k, 0x00) ), next )
+
+TARGET("pclmul,ssse3")
+static uint32_t crc32_pclmul( uint32_t crc, const uint8_t* data, size_t len )
+{
+    const __m128i rev = _mm_set_epi8( 0, 1, 2, 3, 4, 5, 6, 7,
+                                      8, 9,10,11,12,13,14,15 );
+    __m128i k4 = _mm_set_epi64x( _crc32FoldK[0], _crc32FoldK[1] );
+    __m128i k1 = _mm_set_epi64x( _crc32FoldK[2], _crc32FoldK[3] );
+    __m128i x0, x1, x2, x3;
+    uint8_t rem[16];
+
+#define LOADR(i)    _mm_shuffle_epi8( _mm_loadu_si128( \
+                        (const __m128i*) (data + i) ), rev )
+
+    x0 = _mm_xor_si128( LOADR(0), _mm_set_epi32( crc, 0, 0, 0 ) );
+    x1 = LOADR(16);
+    x2 = LOADR(32);
+    x3 = LOADR(48);
+    data += 64;
+    len  -= 64;
+
+    for( ; len >= 64; len -= 64, data += 64 )
+    {
+        x0 = FOLD( x0, k4, LOADR(0) );
+        x1 = FOLD( x1, k4, LOADR(16) );
+        x2 = FOLD( x2, k4, LOADR(32) );
+        x3 = FOLD( x3, k4, LOADR(48) );
+    }
+
+    x0 = FOLD( x0, k1, x1 );
+    x0 = FOLD( x0, k1, x2 );
+    x0 = FOLD( x0, k1, x3 );
+    for( ; len >= 16; len -= 16, data += 16 )
+        x0 = FOLD( x0, k1, LOADR(0) );
+
+    _mm_storeu_si128( (__m128i*) rem, _mm_shuffle_epi8( x0, rev ) );
+    crc = crc32_sliced( 0, rem, 16 );
+    return crc32_sliced( crc, data, len );
+}
+
+
+TARGET("sse4.2")
+static uint32_t crc32c_sse42( uint32_t crc, const uint8_t* data, size_t len )
 {
-    uint32_t crc = 0xffffffff;
-    if( byteCount ) do {
-        crc = crc32_next( crc, *data++ );
-    } while( --byteCount );
+#ifdef __x86_64__
+    uint64_t crc64 = crc;
+    uint64_t n;
+    for( ; len >= 8; len -= 8, data += 8 )
+    {
+        memCpy( &n, data, 8 );
+        crc64 = _mm_crc32_u64( crc64, n );
+    }
+    crc = (uint32_t) crc64;
+#else
+    uint32_t n;
+    for( ; len >= 4; len -= 4, data += 4 )
+    {
+        memCpy( &n, data, 4 );
+        crc = _mm_crc32_u32( crc, n );
+    }
+#endif
+    while( len-- )
+        crc = _mm_crc32_u8( crc, *data++ );
     return crc;
 }
 
 
-#define CHECKSUM_BUF_SIZE    4*1024
+// Return x^n mod P for the non-reflected CRC-32 polynomial.
+static uint32_t crc32_xpow( int n )
+{
+    uint32_t r = 1;
+    while( n-- )
+        r = (r & 0x80000000) ? (r << 1) ^ CRC32_POLYNOMIAL : (r << 1);
+    return r;
+}
+#endif
 
 
-static void file_crc32( FILE* fp, UBuffer* buf, UCell* res )
+/*
+  Build the CRC tables and select the kernels for this CPU.
+  This is called by boron_makeEnv() before any threads exist.
+*/
+static void checksum_init()
 {
-    uint8_t* data;
-    size_t n;
-    uint32_t crc = 0xffffffff;
+    uint32_t crc, c;
+    int i, k;
+
+    if( _checksumReady )
+        return;
 
-    while( 1 )
+    for( i = 0; i < 256; ++i )
     {
-        n = fread( buf->ptr.b, 1, CHECKSUM_BUF_SIZE, fp );
-        if( n < 1 )
-            break;
-        data = buf->ptr.b;
-        do {
-            crc = crc32_next( crc, *data++ );
-        } while( --n );
+        crc = (uint32_t) i << 24;
+        c = i;
+        for( k = 0; k < 8; ++k )
+        {
+            crc = (crc & 0x80000000) ? (crc << 1) ^ CRC32_POLYNOMIAL
+                                     : (crc << 1);
+            c = (c & 1) ? (c >> 1) ^ CRC32C_POLYNOMIAL : (c >> 1);
+        }
+        _crc32Table[0][i]  = crc;
+        _crc32cTable[0][i] = c;
+    }
+    for( k = 1; k < 8; ++k )
+    {
+        for( i = 0; i < 256; ++i )
+        {
+            crc = _crc32Table[k-1][i];
+            _crc32Table[k][i] = (crc << 8) ^ _crc32Table[0][crc >> 24];
+            c = _crc32cTable[k-1][i];
+            _crc32cTable[k][i] = (c >> 8) ^ _crc32cTable[0][c & 255];
+        }
+    }
+
+#ifdef CHECKSUM_X86
+    {
+    unsigned int a, b, ecx, d;
+    if( __get_cpuid( 1, &a, &b, &ecx, &d ) )
+    {
+        if( (ecx & bit_PCLMUL) && (ecx & bit_SSSE3) )
+        {
+            _crc32FoldK[0] = crc32_xpow( 512 + 64 );
+            _crc32FoldK[1] = crc32_xpow( 512 );
+            _crc32FoldK[2] = crc32_xpow( 128 + 64 );
+            _crc32FoldK[3] = crc32_xpow( 128 );
+            _crc32Fold = crc32_pclmul;
+        }
+        if( ecx & bit_SSE4_2 )
+            _crc32cHw = crc32c_sse42;
+        if( (ecx & bit_SSSE3) && (ecx & bit_SSE4_1) &&
+            __get_cpuid_count( 7, 0, &a, &b, &ecx, &d ) && (b & bit_SHA) )
+            SHA1_Blocks = SHA1_TransformNI;
     }
+    }
+#endif
+
+    _checksumReady = 1;
+}
+
+
+static uint32_t crc32_update( uint32_t crc, const uint8_t* data, size_t len )
+{
+#ifdef CHECKSUM_X86
+    if( _crc32Fold && len >= CRC_FOLD_MIN )
+        return _crc32Fold( crc, data, len );
+#endif
+    return crc32_sliced( crc, data, len );
+}
+
+
+static uint32_t crc32c_update( uint32_t crc, const uint8_t* data, size_t len )
+{
+#ifdef CHECKSUM_X86
+    if( _crc32cHw )
+        return _crc32cHw( crc, data, len );
+#endif
+    return crc32c_sliced( crc, data, len );
+}
 
-    ur_setId(res, UT_INT);
-    ur_int(res) = crc;
+
+uint32_t checksum_crc32( uint8_t* data, int byteCount )
+{
+    return crc32_update( 0xffffffff, data, byteCount );
 }
 
 
-static void file_sha1( UThread* ut, FILE* fp, UBuffer* buf, UCell* res )
+//----------------------------------------------------------------------------
+
+
+#define OPT_CHECKSUM_SHA1   1
+#define OPT_CHECKSUM_CRC16  2
+#define OPT_CHECKSUM_CRC32  4
+#define OPT_CHECKSUM_CRC32C 8
+
+typedef struct
 {
-    SHA1_CTX context;
-    UBuffer* sum;
-    size_t n;
+    int type;
+    uint32_t crc;
+    SHA1_CTX sha;
+}
+ChecksumState;
 
-    sum = ur_makeBinaryCell( ut, 20, res );
-    sum->used = 20;
 
-    SHA1_Init( &context );
-    while( 1 )
+static void checksum_begin( ChecksumState* st, int opt )
+{
+    if( opt & OPT_CHECKSUM_CRC32C )
     {
-        n = fread( buf->ptr.b, 1, CHECKSUM_BUF_SIZE, fp );
-        if( n < 1 )
+        st->type = OPT_CHECKSUM_CRC32C;
+        st->crc = 0xffffffff;
+    }
+    else if( opt & OPT_CHECKSUM_CRC32 )
+    {
+        st->type = OPT_CHECKSUM_CRC32;
+        st->crc = 0xffffffff;
+    }
+    else if( opt & OPT_CHECKSUM_CRC16 )
+    {
+        st->type = OPT_CHECKSUM_CRC16;
+        st->crc = CRC16_INITIAL;
+    }
+    else
+    {
+        st->type = OPT_CHECKSUM_SHA1;
+        SHA1_Init( &st->sha );
+    }
+}
+
+
+static void checksum_update( ChecksumState* st, const uint8_t* data,
+                             size_t len )
+{
+    switch( st->type )
+    {
+        case OPT_CHECKSUM_CRC32C:
+            st->crc = crc32c_update( st->crc, data, len );
+            break;
+        case OPT_CHECKSUM_CRC32:
+            st->crc = crc32_update( st->crc, data, len );
+            break;
+        case OPT_CHECKSUM_CRC16:
+            st->crc = crc16_update( st->crc, data, len );
             break;
-        SHA1_Update( &context, buf->ptr.b, n );
+        default:
+            SHA1_Update( &st->sha, data, len );
+            break;
+    }
+}
+
+
+/*
+  Set res to the checksum of all data passed to checksum_update() so far.
+  The state is not modified and may continue to be updated.
+*/
+static void checksum_result( UThread* ut, const ChecksumState* st, UCell* res )
+{
+    if( st->type == OPT_CHECKSUM_SHA1 )
+    {
+        SHA1_CTX context;
+        UBuffer* bin;
+
+        bin = ur_makeBinaryCell( ut, 20, res );
+        bin->used = 20;
+
+        context = st->sha;
+        SHA1_Final( &context, bin->ptr.b );
+    }
+    else
+    {
+        ur_setId(res, UT_INT);
+        ur_int(res) = (st->type == OPT_CHECKSUM_CRC32C) ? ~st->crc : st->crc;
     }
-    SHA1_Final( &context, sum->ptr.b );
 }
 
 
+#define CHECKSUM_BUF_SIZE    64*1024
+
+
 /*-cf-
     checksum
         data    binary!/string!/file!
         /sha1
         /crc16  IBM Bisync, USB
         /crc32  IEEE 802.3, MPEG-2
+        /crc32c Castagnoli (iSCSI, SCTP, ext4)
     return: int!/binary!
     group: data
 
     Computes sha1 checksum by default.
+
+    To checksum data in chunks (e.g. as it is read from a port), open a
+    checksum port with the method name and write to it.  Reading the port
+    returns the checksum of all data written so far.
+
+        ck: open "checksum://crc32c"   ; or open [checksum crc32c]
+        while [b: read/part src 65536] [write ck b]
+        read ck
 */
 CFUNC(cfunc_checksum)
 {
-#define OPT_CHECKSUM_SHA1   1
-#define OPT_CHECKSUM_CRC16  2
-#define OPT_CHECKSUM_CRC32  4
+    ChecksumState st;
     int type = ur_type(a1);
 
     if( (type == UT_BINARY) || (type == UT_STRING) )
     {
         USeriesIter si;
-        uint8_t* it;
-        uint8_t* end;
 
         ur_seriesSlice( ut, &si, a1 );
 
@@ -164,30 +440,9 @@ CFUNC(cfunc_checksum)
             return ur_error( ut, UR_ERR_TYPE,
                              "checksum does not handle ucs2 strings" );
 
-        it  = si.buf->ptr.b + si.it;
-        end = si.buf->ptr.b + si.end;
-
-        type = CFUNC_OPTIONS;
-        if( type > OPT_CHECKSUM_SHA1 )
-        {
-            if( type & OPT_CHECKSUM_CRC32 )
-                ur_int(res) = checksum_crc32( it, end - it );
-            else
-                ur_int(res) = checksum_crc16( it, end - it );
-            ur_setId(res, UT_INT);
-        }
-        else
-        {
-            SHA1_CTX context;
-            UBuffer* bin;
-
-            bin = ur_makeBinaryCell( ut, 20, res );
-            bin->used = 20;
-
-            SHA1_Init( &context );
-            SHA1_Update( &context, it, end - it );
-            SHA1_Final( &context, bin->ptr.b );
-        }
+        checksum_begin( &st, CFUNC_OPTIONS );
+        checksum_update( &st, si.buf->ptr.b + si.it, si.end - si.it );
+        checksum_result( ut, &st, res );
         return UR_OK;
     }
     else if( type == UT_FILE )
@@ -195,6 +450,7 @@ CFUNC(cfunc_checksum)
         const char* filename;
         FILE* fp;
         UBuffer* tmp;
+        size_t n;
 
         filename = boron_cpath( ut, a1, 0 );
         fp = fopen( filename, "rb" );
@@ -203,16 +459,17 @@ CFUNC(cfunc_checksum)
             return ur_error( ut, UR_ERR_ACCESS,
                              "could not open file %s", filename );
         }
+        setvbuf( fp, NULL, _IONBF, 0 );     // Read directly into tmp.
 
         tmp = ur_buffer( BT->tempN );   // Same buffer as filename.
         ur_binReserve( tmp, CHECKSUM_BUF_SIZE );
 
-        if( CFUNC_OPTIONS & OPT_CHECKSUM_CRC32 )
-            file_crc32( fp, tmp, res );
-        else
-            file_sha1( ut, fp, tmp, res );
-
+        checksum_begin( &st, CFUNC_OPTIONS );
+        while( (n = fread( tmp->ptr.b, 1, CHECKSUM_BUF_SIZE, fp )) > 0 )
+            checksum_update( &st, tmp->ptr.b, n );
         fclose( fp );
+
+        checksum_result( ut, &st, res );
         return UR_OK;
     }
     return ur_error( ut, UR_ERR_TYPE,
@@ -220,4 +477,138 @@ CFUNC(cfunc_checksum)
 }
 
 
+//----------------------------------------------------------------------------
+// Checksum port
+
+
+typedef struct
+{
+    const UPortDevice* dev;
+    ChecksumState st;
+}
+ChecksumExt;
+
+
+static int checksum_open( UThread* ut, const UPortDevice* pdev,
+                          const UCell* from, int opt, UCell* res )
+{
+    static const char* methods[] = { "sha1", "crc16", "crc32", "crc32c" };
+    ChecksumExt* ext;
+    const char* name = 0;
+    int i;
+    (void) opt;
+
+    if( ur_is(from, UT_BLOCK) )
+    {
+        UBlockIter bi;
+        ur_blkSlice( ut, &bi, from );
+        if( (bi.end - bi.it) > 1 )
+        {
+            if( ! ur_isWordType( ur_type(bi.it + 1) ) )
+                return ur_error( ut, UR_ERR_TYPE,
+                                 "checksum port expected method word" );
+            name = ur_atomCStr( ut, ur_atom(bi.it + 1) );
+        }
+    }
+    else if( ur_is(from, UT_STRING) )
+    {
+        name = strstr( boron_cstr( ut, from, 0 ), "://" ) + 3;
+        if( ! *name )
+            name = 0;
+    }
+
+    opt = OPT_CHECKSUM_SHA1;
+    if( name )
+    {
+        for( i = 0; i < 4; ++i )
+        {
+            if( strcmp( name, methods[i] ) == 0 )
+                break;
+        }
+        if( i == 4 )
+            return ur_error( ut, UR_ERR_SCRIPT,
+                             "Invalid checksum method %s", name );
+        opt = 1 << i;
+    }
+
+    ext = (ChecksumExt*) memAlloc( sizeof(ChecksumExt) );
+    if( ! ext )
+        return ur_error( ut, UR_ERR_INTERNAL, "Could not alloc checksum port" );
+    checksum_begin( &ext->st, opt );
+
+    boron_makePort( ut, pdev, ext, res );
+    return UR_OK;
+}
+
+
+static void checksum_close( UBuffer* port )
+{
+    memFree( port->ptr.v );
+}
+
+
+static int checksum_read( UThread* ut, UBuffer* port, UCell* dest, int len )
+{
+    (void) len;
+    checksum_result( ut, &((ChecksumExt*) port->ptr.v)->st, dest );
+    return UR_OK;
+}
+
+
+extern int boron_sliceMem( UThread* ut, const UCell* cell, const void** ptr );
+
+static int checksum_write( UThread* ut, UBuffer* port, const UCell* data )
+{
+    const void* mem;
+    int len;
+
+    if( ur_is(data, UT_STRING) )
+    {
+        if( ur_strIsUcs2( ur_bufferSer(data) ) )
+            return ur_error( ut, UR_ERR_TYPE,
+                             "checksum does not handle ucs2 strings" );
+    }
+    else if( ! ur_is(data, UT_BINARY) )
+        return ur_error( ut, UR_ERR_TYPE,
+                         "checksum write expected binary!/string!" );
+
+    len = boron_sliceMem( ut, data, &mem );
+    checksum_update( &((ChecksumExt*) port->ptr.v)->st,
+                     (const uint8_t*) mem, len );
+    return UR_OK;
+}
+
+
+static int checksum_seek( UThread* ut, UBuffer* port, UCell* pos, int where )
+{
+    (void) port;
+    (void) pos;
+    (void) where;
+    return ur_error( ut, UR_ERR_SCRIPT, "cannot seek on checksum port" );
+}
+
+
+#ifdef _WIN32
+static int checksum_waitFD( UBuffer* port, void** handle )
+{
+    (void) port;
+    (void) handle;
+    return -1;
+}
+#else
+static int checksum_waitFD( UBuffer* port )
+{
+    (void) port;
+    return -1;
+}
+#endif
+
+
+UPortDevice port_checksum =
+{
+    checksum_open, checksum_close, checksum_read, checksum_write,
+    checksum_seek, checksum_waitFD, 0
+};
+
+
 //EOF
@@ -262,4 +262,239 @@ CFUNC(cfunc_decompress)
 }
 
 
+//----------------------------------------------------------------------------
+// Codec ports
+
+
+#define CODEC_CHUNK     16384
+
+typedef struct
+{
+    const UPortDevice* dev;
+    UBuffer in;             // Input written but not yet consumed.
+    UIndex  inPos;
+    uint8_t deflate;
+    uint8_t finish;         // Set when none! is written.
+    uint8_t ended;
+#ifdef ZLIB_H
+    z_stream strm;
+#else
+    bz_stream strm;
+#endif
+}
+CodecExt;
+
+
+extern UPortDevice port_deflate;
+extern UPortDevice port_inflate;
+extern int boron_sliceMem( UThread* ut, const UCell* cell, const void** ptr );
+
+static int codec_open( UThread* ut, const UPortDevice* pdev,
+                       const UCell* from, int opt, UCell* res )
+{
+    CodecExt* ext;
+    int level = -1;
+    int ok;
+    (void) opt;
+
+    if( ur_is(from, UT_BLOCK) )
+    {
+        UBlockIter bi;
+        ur_blkSlice( ut, &bi, from );
+        if( (bi.end - bi.it) > 1 && ur_is(bi.it + 1, UT_INT) )
+            level = ur_int(bi.it + 1);
+    }
+
+    ext = (CodecExt*) memAlloc( sizeof(CodecExt) );
+    if( ! ext )
+        return ur_error( ut, UR_ERR_INTERNAL, "Could not alloc codec port" );
+    memSet( ext, 0, sizeof(CodecExt) );
+    ur_binInit( &ext->in, 0 );
+    ext->deflate = (pdev == &port_deflate);
+
+#ifdef ZLIB_H
+    if( ext->deflate )
+        ok = deflateInit( &ext->strm, (level < 0 || level > 9) ?
+                                      Z_DEFAULT_COMPRESSION : level );
+    else
+        ok = inflateInit( &ext->strm );
+    ok = (ok == Z_OK);
+#else
+    if( ext->deflate )
+        ok = BZ2_bzCompressInit( &ext->strm, (level < 1 || level > 9) ?
+                                             3 : level, 0, 0 );
+    else
+        ok = BZ2_bzDecompressInit( &ext->strm, 0, 0 );
+    ok = (ok == BZ_OK);
+#endif
+    if( ! ok )
+    {
+        memFree( ext );
+        return ur_error( ut, UR_ERR_INTERNAL, "Could not init codec stream" );
+    }
+
+    boron_makePort( ut, pdev, ext, res );
+    return UR_OK;
+}
+
+
+static void codec_close( UBuffer* port )
+{
+    CodecExt* ext = (CodecExt*) port->ptr.v;
+
+#ifdef ZLIB_H
+    if( ext->deflate )
+        deflateEnd( &ext->strm );
+    else
+        inflateEnd( &ext->strm );
+#else
+    if( ext->deflate )
+        BZ2_bzCompressEnd( &ext->strm );
+    else
+        BZ2_bzDecompressEnd( &ext->strm );
+#endif
+    ur_binFree( &ext->in );
+    memFree( ext );
+}
+
+
+/*
+  Run the codec over pending input until dest has len bytes or no more
+  progress can be made.  Dest is set to none once the stream has ended and
+  all output has been read.
+*/
+static int codec_read( UThread* ut, UBuffer* port, UCell* dest, int len )
+{
+    CodecExt* ext = (CodecExt*) port->ptr.v;
+    UBuffer* buf;
+    UBuffer* in;
+    int ok;
+
+    if( ext->ended )
+    {
+        ur_setId(dest, UT_NONE);
+        return UR_OK;
+    }
+
+    buf = ur_buffer( dest->series.buf );
+    in  = &ext->in;
+
+    ext->strm.next_in   = (void*) (in->ptr.c + ext->inPos);
+    ext->strm.avail_in  = in->used - ext->inPos;
+    ext->strm.next_out  = (void*) (buf->ptr.c + buf->used);
+    ext->strm.avail_out = len;
+
+#ifdef ZLIB_H
+    if( ext->deflate )
+        ok = deflate( &ext->strm, ext->finish ? Z_FINISH : Z_NO_FLUSH );
+    else
+        ok = inflate( &ext->strm, Z_NO_FLUSH );
+    if( ok == Z_STREAM_END )
+        ext->ended = 1;
+    else if( ok != Z_OK && ok != Z_BUF_ERROR )
+        return ur_error( ut, UR_ERR_ACCESS, "%s stream error (%d)",
+                         ext->deflate ? "deflate" : "inflate", ok );
+#else
+    if( ext->deflate )
+        ok = BZ2_bzCompress( &ext->strm, ext->finish ? BZ_FINISH : BZ_RUN );
+    else
+        ok = BZ2_bzDecompress( &ext->strm );
+    if( ok == BZ_STREAM_END )
+        ext->ended = 1;
+    else if( ok < 0 )
+        return ur_error( ut, UR_ERR_ACCESS, "%s stream error (%d)",
+                         ext->deflate ? "deflate" : "inflate", ok );
+#endif
+
+    ext->inPos = in->used - ext->strm.avail_in;
+    if( ext->inPos == in->used )
+        in->used = ext->inPos = 0;
+
+    len -= ext->strm.avail_out;
+    buf->used += len;
+
+    if( ! len )
+    {
+        if( ext->ended )
+            ur_setId(dest, UT_NONE);
+        else if( ext->finish && ! ext->deflate && ! in->used )
+            return ur_error( ut, UR_ERR_ACCESS, "inflate stream truncated" );
+    }
+    return UR_OK;
+}
+
+
+static int codec_write( UThread* ut, UBuffer* port, const UCell* data )
+{
+    CodecExt* ext = (CodecExt*) port->ptr.v;
+    UBuffer* in;
+    const void* mem;
+    int len;
+
+    if( ext->finish )
+        return ur_error( ut, UR_ERR_SCRIPT, "codec port input is finished" );
+
+    if( ur_is(data, UT_NONE) )
+    {
+        ext->finish = 1;
+        return UR_OK;
+    }
+    if( ! ur_is(data, UT_BINARY) && ! ur_is(data, UT_STRING) )
+        return ur_error( ut, UR_ERR_TYPE,
+                         "codec write expected binary!/string!/none!" );
+
+    len = boron_sliceMem( ut, data, &mem );
+    if( len )
+    {
+        in = &ext->in;
+        if( ext->inPos )
+        {
+            in->used -= ext->inPos;
+            memMove( in->ptr.b, in->ptr.b + ext->inPos, in->used );
+            ext->inPos = 0;
+        }
+        ur_binAppendData( in, (const uint8_t*) mem, len );
+    }
+    return UR_OK;
+}
+
+
+static int codec_seek( UThread* ut, UBuffer* port, UCell* pos, int where )
+{
+    (void) port;
+    (void) pos;
+    (void) where;
+    return ur_error( ut, UR_ERR_SCRIPT, "cannot seek on codec port" );
+}
+
+
+#ifdef _WIN32
+static int codec_waitFD( UBuffer* port, void** handle )
+{
+    (void) port;
+    (void) handle;
+    return -1;
+}
+#else
+static int codec_waitFD( UBuffer* port )
+{
+    (void) port;
+    return -1;
+}
+#endif
+
+
+UPortDevice port_deflate =
+{
+    codec_open, codec_close, codec_read, codec_write, codec_seek,
+    codec_waitFD, CODEC_CHUNK
+};
+
+UPortDevice port_inflate =
+{
+    codec_open, codec_close, codec_read, codec_write, codec_seek,
+    codec_waitFD, CODEC_CHUNK
+};
+
+
 //EOF
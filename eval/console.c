@@ -62,7 +62,14 @@ void usage( const char* arg0 )
             "  -a      Disable audio\n"
 #endif
             "  -e exp  Evaluate expression\n"
+#ifndef BORON_GL
+            "  -g      Use generational garbage collector\n"
+#endif
             "  -h      Show this help and exit\n"
+#ifndef BORON_GL
+            "  -i file Load environment image\n"
+            "  -o file Save environment image and exit\n"
+#endif
             "  -p      Disable prompt and exit on exception\n"
             "  -s      Disable security\n"
           );
@@ -106,6 +113,10 @@ void reportError( UThread* ut, UCell* err, UBuffer* str )
 int main( int argc, char** argv )
 {
     char* cmd = 0;
+#ifndef BORON_GL
+    const char* loadImage = 0;
+    const char* saveImage = 0;
+#endif
     UThread* ut;
     UBuffer rstr;
     UCell* val;
@@ -113,6 +124,7 @@ int main( int argc, char** argv )
     int ret = 0;
     char promptDisabled = 0;
     char secure = 1;
+    char gcMode = UR_GC_FULL;
 
 
     // Parse arguments.
@@ -143,10 +155,28 @@ int main( int argc, char** argv )
                             fileN = -i;
                             i = argc;
                             break;
+#ifndef BORON_GL
+                        case 'g':
+                            gcMode = UR_GC_GENERATIONAL;
+                            break;
+#endif
 
                         case 'h':
                             usage( argv[0] );
                             return 0;
+#ifndef BORON_GL
+                        case 'i':
+                            if( ++i >= argc )
+                                goto usage_err;
+                            loadImage = argv[i];
+                            break;
+
+                        case 'o':
+                            if( ++i >= argc )
+                                goto usage_err;
+                            saveImage = argv[i];
+                            break;
+#endif
 
                         case 'p':
                             promptDisabled = 1;
@@ -172,7 +202,26 @@ usage_err:
     }
 
 
+#ifdef BORON_GL
     ut = boron_makeEnv( 0, 0 );
+#else
+    {
+    UEnvParameters par;
+    boron_envParam( &par );
+    par.gcMode = gcMode;
+    if( loadImage )
+    {
+        ut = boron_makeEnvImage( &par, loadImage, 0, 0 );
+        if( ! ut )
+        {
+            printf( "Cannot load environment image %s\n", loadImage );
+            return 70;      // EX_SOFTWARE
+        }
+    }
+    else
+        ut = boron_makeEnvP( &par );
+    }
+#endif
     if( ! ut )
     {
         puts( "boron_makeEnv failed" );
@@ -180,6 +229,21 @@ usage_err:
     }
     ur_freezeEnv( ut );
 
+#ifndef BORON_GL
+    if( saveImage )
+    {
+        if( ! boron_saveEnvImage( ut, saveImage, 0, 0 ) )
+        {
+            ur_strInit( &rstr, UR_ENC_UTF8, 0 );
+            reportError( ut, boron_exception( ut ), &rstr );
+            ur_strFree( &rstr );
+            ret = 70;   // EX_SOFTWARE
+        }
+        boron_freeEnv( ut );
+        return ret;
+    }
+#endif
+
     if( secure )
         boron_setAccessFunc( ut, promptDisabled ? denyAccess : requestAccess );
 
@@ -0,0 +1,573 @@
+/*
+  Copyright 2016 Karl Robillard
+
+  This file is part of the Boron programming language.
+
+  Boron is free software: you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Boron is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with Boron.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/*
+  Pre-decoded block evaluation (CONFIG_PREDECODE).
+
+  Blocks which are done repeatedly by boron_doBlock() are decoded into a
+  PreOp array with one entry per cell.  The op records how boron_eval1()
+  would dispatch on the cell and, for words bound to a cfunc! with a plain
+  argument program (only FO_fetchArg), the function pointer and arity so the
+  call can be made without interpreting the argument program.
+
+  The ops are only hints.  Each one carries the cell type it was made for
+  and calls re-check the word value, so a modified block never evaluates
+  differently than it would with boron_eval1().  The decoded form is
+  rebuilt when the block memory or length changes.
+
+  Decoded blocks are kept in a per-thread open addressed table keyed by
+  buffer id.  Entries for thread buffers are dropped when the garbage
+  collector sweeps the block.  Until a block is hot its runs are only
+  counted in a small direct mapped array, so blocks which are done once
+  do not allocate anything.
+*/
+
+
+enum PreOpcode
+{
+    PO_EVAL1,       // Use boron_eval1().
+    PO_VALUE,       // Copy cell to result.
+    PO_WORD,        // Get word value or call function.
+    PO_CALL,        // Call cached cfunc! with argc fetched arguments.
+    PO_SETWORD      // Set single set-word! to value of next cell.
+};
+
+
+typedef struct
+{
+    uint8_t    op;          // PreOpcode
+    uint8_t    type;        // Cell type the op was decoded from.
+    uint8_t    argc;        // PO_CALL argument count.
+    uint8_t    _pad0;
+    UIndex     argBufN;     // PO_CALL argument program of cfunc.
+    BoronCFunc func;        // PO_CALL cfunc.
+}
+PreOp;
+
+
+typedef struct PreCode PreCode;
+
+struct PreCode
+{
+    PreCode* prev;          // Smaller code replaced while it may be in use.
+    UIndex   count;
+    PreOp    ops[1];
+};
+
+
+typedef struct PreBlock
+{
+    UIndex   bufN;
+    UIndex   used;          // Block used when decoded.
+    const UCell* cells;     // Block memory when decoded.
+    uint32_t runs;
+    PreCode* code;
+}
+PreBlock;
+
+
+typedef struct
+{
+    UIndex   bufN;
+    uint32_t runs;
+}
+PreRun;
+
+
+#define PRE_HOT_RUNS    3       // Decode block on this boron_doBlock call.
+#define PRE_TABLE_INIT  64
+#define PRE_RUNS_SIZE   256     // Must be a power of two.
+
+
+static inline uint32_t _preHash( UIndex n )
+{
+    uint32_t h = ((uint32_t) n) * 2654435761u;
+    return h ^ (h >> 16);
+}
+
+
+static void _preBlockFree( PreBlock* pb )
+{
+    PreCode* code = pb->code;
+    PreCode* prev;
+    while( code )
+    {
+        prev = code->prev;
+        memFree( code );
+        code = prev;
+    }
+    memFree( pb );
+}
+
+
+static void _preTableInit( UBuffer* tab, int count )
+{
+    ur_arrInit( tab, sizeof(PreBlock*), count );
+    memSet( tab->ptr.v, 0, sizeof(PreBlock*) * count );
+}
+
+
+/*
+  Insert entry into table known to have a free slot.
+*/
+static void _preInsert( UBuffer* tab, PreBlock* pb )
+{
+    PreBlock** table = ur_ptr(PreBlock*, tab);
+    uint32_t mask = ur_avail(tab) - 1;
+    uint32_t i = _preHash( pb->bufN ) & mask;
+    while( table[i] )
+        i = (i + 1) & mask;
+    table[i] = pb;
+    ++tab->used;
+}
+
+
+/*
+  Rebuild table with the entries for which keep() returns non-zero.
+  The other entries are freed.
+*/
+static void _preRehash( UThread* ut, int newSize,
+                        int (*keep)( UThread*, const PreBlock* ) )
+{
+    UBuffer old = BT->preCache;
+    PreBlock** it  = ur_ptr(PreBlock*, &old);
+    PreBlock** end = it + ur_avail(&old);
+
+    _preTableInit( &BT->preCache, newSize );
+    for( ; it != end; ++it )
+    {
+        if( *it )
+        {
+            if( ! keep || keep( ut, *it ) )
+                _preInsert( &BT->preCache, *it );
+            else
+                _preBlockFree( *it );
+        }
+    }
+    ur_arrFree( &old );
+}
+
+
+static void boron_preInit( UThread* ut )
+{
+    UBuffer* runs = &BT->preRuns;
+
+    _preTableInit( &BT->preCache, PRE_TABLE_INIT );
+
+    ur_arrInit( runs, sizeof(PreRun), PRE_RUNS_SIZE );
+    memSet( runs->ptr.v, 0, sizeof(PreRun) * PRE_RUNS_SIZE );
+}
+
+
+static void boron_preFree( UThread* ut )
+{
+    UBuffer* tab = &BT->preCache;
+    PreBlock** it  = ur_ptr(PreBlock*, tab);
+    PreBlock** end = it + ur_testAvail(tab);
+    for( ; it != end; ++it )
+    {
+        if( *it )
+            _preBlockFree( *it );
+    }
+    ur_arrFree( tab );
+    ur_arrFree( &BT->preRuns );
+}
+
+
+static int _preKeepMarked( UThread* ut, const PreBlock* pb )
+{
+    UIndex n = pb->bufN;
+    if( ur_isShared(n) || n >= ut->dataStore.used )
+        return ur_isShared(n);
+    return ut->gcBits.ptr.b[ n >> 3 ] & (1 << (n & 7));
+}
+
+
+/*
+  Drop entries of blocks which are about to be swept.
+  Must only be called during the UR_RECYCLE_SWEEP phase.
+*/
+static void boron_preSweep( UThread* ut )
+{
+    UBuffer* tab = &BT->preCache;
+    if( tab->used )
+        _preRehash( ut, ur_avail(tab), _preKeepMarked );
+}
+
+
+/*
+  Return argument count if cfunc argument program only fetches arguments,
+  or zero if the program must be interpreted by boron_call().
+*/
+static int _preSimpleArgs( UThread* ut, const UCellFunc* fc )
+{
+    const uint8_t* pc;
+    int i, n;
+
+    if( fc->argBufN == UR_INVALID_BUF )
+        return 0;
+    pc = ur_bufferE( fc->argBufN )->ptr.b;
+    if( pc[0] != FO_clearLocal )
+        return 0;
+    n = pc[1];
+    for( i = 0; i < n; ++i )
+    {
+        if( pc[2 + i] != FO_fetchArg )
+            return 0;
+    }
+    return (pc[2 + n] == FO_end) ? n : 0;
+}
+
+
+#define PRE_CELLS(bc) \
+    (ur_isShared((bc)->series.buf) ? \
+        (ut->env->dataStore.ptr.buf - (bc)->series.buf)->ptr.cell : \
+        ur_buffer((bc)->series.buf)->ptr.cell)
+
+
+static const UCell* _preWordCell( UThread* ut, const UCell* cell )
+{
+    switch( ur_binding(cell) )
+    {
+        case UR_BIND_THREAD:
+            return ur_buffer( cell->word.ctx )->ptr.cell + cell->word.index;
+        case UR_BIND_ENV:
+            return (ut->env->dataStore.ptr.buf - cell->word.ctx)->ptr.cell +
+                   cell->word.index;
+    }
+    return 0;
+}
+
+
+static void _preDecode( UThread* ut, PreOp* op, const UCell* it,
+                        const UCell* end )
+{
+    const UCell* val;
+    int n;
+
+    for( ; it != end; ++it, ++op )
+    {
+        op->type    = ur_type(it);
+        op->argc    = 0;
+        op->_pad0   = 0;
+        op->argBufN = UR_INVALID_BUF;
+        op->func    = 0;
+
+        switch( ur_type(it) )
+        {
+            case UT_WORD:
+                op->op = PO_WORD;
+                val = _preWordCell( ut, it );
+                if( val && ur_is(val, UT_CFUNC) &&
+                    (n = _preSimpleArgs( ut, (const UCellFunc*) val )) )
+                {
+                    op->op      = PO_CALL;
+                    op->argc    = n;
+                    op->argBufN = ((const UCellFunc*) val)->argBufN;
+                    op->func    = ur_funcFunc(val);
+                }
+                break;
+
+            case UT_SETWORD:
+                if( (it + 1) != end && ! ur_is(it + 1, UT_SETWORD) &&
+                                       ! ur_is(it + 1, UT_SETPATH) )
+                    op->op = PO_SETWORD;
+                else
+                    op->op = PO_EVAL1;
+                break;
+
+            case UT_LITWORD:
+            case UT_GETWORD:
+            case UT_PAREN:
+            case UT_PATH:
+            case UT_LITPATH:
+            case UT_SETPATH:
+            case UT_FUNC:
+            case UT_CFUNC:
+                op->op = PO_EVAL1;
+                break;
+
+            default:
+                op->op = PO_VALUE;
+                break;
+        }
+    }
+}
+
+
+/*
+  Get pre-decoded ops for block or zero if the block should be evaluated
+  with boron_eval1().
+
+  \param bufN   Block buffer id.
+  \param buf    Block buffer.
+*/
+static const PreOp* boron_preOps( UThread* ut, UIndex bufN,
+                                  const UBuffer* buf )
+{
+    UBuffer* tab = &BT->preCache;
+    PreBlock** table = ur_ptr(PreBlock*, tab);
+    PreBlock* pb;
+    PreCode* code;
+    PreRun* pr;
+    uint32_t hash = _preHash( bufN );
+    uint32_t mask = ur_avail(tab) - 1;
+    uint32_t i = hash & mask;
+
+    while( (pb = table[i]) )
+    {
+        if( pb->bufN == bufN )
+            goto found;
+        i = (i + 1) & mask;
+    }
+
+    // Count the runs of a new block without allocating a PreBlock.  A slot
+    // shared with another block restarts the count.
+    pr = ur_ptr(PreRun, &BT->preRuns) + (hash & (PRE_RUNS_SIZE - 1));
+    if( pr->bufN != bufN )
+    {
+        pr->bufN = bufN;
+        pr->runs = 1;
+        return 0;
+    }
+    if( ++pr->runs < PRE_HOT_RUNS )
+        return 0;
+    pr->bufN = UR_INVALID_BUF;
+
+    // Keep table at most half full.
+    if( (tab->used + 1) * 2 > ur_avail(tab) )
+        _preRehash( ut, ur_avail(tab) * 2, 0 );
+
+    pb = (PreBlock*) memAlloc( sizeof(PreBlock) );
+    pb->bufN  = bufN;
+    pb->used  = buf->used;
+    pb->cells = buf->ptr.cell;
+    pb->runs  = PRE_HOT_RUNS - 1;   // Decoded below.
+    pb->code  = 0;
+    _preInsert( tab, pb );
+
+found:
+
+    if( pb->cells != buf->ptr.cell || pb->used != buf->used )
+    {
+        // Block has been modified; decode again after it becomes hot.
+        pb->used  = buf->used;
+        pb->cells = buf->ptr.cell;
+        pb->runs  = 1;
+        return 0;
+    }
+    if( pb->runs < PRE_HOT_RUNS )
+    {
+        if( ++pb->runs < PRE_HOT_RUNS )
+            return 0;
+
+        // Code already in use by an outer evaluation is updated in place
+        // (ops are only hints), so it can only be freed with the PreBlock.
+        code = pb->code;
+        if( ! code || code->count < buf->used )
+        {
+            code = (PreCode*) memAlloc( sizeof(PreCode) +
+                                        sizeof(PreOp) * buf->used );
+            code->prev  = pb->code;
+            code->count = buf->used;
+            pb->code = code;
+        }
+        _preDecode( ut, code->ops, buf->ptr.cell, buf->ptr.cell + buf->used );
+    }
+    return pb->code->ops;
+}
+
+
+/*
+  Fetch arguments and call cfunc.  This is the same as the boron_call()
+  path for an argument program of only FO_fetchArg instructions.
+  blkC->series.it must be just past the function word.
+*/
+static int boron_evalPre( UThread*, UCell* blkC, const PreOp* ops,
+                          UCell* res );
+
+static int _preCallC( UThread* ut, const PreOp* fop, int flags, UCell* blkC,
+                      const PreOp* ops, UCell* res )
+{
+    UCell* args;
+    UCell* it;
+    UCell* end;
+    int nc = fop->argc;
+    BoronCFunc func = fop->func;
+    int ok;
+#ifdef CONFIG_PROFILE
+    UIndex site = blkC->series.it - 1;
+#endif
+
+    if( ! (args = boron_stackPushN( ut, nc )) )
+    {
+        BT->fo.optionMask = 0;
+        goto traceError;
+    }
+    end = args + nc;
+    for( it = args; it != end; ++it )
+        ur_setId(it, UT_NONE);
+
+    for( it = args; it != end; ++it )
+    {
+        const UCell* cell;
+        const PreOp* op;
+
+        if( blkC->series.it >= blkC->series.end )
+        {
+            ur_error( ut, UR_ERR_SCRIPT, "Unexpected end of block" );
+            goto cleanup_trace;
+        }
+
+        // Inline literal arguments.
+        cell = PRE_CELLS(blkC) + blkC->series.it;
+        op = ops + blkC->series.it;
+        if( op->op == PO_VALUE && ur_type(cell) == op->type )
+        {
+            *it = *cell;
+            ++blkC->series.it;
+        }
+        else if( ! boron_evalPre( ut, blkC, ops, it ) )
+        {
+            boron_stackPopN( ut, nc );
+            return UR_THROW;
+        }
+    }
+
+    PROF_ENTER( func, 0, blkC->series.buf, site );
+    ok = func( ut, args, res );
+    PROF_LEAVE;
+    if( ! ok && ! (flags & FUNC_FLAG_GHOST) )
+        goto cleanup_trace;
+    boron_stackPopN( ut, nc );
+    return ok;
+
+cleanup_trace:
+
+    boron_stackPopN( ut, nc );
+
+traceError:
+
+    ur_appendTrace( ut, blkC->series.buf, blkC->series.it-1 );
+    return UR_THROW;
+}
+
+
+/*
+  Evaluate one value in block using pre-decoded ops.
+  This has the same results and error traces as boron_eval1().
+
+  \param blkC   Block cell where series.it < series.end.
+                The series.buf must be held.
+  \param ops    Ops from boron_preOps() for blkC->series.buf.
+  \param res    Result.  This cell must be in a held block.
+
+  \return UR_OK/UR_THROW.
+*/
+static int boron_evalPre( UThread* ut, UCell* blkC, const PreOp* ops,
+                          UCell* res )
+{
+    const UCell* cell;
+    const UCell* val;
+    const PreOp* op;
+
+    cell = PRE_CELLS(blkC) + blkC->series.it;
+    op = ops + blkC->series.it;
+    if( ur_type(cell) != op->type )
+        return boron_eval1( ut, blkC, res );
+
+    switch( op->op )
+    {
+        case PO_VALUE:
+            *res = *cell;
+            ++blkC->series.it;
+            return UR_OK;
+
+        case PO_CALL:
+            if( ! (val = _preWordCell( ut, cell )) )
+                break;
+            if( ur_is(val, UT_CFUNC) && ur_funcFunc(val) == op->func &&
+                ((const UCellFunc*) val)->argBufN == op->argBufN )
+            {
+                ++blkC->series.it;
+                return _preCallC( ut, op, val->id.flags, blkC, ops, res );
+            }
+            goto word_value;
+
+        case PO_WORD:
+            if( ! (val = ur_wordCell( ut, cell )) )
+                goto traceError;
+word_value:
+            if( ur_is(val, UT_CFUNC) || ur_is(val, UT_FUNC) )
+            {
+                BT->fo.jumpEnd = 0;
+                ++blkC->series.it;
+                return boron_call( ut, (const UCellFunc*) val, blkC, res );
+            }
+            if( ur_is(val, UT_UNSET) )
+            {
+                ur_error( ut, UR_ERR_SCRIPT, "unset word '%s",
+                          ur_wordCStr( cell ) );
+                goto traceError;
+            }
+#ifdef CONFIG_ASSEMBLE
+            if( ur_is(val, UT_AFUNC) )
+                break;
+#endif
+            *res = *val;
+            ++blkC->series.it;
+            return UR_OK;
+
+        case PO_SETWORD:
+        {
+            UCell sw;
+            UCell* dest;
+
+            if( blkC->series.it + 1 >= blkC->series.end ||
+                ur_is(cell + 1, UT_SETWORD) || ur_is(cell + 1, UT_SETPATH) )
+                break;
+
+            sw = *cell;
+            ++blkC->series.it;
+            if( ! boron_evalPre( ut, blkC, ops, res ) )
+                return UR_THROW;
+
+            if( ur_binding(&sw) == UR_BIND_THREAD )
+            {
+                ur_gcWrite( sw.word.ctx );
+                dest = ur_buffer( sw.word.ctx )->ptr.cell + sw.word.index;
+            }
+            else if( ! (dest = ur_wordCellM( ut, &sw )) )
+            {
+                --blkC->series.it;
+                goto traceError;
+            }
+            *dest = *res;
+        }
+            return UR_OK;
+    }
+    return boron_eval1( ut, blkC, res );
+
+traceError:
+
+    ur_appendTrace( ut, blkC->series.buf, blkC->series.it );
+    return UR_THROW;
+}
+
+
+//EOF
@@ -0,0 +1,658 @@
+/*
+  Copyright 2026 Karl Robillard
+
+  This file is part of the Boron programming language.
+
+  Boron is free software: you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Boron is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with Boron.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/*
+  The profiler is called by boron_call() and the pre-decoded cfunc call
+  around the execution of each function body (after the arguments have been
+  evaluated).  When BT->prof is zero the only cost is that test.
+
+  Each distinct function (by cfunc pointer or func! bodyN) gets a ProfEntry
+  for flat totals, and each distinct call path gets a ProfNode for the
+  collapsed stack report.  Time is measured in nanoseconds.
+
+  Control functions such as either and loop evaluate blocks, so the time
+  a cfunc spends in boron_doBlock() is tracked separately to give the time
+  spent in C code (native) as opposed to interpreting script.
+*/
+
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <time.h>
+#endif
+
+
+typedef struct
+{
+    BoronCFunc cfunc;   // Zero for func!
+    UIndex   bodyN;
+    UIndex   siteN;     // First call site (as recorded by ur_appendTrace).
+    UIndex   siteIt;
+    uint32_t nameOff;
+    uint32_t depth;     // Number of active calls (for recursion).
+    uint64_t calls;
+    uint64_t self;
+    uint64_t total;
+    uint64_t native;    // Time in C code (cfunc only).
+}
+ProfEntry;
+
+typedef struct
+{
+    uint32_t parent;
+    uint32_t entry;
+    uint64_t self;
+}
+ProfNode;
+
+typedef struct
+{
+    uint32_t node;
+    uint32_t entry;
+    uint64_t start;
+    uint64_t child;     // Time in called functions.
+    uint64_t eval;      // Time cfunc spent in boron_doBlock().
+    uint64_t childEval; // Part of child which was inside eval.
+    uint8_t  cfunc;
+    uint8_t  inEval;
+}
+ProfFrame;
+
+struct ProfState
+{
+    UBuffer  entries;   // ProfEntry array.
+    UBuffer  nodes;     // ProfNode array.
+    UBuffer  frames;    // ProfFrame stack.
+    UBuffer  names;     // Entry names as NUL terminated strings.
+    uint32_t* entryHash;
+    uint32_t* nodeHash;
+    uint32_t entryMask;
+    uint32_t nodeMask;
+    uint64_t start;
+    uint64_t stop;
+};
+
+#define PROF_HASH_INIT  256
+#define PROF_EMPTY      0xffffffff
+
+
+static uint64_t prof_clock()
+{
+#ifdef _WIN32
+    static LARGE_INTEGER freq;
+    LARGE_INTEGER count;
+    if( ! freq.QuadPart )
+        QueryPerformanceFrequency( &freq );
+    QueryPerformanceCounter( &count );
+    return (uint64_t) ((double) count.QuadPart * 1e9 / freq.QuadPart);
+#else
+    struct timespec ts;
+    clock_gettime( CLOCK_MONOTONIC, &ts );
+    return (uint64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+#endif
+}
+
+
+static uint32_t* prof_hashAlloc( uint32_t size )
+{
+    uint32_t* tab = (uint32_t*) memAlloc( size * sizeof(uint32_t) );
+    memSet( tab, 0xff, size * sizeof(uint32_t) );
+    return tab;
+}
+
+
+static uint32_t prof_entryHash( BoronCFunc cfunc, UIndex bodyN )
+{
+    return (uint32_t) (((uintptr_t) cfunc >> 4) ^ bodyN) * 2654435761u;
+}
+
+
+static uint32_t prof_nodeHash( uint32_t parent, uint32_t entry )
+{
+    return (parent * 31 + entry) * 2654435761u;
+}
+
+
+/*
+  Double the size of a hash table when it becomes half full.
+*/
+static void prof_rehash( struct ProfState* ps, int nodes )
+{
+    uint32_t* tab;
+    uint32_t* old;
+    uint32_t mask, h, i, n;
+
+    if( nodes )
+    {
+        old  = ps->nodeHash;
+        mask = ps->nodeMask;
+        n    = ps->nodes.used;
+    }
+    else
+    {
+        old  = ps->entryHash;
+        mask = ps->entryMask;
+        n    = ps->entries.used;
+    }
+    mask = mask * 2 + 1;
+    tab = prof_hashAlloc( mask + 1 );
+
+    for( i = 0; i < n; ++i )
+    {
+        if( nodes )
+        {
+            const ProfNode* pn = ur_ptr(ProfNode, &ps->nodes) + i;
+            h = prof_nodeHash( pn->parent, pn->entry );
+        }
+        else
+        {
+            const ProfEntry* pe = ur_ptr(ProfEntry, &ps->entries) + i;
+            h = prof_entryHash( pe->cfunc, pe->bodyN );
+        }
+        while( tab[ h & mask ] != PROF_EMPTY )
+            ++h;
+        tab[ h & mask ] = i;
+    }
+
+    memFree( old );
+    if( nodes )
+    {
+        ps->nodeHash = tab;
+        ps->nodeMask = mask;
+    }
+    else
+    {
+        ps->entryHash = tab;
+        ps->entryMask = mask;
+    }
+}
+
+
+/*
+  Append name of function called at blkN/it to the names buffer.
+*/
+static void prof_addName( UThread* ut, struct ProfState* ps, UIndex blkN,
+                          UIndex it, int cfunc )
+{
+    UBuffer* names = &ps->names;
+    const UBuffer* blk = ur_bufferE( blkN );
+    const char* cp = cfunc ? "(cfunc)" : "(func)";
+
+    if( it >= 0 && it < blk->used )
+    {
+        const UCell* cell = blk->ptr.cell + it;
+        if( ur_isWordType( ur_type(cell) ) )
+        {
+            cp = ur_wordCStr( cell );
+        }
+        else if( ur_is(cell, UT_PATH) )
+        {
+            UBuffer str;
+            ur_strInit( &str, UR_ENC_LATIN1, 0 );
+            ur_toStr( ut, cell, &str, 0 );
+            if( ! ur_strIsUcs2( &str ) )
+                ur_binAppendData( names, str.ptr.b, str.used );
+            ur_strFree( &str );
+            cp = "";
+        }
+    }
+    ur_binAppendData( names, (const uint8_t*) cp, strLen(cp) + 1 );
+}
+
+
+static uint32_t prof_entry( UThread* ut, struct ProfState* ps,
+                            BoronCFunc cfunc, UIndex bodyN,
+                            UIndex siteN, UIndex siteIt )
+{
+    ProfEntry* pe;
+    uint32_t h = prof_entryHash( cfunc, bodyN );
+    uint32_t i;
+
+    while( (i = ps->entryHash[ h & ps->entryMask ]) != PROF_EMPTY )
+    {
+        pe = ur_ptr(ProfEntry, &ps->entries) + i;
+        if( pe->cfunc == cfunc && pe->bodyN == bodyN )
+            return i;
+        ++h;
+    }
+
+    i = ps->entries.used;
+    ps->entryHash[ h & ps->entryMask ] = i;
+
+    ur_arrReserve( &ps->entries, i + 1 );
+    ps->entries.used = i + 1;
+    pe = ur_ptr(ProfEntry, &ps->entries) + i;
+    memSet( pe, 0, sizeof(ProfEntry) );
+    pe->cfunc   = cfunc;
+    pe->bodyN   = bodyN;
+    pe->siteN   = siteN;
+    pe->siteIt  = siteIt;
+    pe->nameOff = ps->names.used;
+    prof_addName( ut, ps, siteN, siteIt, cfunc ? 1 : 0 );
+
+    if( (uint32_t) ps->entries.used * 2 > ps->entryMask )
+        prof_rehash( ps, 0 );
+    return i;
+}
+
+
+static uint32_t prof_node( struct ProfState* ps, uint32_t parent,
+                           uint32_t entry )
+{
+    ProfNode* pn;
+    uint32_t h = prof_nodeHash( parent, entry );
+    uint32_t i;
+
+    while( (i = ps->nodeHash[ h & ps->nodeMask ]) != PROF_EMPTY )
+    {
+        pn = ur_ptr(ProfNode, &ps->nodes) + i;
+        if( pn->parent == parent && pn->entry == entry )
+            return i;
+        ++h;
+    }
+
+    i = ps->nodes.used;
+    ps->nodeHash[ h & ps->nodeMask ] = i;
+
+    ur_arrReserve( &ps->nodes, i + 1 );
+    ps->nodes.used = i + 1;
+    pn = ur_ptr(ProfNode, &ps->nodes) + i;
+    pn->parent = parent;
+    pn->entry  = entry;
+    pn->self   = 0;
+
+    if( (uint32_t) ps->nodes.used * 2 > ps->nodeMask )
+        prof_rehash( ps, 1 );
+    return i;
+}
+
+
+/*
+  Begin timing a function body.
+
+  \param cfunc  C function or zero if bodyN is used.
+  \param bodyN  Body block of func!.
+  \param siteN  Block containing the call.
+  \param siteIt Index of function word in siteN.
+*/
+static void prof_enter( UThread* ut, BoronCFunc cfunc, UIndex bodyN,
+                        UIndex siteN, UIndex siteIt )
+{
+    struct ProfState* ps = BT->prof;
+    ProfFrame* top;
+    ProfEntry* pe;
+    uint32_t ei, ni;
+
+    ei = prof_entry( ut, ps, cfunc, bodyN, siteN, siteIt );
+    top = ur_ptr(ProfFrame, &ps->frames) + ps->frames.used - 1;
+    ni = prof_node( ps, top->node, ei );
+
+    pe = ur_ptr(ProfEntry, &ps->entries) + ei;
+    ++pe->calls;
+    ++pe->depth;
+
+    ur_arrReserve( &ps->frames, ps->frames.used + 1 );
+    top = ur_ptr(ProfFrame, &ps->frames) + ps->frames.used++;
+    top->node  = ni;
+    top->entry = ei;
+    top->child = top->eval = top->childEval = 0;
+    top->cfunc = cfunc ? 1 : 0;
+    top->inEval = 0;
+    top->start = prof_clock();
+}
+
+
+/*
+  End timing of the function body started by the last prof_enter().
+*/
+static void prof_leave( UThread* ut )
+{
+    struct ProfState* ps = BT->prof;
+    ProfFrame* top;
+    ProfEntry* pe;
+    uint64_t elapsed;
+    uint64_t self;
+
+    // Ignore a call which began before profiling was enabled.
+    if( ps->frames.used < 2 )
+        return;
+
+    top = ur_ptr(ProfFrame, &ps->frames) + --ps->frames.used;
+    elapsed = prof_clock() - top->start;
+    self = elapsed - top->child;
+
+    ur_ptr(ProfNode, &ps->nodes)[ top->node ].self += self;
+    pe = ur_ptr(ProfEntry, &ps->entries) + top->entry;
+    pe->self += self;
+    if( --pe->depth == 0 )
+        pe->total += elapsed;
+    if( top->cfunc )
+        pe->native += elapsed - top->eval - (top->child - top->childEval);
+
+    --top;
+    top->child += elapsed;
+    if( top->inEval )
+        top->childEval += elapsed;
+}
+
+
+/*
+  Return non-zero if the current function is a cfunc which has not yet
+  entered prof_doBlock().
+*/
+static int prof_cfuncEval( UThread* ut )
+{
+    struct ProfState* ps = BT->prof;
+    const ProfFrame* top = ur_ptr(ProfFrame, &ps->frames) + ps->frames.used-1;
+    return top->cfunc && ! top->inEval;
+}
+
+
+/*
+  Evaluate block for a cfunc, recording the time spent.
+*/
+static int prof_doBlock( UThread* ut, const UCell* blkC, UCell* res )
+{
+    struct ProfState* ps = BT->prof;
+    ProfFrame* top;
+    UIndex fi = ps->frames.used - 1;
+    uint64_t start;
+    int ok;
+
+    ur_ptr(ProfFrame, &ps->frames)[ fi ].inEval = 1;
+    start = prof_clock();
+    ok = boron_doBlock( ut, blkC, res );
+
+    // Profiling may have been turned off or restarted by the block.
+    if( BT->prof == ps && fi < ps->frames.used )
+    {
+        top = ur_ptr(ProfFrame, &ps->frames) + fi;
+        top->eval += prof_clock() - start;
+        top->inEval = 0;
+    }
+    return ok;
+}
+
+
+static void prof_free( UThread* ut )
+{
+    struct ProfState* ps = BT->profState;
+    if( ps )
+    {
+        ur_arrFree( &ps->entries );
+        ur_arrFree( &ps->nodes );
+        ur_arrFree( &ps->frames );
+        ur_binFree( &ps->names );
+        memFree( ps->entryHash );
+        memFree( ps->nodeHash );
+        memFree( ps );
+        BT->prof = BT->profState = 0;
+    }
+}
+
+
+/*
+  Clear any previous data and enable profiling for the thread.
+*/
+static void prof_start( UThread* ut )
+{
+    struct ProfState* ps = BT->profState;
+    ProfFrame* top;
+    ProfEntry* pe;
+
+    if( ps )
+    {
+        ps->entries.used = ps->nodes.used = ps->frames.used = 0;
+        ps->names.used = 0;
+        memSet( ps->entryHash, 0xff, (ps->entryMask + 1) * sizeof(uint32_t) );
+        memSet( ps->nodeHash,  0xff, (ps->nodeMask + 1) * sizeof(uint32_t) );
+    }
+    else
+    {
+        ps = (struct ProfState*) memAlloc( sizeof(struct ProfState) );
+        ur_arrInit( &ps->entries, sizeof(ProfEntry), 64 );
+        ur_arrInit( &ps->nodes,   sizeof(ProfNode), 256 );
+        ur_arrInit( &ps->frames,  sizeof(ProfFrame), 64 );
+        ur_binInit( &ps->names, 1024 );
+        ps->entryHash = prof_hashAlloc( PROF_HASH_INIT );
+        ps->nodeHash  = prof_hashAlloc( PROF_HASH_INIT );
+        ps->entryMask = ps->nodeMask = PROF_HASH_INIT - 1;
+        BT->profState = ps;
+    }
+
+    // Entry & node zero are the top level (code outside any function).
+    ps->entries.used = ps->nodes.used = ps->frames.used = 1;
+    pe = ur_ptr(ProfEntry, &ps->entries);
+    memSet( pe, 0, sizeof(ProfEntry) );
+    pe->siteN = pe->siteIt = -1;
+    pe->calls = 1;
+    ur_binAppendData( &ps->names, (const uint8_t*) "(top)", 6 );
+    ur_ptr(ProfNode, &ps->nodes)->parent = PROF_EMPTY;
+    ur_ptr(ProfNode, &ps->nodes)->entry  = 0;
+    ur_ptr(ProfNode, &ps->nodes)->self   = 0;
+
+    top = ur_ptr(ProfFrame, &ps->frames);
+    memSet( top, 0, sizeof(ProfFrame) );
+
+    BT->prof = ps;
+    ps->start = top->start = prof_clock();
+    ps->stop = 0;
+}
+
+
+static void prof_stop( UThread* ut )
+{
+    if( BT->prof )
+    {
+        BT->prof->stop = prof_clock();
+        BT->prof = 0;
+    }
+}
+
+
+static int prof_compareSelf( const void* a, const void* b )
+{
+    const ProfEntry* ea = *((const ProfEntry* const*) a);
+    const ProfEntry* eb = *((const ProfEntry* const*) b);
+    if( ea->self == eb->self )
+        return 0;
+    return (ea->self > eb->self) ? -1 : 1;
+}
+
+
+#define PROF_NAME(ps,i) \
+    (ps->names.ptr.c + ur_ptr(ProfEntry, &ps->entries)[i].nameOff)
+
+/*
+  Append flat profile report to string.
+*/
+static void prof_reportFlat( struct ProfState* ps, uint64_t total,
+                             UBuffer* str )
+{
+    char line[ 160 ];
+    const ProfEntry* first = ur_ptr(ProfEntry, &ps->entries);
+    const ProfEntry* pe;
+    const ProfEntry** order;
+    uint64_t cfuncTime = 0;
+    double ms = 1.0 / 1000000.0;
+    double pct;
+    uint32_t i, n = ps->entries.used;
+
+    order = (const ProfEntry**) memAlloc( n * sizeof(ProfEntry*) );
+    for( i = 0; i < n; ++i )
+    {
+        order[i] = pe = first + i;
+        cfuncTime += pe->native;
+    }
+    qsort( order, n, sizeof(ProfEntry*), prof_compareSelf );
+
+    pct = total ? 100.0 / total : 0.0;
+    sprintf( line, "total %.3f ms, interpreted %.3f ms, cfunc %.3f ms\n\n",
+             total * ms, (total - cfuncTime) * ms, cfuncTime * ms );
+    ur_strAppendCStr( str, line );
+    ur_strAppendCStr( str,
+        "  self ms   self%  total ms      calls  name\n" );
+
+    for( i = 0; i < n; ++i )
+    {
+        pe = order[i];
+        sprintf( line, "%9.3f %7.2f %9.3f %10lu  ",
+                 pe->self * ms, pe->self * pct, pe->total * ms,
+                 (unsigned long) pe->calls );
+        ur_strAppendCStr( str, line );
+        ur_strAppendCStr( str, ps->names.ptr.c + pe->nameOff );
+
+        if( pe->cfunc )
+            sprintf( line, "  (cfunc %.3f ms, from %d:%d)\n",
+                     pe->native * ms, pe->siteN, pe->siteIt );
+        else if( pe != first )
+            sprintf( line, "  (body %d, from %d:%d)\n",
+                     pe->bodyN, pe->siteN, pe->siteIt );
+        else
+            strcpy( line, "\n" );
+        ur_strAppendCStr( str, line );
+    }
+
+    memFree( order );
+}
+
+
+/*
+  Append call stacks in collapsed format (as used by flamegraph.pl) to
+  string.  The count for each stack is the self time in microseconds.
+*/
+static void prof_reportCollapsed( struct ProfState* ps, UBuffer* str )
+{
+    char line[ 32 ];
+    const ProfNode* nodes = ur_ptr(ProfNode, &ps->nodes);
+    const ProfNode* pn;
+    UBuffer path;
+    uint32_t i, k, depth;
+    uint64_t usec;
+
+    ur_arrInit( &path, sizeof(uint32_t), 64 );
+    for( i = 0; i < (uint32_t) ps->nodes.used; ++i )
+    {
+        usec = (nodes[i].self + 500) / 1000;
+        if( ! usec )
+            continue;
+
+        depth = 0;
+        for( pn = nodes + i; pn->parent != PROF_EMPTY;
+             pn = nodes + pn->parent )
+            ++depth;
+        ur_arrReserve( &path, depth + 1 );
+
+        // Fill path from leaf up so it can be printed from the root down.
+        k = depth;
+        ur_ptr(uint32_t, &path)[ k ] = i;
+        for( pn = nodes + i; pn->parent != PROF_EMPTY;
+             pn = nodes + pn->parent )
+            ur_ptr(uint32_t, &path)[ --k ] = pn->parent;
+
+        for( k = 0; k <= depth; ++k )
+        {
+            if( k )
+                ur_strAppendChar( str, ';' );
+            pn = nodes + ur_ptr(uint32_t, &path)[ k ];
+            ur_strAppendCStr( str, PROF_NAME(ps, pn->entry) );
+        }
+        sprintf( line, " %lu\n", (unsigned long) usec );
+        ur_strAppendCStr( str, line );
+    }
+    ur_arrFree( &path );
+}
+
+
+/*-cf-
+    profile
+        what    word!/block!  'on, 'off, 'report, or block to evaluate.
+        /collapsed  Report stacks in collapsed format for flame graphs.
+    return: Result of block, report string!, or unset!.
+    group: eval
+    see: cpu-cycles
+
+    Profile the time spent in each function of the current thread.
+
+    'on clears any previous data and begins profiling; 'off stops it.
+    If what is a block then profiling is on only while it is evaluated.
+
+    'report returns the data collected so far.  The default report lists
+    each function with its self time (excluding calls to other functions),
+    total time, and call count, sorted by self time.  Functions are named
+    by the word used at their first call, followed by the func! body block
+    and the block:index of that call.  The /collapsed report has a line for
+    each call stack with a self time of at least one microsecond.
+*/
+CFUNC(cfunc_profile)
+{
+    if( ur_is(a1, UT_BLOCK) )
+    {
+        int ok;
+        prof_start( ut );
+        ok = boron_doBlock( ut, a1, res );
+        prof_stop( ut );
+        return ok;
+    }
+
+    if( ur_isWordType( ur_type(a1) ) )
+    {
+        const char* name = ur_atomCStr( ut, ur_atom(a1) );
+
+        if( ! strcmp( name, "on" ) )
+        {
+            prof_start( ut );
+            ur_setId(res, UT_UNSET);
+            return UR_OK;
+        }
+        if( ! strcmp( name, "off" ) )
+        {
+            prof_stop( ut );
+            ur_setId(res, UT_UNSET);
+            return UR_OK;
+        }
+        if( ! strcmp( name, "report" ) )
+        {
+            struct ProfState* ps = BT->profState;
+            UBuffer* str = ur_makeStringCell( ut, UR_ENC_UTF8, 0, res );
+            if( ps )
+            {
+                uint64_t end = BT->prof ? prof_clock() : ps->stop;
+                uint64_t total = end - ps->start;
+                ProfEntry* top = ur_ptr(ProfEntry, &ps->entries);
+
+                // Top level self time is everything outside functions.
+                top->total = total;
+                top->self = total - ur_ptr(ProfFrame, &ps->frames)->child;
+                ur_ptr(ProfNode, &ps->nodes)->self = top->self;
+
+                if( CFUNC_OPTIONS & 1 )
+                    prof_reportCollapsed( ps, str );
+                else
+                    prof_reportFlat( ps, total, str );
+            }
+            return UR_OK;
+        }
+    }
+    return ur_error( ut, UR_ERR_SCRIPT,
+                     "profile expected 'on, 'off, 'report, or block!" );
+}
+
+
+//EOF
@@ -0,0 +1,234 @@
+/*
+  Copyright 2026 Karl Robillard
+
+  This file is part of the Boron programming language.
+
+  Boron is free software: you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Boron is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with Boron.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+//----------------------------------------------------------------------------
+// Serial stream ports
+
+
+typedef struct
+{
+    const UPortDevice* dev;
+    USerialWriter wr;
+    UBuffer out;            // Serialized values not yet read.
+}
+SerialWriterExt;
+
+
+typedef struct
+{
+    const UPortDevice* dev;
+    USerialReader rd;
+    UBuffer in;             // Input written but not yet consumed.
+    UIndex  inPos;
+    uint8_t finish;         // Set when none! is written.
+}
+SerialReaderExt;
+
+
+extern UPortDevice port_serialize;
+extern UPortDevice port_unserialize;
+extern int boron_sliceMem( UThread* ut, const UCell* cell, const void** ptr );
+
+static int serial_open( UThread* ut, const UPortDevice* pdev,
+                        const UCell* from, int opt, UCell* res )
+{
+    void* ext;
+    (void) from;
+    (void) opt;
+
+    if( pdev == &port_serialize )
+    {
+        SerialWriterExt* wx = memAlloc( sizeof(SerialWriterExt) );
+        if( wx )
+        {
+            ur_serialWriterInit( &wx->wr );
+            ur_binInit( &wx->out, 0 );
+        }
+        ext = wx;
+    }
+    else
+    {
+        SerialReaderExt* rx = memAlloc( sizeof(SerialReaderExt) );
+        if( rx )
+        {
+            ur_serialReaderInit( &rx->rd );
+            ur_binInit( &rx->in, 0 );
+            rx->inPos  = 0;
+            rx->finish = 0;
+        }
+        ext = rx;
+    }
+    if( ! ext )
+        return ur_error( ut, UR_ERR_INTERNAL, "Could not alloc serial port" );
+
+    boron_makePort( ut, pdev, ext, res );
+    return UR_OK;
+}
+
+
+static void serial_close( UBuffer* port )
+{
+    if( *((const UPortDevice**) port->ptr.v) == &port_serialize )
+    {
+        SerialWriterExt* wx = (SerialWriterExt*) port->ptr.v;
+        ur_serialWriterFree( &wx->wr );
+        ur_binFree( &wx->out );
+    }
+    else
+    {
+        SerialReaderExt* rx = (SerialReaderExt*) port->ptr.v;
+        ur_serialReaderFree( &rx->rd );
+        ur_binFree( &rx->in );
+    }
+    memFree( port->ptr.v );
+}
+
+
+/*
+  Return all the serialized output as a binary.  The pending buffer is
+  handed to the result so the data is not copied.
+*/
+static int serialize_read( UThread* ut, UBuffer* port, UCell* dest, int len )
+{
+    SerialWriterExt* wx = (SerialWriterExt*) port->ptr.v;
+    UBuffer* bin;
+    UBuffer tmp;
+    (void) len;
+
+    bin = ur_makeBinaryCell( ut, 0, dest );     // Invalidates port.
+    tmp = *bin;
+    *bin = wx->out;
+    wx->out = tmp;
+    return UR_OK;
+}
+
+
+static int serialize_write( UThread* ut, UBuffer* port, const UCell* data )
+{
+    SerialWriterExt* wx = (SerialWriterExt*) port->ptr.v;
+    return ur_serialWrite( ut, &wx->wr, data, &wx->out );
+}
+
+
+/*
+  Set dest to a block holding the next value, or none if more input is
+  needed.
+*/
+static int unserialize_read( UThread* ut, UBuffer* port, UCell* dest, int len )
+{
+    SerialReaderExt* rx = (SerialReaderExt*) port->ptr.v;
+    UBuffer* in = &rx->in;
+    int n;
+    (void) len;
+
+    n = ur_serialRead( ut, &rx->rd, in->ptr.b + rx->inPos,
+                       in->ptr.b + in->used, dest );
+    if( n < 0 )
+        return UR_THROW;
+    if( n )
+    {
+        rx->inPos += n;
+        if( rx->inPos == in->used )
+            in->used = rx->inPos = 0;
+    }
+    else
+    {
+        if( rx->finish && in->used )
+            return ur_error( ut, UR_ERR_ACCESS, "serial stream truncated" );
+        ur_setId(dest, UT_NONE);
+    }
+    return UR_OK;
+}
+
+
+static int unserialize_write( UThread* ut, UBuffer* port, const UCell* data )
+{
+    SerialReaderExt* rx = (SerialReaderExt*) port->ptr.v;
+    UBuffer* in;
+    const void* mem;
+    int len;
+
+    if( rx->finish )
+        return ur_error( ut, UR_ERR_SCRIPT, "serial port input is finished" );
+
+    if( ur_is(data, UT_NONE) )
+    {
+        rx->finish = 1;
+        return UR_OK;
+    }
+    if( ! ur_is(data, UT_BINARY) )
+        return ur_error( ut, UR_ERR_TYPE,
+                         "unserialize write expected binary!/none!" );
+
+    len = boron_sliceMem( ut, data, &mem );
+    if( len )
+    {
+        in = &rx->in;
+        if( rx->inPos )
+        {
+            in->used -= rx->inPos;
+            memMove( in->ptr.b, in->ptr.b + rx->inPos, in->used );
+            rx->inPos = 0;
+        }
+        ur_binAppendData( in, (const uint8_t*) mem, len );
+    }
+    return UR_OK;
+}
+
+
+static int serial_seek( UThread* ut, UBuffer* port, UCell* pos, int where )
+{
+    (void) port;
+    (void) pos;
+    (void) where;
+    return ur_error( ut, UR_ERR_SCRIPT, "cannot seek on serial port" );
+}
+
+
+#ifdef _WIN32
+static int serial_waitFD( UBuffer* port, void** handle )
+{
+    (void) port;
+    (void) handle;
+    return -1;
+}
+#else
+static int serial_waitFD( UBuffer* port )
+{
+    (void) port;
+    return -1;
+}
+#endif
+
+
+UPortDevice port_serialize =
+{
+    serial_open, serial_close, serialize_read, serialize_write, serial_seek,
+    serial_waitFD, 0
+};
+
+UPortDevice port_unserialize =
+{
+    serial_open, serial_close, unserialize_read, unserialize_write,
+    serial_seek, serial_waitFD, 0
+};
+
+
+//EOF
@@ -24,6 +24,7 @@
 #define OPT_SORT_CASE   0x01
 #define OPT_SORT_GROUP  0x02
 #define OPT_SORT_FIELD  0x04
+#define OPT_SORT_PARALLEL   0x08
 
 
 struct CompareField
@@ -196,6 +197,758 @@ static int _compareField( struct CompareField* cf,
 }
 
 
+/*
+  Generate LSD radix sort functions for unsigned integer keys.
+
+  Keys are sorted using 8-bit digits.  If val is non-zero then the values
+  are moved along with the keys.  Passes where every key has the same digit
+  are skipped, so small ranges of values only need a few passes.  The sort
+  is stable.
+*/
+#define RADIX_SORT(T) \
+static void _radixSort_ ## T( T* key, uint32_t* val, uint32_t n ) { \
+    uint32_t count[ sizeof(T) ][ 256 ]; \
+    uint32_t* cp; \
+    T* tkey; \
+    T* kit; \
+    T* kend; \
+    uint32_t* tval; \
+    uint32_t* vp; \
+    uint32_t i, sum, tmp; \
+    int pass, shift; \
+    if( n < 2 ) \
+        return; \
+    memSet( count, 0, sizeof(count) ); \
+    kend = key + n; \
+    for( kit = key; kit != kend; ++kit ) { \
+        for( pass = 0; pass < (int) sizeof(T); ++pass ) \
+            ++count[ pass ][ (*kit >> (pass * 8)) & 0xff ]; \
+    } \
+    tkey = (T*) memAlloc( n * (sizeof(T) + (val ? sizeof(uint32_t) : 0)) ); \
+    tval = (uint32_t*) (tkey + n); \
+    for( pass = 0; pass < (int) sizeof(T); ++pass ) { \
+        cp = count[ pass ]; \
+        shift = pass * 8; \
+        if( cp[ (*key >> shift) & 0xff ] == n ) \
+            continue; \
+        for( sum = i = 0; i < 256; ++i ) { \
+            tmp = cp[i]; \
+            cp[i] = sum; \
+            sum += tmp; \
+        } \
+        for( i = 0; i < n; ++i ) { \
+            vp = cp + ((key[i] >> shift) & 0xff); \
+            tkey[ *vp ] = key[i]; \
+            if( val ) \
+                tval[ *vp ] = val[i]; \
+            ++(*vp); \
+        } \
+        memCpy( key, tkey, n * sizeof(T) ); \
+        if( val ) \
+            memCpy( val, tval, n * sizeof(uint32_t) ); \
+    } \
+    memFree( tkey ); \
+}
+
+RADIX_SORT(uint16_t)
+RADIX_SORT(uint32_t)
+RADIX_SORT(uint64_t)
+
+
+/*
+  Parallel sorting splits the keys into one run per task, sorts each run
+  and then merges pairs of runs until one remains.  The runs are sorted
+  with the comparison or the radix sort used by the serial code.
+
+  Comparison sorts break ties on element position so that each run is
+  stable, and the merge takes from the left run when keys are equal, so the
+  parallel result is stable.  The compare functions only read the dataStore
+  and the calling thread waits for the workers, so ur_compare() is safe to
+  use from the workers.
+*/
+
+#define SORT_PARALLEL_MIN   4096    // Keys required to use worker threads.
+#define SORT_TASK_MAX       16
+
+typedef struct ParallelSort ParallelSort;
+typedef void (*SortTaskFunc)( ParallelSort*, int );
+
+struct ParallelSort
+{
+#ifdef CONFIG_THREAD
+    OSMutex mutex;
+    int threaded;
+#endif
+    SortTaskFunc func;
+    int taskCount;
+    int nextTask;
+    int runs;
+    uint32_t run[ SORT_TASK_MAX + 1 ];  // Start of each run & end of last.
+    QuickSortIndex qs;      // Comparison sort if qs.compare is non-zero.
+    uint32_t stride;
+    uint64_t* key;          // Radix sort keys.
+    uint32_t* val;          // Index or radix sort values.
+    uint64_t* tkey;
+    uint32_t* tval;
+};
+
+
+#ifdef CONFIG_THREAD
+/*
+  Return number of tasks to split a sort of count keys into.
+*/
+static int _sortTasks( uint32_t count )
+{
+    long n;
+
+    if( count < SORT_PARALLEL_MIN )
+        return 1;
+#ifdef _WIN32
+    {
+    SYSTEM_INFO si;
+    GetSystemInfo( &si );
+    n = si.dwNumberOfProcessors;
+    }
+#else
+    n = sysconf( _SC_NPROCESSORS_ONLN );
+#endif
+    if( n > SORT_TASK_MAX )
+        n = SORT_TASK_MAX;
+    return (n < 2) ? 1 : (int) n;
+}
+
+
+static void _sortWork( ParallelSort* ps )
+{
+    int task;
+    for(;;)
+    {
+        mutexLock( ps->mutex );
+        task = ps->nextTask++;
+        mutexUnlock( ps->mutex );
+        if( task >= ps->taskCount )
+            break;
+        ps->func( ps, task );
+    }
+}
+
+
+#ifdef _WIN32
+static DWORD WINAPI _sortThread( LPVOID arg )
+#else
+static void* _sortThread( void* arg )
+#endif
+{
+    _sortWork( (ParallelSort*) arg );
+    return 0;
+}
+
+
+/*
+  Run func for each task on a pool of worker threads and wait for them
+  to finish.  The calling thread also takes tasks, so all the work is
+  still done if threads cannot be created.
+*/
+static void _sortRun( ParallelSort* ps, SortTaskFunc func, int taskCount )
+{
+    OSThread thr[ SORT_TASK_MAX ];
+    int n = 0;
+    int i;
+
+    if( ! ps->threaded )
+    {
+        for( i = 0; i < taskCount; ++i )
+            func( ps, i );
+        return;
+    }
+
+    ps->func = func;
+    ps->taskCount = taskCount;
+    ps->nextTask = 0;
+
+    for( i = 1; i < taskCount; ++i )
+    {
+#ifdef _WIN32
+        if( (thr[n] = CreateThread( NULL, 0, _sortThread, ps, 0, NULL ))
+                == NULL )
+#else
+        if( pthread_create( thr + n, 0, _sortThread, ps ) != 0 )
+#endif
+            break;
+        ++n;
+    }
+
+    _sortWork( ps );
+
+    for( i = 0; i < n; ++i )
+    {
+#ifdef _WIN32
+        WaitForSingleObject( thr[i], INFINITE );
+        CloseHandle( thr[i] );
+#else
+        pthread_join( thr[i], NULL );
+#endif
+    }
+}
+#else
+static int _sortTasks( uint32_t count )
+{
+    (void) count;
+    return 1;
+}
+
+
+static void _sortRun( ParallelSort* ps, SortTaskFunc func, int taskCount )
+{
+    int i;
+    for( i = 0; i < taskCount; ++i )
+        func( ps, i );
+}
+#endif
+
+
+static int _compareStable( ParallelSort* ps, const uint8_t* a,
+                           const uint8_t* b )
+{
+    int c = ps->qs.compare( ps->qs.user, (void*) a, (void*) b );
+    if( c )
+        return c;
+    return (a < b) ? -1 : (a > b);
+}
+
+
+static void _sortRunTask( ParallelSort* ps, int task )
+{
+    uint32_t first = ps->run[ task ];
+    uint32_t end   = ps->run[ task + 1 ];
+
+    if( ps->qs.compare )
+    {
+        QuickSortIndex q = ps->qs;
+        q.index   = ps->val + first;
+        q.user    = (uint8_t*) ps;
+        q.compare = (QuickSortFunc) _compareStable;
+        quickSortIndex( &q, first * ps->stride, end * ps->stride,
+                        ps->stride );
+    }
+    else
+    {
+        _radixSort_uint64_t( ps->key + first,
+                             ps->val ? ps->val + first : NULL, end - first );
+    }
+}
+
+
+static void _sortMergeTask( ParallelSort* ps, int task )
+{
+    uint32_t i, j, mid, end, out;
+    int r = task * 2;
+
+    out = i = ps->run[ r ];
+    mid = ps->run[ (r + 1 < ps->runs) ? r + 1 : ps->runs ];
+    end = ps->run[ (r + 2 < ps->runs) ? r + 2 : ps->runs ];
+    j = mid;
+
+    if( ps->qs.compare )
+    {
+        const QuickSortIndex* qs = &ps->qs;
+        const uint32_t* src = ps->val;
+        uint32_t* dst = ps->tval;
+        uint32_t es = qs->elemSize;
+
+        while( i < mid && j < end )
+        {
+            if( qs->compare( qs->user, qs->data + src[j] * es,
+                                       qs->data + src[i] * es ) < 0 )
+                dst[ out++ ] = src[ j++ ];
+            else
+                dst[ out++ ] = src[ i++ ];
+        }
+    }
+    else
+    {
+        const uint64_t* key = ps->key;
+        const uint32_t* val = ps->val;
+        int k;
+
+        while( i < mid && j < end )
+        {
+            k = (key[j] < key[i]) ? j++ : i++;
+            ps->tkey[ out ] = key[k];
+            if( val )
+                ps->tval[ out ] = val[k];
+            ++out;
+        }
+        memCpy( ps->tkey + out, key + i, (mid - i) * sizeof(uint64_t) );
+        memCpy( ps->tkey + out + (mid - i), key + j,
+                (end - j) * sizeof(uint64_t) );
+        if( ! val )
+            return;
+    }
+    memCpy( ps->tval + out, ps->val + i, (mid - i) * sizeof(uint32_t) );
+    memCpy( ps->tval + out + (mid - i), ps->val + j,
+            (end - j) * sizeof(uint32_t) );
+}
+
+
+/*
+  Sort the runs and merge them.  The result is left in ps->key & ps->val,
+  which are swapped with the temporary arrays after each merge pass.
+*/
+static void _sortParallel( ParallelSort* ps, uint32_t count, int tasks )
+{
+    uint64_t* tk;
+    uint32_t* tv;
+    int i;
+
+    ps->runs = tasks;
+    for( i = 0; i <= tasks; ++i )
+        ps->run[i] = (uint32_t) (((uint64_t) count * i) / tasks);
+
+#ifdef CONFIG_THREAD
+    ps->threaded = ! mutexInitF( ps->mutex );
+#endif
+
+    _sortRun( ps, _sortRunTask, tasks );
+
+    while( ps->runs > 1 )
+    {
+        tasks = (ps->runs + 1) / 2;
+        _sortRun( ps, _sortMergeTask, tasks );
+
+        tk = ps->key;
+        ps->key  = ps->tkey;
+        ps->tkey = tk;
+        tv = ps->val;
+        ps->val  = ps->tval;
+        ps->tval = tv;
+
+        for( i = 0; i < tasks; ++i )
+            ps->run[ i ] = ps->run[ i * 2 ];
+        ps->run[ tasks ] = count;
+        ps->runs = tasks;
+    }
+
+#ifdef CONFIG_THREAD
+    if( ps->threaded )
+        mutexFree( ps->mutex );
+#endif
+}
+
+
+/*
+  Parallel version of quickSortIndex() with a stable result.
+  This may be called with a single task to do a stable serial sort.
+
+  \param tasks  Number of tasks from _sortTasks().
+
+  \return Number of indices set and sorted in qs->index.
+*/
+static uint32_t _parallelSortIndex( const QuickSortIndex* qs, uint32_t count,
+                                    uint32_t stride, int tasks )
+{
+    ParallelSort ps;
+    uint32_t* tmp = (uint32_t*) memAlloc( count * sizeof(uint32_t) );
+
+    ps.qs     = *qs;
+    ps.stride = stride;
+    ps.key    = ps.tkey = NULL;
+    ps.val    = qs->index;
+    ps.tval   = tmp;
+    _sortParallel( &ps, count, tasks );
+
+    if( ps.val != qs->index )
+        memCpy( qs->index, ps.val, count * sizeof(uint32_t) );
+    memFree( tmp );
+    return count;
+}
+
+
+/*
+  Parallel version of _radixSort_uint64_t().
+
+  \param tasks  Number of tasks from _sortTasks().
+*/
+static void _parallelRadix( uint64_t* key, uint32_t* val, uint32_t count,
+                            int tasks )
+{
+    ParallelSort ps;
+    uint64_t* tmp;
+
+    tmp = (uint64_t*) memAlloc( count * (sizeof(uint64_t) +
+                                        (val ? sizeof(uint32_t) : 0)) );
+    ps.qs.compare = NULL;
+    ps.stride = 1;
+    ps.key    = key;
+    ps.val    = val;
+    ps.tkey   = tmp;
+    ps.tval   = val ? (uint32_t*) (tmp + count) : NULL;
+    _sortParallel( &ps, count, tasks );
+
+    if( ps.key != key )
+    {
+        memCpy( key, ps.key, count * sizeof(uint64_t) );
+        if( val )
+            memCpy( val, ps.val, count * sizeof(uint32_t) );
+    }
+    memFree( tmp );
+}
+
+
+/*
+  Generate parallel radix sorts for keys narrower than 64 bits.
+*/
+#define PARALLEL_RADIX(T) \
+static void _parallelRadix_ ## T( T* it, uint32_t count, int tasks ) { \
+    uint64_t* key = (uint64_t*) memAlloc( count * sizeof(uint64_t) ); \
+    uint32_t i; \
+    for( i = 0; i < count; ++i ) \
+        key[i] = it[i]; \
+    _parallelRadix( key, NULL, count, tasks ); \
+    for( i = 0; i < count; ++i ) \
+        it[i] = (T) key[i]; \
+    memFree( key ); \
+}
+
+PARALLEL_RADIX(uint16_t)
+PARALLEL_RADIX(uint32_t)
+
+#define _parallelRadix_uint64_t(it,count,tasks) \
+    _parallelRadix(it,NULL,count,tasks)
+
+
+/*
+  Map IEEE float bits to an unsigned key with the same ordering.
+*/
+#define FLOAT_KEY(k,sign)   ((k & sign) ? ~k : (k | sign))
+#define FLOAT_UNKEY(k,sign) ((k & sign) ? (k & ~sign) : ~k)
+
+#define F32_SIGN    0x80000000
+#define F64_SIGN    0x8000000000000000ULL
+
+
+static uint64_t _decimalKey( double d )
+{
+    union {
+        double d;
+        uint64_t k;
+    } num;
+    num.d = (d == 0.0) ? 0.0 : d;   // Order -0.0 the same as 0.0.
+    return FLOAT_KEY( num.k, F64_SIGN );
+}
+
+
+typedef struct
+{
+    const uint8_t* it;
+    const uint8_t* end;
+    int elemSize;
+}
+SortString;
+
+
+int compare_ic_uint8_t( const uint8_t*, const uint8_t*,
+                        const uint8_t*, const uint8_t* );
+int compare_ic_uint16_t( const uint16_t*, const uint16_t*,
+                         const uint16_t*, const uint16_t* );
+
+/*
+  Same ordering as string_compare() without the per-call slice lookup.
+*/
+static int _compareString( void* user, const SortString* a,
+                           const SortString* b )
+{
+    if( a->elemSize != b->elemSize )
+        return 0;
+    if( a->elemSize == 2 )
+    {
+        return (user ? compare_uint16_t : compare_ic_uint16_t)(
+                    (const uint16_t*) a->it, (const uint16_t*) a->end,
+                    (const uint16_t*) b->it, (const uint16_t*) b->end );
+    }
+    return (user ? compare_uint8_t : compare_ic_uint8_t)(
+                a->it, a->end, b->it, b->end );
+}
+
+
+enum SortBlockKey
+{
+    SORT_KEY_INT,
+    SORT_KEY_DECIMAL,
+    SORT_KEY_STRING,
+    SORT_KEY_OTHER
+};
+
+
+/*
+  Sort a block slice where the first cell of every group is an int!,
+  decimal!, or string type without calling ur_compare() for each pair.
+
+  \param index  Array of count entries to be set to the sorted cell positions.
+  \param tasks  Number of tasks from _sortTasks().
+
+  \return Non-zero if the block was sorted, or zero if the cells are not
+          handled.
+*/
+static int _sortBlockFast( UThread* ut, const UCell* cells, uint32_t count,
+                           uint32_t group, uint32_t* index, uint32_t opt,
+                           int tasks )
+{
+    const UCell* cell;
+    uint32_t i;
+    int kt = SORT_KEY_OTHER;
+
+    if( count < 2 )
+        return 0;
+
+    for( i = 0; i < count; ++i )
+    {
+        cell = cells + i * group;
+        switch( ur_type(cell) )
+        {
+            case UT_INT:
+                if( kt == SORT_KEY_OTHER )
+                    kt = SORT_KEY_INT;
+                else if( kt == SORT_KEY_STRING )
+                    return 0;
+                break;
+            case UT_DECIMAL:
+                if( kt == SORT_KEY_STRING )
+                    return 0;
+                kt = SORT_KEY_DECIMAL;
+                break;
+            case UT_STRING:
+            case UT_FILE:
+                if( i && kt != SORT_KEY_STRING )
+                    return 0;
+                kt = SORT_KEY_STRING;
+                break;
+            default:
+                return 0;
+        }
+    }
+
+    if( kt == SORT_KEY_STRING )
+    {
+        QuickSortIndex qs;
+        SortString* ss;
+        const UBuffer* buf;
+
+        ss = (SortString*) memAlloc( count * sizeof(SortString) );
+        for( i = 0; i < count; ++i )
+        {
+            cell = cells + i * group;
+            buf = ur_bufferSer( cell );
+            ss[i].elemSize = buf->elemSize;
+            ss[i].it  = buf->ptr.b + cell->series.it * buf->elemSize;
+            ss[i].end = buf->ptr.b + (ur_isSliced(cell) ?
+                                      cell->series.end : buf->used) *
+                                     buf->elemSize;
+            if( ss[i].end < ss[i].it )
+                ss[i].end = ss[i].it;
+        }
+
+        qs.index    = index;
+        qs.user     = (uint8_t*) ((opt & OPT_SORT_CASE) ? ut : NULL);
+        qs.data     = (uint8_t*) ss;
+        qs.elemSize = sizeof(SortString);
+        qs.compare  = (QuickSortFunc) _compareString;
+        if( opt & OPT_SORT_PARALLEL )
+            _parallelSortIndex( &qs, count, 1, tasks );
+        else
+            quickSortIndex( &qs, 0, count, 1 );
+        memFree( ss );
+
+        if( group > 1 )
+        {
+            for( i = 0; i < count; ++i )
+                index[i] *= group;
+        }
+    }
+    else
+    {
+        for( i = 0; i < count; ++i )
+            index[i] = i * group;
+
+        if( kt == SORT_KEY_INT && tasks < 2 )
+        {
+            uint32_t* key = (uint32_t*) memAlloc( count * sizeof(uint32_t) );
+            for( i = 0; i < count; ++i )
+                key[i] = ((uint32_t) ur_int(cells + i * group)) ^ F32_SIGN;
+            _radixSort_uint32_t( key, index, count );
+            memFree( key );
+        }
+        else
+        {
+            uint64_t* key = (uint64_t*) memAlloc( count * sizeof(uint64_t) );
+            for( i = 0; i < count; ++i )
+            {
+                cell = cells + i * group;
+                if( kt == SORT_KEY_INT )
+                    key[i] = ((uint32_t) ur_int(cell)) ^ F32_SIGN;
+                else
+                    key[i] = _decimalKey( ur_is(cell, UT_INT) ?
+                                (double) ur_int(cell) : ur_decimal(cell) );
+            }
+            if( tasks > 1 )
+                _parallelRadix( key, index, count, tasks );
+            else
+                _radixSort_uint64_t( key, index, count );
+            memFree( key );
+        }
+    }
+    return 1;
+}
+
+
+/*
+  Sort a vector! slice into res.
+*/
+static void _sortVector( UThread* ut, const UCell* a1, UCell* res,
+                         uint32_t opt )
+{
+    USeriesIter si;
+    UBuffer* buf;
+    int len;
+    int i;
+    int tasks;
+
+    ur_seriesSlice( ut, &si, a1 );
+    len = si.end - si.it;
+    tasks = (opt & OPT_SORT_PARALLEL) ? _sortTasks( len ) : 1;
+
+    buf = ur_makeVectorCell( ut, si.buf->form, len, res );
+    si.buf = ur_bufferSer( a1 );    // Re-aquire after ur_makeVectorCell.
+    if( len < 1 )
+        return;
+    memCpy( buf->ptr.b, si.buf->ptr.b + si.it * si.buf->elemSize,
+            len * buf->elemSize );
+    buf->used = len;
+
+#define VEC_RADIX(T) \
+    if( tasks > 1 ) \
+        _parallelRadix_ ## T( it, len, tasks ); \
+    else \
+        _radixSort_ ## T( it, NULL, len );
+
+#define VEC_SORT(T,ELEM,FLIP) { \
+    T* it = buf->ptr.ELEM; \
+    for( i = 0; i < len; ++i ) it[i] ^= FLIP; \
+    VEC_RADIX(T) \
+    for( i = 0; i < len; ++i ) it[i] ^= FLIP; \
+}
+
+#define VEC_SORT_FLOAT(T,SIGN) { \
+    T* it = (T*) buf->ptr.v; \
+    T k; \
+    for( i = 0; i < len; ++i ) { k = it[i]; it[i] = FLOAT_KEY(k,SIGN); } \
+    VEC_RADIX(T) \
+    for( i = 0; i < len; ++i ) { k = it[i]; it[i] = FLOAT_UNKEY(k,SIGN); } \
+}
+
+    switch( buf->form )
+    {
+        case UR_VEC_I16:
+            VEC_SORT( uint16_t, u16, 0x8000 )
+            break;
+        case UR_VEC_U16:
+            VEC_SORT( uint16_t, u16, 0 )
+            break;
+        case UR_VEC_I32:
+            VEC_SORT( uint32_t, u32, F32_SIGN )
+            break;
+        case UR_VEC_U32:
+            VEC_SORT( uint32_t, u32, 0 )
+            break;
+        case UR_VEC_F32:
+            VEC_SORT_FLOAT( uint32_t, F32_SIGN )
+            break;
+        case UR_VEC_F64:
+            VEC_SORT_FLOAT( uint64_t, F64_SIGN )
+            break;
+    }
+}
+
+
+/*
+  Sort the bytes of a binary! slice or the characters of a string! slice
+  into res.  Latin-1 strings & binaries use a counting sort, UCS-2 strings
+  a radix sort.  Without /case, characters are ordered by their lowercase
+  value first so that "bBaA" sorts to "AaBb".
+*/
+static void _sortChars( UThread* ut, const UCell* a1, UCell* res, int ucase )
+{
+    USeriesIter si;
+    UBuffer* buf;
+    int type = ur_type(a1);
+    int len;
+    int i;
+
+    ur_seriesSlice( ut, &si, a1 );
+    len = si.end - si.it;
+
+    if( type == UT_BINARY )
+        buf = ur_makeBinaryCell( ut, len, res );
+    else
+    {
+        buf = ur_makeStringCell( ut, si.buf->form, len, res );
+        ur_type(res) = type;
+    }
+    si.buf = ur_bufferSer( a1 );    // Re-aquire after make.
+    if( len < 1 )
+        return;
+    buf->used = len;
+
+    if( type == UT_BINARY || ! ur_strIsUcs2(si.buf) )
+    {
+        uint32_t count[ 256 ];
+        uint32_t order[ 256 ];
+        const uint8_t* it  = si.buf->ptr.b + si.it;
+        const uint8_t* end = si.buf->ptr.b + si.end;
+        uint8_t* out = buf->ptr.b;
+        int c;
+
+        memSet( count, 0, sizeof(count) );
+        while( it != end )
+            ++count[ *it++ ];
+
+        for( c = 0; c < 256; ++c )
+            order[c] = (type == UT_BINARY || ucase) ? (uint32_t) c :
+                       ((uint32_t) ur_charLowercase(c) << 8) | c;
+        if( type != UT_BINARY && ! ucase )
+            _radixSort_uint32_t( order, NULL, 256 );
+
+        for( i = 0; i < 256; ++i )
+        {
+            c = order[i] & 0xff;
+            memSet( out, c, count[c] );
+            out += count[c];
+        }
+    }
+    else
+    {
+        const uint16_t* it = si.buf->ptr.u16 + si.it;
+        uint16_t* out = buf->ptr.u16;
+
+        if( ucase )
+        {
+            memCpy( out, it, len * sizeof(uint16_t) );
+            _radixSort_uint16_t( out, NULL, len );
+        }
+        else
+        {
+            uint32_t* key = (uint32_t*) memAlloc( len * sizeof(uint32_t) );
+            for( i = 0; i < len; ++i )
+                key[i] = ((uint32_t) ur_charLowercase(it[i]) << 16) | it[i];
+            _radixSort_uint32_t( key, NULL, len );
+            for( i = 0; i < len; ++i )
+                out[i] = key[i] & 0xffff;
+            memFree( key );
+        }
+    }
+}
+
+
 /*-cf-
     sort
         set         series
@@ -204,8 +957,15 @@ static int _compareField( struct CompareField* cf,
             size    int!
         /field      Sort on specified context words or block indices.
             which   block!
+        /parallel   Use worker threads to sort large blocks & vectors.
     return: New series with sorted elements.
     group: series
+
+    Vectors, binaries, and blocks containing only int! & decimal! values
+    are sorted with a stable radix sort.  Strings are sorted by character.
+
+    With /parallel the sort of a block is stable.  Worker threads are only
+    used if Boron was built with thread support and the series is large.
 */
 CFUNC(cfunc_sort)
 {
@@ -222,6 +982,7 @@ CFUNC(cfunc_sort)
         int group;
         int len;
         int indexLen;
+        int tasks;
 
         ur_blkSlice( ut, &bi, a1 );
         len = bi.end - bi.it;
@@ -240,6 +1001,7 @@ CFUNC(cfunc_sort)
             group = 1;
             indexLen = len;
         }
+        tasks = (fld.opt & OPT_SORT_PARALLEL) ? _sortTasks( indexLen ) : 1;
 
         // Make invalidates bi.buf.
         blk = ur_makeBlockCell( ut, type, len, res );
@@ -248,6 +1010,15 @@ CFUNC(cfunc_sort)
         qs.data     = (uint8_t*) bi.it;
         qs.elemSize = sizeof(UCell);
 
+        ip = qs.index;
+        if( ! (fld.opt & OPT_SORT_FIELD) &&
+            _sortBlockFast( ut, bi.it, indexLen, group, qs.index, fld.opt,
+                            tasks ) )
+        {
+            iend = ip + indexLen;
+            goto copy;
+        }
+
         if( fld.opt & OPT_SORT_FIELD )
         {
             fld.ut = ut;
@@ -263,10 +1034,13 @@ CFUNC(cfunc_sort)
                                 ur_compareCase : ur_compare);
         }
 
-        ip = qs.index;
-        iend = ip + quickSortIndex( &qs, 0, len, group );
+        if( fld.opt & OPT_SORT_PARALLEL )
+            iend = ip + _parallelSortIndex( &qs, indexLen, group, tasks );
+        else
+            iend = ip + quickSortIndex( &qs, 0, len, group );
 
-        len = qs.elemSize * group;
+copy:
+        len = sizeof(UCell) * group;
         while( ip != iend )
         {
             memCpy( blk->ptr.cell + blk->used, bi.it + *ip, len );
@@ -275,7 +1049,25 @@ CFUNC(cfunc_sort)
         }
         return UR_OK;
     }
-    return ur_error( ut, UR_ERR_INTERNAL, "FIXME: sort only supports block!" );
+
+    if( CFUNC_OPTIONS & (OPT_SORT_GROUP | OPT_SORT_FIELD) )
+        return ur_error( ut, UR_ERR_SCRIPT,
+                         "sort /group & /field only support block!" );
+
+    switch( type )
+    {
+        case UT_BINARY:
+        case UT_STRING:
+        case UT_FILE:
+            _sortChars( ut, a1, res, CFUNC_OPTIONS & OPT_SORT_CASE );
+            return UR_OK;
+
+        case UT_VECTOR:
+            _sortVector( ut, a1, res, CFUNC_OPTIONS );
+            return UR_OK;
+    }
+    return ur_error( ut, UR_ERR_TYPE,
+                     "sort expected block!/string!/binary!/vector!" );
 }
 
 
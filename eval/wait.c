@@ -29,14 +29,26 @@
 #else
 #include <sys/select.h>
 #include <errno.h>
+#include <unistd.h>
+#ifdef __linux
+#define USE_EPOLL
+#include <sys/epoll.h>
+#else
+#include <poll.h>
+#endif
 #endif
 
 #include "boron.h"
 #include "boron_internal.h"
+#include "os.h"
 
 
 #define MAX_PORTS   16      // LIMIT: Maximum ports wait can handle.
 
+#ifndef _WIN32
+UPortDevice port_waitset;
+#endif
+
 
 typedef struct
 {
@@ -58,19 +70,23 @@ typedef struct
     int nfds;
     uint16_t timeout;
     uint16_t portCount;
+    const UCell* waitset;
 #endif
     PortInfo ports[ MAX_PORTS ];
 }
 WaitInfo;
 
 
-static void _waitOnPort( UThread* ut, WaitInfo* wi, const UCell* portC )
+static int _waitOnPort( UThread* ut, WaitInfo* wi, const UCell* portC )
 {
     int fd;
     PORT_SITE(dev, pbuf, portC);
     if( dev )
     {
-        assert( wi->portCount < MAX_PORTS );
+        if( wi->portCount == MAX_PORTS )
+            return ur_error( ut, UR_ERR_SCRIPT,
+                             "wait can only handle %d ports (use a waitset)",
+                             MAX_PORTS );
 #ifdef _WIN32
         fd = dev->waitFD( pbuf, wi->handles + wi->portCount );
         if( fd > -1 )
@@ -80,6 +96,9 @@ static void _waitOnPort( UThread* ut, WaitInfo* wi, const UCell* portC )
             ++wi->portCount;
         }
 #else
+        if( dev == &port_waitset && ! wi->waitset )
+            wi->waitset = portC;
+
         fd = dev->waitFD( pbuf );
         if( fd > -1 )
         {
@@ -95,6 +114,7 @@ static void _waitOnPort( UThread* ut, WaitInfo* wi, const UCell* portC )
         }
 #endif
     }
+    return UR_OK;
 }
 
 
@@ -118,12 +138,13 @@ static int _fillWaitInfo( UThread* ut, WaitInfo* wi,
             const UCell* cell;
             if( ! (cell = ur_wordCell( ut, it )) )
                 return UR_THROW;
-            if( ur_is(cell, UT_PORT) )
-                _waitOnPort( ut, wi, cell );
+            if( ur_is(cell, UT_PORT) && ! _waitOnPort( ut, wi, cell ) )
+                return UR_THROW;
         }
         else if( ur_is(it, UT_PORT) )
         {
-            _waitOnPort( ut, wi, it );
+            if( ! _waitOnPort( ut, wi, it ) )
+                return UR_THROW;
         }
         else if( ur_is(it, UT_DECIMAL) || ur_is(it, UT_TIME) )
         {
@@ -144,6 +165,353 @@ static int _fillWaitInfo( UThread* ut, WaitInfo* wi,
 }
 
 
+//----------------------------------------------------------------------------
+// Wait set port
+
+#ifndef _WIN32
+
+
+/*
+  The registered ports are kept in a held block so that they are not
+  recycled while only the wait set refers to them.  With epoll each event
+  holds the port buffer id, and ports which are closed are dropped by the
+  kernel and later removed from the block.  Without epoll, the fds are
+  polled in block order.
+*/
+typedef struct
+{
+    const UPortDevice* dev;
+    UThread* ut;            // Thread which holds the block.
+    UIndex   blkN;          // Registered ports.
+    UIndex   hold;
+    int      compactLen;    // Remove closed ports when the block is this big.
+#ifdef USE_EPOLL
+    int      epfd;
+    UBuffer  events;
+#else
+    UBuffer  fds;           // struct pollfd for each registered port.
+#endif
+}
+WaitSetExt;
+
+
+#define _portIsOpen(buf)    ((buf)->type == UT_PORT && (buf)->ptr.v)
+
+
+static int waitset_open( UThread* ut, const UPortDevice* pdev,
+                         const UCell* from, int opt, UCell* res )
+{
+    WaitSetExt* ext;
+    (void) from;
+    (void) opt;
+
+    ext = (WaitSetExt*) memAlloc( sizeof(WaitSetExt) );
+    if( ! ext )
+        return ur_error( ut, UR_ERR_INTERNAL, "Could not alloc waitset port" );
+#ifdef USE_EPOLL
+    ext->epfd = epoll_create1( EPOLL_CLOEXEC );
+    if( ext->epfd < 0 )
+    {
+        memFree( ext );
+        return ur_error( ut, UR_ERR_ACCESS, "epoll_create1 - %s",
+                         strerror(errno) );
+    }
+    ur_arrInit( &ext->events, sizeof(struct epoll_event), 0 );
+#else
+    ur_arrInit( &ext->fds, sizeof(struct pollfd), 0 );
+#endif
+    ext->ut   = ut;
+    ext->blkN = ur_makeBlock( ut, 0 );
+    ext->hold = ur_holdBuffer( ut, ext->blkN );
+    ext->compactLen = 64;
+
+    boron_makePort( ut, pdev, ext, res );
+    return UR_OK;
+}
+
+
+static void waitset_close( UBuffer* port )
+{
+    WaitSetExt* ext = (WaitSetExt*) port->ptr.v;
+
+#ifdef USE_EPOLL
+    close( ext->epfd );
+    ur_arrFree( &ext->events );
+#else
+    ur_arrFree( &ext->fds );
+#endif
+    ur_releaseBuffer( ext->ut, ext->hold );
+    memFree( ext );
+}
+
+
+/*
+  Remove any closed ports from the block.
+*/
+static void _waitsetCompact( UThread* ut, WaitSetExt* ext )
+{
+    UBuffer* blk = ur_buffer( ext->blkN );
+    UCell* it  = blk->ptr.cell;
+    UCell* end = it + blk->used;
+    UCell* out = it;
+#ifndef USE_EPOLL
+    struct pollfd* pfd = ext->fds.ptr.v;
+    struct pollfd* pout = pfd;
+#endif
+
+    for( ; it != end; ++it )
+    {
+        if( _portIsOpen( ur_buffer( it->port.buf ) ) )
+        {
+            *out++ = *it;
+#ifndef USE_EPOLL
+            *pout++ = *pfd;
+#endif
+        }
+#ifndef USE_EPOLL
+        ++pfd;
+#endif
+    }
+    blk->used = out - blk->ptr.cell;
+#ifndef USE_EPOLL
+    ext->fds.used = blk->used;
+#endif
+    ext->compactLen = (blk->used < 32) ? 64 : blk->used * 2;
+}
+
+
+static int _waitsetAdd( UThread* ut, WaitSetExt* ext, const UCell* portC )
+{
+    UBuffer* blk;
+    int fd;
+    PORT_SITE(dev, pbuf, portC);
+
+    if( ! dev || (fd = dev->waitFD( pbuf )) < 0 )
+        return ur_error( ut, UR_ERR_SCRIPT, "waitset cannot wait on port" );
+
+    blk = ur_buffer( ext->blkN );
+    if( blk->used >= ext->compactLen )
+    {
+        _waitsetCompact( ut, ext );
+        blk = ur_buffer( ext->blkN );
+    }
+
+#ifdef USE_EPOLL
+    {
+    struct epoll_event ev;
+    ev.events   = EPOLLIN;
+    ev.data.u64 = 0;
+    ev.data.u32 = portC->port.buf;
+    if( epoll_ctl( ext->epfd, EPOLL_CTL_ADD, fd, &ev ) )
+    {
+        if( errno == EEXIST )
+            return UR_OK;
+        return ur_error( ut, UR_ERR_ACCESS, "epoll_ctl - %s",
+                         strerror(errno) );
+    }
+    }
+#else
+    {
+    struct pollfd* pfd;
+    UCell* it  = blk->ptr.cell;
+    UCell* end = it + blk->used;
+    for( ; it != end; ++it )
+    {
+        if( it->port.buf == portC->port.buf )
+            return UR_OK;
+    }
+    ur_arrReserve( &ext->fds, ext->fds.used + 1 );
+    pfd = ((struct pollfd*) ext->fds.ptr.v) + ext->fds.used++;
+    pfd->fd      = fd;
+    pfd->events  = POLLIN;
+    pfd->revents = 0;
+    }
+#endif
+
+    ur_blkPush( blk, portC );
+    return UR_OK;
+}
+
+
+static int waitset_write( UThread* ut, UBuffer* port, const UCell* data )
+{
+    WaitSetExt* ext = (WaitSetExt*) port->ptr.v;
+
+    if( ur_is(data, UT_PORT) )
+        return _waitsetAdd( ut, ext, data );
+
+    if( ur_is(data, UT_BLOCK) )
+    {
+        UBlockIter bi;
+        const UCell* cell;
+        ur_blkSlice( ut, &bi, data );
+        ur_foreach( bi )
+        {
+            cell = bi.it;
+            if( ur_is(cell, UT_WORD) )
+            {
+                if( ! (cell = ur_wordCell( ut, cell )) )
+                    return UR_THROW;
+            }
+            if( ! ur_is(cell, UT_PORT) )
+                return ur_error( ut, UR_ERR_TYPE,
+                                 "waitset write expected block of port!" );
+            if( ! _waitsetAdd( ut, ext, cell ) )
+                return UR_THROW;
+        }
+        return UR_OK;
+    }
+
+    if( ur_is(data, UT_NONE) )
+    {
+        UBuffer* blk = ur_buffer( ext->blkN );
+#ifdef USE_EPOLL
+        int fd = epoll_create1( EPOLL_CLOEXEC );
+        if( fd < 0 )
+            return ur_error( ut, UR_ERR_ACCESS, "epoll_create1 - %s",
+                             strerror(errno) );
+        close( ext->epfd );
+        ext->epfd = fd;
+#else
+        ext->fds.used = 0;
+#endif
+        blk->used = 0;
+        ext->compactLen = 64;
+        return UR_OK;
+    }
+
+    return ur_error( ut, UR_ERR_TYPE,
+                     "waitset write expected port!/block!/none!" );
+}
+
+
+/*
+  Set res to a block of all the registered ports which are ready for
+  reading.  If none are ready after timeout milliseconds then res is set to
+  an empty block, or none if noneOnTimeout is set.
+
+  \param timeout    Milliseconds to wait, or -1 to wait forever.
+*/
+static int _waitsetReady( UThread* ut, WaitSetExt* ext, int timeout,
+                          int noneOnTimeout, UCell* res )
+{
+    UBuffer* blk = ur_buffer( ext->blkN );
+    UBuffer* rblk;
+    int n;
+
+    if( blk->used >= ext->compactLen )
+        _waitsetCompact( ut, ext );
+
+#ifdef USE_EPOLL
+    {
+    struct epoll_event* ev;
+    int max = ur_buffer( ext->blkN )->used;
+    if( max < 1 )
+        max = 1;
+    ur_arrReserve( &ext->events, max );
+    ev = (struct epoll_event*) ext->events.ptr.v;
+
+    n = epoll_wait( ext->epfd, ev, max, timeout );
+    if( n < 0 )
+    {
+        if( errno != EINTR )
+            return ur_error( ut, UR_ERR_INTERNAL, "epoll_wait - %s",
+                             strerror(errno) );
+        n = 0;
+    }
+    if( ! n && noneOnTimeout )
+        goto timeout;
+
+    rblk = ur_makeBlockCell( ut, UT_BLOCK, n, res );
+    for( ; n; --n, ++ev )
+    {
+        UIndex bufN = ev->data.u32;
+        if( _portIsOpen( ur_buffer( bufN ) ) )
+        {
+            UCell* cell = ur_blkAppendNew( rblk, UT_PORT );
+            ur_setSeries( cell, bufN, 0 );
+        }
+    }
+    }
+#else
+    {
+    struct pollfd* pfd;
+    struct pollfd* pend;
+    UCell* cell;
+
+    // Closed ports must not be polled as their fd may have been reused.
+    _waitsetCompact( ut, ext );
+
+    pfd  = (struct pollfd*) ext->fds.ptr.v;
+    pend = pfd + ext->fds.used;
+    n = poll( pfd, ext->fds.used, timeout );
+    if( n < 0 )
+    {
+        if( errno != EINTR )
+            return ur_error( ut, UR_ERR_INTERNAL, "poll - %s",
+                             strerror(errno) );
+        n = 0;
+    }
+    if( ! n && noneOnTimeout )
+        goto timeout;
+
+    rblk = ur_makeBlockCell( ut, UT_BLOCK, n, res );
+    cell = ur_buffer( ext->blkN )->ptr.cell;
+    for( ; n && pfd != pend; ++pfd, ++cell )
+    {
+        if( pfd->revents )
+        {
+            ur_blkPush( rblk, cell );
+            --n;
+        }
+    }
+    }
+#endif
+    return UR_OK;
+
+timeout:
+
+    ur_setId( res, UT_NONE );
+    return UR_OK;
+}
+
+
+static int waitset_read( UThread* ut, UBuffer* port, UCell* dest, int len )
+{
+    (void) len;
+    return _waitsetReady( ut, (WaitSetExt*) port->ptr.v, 0, 0, dest );
+}
+
+
+static int waitset_seek( UThread* ut, UBuffer* port, UCell* pos, int where )
+{
+    (void) port;
+    (void) pos;
+    (void) where;
+    return ur_error( ut, UR_ERR_SCRIPT, "cannot seek on waitset port" );
+}
+
+
+static int waitset_waitFD( UBuffer* port )
+{
+#ifdef USE_EPOLL
+    return ((WaitSetExt*) port->ptr.v)->epfd;
+#else
+    (void) port;
+    return -1;
+#endif
+}
+
+
+UPortDevice port_waitset =
+{
+    waitset_open, waitset_close, waitset_read, waitset_write, waitset_seek,
+    waitset_waitFD, 0
+};
+
+#endif
+
+
 /*-cf-
     wait
         target  int!/decimal!/time!/block!/port!
@@ -151,6 +519,9 @@ static int _fillWaitInfo( UThread* ut, WaitInfo* wi,
     group: io
 
     Wait for data on ports.
+
+    If the only port given is a waitset then a block of all its ports which
+    are ready for reading is returned, or none on timeout.
 */
 // (target -- port)
 CFUNC_PUB( cfunc_wait )
@@ -204,6 +575,7 @@ CFUNC_PUB( cfunc_wait )
     wi.nfds = 0;
     wi.timeout = 0;
     wi.portCount = 0;
+    wi.waitset = 0;
 
     FD_ZERO( &wi.readfds );
     //FD_SET( 0, &wi.readfds );    // stdin
@@ -221,6 +593,24 @@ CFUNC_PUB( cfunc_wait )
             return UR_THROW;
     }
 
+    if( wi.waitset )
+    {
+#ifndef USE_EPOLL
+        if( wi.portCount )
+            return ur_error( ut, UR_ERR_SCRIPT,
+                             "waitset cannot be waited on with other ports" );
+#endif
+        if( wi.portCount <= 1 )
+        {
+            PORT_SITE(dev, pbuf, wi.waitset);
+            (void) dev;
+            return _waitsetReady( ut, (WaitSetExt*) pbuf->ptr.v,
+                                  wi.timeout ? (int) (wi.tv.tv_sec * 1000 +
+                                               wi.tv.tv_usec / 1000) : -1,
+                                  1, res );
+        }
+    }
+
     n = select( wi.nfds, &wi.readfds, NULL, NULL,
                 wi.timeout ? &wi.tv : NULL );
     if( n == -1 )
@@ -115,6 +115,10 @@ UEnvParameters* boron_envParam( UEnvParameters* );
 UThread* boron_makeEnvP( UEnvParameters* );
 UThread* boron_makeEnv( const UDatatype** dtTable, unsigned int dtCount );
 void     boron_freeEnv( UThread* );
+int      boron_saveEnvImage( UThread*, const char* file,
+                             const BoronCFunc* extFuncs, int extCount );
+UThread* boron_makeEnvImage( UEnvParameters*, const char* file,
+                             const BoronCFunc* extFuncs, int extCount );
 void     boron_addCFunc( UThread*, BoronCFunc func, const char* sig );
 void     boron_overrideCFunc( UThread*, const char* name, BoronCFunc func );
 void     boron_addPortDevice( UThread*, const UPortDevice*, UAtom name );
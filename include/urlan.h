@@ -69,6 +69,7 @@ enum UrlanDataType
                 /* Other */
     UT_CONTEXT,
     UT_ERROR,
+    UT_MAP,
 
     UT_BI_COUNT,
     UT_MAX      = 64,
@@ -141,14 +142,40 @@ enum UrlanVectorType
     UR_VEC_F64
 };
 
+enum UrlanVectorFold
+{
+    UR_VFOLD_SUM,
+    UR_VFOLD_MIN,
+    UR_VFOLD_MAX,
+    UR_VFOLD_DOT,
+    UR_VFOLD_MEAN
+};
+
+enum UrlanVectorCompare
+{
+    UR_VCMP_EQ,
+    UR_VCMP_LT,
+    UR_VCMP_GT,
+    UR_VCMP_LE,
+    UR_VCMP_GE
+};
+
 
 #define UR_INVALID_BUF  0
 #define UR_INVALID_HOLD -1
+#ifdef CONFIG_ATOM32
+#define UR_INVALID_ATOM 0xffffffff
+#else
 #define UR_INVALID_ATOM 0xffff
+#endif
 
 
 typedef int32_t     UIndex;
+#ifdef CONFIG_ATOM32
+typedef uint32_t    UAtom;  // Programs must also define CONFIG_ATOM32.
+#else
 typedef uint16_t    UAtom;
+#endif
 
 
 typedef struct
@@ -209,9 +236,14 @@ typedef struct
     uint8_t  binding;
     uint8_t  _pad0;
     UIndex   ctx;       /* Same location as UCellSeries buf. */
+#ifdef CONFIG_ATOM32
+    uint32_t index;
+    UAtom    atom;
+#else
     uint16_t index;     /* LIMIT: Words per context. */
     UAtom    atom;
     UAtom    sel[2];
+#endif
 }
 UCellWord;
 
@@ -271,6 +303,7 @@ struct UBuffer
         uint8_t*    b;      //!< bytes
         int16_t*    i16;    //!< int16_t
         uint16_t*   u16;    //!< uint16_t
+        UAtom*      atom;   //!< UAtom
         int32_t*    i;      //!< int32_t
         uint32_t*   u32;    //!< uint32_t
         double*     d;      //!< doubles
@@ -282,6 +315,8 @@ struct UBuffer
 
 /* Buffer flags */
 #define UR_STRING_ENC_UP    0x01
+#define UR_BIN_MAPPED       0x02    // Binary data is a read-only file map.
+#define UR_BUF_BORROWED     0x04    // Series data is in unserialized memory.
 
 
 typedef struct UEnv         UEnv;
@@ -297,11 +332,51 @@ enum UThreadMethod
 };
 
 
+enum UrlanGCMode
+{
+    UR_GC_FULL,             // Mark & sweep the whole dataStore every time.
+    UR_GC_GENERATIONAL      // Minor collections of recent buffers.
+};
+
+
+typedef struct
+{
+    uint32_t minorCount;    // Number of minor (young buffer) collections.
+    uint32_t majorCount;    // Number of full collections.
+    int32_t  oldCount;      // Buffers in the old generation.
+    int32_t  oldLimit;      // Old buffer count which forces a full collection.
+    double   minorPause;    // Total seconds spent in minor collections.
+    double   majorPause;    // Total seconds spent in full collections.
+    double   maxPause;      // Longest collection in seconds.
+    double   lastPause;     // Duration of the last collection in seconds.
+    uint64_t sweptTotal;    // Buffers freed by all collections.
+    int32_t  markedCount;   // Buffers which survived the last sweep.
+    int32_t  sweptCount;    // Buffers freed by the last collection.
+    int32_t  bufferCount;   // Size of dataStore (set by ur_gcStats).
+    int32_t  freeCount;     // Length of free buffer list (set by ur_gcStats).
+    uint64_t liveBytes;     // Data bytes of the buffers kept by collections.
+}
+UGCStats;
+
+
+typedef struct
+{
+    uint32_t freeMin;       // Grow dataStore if recycle frees less than this %.
+    uint32_t growth;        // Percentage of dataStore size to grow by.
+    uint64_t heapLimit;     // Do not grow when buffer data exceeds this size.
+}
+UGCPolicy;
+
+
 struct UThread
 {
     UBuffer     dataStore;
     UBuffer     holds;
     UBuffer     gcBits;
+    UBuffer     gcOldBits;  // Generational GC: Bit set for old buffers.
+    UBuffer     gcOldState; // Generational GC: Old buffer change tracking.
+    UBuffer     gcOldList;  // Generational GC: Old buffers to be traced.
+    UBuffer     gcYoung;    // Generational GC: Buffers made since recycle.
     UCell       tmpWordCell;
     int32_t     freeBufCount;
     UIndex      freeBufList;
@@ -310,6 +385,9 @@ struct UThread
     const UDatatype** types;
     const UCell* (*wordCell)( UThread*, const UCell* );
     UCell* (*wordCellM)( UThread*, const UCell* );
+    UGCStats    gcStats;
+    UGCPolicy   gcPolicy;
+    void*       parseCache; // Compiled string parse rules.
 };
 
 
@@ -373,6 +451,36 @@ typedef struct
 UBindTarget;
 
 
+typedef struct
+{
+    UBuffer text;
+    UIndex  blkN;
+    int     encoding;
+    int     lines;
+    int     sol;
+    int     retryLen;
+}
+UTokenizer;
+
+
+typedef struct
+{
+    UBuffer atomMap;    // Atoms written so far.
+    UBuffer atomHash;
+    UBuffer bufMap;     // Buffers of the current value.
+    UBuffer bufHash;
+    UBuffer ctxAtoms;
+}
+USerialWriter;
+
+
+typedef struct
+{
+    UBuffer atoms;      // Atoms read so far.
+}
+USerialReader;
+
+
 enum UrlanCompareTest
 {
     UR_COMPARE_SAME,
@@ -451,24 +559,43 @@ USeriesType;
 typedef struct
 {
     UAtom    atom;
+#ifdef CONFIG_ATOM32
+    uint32_t index;
+#else
     uint16_t index;     // LIMIT: 65535 words per context.
+#endif
 }
 UAtomEntry;
 
 
 typedef struct
 {
-    unsigned int atomLimit;         //!< Maximum number of atoms.
-    unsigned int atomNamesSize;     //!< Fixed byte size of atom name buffer.
+    unsigned int atomLimit;         //!< Initial number of atoms.
+    unsigned int atomNamesSize;     //!< Initial byte size of atom names.
+    unsigned int atomMax;           //!< Maximum number of atoms.
     unsigned int envSize;           //!< Byte size of environment structure.
     unsigned int threadSize;        //!< Byte size of thread structure.
     unsigned int dtCount;           //!< Number of entries in dtTable.
     const UDatatype** dtTable;      //!< Pointers to user defined datatypes.
     void (*threadMethod)(UThread*, enum UThreadMethod);
+    unsigned int gcMode;            //!< UR_GC_FULL or UR_GC_GENERATIONAL.
+    unsigned int gcFreeMin;         //!< Grow if recycle frees less than %.
+    unsigned int gcGrowth;          //!< Percentage of dataStore to grow by.
+    unsigned int gcHeapLimit;       //!< Kilobytes of data to stop growth.
 }
 UEnvParameters;
 
 
+typedef struct
+{
+    void*    user;          //!< Passed to the methods.
+    uint32_t check;         //!< Application value which must match on load.
+    int (*bufferImage)( void* user, const UBuffer*, uint8_t* dest, int* fwd );
+    int (*cellImage)( void* user, UCell*, int load );
+}
+UEnvImageMethods;
+
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -480,11 +607,17 @@ UThread* ur_makeEnv( int atomLimit, const UDatatype** dtTable,
                      void (*thrMethod)(UThread*,enum UThreadMethod) );
 void     ur_freeEnv( UThread* );
 void     ur_freezeEnv( UThread* );
+int      ur_saveEnvImage( UThread*, const char* file,
+                          const UEnvImageMethods* );
+int      ur_loadEnvImage( UThread*, const char* file,
+                          const UEnvImageMethods* );
 UThread* ur_makeThread( const UThread* );
 int      ur_destroyThread( UThread* );
 int      ur_datatypeCount( UThread* );
 UAtom    ur_internAtom( UThread*, const char* it, const char* end );
 UAtom*   ur_internAtoms( UThread*, const char* words, UAtom* atoms );
+const uint8_t* ur_internAtomList( UThread*, const uint8_t* names,
+                          const uint8_t* end, int count, UAtom* atoms );
 const char* ur_atomCStr( UThread*, UAtom atom );
 void     ur_atomsSort( UAtomEntry* entries, int low, int high );
 int      ur_atomsSearch( const UAtomEntry* entries, int count, UAtom atom );
@@ -494,6 +627,9 @@ UIndex   ur_holdBuffer( UThread*, UIndex bufN );
 void     ur_releaseBuffer( UThread*, UIndex hold );
 void     ur_recycle( UThread* );
 int      ur_markBuffer( UThread*, UIndex bufN );
+void     ur_recycleFull( UThread* );
+void     ur_gcWriteBuffer( UThread*, UIndex bufN );
+const UGCStats* ur_gcStats( UThread*, uint64_t* typeBytes );
 int      ur_error( UThread*, int errorType, const char* fmt, ... );
 UBuffer* ur_errorBlock( UThread* );
 UBuffer* ur_threadContext( UThread* );
@@ -502,9 +638,23 @@ void     ur_appendTrace( UThread*, UIndex blkN, UIndex it );
 UIndex   ur_tokenize( UThread*, const char* it, const char* end, UCell* res );
 UIndex   ur_tokenizeType( UThread*, int inputEncoding,
                           const char* it, const char* end, UCell* res );
+void     ur_tokenizerInit( UTokenizer*, int inputEncoding, UIndex blkN );
+void     ur_tokenizerFree( UTokenizer* );
+int      ur_tokenizerFeed( UThread*, UTokenizer*, const char* it,
+                           const char* end );
+int      ur_tokenizerEnd( UThread*, UTokenizer* );
 int      ur_serialize( UThread*, UIndex blkN, UCell* res );
 int      ur_unserialize( UThread*, const uint8_t* start, const uint8_t* end,
                          UCell* res );
+int      ur_unserializeBin( UThread*, UIndex binN, UCell* res );
+void     ur_serialWriterInit( USerialWriter* );
+void     ur_serialWriterFree( USerialWriter* );
+int      ur_serialWrite( UThread*, USerialWriter*, const UCell* val,
+                         UBuffer* bin );
+void     ur_serialReaderInit( USerialReader* );
+void     ur_serialReaderFree( USerialReader* );
+int      ur_serialRead( UThread*, USerialReader*, const uint8_t* start,
+                        const uint8_t* end, UCell* res );
 void     ur_toStr( UThread*, const UCell* cell, UBuffer* str, int depth );
 void     ur_toText( UThread*, const UCell* cell, UBuffer* str );
 const UCell* ur_wordCell( UThread*, const UCell* cell );
@@ -523,6 +673,7 @@ int      ur_isTrue( const UCell* cell );
 int      ur_same( UThread*, const UCell* a, const UCell* b );
 int      ur_equal( UThread*, const UCell* a, const UCell* b );
 int      ur_equalCase( UThread*, const UCell* a, const UCell* b );
+int      ur_hashCell( UThread*, const UCell* cell, uint32_t* keys );
 int      ur_compare( UThread*, const UCell* a, const UCell* b );
 int      ur_compareCase( UThread*, const UCell* a, const UCell* b );
 
@@ -535,6 +686,7 @@ int      ur_charUppercase( int c );
 
 UIndex   ur_makeBinary( UThread*, int size );
 UBuffer* ur_makeBinaryCell( UThread*, int size, UCell* cell );
+UBuffer* ur_makeBitsetCell( UThread*, int bitCount, UCell* cell );
 void     ur_binInit( UBuffer*, int size );
 void     ur_binReserve( UBuffer*, int size );
 void     ur_binExpand( UBuffer*, int index, int count );
@@ -544,6 +696,7 @@ void     ur_binAppendArray( UBuffer*, const USeriesIter* si );
 const char* ur_binAppendBase( UBuffer* buf, const char* it, const char* end,
                               enum UrlanBinaryEncoding enc );
 void     ur_binFree( UBuffer* );
+int      ur_binMapFile( UBuffer*, const char* path, int size );
 void     ur_binSlice( UThread*, UBinaryIter*, const UCell* cell );
 int      ur_binSliceM( UThread*, UBinaryIterM*, const UCell* cell );
 void     ur_binToStr( UBuffer*, int encoding );
@@ -617,9 +770,28 @@ const UBuffer* ur_sortedContext( UThread*, const UCell* );
 #define  ur_ctxLookupNoSort ur_ctxLookup
 #define  ur_ctxCell(c,n)    ((c)->ptr.cell + (n))
 
+UIndex   ur_makeMap( UThread*, int size );
+UBuffer* ur_makeMapCell( UThread*, int size, UCell* cell );
+UBuffer* ur_mapClone( UThread*, const UCell* src, UCell* cell );
+void     ur_mapInit( UBuffer*, int size );
+void     ur_mapReserve( UBuffer*, int size );
+void     ur_mapFree( UBuffer* );
+void     ur_mapClear( UBuffer* );
+int      ur_mapLookup( UThread*, const UBuffer*, const UCell* key );
+int      ur_mapInsert( UThread*, UBuffer*, const UCell* key, const UCell* val );
+int      ur_mapRemove( UThread*, UBuffer*, const UCell* key );
+void     ur_mapRehash( UThread*, UBuffer* );
+#define  ur_mapKey(c,n)     ((c)->ptr.cell + (n) * 2)
+#define  ur_mapValue(c,n)   ((c)->ptr.cell + (n) * 2 + 1)
+#define  ur_mapSize(c)      ((c)->used / 2)
+
 UIndex   ur_makeVector( UThread*, enum UrlanVectorType, int size );
 UBuffer* ur_makeVectorCell( UThread*, enum UrlanVectorType, int size, UCell* );
 void     ur_vecInit( UBuffer*, int type, int elemSize, int size );
+int      ur_vecFold( UThread*, int op, const UCell* vec, const UCell* vecB,
+                     UCell* res );
+int      ur_vecMask( UThread*, int cmp, const UCell* vec, const UCell* val,
+                     UCell* res );
 
 void     ur_arrInit( UBuffer*, int size, int count );
 void     ur_arrReserve( UBuffer*, int count );
@@ -693,6 +865,11 @@ void     ur_arrAppendFloat( UBuffer*, float );
 #define ur_bufferSer(c)     ur_bufferSeries(ut,c)
 #define ur_bufferSerM(c)    ur_bufferSeriesM(ut,c)
 
+// C code which stores a buffer reference in an existing thread buffer
+// without changing its used member must call ur_gcWrite() on it.
+#define ur_gcWrite(n) \
+    do { if( (n) < ut->gcOldState.used ) ur_gcWriteBuffer(ut,n); } while(0)
+
 #define ur_foreach(bi)      for(; bi.it != bi.end; ++bi.it)
 
 #define ur_wordCStr(c)      ur_atomCStr(ut, ur_atom(c))
@@ -6,6 +6,8 @@ options [
     checksum: true          "Enable checksum function"
     compress: 'zlib         "Include compressor ('zlib/'bzip2/none)"
     execute:  true          "Enable execute function"
+    predecode: true         "Pre-decode frequently evaluated blocks"
+    profile:  true          "Enable profile function"
     random:   true          "Include random number generator"
     readline: 'linenoise    "Console editing ('linenoise/'gnu/none)"
     socket:   true          "Enable socket port!"
@@ -13,8 +15,9 @@ options [
     static:   false         "Build static library and stand-alone executable"
     thread:   false         "Enable thread functions"
     timecode: false         "Enable timecode! datatype"
-    atom-limit: 2048        "Set maximum number of words"
-    atom-names: mul atom-limit 16   "Set byte size of word name buffer"
+    atom32:   false         "Use 32-bit atoms; word tables grow as needed"
+    atom-limit: 2048        "Set maximum (or initial with atom32) number of words"
+    atom-names: mul atom-limit 16   "Set initial byte size of word name buffer"
 ]
 
 default [
@@ -22,6 +25,7 @@ default [
 
     objdir %obj
     include_from [%include %urlan %eval %support]
+    if atom32 [cflags {-DCONFIG_ATOM32}]
 
     macx [
         cflags {-std=c99}
@@ -62,6 +66,12 @@ lib-spec: [
     if execute [
         cflags {-DCONFIG_EXECUTE}
     ]
+    if predecode [
+        cflags {-DCONFIG_PREDECODE}
+    ]
+    if profile [
+        cflags {-DCONFIG_PROFILE}
+    ]
     if random [
         cflags {-DCONFIG_RANDOM}
         sources [
@@ -102,6 +112,7 @@ lib-spec: [
         %path.c
         %string.c
         %context.c
+        %map.c
         %gc.c
         %serialize.c
         %tokenize.c
@@ -19,13 +19,53 @@
 
 
 #include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include "mem_util.h"
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+
+#define V16             __m128i
+#define vload(p)        _mm_loadu_si128( (const __m128i*) (p) )
+#define vmask(v)        _mm_movemask_epi8( v )
+#define vset_uint8_t    _mm_set1_epi8
+#define vset_uint16_t   _mm_set1_epi16
+#define veq_uint8_t     _mm_cmpeq_epi8
+#define veq_uint16_t    _mm_cmpeq_epi16
+#define vand            _mm_and_si128
+#define vor             _mm_or_si128
+
+// Number of elements in a vector & bits per element in a vmask() result.
+#define LANES_uint8_t   16
+#define LANES_uint16_t  8
+#define MBITS_uint8_t   1
+#define MBITS_uint16_t  2
+#define MONE_uint8_t    0xffff  // vmask() bits to keep for one per element.
+#define MONE_uint16_t   0x5555
+#define MASK_BIT(m)     __builtin_ctz( m )
+#define MASK_LAST(m)    (31 - __builtin_clz( m ))
+#endif
 
 
 /*
   Returns pointer to val or zero if val not found.
+
+  The C library memchr() is used for bytes as it is vectorized (and selects
+  the best instructions for the CPU at runtime on most systems).
 */
+const uint8_t* find_uint8_t( const uint8_t* it, const uint8_t* end,
+                             uint8_t val )
+{
+    if( it == end )
+        return 0;
+    return (const uint8_t*) memchr( it, val, end - it );
+}
+
+
 #define FIND(T) \
 const T* find_ ## T( const T* it, const T* end, T val ) { \
+    FIND_SIMD(T) \
     while( it != end ) { \
         if( *it == val ) \
             return it; \
@@ -34,8 +74,25 @@ const T* find_ ## T( const T* it, const T* end, T val ) { \
     return 0; \
 }
 
-FIND(uint8_t)
+#ifdef __SSE2__
+#define FIND_SIMD(T) \
+    V16 vval = vset_ ## T( val ); \
+    int mask; \
+    while( end - it >= LANES_ ## T ) { \
+        mask = vmask( veq_ ## T( vload(it), vval ) ); \
+        if( mask ) \
+            return it + MASK_BIT(mask) / MBITS_ ## T; \
+        it += LANES_ ## T; \
+    }
+#else
+#define FIND_SIMD(T)
+#endif
+
 FIND(uint16_t)
+
+#undef FIND_SIMD
+#define FIND_SIMD(T)
+
 FIND(uint32_t)
 
 
@@ -44,6 +101,7 @@ FIND(uint32_t)
 */
 #define FIND_LAST(T) \
 const T* find_last_ ## T( const T* it, const T* end, T val ) { \
+    FIND_LAST_SIMD(T) \
     while( it != end ) { \
         --end; \
         if( *end == val ) \
@@ -52,8 +110,26 @@ const T* find_last_ ## T( const T* it, const T* end, T val ) { \
     return 0; \
 }
 
+#ifdef __SSE2__
+#define FIND_LAST_SIMD(T) \
+    V16 vval = vset_ ## T( val ); \
+    int mask; \
+    while( end - it >= LANES_ ## T ) { \
+        end -= LANES_ ## T; \
+        mask = vmask( veq_ ## T( vload(end), vval ) ); \
+        if( mask ) \
+            return end + MASK_LAST(mask) / MBITS_ ## T; \
+    }
+#else
+#define FIND_LAST_SIMD(T)
+#endif
+
 FIND_LAST(uint8_t)
 FIND_LAST(uint16_t)
+
+#undef FIND_LAST_SIMD
+#define FIND_LAST_SIMD(T)
+
 FIND_LAST(uint32_t)
 
 
@@ -106,31 +182,144 @@ FIND_LAST_CHARSET(uint16_t)
 /*
   Returns first occurance of pattern or 0 if it is not found.
 
-  TODO: Look at using a faster search algorithm such as Boyer-Moore or grep
-        source.
+  The input is filtered a vector at a time by comparing the first and last
+  pattern characters against all positions at once, and only candidates
+  where both match are checked in full.  Long patterns in long inputs use
+  the Boyer-Moore-Horspool algorithm instead.
 */
 #define FIND_PATTERN(N,T,P) \
 const T* find_pattern_ ## N( const T* it, const T* end, \
         const P* pit, const P* pend ) { \
-    int pfirst = *pit++; \
-    while( it != end ) { \
-        if( *it == pfirst ) { \
-            const T* in = it + 1; \
-            const P* p  = pit; \
-            while( p != pend && in != end ) { \
-                if( *in != *p ) \
-                    break; \
-                ++in; \
-                ++p; \
-            } \
-            if( p == pend ) \
+    const T* last; \
+    ptrdiff_t m = pend - pit; \
+    P pfirst, plast; \
+    if( m < 1 || m > end - it ) \
+        return 0; \
+    pfirst = pit[0]; \
+    plast  = pit[m - 1]; \
+    PATTERN_RANGE(N) \
+    FIND_PATTERN_LONG(N) \
+    FIND_PATTERN_SIMD(N,T,P) \
+    last = end - m; \
+    for( ; it <= last; ++it ) { \
+        if( *it == pfirst && it[m - 1] == plast ) { \
+            if( PATTERN_EQ(N,it,pit,m) ) \
                 return it; \
         } \
-        ++it; \
     } \
     return 0; \
 }
 
+#define SAME_EQ(it,pit,m) \
+    (m < 3 || ! memcmp( it + 1, pit + 1, (m - 2) * sizeof(*it) ))
+
+static int pattern_eq_8_16( const uint8_t* it, const uint16_t* pit,
+                            ptrdiff_t m )
+{
+    ptrdiff_t i;
+    for( i = 1; i < m - 1; ++i )
+        if( it[i] != pit[i] )
+            return 0;
+    return 1;
+}
+
+static int pattern_eq_16_8( const uint16_t* it, const uint8_t* pit,
+                            ptrdiff_t m )
+{
+    ptrdiff_t i;
+    for( i = 1; i < m - 1; ++i )
+        if( it[i] != pit[i] )
+            return 0;
+    return 1;
+}
+
+#define PATTERN_EQ_8(it,pit,m)      SAME_EQ(it,pit,m)
+#define PATTERN_EQ_16(it,pit,m)     SAME_EQ(it,pit,m)
+#define PATTERN_EQ_8_16(it,pit,m)   pattern_eq_8_16(it,pit,m)
+#define PATTERN_EQ_16_8(it,pit,m)   pattern_eq_16_8(it,pit,m)
+#define PATTERN_EQ(N,it,pit,m)      PATTERN_EQ_ ## N(it,pit,m)
+
+// A 16-bit pattern with characters over 255 cannot be in 8-bit input.
+#define PATTERN_RANGE(N)    PATTERN_RANGE_ ## N
+#define PATTERN_RANGE_8
+#define PATTERN_RANGE_16
+#define PATTERN_RANGE_16_8
+#define PATTERN_RANGE_8_16 \
+    if( pfirst > 255 || plast > 255 ) \
+        return 0;
+
+#ifdef __SSE2__
+#define FIND_PATTERN_SIMD(N,T,P) \
+    { \
+    V16 vfirst = vset_ ## T( pfirst ); \
+    V16 vlast  = vset_ ## T( plast ); \
+    int mask, i; \
+    while( end - it >= m - 1 + LANES_ ## T ) { \
+        mask = vmask( vand( veq_ ## T( vload(it), vfirst ), \
+                            veq_ ## T( vload(it + m - 1), vlast ) ) ) & \
+               MONE_ ## T; \
+        while( mask ) { \
+            i = MASK_BIT(mask) / MBITS_ ## T; \
+            if( PATTERN_EQ(N,(it + i),pit,m) ) \
+                return it + i; \
+            mask &= mask - 1; \
+        } \
+        it += LANES_ ## T; \
+    } \
+    }
+#else
+#define FIND_PATTERN_SIMD(N,T,P)
+#endif
+
+
+/*
+  Boyer-Moore-Horspool search for 8-bit patterns.  If fold is not zero then
+  characters are compared after mapping through it (for case-insensitive
+  searches).
+*/
+const uint8_t* find_horspool_8( const uint8_t* it, const uint8_t* end,
+                                const uint8_t* pit, const uint8_t* pend,
+                                const uint8_t* fold )
+{
+    ptrdiff_t skip[ 256 ];
+    ptrdiff_t m = pend - pit;
+    ptrdiff_t i;
+    const uint8_t* last;
+    int plast;
+
+#define FOLD(c)     (fold ? fold[c] : c)
+    for( i = 0; i < 256; ++i )
+        skip[ i ] = m;
+    for( i = 0; i < m - 1; ++i )
+        skip[ FOLD( pit[i] ) ] = m - 1 - i;
+    plast = FOLD( pit[m - 1] );
+
+    last = end - m;
+    while( it <= last )
+    {
+        int c = FOLD( it[m - 1] );
+        if( c == plast )
+        {
+            for( i = 0; i < m - 1; ++i )
+                if( FOLD( it[i] ) != FOLD( pit[i] ) )
+                    break;
+            if( i == m - 1 )
+                return it;
+        }
+        it += skip[ c ];
+    }
+    return 0;
+#undef FOLD
+}
+
+#define FIND_PATTERN_LONG(N)    FIND_PATTERN_LONG_ ## N
+#define FIND_PATTERN_LONG_8 \
+    if( m >= HORSPOOL_MIN_PATTERN && end - it >= HORSPOOL_MIN_INPUT ) \
+        return find_horspool_8( it, end, pit, pend, 0 );
+#define FIND_PATTERN_LONG_16
+#define FIND_PATTERN_LONG_8_16
+#define FIND_PATTERN_LONG_16_8
+
 FIND_PATTERN(8,uint8_t,uint8_t)
 FIND_PATTERN(16,uint16_t,uint16_t)
 FIND_PATTERN(8_16,uint8_t,uint16_t)
@@ -40,6 +40,14 @@ const uint8_t* find_pattern_8_16( const uint8_t* it, const uint8_t* end,
 const uint16_t* find_pattern_16_8( const uint16_t* it, const uint16_t* end,
                                    const uint8_t* pit, const uint8_t* pend );
 
+// Pattern & input lengths where find_horspool_8() is used.
+#define HORSPOOL_MIN_PATTERN    32
+#define HORSPOOL_MIN_INPUT      4096
+
+const uint8_t* find_horspool_8( const uint8_t* it, const uint8_t* end,
+                                const uint8_t* pit, const uint8_t* pend,
+                                const uint8_t* fold );
+
 const uint8_t* match_pattern_8( const uint8_t* it, const uint8_t* end,
                                 const uint8_t* pit, const uint8_t* pend );
 const uint16_t* match_pattern_16( const uint16_t* it, const uint16_t* end,
@@ -134,8 +134,8 @@ void SHA1_Transform(uint32_t state[5], const uint8_t buffer[64])
     CHAR64LONG16* block;
 
 #ifdef SHA1HANDSOFF
-    static uint8_t workspace[64];
-    block = (CHAR64LONG16*)workspace;
+    CHAR64LONG16 workspace;     /* On the stack so threads can share this. */
+    block = &workspace;
     memcpy(block, buffer, 64);
 #else
     block = (CHAR64LONG16*)buffer;
@@ -182,6 +182,116 @@ void SHA1_Transform(uint32_t state[5], const uint8_t buffer[64])
 }
 
 
+/* Hash consecutive blocks. */
+static void SHA1_TransformBlocks(uint32_t state[5], const uint8_t* data,
+                                 size_t blocks)
+{
+    for ( ; blocks; --blocks, data += 64)
+        SHA1_Transform(state, data);
+}
+
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+
+/*
+  Hash blocks using the x86 SHA extensions.  Rounds are done four at a time
+  by sha1rnds4, with the message schedule computed by sha1msg1/sha1msg2
+  three groups ahead.  The caller must check CPUID for SHA, SSSE3, and SSE4.1.
+*/
+#define NI_LOAD(M) \
+    M = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*) data), MASK); \
+    data += 16
+#define NI_ROUNDS(Ea,Eb,Mn,F) \
+    Eb = _mm_sha1nexte_epu32(Eb, Mn); \
+    Ea = ABCD; \
+    ABCD = _mm_sha1rnds4_epu32(ABCD, Eb, F)
+#define NI_MSG1(Mp,Mn)      Mp = _mm_sha1msg1_epu32(Mp, Mn)
+#define NI_MSG2(Mq,Mn)      Mq = _mm_sha1msg2_epu32(Mq, Mn)
+#define NI_XOR(Mr,Mn)       Mr = _mm_xor_si128(Mr, Mn)
+
+__attribute__((target("sha,ssse3,sse4.1")))
+static void SHA1_TransformNI(uint32_t state[5], const uint8_t* data,
+                             size_t blocks)
+{
+    const __m128i MASK = _mm_set_epi64x(0x0001020304050607ULL,
+                                        0x08090a0b0c0d0e0fULL);
+    __m128i ABCD, ABCD_SAVE, E0, E0_SAVE, E1;
+    __m128i MSG0, MSG1, MSG2, MSG3;
+
+    ABCD = _mm_loadu_si128((const __m128i*) state);
+    ABCD = _mm_shuffle_epi32(ABCD, 0x1B);
+    E0   = _mm_set_epi32(state[4], 0, 0, 0);
+
+    for ( ; blocks; --blocks)
+    {
+        ABCD_SAVE = ABCD;
+        E0_SAVE   = E0;
+
+        /* Rounds 0-15 */
+        NI_LOAD(MSG0);
+        E0 = _mm_add_epi32(E0, MSG0);
+        E1 = ABCD;
+        ABCD = _mm_sha1rnds4_epu32(ABCD, E0, 0);
+
+        NI_LOAD(MSG1);
+        NI_ROUNDS(E0, E1, MSG1, 0);
+        NI_MSG1(MSG0, MSG1);
+
+        NI_LOAD(MSG2);
+        NI_ROUNDS(E1, E0, MSG2, 0);
+        NI_MSG1(MSG1, MSG2);  NI_XOR(MSG0, MSG2);
+
+        NI_LOAD(MSG3);
+        NI_MSG2(MSG0, MSG3);
+        NI_ROUNDS(E0, E1, MSG3, 0);
+        NI_MSG1(MSG2, MSG3);  NI_XOR(MSG1, MSG3);
+
+        /* Rounds 16-79 */
+#define NI_GROUP(Ea,Eb,Mn,Mq,Mr,Mp,F) \
+        NI_MSG2(Mq, Mn); \
+        NI_ROUNDS(Ea, Eb, Mn, F); \
+        NI_MSG1(Mp, Mn);  NI_XOR(Mr, Mn)
+
+        NI_GROUP(E1, E0, MSG0, MSG1, MSG2, MSG3, 0);    /* 16 */
+        NI_GROUP(E0, E1, MSG1, MSG2, MSG3, MSG0, 1);
+        NI_GROUP(E1, E0, MSG2, MSG3, MSG0, MSG1, 1);
+        NI_GROUP(E0, E1, MSG3, MSG0, MSG1, MSG2, 1);
+        NI_GROUP(E1, E0, MSG0, MSG1, MSG2, MSG3, 1);    /* 32 */
+        NI_GROUP(E0, E1, MSG1, MSG2, MSG3, MSG0, 1);
+        NI_GROUP(E1, E0, MSG2, MSG3, MSG0, MSG1, 2);
+        NI_GROUP(E0, E1, MSG3, MSG0, MSG1, MSG2, 2);
+        NI_GROUP(E1, E0, MSG0, MSG1, MSG2, MSG3, 2);    /* 48 */
+        NI_GROUP(E0, E1, MSG1, MSG2, MSG3, MSG0, 2);
+        NI_GROUP(E1, E0, MSG2, MSG3, MSG0, MSG1, 2);
+        NI_GROUP(E0, E1, MSG3, MSG0, MSG1, MSG2, 3);
+        NI_GROUP(E1, E0, MSG0, MSG1, MSG2, MSG3, 3);    /* 64 */
+
+        NI_MSG2(MSG2, MSG1);
+        NI_ROUNDS(E0, E1, MSG1, 3);
+        NI_XOR(MSG3, MSG1);
+
+        NI_MSG2(MSG3, MSG2);
+        NI_ROUNDS(E1, E0, MSG2, 3);
+
+        NI_ROUNDS(E0, E1, MSG3, 3);
+
+        E0   = _mm_sha1nexte_epu32(E0, E0_SAVE);
+        ABCD = _mm_add_epi32(ABCD, ABCD_SAVE);
+    }
+
+    ABCD = _mm_shuffle_epi32(ABCD, 0x1B);
+    _mm_storeu_si128((__m128i*) state, ABCD);
+    state[4] = _mm_extract_epi32(E0, 3);
+}
+#endif
+
+
+/* Block function used by SHA1_Update; may be set to an accelerated one. */
+static void (*SHA1_Blocks)(uint32_t state[5], const uint8_t* data,
+                           size_t blocks) = SHA1_TransformBlocks;
+
+
 /* SHA1Init - Initialize new context */
 void SHA1_Init(SHA1_CTX* context)
 {
@@ -205,10 +315,9 @@ void SHA1_Update(SHA1_CTX* context, const uint8_t* data, const size_t len)
     context->count[1] += (len >> 29);
     if ((j + len) > 63) {
         memcpy(&context->buffer[j], data, (i = 64-j));
-        SHA1_Transform(context->state, context->buffer);
-        for ( ; i + 63 < len; i += 64) {
-            SHA1_Transform(context->state, data + i);
-        }
+        SHA1_Blocks(context->state, context->buffer, 1);
+        SHA1_Blocks(context->state, data + i, (len - i) / 64);
+        i += (len - i) & ~((size_t) 63);
         j = 0;
     }
     else i = 0;
@@ -0,0 +1,20 @@
+; Atom interning benchmark: several threads tokenizing at once.
+; Requires a build with thread support (./configure --thread).
+
+worker: {
+    text: make string! 20000
+    n: 0
+    loop 1500 [
+        append text rejoin [
+            "word" n " set" n ": 'lit" n " /opt" n " :get" n " "
+        ]
+        n: add n 1
+        if eq? n 150 [n: 0]
+    ]
+    loop 300 [to-block text]
+    write thread-port 'done
+}
+
+ports: []
+loop 4 [append ports thread/port worker]
+foreach p ports [wait p read p]
@@ -0,0 +1,24 @@
+; Checksum benchmark: CRC and SHA-1 throughput over an 8MB binary, both
+; whole and fed in 64K chunks through a checksum port.
+
+random/seed 7
+blk: make binary! 65536
+loop 65536 [append blk random 255]
+data: make binary! 8388608
+loop 128 [append data blk]
+
+n: 0
+loop 4 [
+    n: add n checksum/crc32 data
+    n: add n checksum/crc32c data
+]
+s: checksum data
+ck: open [checksum crc32c]
+pos: data
+while [not tail? pos] [
+    write ck slice pos 65536
+    pos: skip pos 65536
+]
+probe eq? read ck checksum/crc32c data
+probe n
+probe s
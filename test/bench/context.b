@@ -0,0 +1,20 @@
+; Context benchmark: grow large contexts one word at a time while looking up
+; words between appends.
+
+text: make string! 40000
+n: 0
+loop 1500 [
+    append text rejoin ["key" n " "]
+    n: add n 1
+]
+keys: to-block text
+
+n: 0
+loop 2 [
+    ctx: context []
+    foreach w keys [
+        set append ctx w 1
+        n: add n get in ctx first keys
+    ]
+]
+probe n
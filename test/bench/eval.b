@@ -0,0 +1,20 @@
+; Evaluator benchmark: function calls, loops, and local words.
+
+fib: func [n] [either lt? n 2 [n] [add fib sub n 1 fib sub n 2]]
+
+sum: func [blk | total] [
+    total: 0
+    foreach x blk [total: add total x]
+    total
+]
+
+print fib 25
+
+s: 0
+loop 1000000 [s: add s 1]
+print s
+
+blk: []
+loop 1000 [append blk 3]
+loop 1000 [sum blk]
+print sum blk
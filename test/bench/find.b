@@ -0,0 +1,26 @@
+; Find benchmark: search a large log text for strings & chars.
+
+random/seed 3
+words: ["connect" "timeout" "Request" "user" "GET" "/index.html" "ERROR"
+        "cache" "miss" "Retry" "status=200" "bytes" "session" "Ok"]
+log: make string! 400000
+while [lt? size? log 400000] [
+    loop 12 [append log pick words random size? words  append log ' ']
+    append log '^/'
+]
+append log "needle-in-the-haystack at the very end of this long log text"
+bin: to-binary log
+long: "needle-in-the-haystack at the very end"
+
+n: 0
+loop 40 [
+    if find log "haystack" [++ n]
+    if find/case log "Haystack" [++ n]
+    if find log "HAYSTACK" [++ n]
+    if find log long [++ n]
+    if find log 'Z' [++ n]
+    if find log 'z' [++ n]
+    if find/last log "connect" [++ n]
+    if find bin #{6E6565646C65} [++ n]
+]
+probe n
@@ -0,0 +1,14 @@
+; Garbage collection benchmark: long lived data with short lived temporaries.
+;
+; Compare the collectors with: ./run_bench -i ../../boron -i "../../boron -g"
+
+data: make block! 100000
+loop 100000 [append data join "item" 1]
+
+n: 0
+loop 200000 [
+    t: join "tmp" n
+    b: reduce [t t]
+    n: add n 1
+]
+probe size? data
@@ -0,0 +1,38 @@
+; Map benchmark: report lookups per second using select on a map! and on
+; a block holding the same key/value pairs.
+
+lookups: func [label series keys /local start n] [
+    recycle
+    start: now
+    n: 0
+    loop 10 [
+        foreach k keys [n: add n select series k]
+    ]
+    print [label to-int div mul 10 size? keys to-decimal sub now start "/s"]
+]
+
+keys: make block! 2000
+blk: make block! 4000
+n: 0
+loop 2000 [
+    append keys k: join "key" n
+    append append blk k n
+    n: add n 1
+]
+m: make map! blk
+
+lookups "map string" m keys
+lookups "block string" blk keys
+
+keys: make block! 2000
+blk: make block! 4000
+n: 0
+loop 2000 [
+    append keys n
+    append append blk n n
+    n: add n 1
+]
+m: make map! blk
+
+lookups "map int" m keys
+lookups "block int" blk keys
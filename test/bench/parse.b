@@ -0,0 +1,51 @@
+; Parse benchmark: a log line grammar and a keyword tokenizer.
+
+digit: charset "0123456789"
+alpha: charset "abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ"
+word-char: charset "abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789-_/."
+space: charset " ^-"
+
+level: ["DEBUG" | "INFO" | "NOTICE" | "WARN" | "ERROR" | "FATAL"]
+method: ["GET" | "POST" | "PUT" | "DELETE" | "HEAD" | "OPTIONS" | "PATCH"]
+date: [4 digit '-' 2 digit '-' 2 digit]
+time: [2 digit ':' 2 digit ':' 2 digit opt ['.' some digit]]
+ip: [some digit '.' some digit '.' some digit '.' some digit]
+kv: [some word-char '=' [{"} thru {"} | some word-char]]
+request: [method some space some word-char some space "HTTP/1." digit]
+field: [request | ip | kv | some word-char]
+line: [date 'T' time some space level some space any [field any space]]
+
+lines: [
+    {2024-01-15T10:22:01.123 INFO GET /index.html HTTP/1.1 200 client=10.0.0.1 bytes=5120}
+    {2024-01-15T10:22:02 WARN 192.168.1.20 user="bob smith" retry=3 path=/api/v1/items}
+    {2024-01-15T10:22:03.5 ERROR POST /api/login HTTP/1.0 500 error="timeout" ms=3000}
+    {2024-01-15T10:22:04 DEBUG cache hit key=user-42 size=128 ttl=60}
+]
+
+kw: 0
+keyword: [
+    "break" | "case" | "catch" | "class" | "const" | "continue" | "default"
+  | "do" | "else" | "enum" | "export" | "extends" | "finally" | "for"
+  | "function" | "if" | "import" | "in" | "let" | "new" | "return"
+  | "static" | "super" | "switch" | "this" | "throw" | "try" | "typeof"
+  | "var" | "void" | "while" | "with" | "yield"
+]
+token: [
+    keyword (++ kw)
+  | some digit
+  | {"} thru {"}
+  | '(' | ')' | '{' | '}' | ';' | '=' | '+' | '<' | '.' | ','
+  | some alpha
+]
+src: {for (let i = 0; i < count; i++) { if (x) return total; else value = "a" + b.c; }}
+src: join src " while (i) { this.yield = new Thing(typeof v, void 0); throw err; }"
+
+n: 0
+loop 25000 [
+    foreach l lines [if parse l line [++ n]]
+]
+loop 2000 [
+    if parse/case src [some [token | some space]] [++ n]
+]
+probe n
+probe kw
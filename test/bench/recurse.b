@@ -0,0 +1,22 @@
+; Recursion benchmark: local word access at depth.
+
+fib: func [n] [either lt? n 2 [n] [add fib sub n 1 fib sub n 2]]
+
+ack: func [m n] [
+    either zero? m [add n 1] [
+        either zero? n [ack sub m 1 1] [ack sub m 1 ack m sub n 1]
+    ]
+]
+
+; Locals of an outer function read from inside a nested, recursive one.
+depth: func [n | inner] [
+    inner: func [d] [either zero? d [n] [add 1 inner sub d 1]]
+    inner 40
+]
+
+probe fib 24
+loop 200 [ack 2 10]
+probe ack 2 10
+s: 0
+loop 2000 [s: add s depth 5]
+probe s
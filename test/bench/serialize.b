@@ -0,0 +1,50 @@
+; Serialize benchmark: round trip of a block holding strings, binaries,
+; vectors, and nested word blocks, compared with a mold and to-block round
+; trip of the same data.  The records are also sent one at a time through
+; serialize & unserialize ports.
+
+random/seed 7
+data: make block! 4096
+loop 4096 [
+    bin: make binary! 256
+    loop 256 [append bin random 255]
+    vec: make vector! 'i32
+    loop 64 [append vec random 1000]
+    append/block data reduce [
+        'item random 100000 "some string data" bin vec [a b [c d] e]
+    ]
+]
+
+s: none
+serial: cpu-cycles 1 [
+    loop 16 [
+        s: serialize data
+        r: unserialize s
+    ]
+]
+
+sw: open [serialize]
+sr: open [unserialize]
+n: 0
+streamed: cpu-cycles 1 [
+    loop 16 [
+        foreach v data [write sw v]
+        write sr read sw
+        while [read sr] [n: add n 1]
+    ]
+]
+
+molded: cpu-cycles 1 [
+    loop 16 [
+        t: mold data
+        r: to-block t
+    ]
+]
+
+probe size? s
+probe eq? mold data mold unserialize s
+probe n
+; The cycle counts may be bignum! so they are divided as decimal!.
+per-trip: func [cycles] [div to-decimal cycles 16.0]
+print ["cycles/round-trip  serialize:" per-trip serial
+       "  stream:" per-trip streamed "  mold:" per-trip molded]
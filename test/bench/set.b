@@ -0,0 +1,21 @@
+; Set benchmark: intersect, difference and union of large blocks and strings.
+
+a: make block! 20000
+b: make block! 20000
+n: 0
+loop 10000 [
+    append a n
+    append b to-decimal add n 5000
+    n: add n 1
+]
+s: make string! 40000
+loop 4 [append s a]
+
+n: 0
+loop 4 [
+    n: add n size? intersect a b
+    n: add n size? difference a b
+    n: add n size? union a b
+    n: add n size? union s "xyz"
+]
+probe n
@@ -0,0 +1,28 @@
+; Sort benchmark: numeric blocks, string blocks, vectors and strings.
+; The /parallel sorts only use threads if built with --thread.
+
+random/seed 1
+a: make block! 100000
+d: make block! 100000
+s: make block! 20000
+v: make vector! 'i32
+loop 100000 [
+    append a random 1000000
+    append d div random 1000000 7.0
+]
+loop 20000 [append s join "item-" random 1000000]
+append v a
+str: make string! 100000
+loop 1000 [append str "The quick brown fox jumps over the lazy dog. "]
+
+n: 0
+loop 4 [
+    n: add n size? sort a
+    n: add n size? sort d
+    n: add n size? sort s
+    n: add n size? sort v
+    n: add n size? sort str
+    n: add n size? sort/parallel d
+    n: add n size? sort/parallel s
+]
+probe n
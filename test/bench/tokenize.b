@@ -0,0 +1,47 @@
+; Tokenizer benchmark: report to-block throughput in MB/s on synthetic text
+; and on the Boron test scripts.
+
+; Texts is a string! or a block of strings which are tokenized separately.
+mb-sec: func [label texts /local start n mb] [
+    if string? texts [texts: reduce [texts]]
+    recycle
+    start: now
+    n: 0
+    while [lt? n 16777216] [
+        foreach t texts [
+            to-block t
+            n: add n size? t
+        ]
+    ]
+    mb: div to-decimal n 1048576.0
+    print [label div mb to-decimal sub now start "MB/s"]
+]
+
+text: make string! 65536
+loop 600 [
+    append text {record 1234 "Some string value" [x 1.5 y -2.25]
+    {A longer text field that spans
+    more than one line} ; Comment to end of line
+    /* Block comment */ 'lit :get set: 2018-05-04 10:30:00 %file.txt
+}
+]
+mb-sec "values" text
+
+para: {Lorem ipsum dolor sit amet, consectetur adipiscing elit, sed do
+    eiusmod tempor incididunt ut labore et dolore magna aliqua.  Ut enim
+    ad minim veniam, quis nostrud exercitation ullamco laboris nisi.
+}
+text: make string! 65536
+loop 60 [
+    append text rejoin [
+        "note {" para para para "}^/"
+        "/*^/" para para "*/^/; " para
+    ]
+]
+mb-sec "text" text
+
+scripts: []
+foreach f sort read %.. [
+    if eq? %.b skip tail f -2 [append scripts read/text join %../ f]
+]
+mb-sec "scripts" scripts
@@ -0,0 +1,39 @@
+; Vector benchmark: element-wise math, reductions, and masks on 1M element
+; f32 vectors using the vector! operators, compared with the same work done
+; by a scripted loop over the elements.
+
+random/seed 7
+n: 1048576
+a: make vector! 'f32
+b: make vector! 'f32
+loop n [
+    append a random 1.0
+    append b random 1.0
+]
+
+native: cpu-cycles 1 [
+    loop 16 [
+        c: add mul a 2.0 b
+        s: fold c 'sum
+        d: dot a b
+        m: mask c '> 1.5
+    ]
+]
+
+scripted: cpu-cycles 1 [
+    c: make vector! 'f32
+    s: 0.0
+    d: 0.0
+    i: 1
+    loop n [
+        x: add mul pick a i 2.0 pick b i
+        append c x
+        s: add s x
+        d: add d mul pick a i pick b i
+        i: add i 1
+    ]
+]
+
+probe s
+probe d
+print ["cycles/element  native:" div native mul 16 n "  scripted:" div scripted n]
@@ -0,0 +1,16 @@
+; Word benchmark: load data where keys become words, then look them up.
+; Compare a default build with one configured using --atom32.
+
+text: make string! 40000
+n: 0
+loop 1000 [
+    append text rejoin ["key" n ": " n " "]
+    n: add n 1
+]
+
+loop 40 [
+    data: context to-block text
+    n: 0
+    foreach w words-of data [n: add n get in data w]
+]
+probe n
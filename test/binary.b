@@ -85,3 +85,30 @@ probe encode 16 b64
 probe encode 64 b 
 probe reduce [slice b 1 slice b 2 slice b 3]
 probe [64#{qw==} 64#{q80=} 64#{q80B}]
+
+
+print "---- checksum"
+s: "123456789"
+probe checksum s
+probe checksum/crc16 s
+probe checksum/crc32 s
+probe checksum/crc32c s
+b: make binary! 1000
+loop 1000 [append b and 255 mul 7 size? b]
+probe checksum/crc32 b
+probe checksum/crc32c b
+probe checksum/sha1 b
+foreach m [sha1 crc16 crc32 crc32c] [
+    ck: open reduce ['checksum m]
+    pos: b
+    while [not tail? pos] [
+        write ck slice pos 99
+        pos: skip pos 99
+    ]
+    probe eq? read ck do reduce [to-path reduce ['checksum m] b]
+    close ck
+]
+ck: open "checksum://crc32c"
+write ck s
+probe read ck
+probe error? try [open [checksum md5]]
@@ -65,6 +65,24 @@ probe difference [a b c d] [c 1 'a]
 probe difference b: ["h" 45 new 45] b
 probe difference [3 2 2 0] [1 3 4]
 probe union [3 2 2 0] [1 3 4]
+probe intersect [1 2.0 'a' "Ab" a] [2 97 "aB" 'a]
+probe union [1 1.0 #[1 2] (a) x: :x] [1.00000001 #[1 2] (a) 'x]
+
+big: make block! 60
+i: 0
+loop 30 [append big reduce [i to-decimal i to-string i]  ++ i]
+probe difference big [0 1.0 "2" 3.0 "4"]
+probe size? intersect big reverse copy big
+probe size? union big big
+probe size? union next big big
+probe intersect "Hello World" "ORLD"
+probe difference "Hello World" "lo"
+probe union "abc" "CDE"
+probe union #{0102030201} #{0405}
+probe intersect #{0102030201} #{020205}
+probe difference #[1 2 3 4 3] #[2 4]
+probe union #[1.0 2] #[2.0 3 1.5]
+probe try [union #[1] #[1.0]]
 
 
 print "---- change"
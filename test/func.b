@@ -143,3 +143,33 @@ b: make fc [v: 3]
 a/f
 b/f
 
+
+
+print "---- outer frame"
+outer: func [n | inner] [
+    inner: func [d] [either zero? d [n] [add 1 inner sub d 1]]
+    inner 3
+]
+probe outer 10
+probe outer outer 1
+fl: func [a] [does [a]]
+g: fl 5
+probe try [g]
+
+
+print "---- profile"
+pfib: func [n] [either lt? n 2 [n] [add pfib sub n 1 pfib sub n 2]]
+probe profile [pfib 10]
+rep: profile 'report
+probe to-logic find rep "177  pfib  (body"
+probe to-logic find rep "88  add  (cfunc"
+rep: profile/collapsed 'report
+probe to-logic find rep "^/(top);pfib;either;pfib;either;pfib"
+profile 'on
+pfib 2
+profile 'off
+probe to-logic find profile 'report "3  pfib"
+probe error? try [profile 'bogus]
+o: context [aaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaa: context [bbbbbbbbbbbbbbbbbbbbbbbbbbbbbbbbbbbbbbbbbbbbbbbbbbbbbbbbbbbb: context [cccccccccccccccccccccccccccccccccccccccccccccccccccccccccccc: func [] [1]]]]
+profile [o/aaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaa/bbbbbbbbbbbbbbbbbbbbbbbbbbbbbbbbbbbbbbbbbbbbbbbbbbbbbbbbbbbb/cccccccccccccccccccccccccccccccccccccccccccccccccccccccccccc]
+probe to-logic find profile 'report "/cccccccccccccccccccccccccccccccccccccccccccccccccccccccccccc  (body"
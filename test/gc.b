@@ -0,0 +1,15 @@
+print "---- gc-stats"
+recycle
+st: context gc-stats
+probe words-of st
+probe gt? st/full 0
+probe type? st/free
+b: make block! 1000
+st: context gc-stats/types
+probe words-of st
+probe gt? select st/bytes block! 16000
+
+print "---- gc-policy"
+probe gc-policy []
+probe gc-policy [growth: 100 heap-limit: 1000000]
+probe gc-policy [free-min: 0]
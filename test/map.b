@@ -0,0 +1,64 @@
+print "---- make"
+m: make map! [a 1 "Key" 2 3 three 4.0 four #{0102} bin 1,2 coord]
+probe m
+probe size? m
+probe make map! []
+probe try [make map! [a]]
+
+
+print "---- select"
+probe select m 'a
+probe m/a
+probe pick m "key"
+probe pick m 3.0
+probe pick m 4
+probe pick m 1,2
+probe pick m #{0102}
+probe pick m 'missing
+probe m/missing
+
+
+print "---- poke"
+m/a: 10
+m/b: 20
+k: "str"
+m/:k: 30
+poke m 5 'five
+probe m
+probe try [poke m number! 1]
+
+
+print "---- remove"
+probe remove/key m "KEY"
+remove/key m 'none-such
+probe size? m
+probe words-of m
+probe values-of m
+foreach [k v] m [print [mold k mold v]]
+
+
+print "---- copy"
+n: copy m
+probe equal? n m
+poke n 'a 11
+probe equal? n m
+probe empty? clear n
+probe size? m
+
+
+print "---- many keys"
+m: make map! 0
+i: 0
+loop 1000 [poke m i to-string i  ++ i]
+loop 500 [remove/key m i: sub i 2]
+n: 0
+foreach [k v] m [if eq? k to-int v [++ n]]
+probe n
+probe m/999
+probe pick m 998
+
+
+print "---- serialize"
+m: make map! [a 1 b [x y] "s" 3]
+probe u: first unserialize serialize reduce [m]
+probe select u "S"
@@ -58,3 +58,28 @@ parse str [thru "стол" some white a: to ',' :a]
 probe a
 parse str [to "Plasma" b: to #{2C20} :b]
 probe b
+
+
+print "---- string alternatives"
+kw: ["cat" | "dog" | "cow"]
+probe reduce [parse "dog" kw  parse "DOG" kw  parse/case "DOG" kw]
+poke kw 3 "bird"
+probe reduce [parse "dog" kw  parse "bird" kw]
+change first kw "b"
+probe reduce [parse "bat" kw  parse "cat" kw]
+r: [["ab" | "cd"] | 'x']
+probe parse "cd" r
+poke first r 3 "zz"
+probe reduce [parse "cd" r  parse "zz" r]
+w: "a"
+probe parse "bb" [(w: "b") w "b"]
+probe parse "" ['x' | ]
+expr: ["(" any expr ")" | 'x']
+probe parse "((x)x)" [some expr]
+probe parse {Чувар} ["a" | "Чу" thru "р"]
+probe parse #{0102} [#{03} | #{01} skip]
+m: copy "a"
+rule: reduce [m]
+probe parse "ab" [rule (clear m append m "b") rule]
+r2: copy ["x"]
+probe parse "xy" [r2 (poke r2 1 "y") r2]
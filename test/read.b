@@ -15,3 +15,79 @@ while [read/part/into fp 20 str] [
 ]
 probe len
 close fp
+
+
+print "---- load in pieces"
+f: %load-test.tmp
+text: make string! 150000
+while [lt? size? text 150000] [
+    append text {word 12 {str^/ {nested} } [a [b 1.5]] "quoted" 2,3 12:30
+        /* c /* n */ */ %file.txt #{0102FF} #[1 2 3] ; comment^/}
+]
+write f text
+a: load f
+probe size? a
+probe equal? mold a mold to-block text
+write f join text "^/[ok"
+print try [load f]
+delete f
+
+
+print "---- read/mmap"
+m: read/mmap %data-104
+probe type? m
+probe eq? m read %data-104
+probe to-string read/mmap/part %data-104 9
+probe checksum/sha1 m
+probe parse m [thru "consulatu" 5 skip]
+probe index? find m "104"
+probe error? try [append m #{00}]
+probe error? try [read/mmap/text %data-104]
+c: copy m
+probe size? append c #{21}
+f: %mmap-test.tmp
+write f serialize [a 1 "str" #{0102}]
+probe load f
+write f compress m
+probe eq? m decompress read/mmap f
+write f ""
+probe read/mmap f
+delete f
+m: none
+recycle
+
+
+print "---- codec ports"
+f: %codec-test.tmp
+src: open %data-104
+dst: open/new f
+z: open "deflate://"
+while [b: read/part src 1000] [
+    write z b
+    while [not empty? c: read z] [write dst c]
+]
+write z none
+while [c: read z] [write dst c]
+close z
+close dst
+close src
+m: read %data-104
+probe eq? m decompress read f
+src: open f
+z: open [inflate]
+out: make binary! 0
+while [b: read/part src 100] [
+    write z b
+    while [all [c: read/part z 512 not empty? c]] [append out c]
+]
+probe eq? m out
+probe read z
+write z none
+probe error? try [write z #{00}]
+z: open [deflate 9]
+write z "codec"
+write z none
+probe to-string decompress read z
+probe read z
+close src
+delete f
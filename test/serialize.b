@@ -24,7 +24,7 @@ append input reduce skip tail input -4
 
 bin: serialize input
 probe size? bin
-probe bin
+probe to-string slice bin 4
 
 out: unserialize bin
 
@@ -36,5 +36,83 @@ if eq? input-str out-str [
     print out-str
 ]
 
+; Version 1 data can still be read.
+bor1: #{424F523100000162000000111721816300000064000500050105C0FFFFFFFE05C0FFFFFFFF86000000000000000006000000000000F03F06F59F353FE2F723C108713D0AD7238AD1408BC0C2C6000000C044809E2F0A0280FFFE80FFFF0A0601040508090C8D00000D00010F00020F00010E00030E00011000041000019701009402001203009604001605008D010601050D010602060D010603070D010604081C071C0814090102140902020617030502180A00170B0014000D5461737479207472656174732E120800112233AABBCCDD1644050263E70355F3FFFF0000000001000000FFFFFFFF16460334B58347000080BF000000001C0509050607081C0C1C071C081409010214090202061C030A0B0C140D000504021C030A0B0C140E0005021C071400082A2A746578742A2A17020504140F00170305061410000D00011C030A0B0C020202140003426F62140003546F6D14000374776F1400057468726565736F6D6520776F72647320736574206C69742067657420637478312063747832206974657220736C69632063747850206E616D65207370656564206368696C6400}
+probe eq? input-str mold unserialize bor1
+
+
+print "---- in place"
+; Unserialized series use the data in place until they are modified.
+blk: [a "hello" #{0102} #[1 2 3] [x y]]
+sb: serialize blk
+u: unserialize sb
+poke u/2 1 'j'
+append u/3 #{03}
+poke u/4 1 9
+append u/5 'z
+probe u
+probe unserialize sb
+
+f: %serialize-test.tmp
+write f sb
+m: read/mmap f
+u: unserialize m
+uppercase u/2
+poke u/4 2 7
+probe u
+probe eq? m sb
+m: none
+recycle
+probe u
+delete f
+
+
+print "---- stream"
+w: open [serialize]
+write w [a "hello" #{0102}]
+write w 'a
+write w make context! [b: 3 c: "x"]
+probe error? try [write w :print]
+s1: read w
+write w [a b]
+s2: read w
+probe empty? read w
+
+r: open [unserialize]
+write r slice s1 40
+probe read r
+write r skip s1 40
+probe read r
+probe read r
+probe read r
+probe read r
+write r s2
+probe read r
+write r none
+probe read r
+close r
+close w
+probe error? try [unserialize s2]
+
+r: open "unserialize://"
+write r slice s1 40
+write r none
+probe error? try [read r]
+
+
+print "---- corrupt"
+; Damaged data must throw an error (or load) without crashing.
+random/seed 11
+foreach src reduce [bor1 serialize unserialize bor1] [
+    loop 400 [
+        c: copy src
+        loop random 4 [poke c random size? c sub random 256 1]
+        if eq? 1 random 4 [c: slice c random size? c]
+        try [unserialize c]
+    ]
+    recycle
+    probe eq? input-str mold unserialize src
+]
+
 ;print size? compress bin
 ;print size? compress out-str
@@ -39,3 +39,52 @@ strb: [
 ]
 probe sort/field strb [3 1]
 */
+
+
+print "---- sort numbers"
+probe sort [3 -7 0 2147483647 -2147483648 12 -1]
+probe sort [2.5 -1 0.0 -0.5 3 -100.25 1]
+probe sort/group [3.0 c  -1 a  2 b] 2
+probe sort ["pear" "Apple" "fig" "banana" %cherry]
+probe sort/case ["pear" "Apple" "fig" "banana" %cherry]
+
+
+print "---- sort vector!"
+probe sort #[9 -3 0 70000 -70000 5]
+probe sort #[2.5 -1.0 0.0 -0.25 100.0]
+v: make vector! 'i16
+append v [300 -2 7 -32768 32767]
+probe sort v
+v: make vector! 'u16
+append v [300 2 65535 0]
+probe sort v
+v: make vector! 'f64
+append v [1.5 -8.0 0.125 -0.5]
+probe sort v
+probe sort skip #[5 4 3 2 1] 2
+
+
+print "---- sort string!/binary!"
+probe sort "hello World"
+probe sort/case "hello World"
+probe sort skip "dcba" 1
+probe sort #{FF00807F01}
+probe sort ""
+probe sort "z^(0101)B^(0100)a"
+probe sort/case "z^(0101)B^(0100)a"
+probe try [sort/group "abc" 2]
+
+
+print "---- sort/parallel"
+random/seed 5
+big: make block! 10000
+loop 5000 [append big reduce [random 100 random 1000]]
+probe eq? sort/group/parallel big 2 sort/group big 2
+recs: make block! 5000
+i: 0
+loop 5000 [append/block recs reduce [random 100 ++ i]]
+probe eq? sort/parallel/field recs [1] sort/field recs [1 2]
+v: make vector! 'f32
+loop 10000 [append v div random 1000 8.0]
+probe eq? sort/parallel v sort v
+probe sort/parallel [3 1 2]
@@ -122,6 +122,16 @@ probe find/case sq "WINTER"
 probe find/case sq lowercase "WINTER"
 probe encoding? u2
 probe find sq slice u2 5
+probe find sq ""
+probe find "Grüße AUS KÖLN" "köln"
+probe find/last "Hello hello HELLO" 'L'
+probe find "Rests ЃԐ" "ԐЁ"
+long: "the thirty-two or more character long pattern"
+big: make string! 8000
+loop 200 [append big "padding text THE THIRTY-TWO OR MORE "]
+append big long
+probe size? find/case big long
+probe size? find big uppercase copy long
 
 ; Find does't work with utf8 series & latin1 value.
 ;probe find encode 'utf8 "Some Random Bits" "Random"
@@ -30,3 +30,48 @@ probe poke a 3 8.0,9.2,10
 print "---- reverse"
 probe reverse #[1 2 3 4]
 probe reverse/part #[1 2 3 4 5] 3
+
+
+print "---- math"
+a: #[1 2 3 4 5 6 7 8 9 10]
+b: #[10 20 30 40 50 60 70 80 90 100]
+probe add a b
+probe sub 100 a
+probe mul a 3
+probe div b next a
+probe mod b 7
+probe xor a 6
+probe mul #[1.5 2.5] 2
+probe sub 1.0 #[0.25 0.5]
+probe add append make vector! 'i16 [32767 -32768] 1
+probe add append make vector! 'f64 [1.5 2.5 3] #[1 2 3]
+probe try [div a #[1 0 1]]
+probe try [and #[1.0] 1]
+v: append make vector! 'i32 [10 -7 9]
+probe div v 2.5
+probe mod v 2.5
+probe div v 0.5
+probe error? try [div v 0.0]
+probe add v #[0.5 0.5 0.5]
+probe sub #[0.5 0.5 0.5] v
+probe error? try [and v #[1.0 1.0 1.0]]
+
+
+print "---- fold"
+probe fold a 'sum
+probe fold a 'min
+probe fold a 'max
+probe fold a 'mean
+probe fold #[1.5 -2.5 4.0] 'min
+probe fold make vector! 'i32 'max
+probe fold append make vector! 'u32 [-1 -1] 'sum
+probe dot a b
+probe dot #[1.0 2.0 3.0] #[4.0 5.0 6.0]
+
+
+print "---- mask"
+probe mask a '> 5
+probe mask a '= 4
+probe mask a '< sub b 85
+probe mask #[1.5 2.5 3.5] '>= 2.5
+probe mask #[1 2 3] '> 1.5
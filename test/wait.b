@@ -0,0 +1,40 @@
+print "---- waitset"
+ws: open [waitset]
+s: open "tcp://:16044"
+write ws s
+probe wait [ws 0.1]
+probe empty? read ws
+
+; More connections than a plain wait block can handle.
+clients: []
+cons: []
+loop 20 [
+    append clients open "tcp://localhost:16044"
+    foreach p wait [ws 1.0] [
+        if eq? p s [
+            con: read s
+            append cons con
+            write ws con
+        ]
+    ]
+]
+probe size? cons
+
+foreach i [3 7 11] [write pick clients i "hello"]
+wait 0.1
+ready: wait [ws 1.0]
+probe size? ready
+foreach p ready [probe to-string read p]
+
+; Closed ports are dropped.
+foreach p ready [close p]
+foreach i [3 7 11] [close pick clients i]
+probe wait [ws 0.1]
+
+write ws none
+probe empty? read ws
+probe error? try [write ws 1]
+close ws
+foreach c clients [close c]
+foreach c cons [close c]
+close s
@@ -30,6 +30,7 @@
 
 #include "urlan.h"
 #include "os.h"
+#include "env.h"
 
 
 // Align for 64-bit pointers or doubles if size > 4.
@@ -80,13 +81,45 @@ void ur_arrFree( UBuffer* buf )
 {
     if( buf->ptr.b )
     {
-        memFree( buf->ptr.b - FORWARD(buf->elemSize) );
+        if( buf->flags & UR_BUF_BORROWED )
+        {
+            ur_releaseBorrowed( buf->ptr.b );
+            buf->flags &= ~UR_BUF_BORROWED;
+        }
+        else
+            memFree( buf->ptr.b - FORWARD(buf->elemSize) );
         buf->ptr.b = 0;
     }
     buf->used = 0;
 }
 
 
+/*
+  Copy array memory (including the header before ptr) for an environment
+  image.  The copy has no space beyond the used elements.
+
+  \param buf   Array buffer with ptr set.
+  \param dest  Destination or zero to only get the size.
+  \param fwd   Set to the number of header bytes before ptr.
+
+  \return Number of bytes copied to dest.
+*/
+int ur_arrImage( const UBuffer* buf, uint8_t* dest, int* fwd )
+{
+    int f = FORWARD(buf->elemSize);
+    int size = buf->elemSize * buf->used;
+
+    *fwd = f;
+    if( dest )
+    {
+        memSet( dest, 0, f );
+        ((int32_t*) (dest + f))[-1] = buf->used;
+        memCpy( dest + f, buf->ptr.b, size );
+    }
+    return f + size;
+}
+
+
 /**
   Allocates enough memory to hold count elements.
   buf->used is not changed.
@@ -111,7 +144,16 @@ void ur_arrReserve( UBuffer* buf, int count )
 
     fwd = FORWARD(buf->elemSize);
 
-    if( buf->ptr.b )
+    if( buf->flags & UR_BUF_BORROWED )
+    {
+        // Copy on write; the borrowed memory cannot grow.
+        mem = (uint8_t*) memAlloc( (buf->elemSize * avail) + fwd );
+        assert( mem );
+        memCpy( mem + fwd, buf->ptr.b, buf->elemSize * ur_avail(buf) );
+        ur_releaseBorrowed( buf->ptr.b );
+        buf->flags &= ~UR_BUF_BORROWED;
+    }
+    else if( buf->ptr.b )
         mem = (uint8_t*) memRealloc( buf->ptr.b - fwd,
                                      (buf->elemSize * avail) + fwd );
     else
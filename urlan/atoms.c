@@ -23,17 +23,55 @@
 #define LOWERCASE(c)    if(c >= 'A' && c <= 'Z') c -= 'A' - 'a'
 
 
-typedef struct
+/*
+  Atom records and names are never moved or changed once added.  Records
+  are kept in fixed size segments and names in a list of chunks so that
+  the tables can grow (up to UAtomTable::limit) without moving them.
+
+  The lookup table is an open-addressed array of atom + 1 slots.  New atoms
+  are published by storing the slot last, so existing atoms can be found
+  without locking.  Only new atoms are added under LOCK_GLOBAL.  When the
+  lookup table fills up a larger one replaces it, but the old one is kept
+  until the environment is freed as other threads may still be using it.
+*/
+typedef struct AtomRec
 {
-    uint32_t hash;
-    uint16_t nameIndex;     // Index into atomNames.ptr.c
-    uint16_t nameLen;
-
-    uint16_t head;
-    uint16_t chain;
+    uint32_t    hash;
+    uint32_t    nameLen;
+    const char* name;
 }
 AtomRec;
 
+typedef struct AtomHash
+{
+    struct AtomHash* prev;  // Replaced table.
+    uint32_t mask;          // Slot count - 1.
+    uint32_t slot[];        // Atom + 1 or zero if empty.
+}
+AtomHash;
+
+typedef struct AtomNames
+{
+    struct AtomNames* prev; // Full chunk.
+    uint32_t used;
+    uint32_t avail;
+    char     name[];
+}
+AtomNames;
+
+// Atom record in an environment image (name is an offset in the image).
+typedef struct
+{
+    uint32_t    hash;
+    uint32_t    nameLen;
+    uint32_t    name;
+}
+AtomImageRec;
+
+#define ATOM_SEG_MIN    10
+#define ATOM_REC(tab,n) \
+    ((tab)->seg[ (n) >> (tab)->segBits ] + ((n) & ((1 << (tab)->segBits) - 1)))
+
 
 /**
   \ingroup urlan_core
@@ -46,11 +84,11 @@ AtomRec;
 */
 const char* ur_atomCStr( UThread* ut, UAtom atom /*, int* plen*/ )
 {
-    UEnv* env = ut->env;
-    AtomRec* rec = ((AtomRec*) env->atomTable.ptr.v) + atom;
+    const UAtomTable* tab = &ut->env->atoms;
+    const AtomRec* rec = ATOM_REC( tab, atom );
     //if( plen )
     //    *plen = rec->nameLen;
-    return env->atomNames.ptr.c + rec->nameIndex;
+    return rec->name;
 }
 
 
@@ -70,76 +108,299 @@ uint32_t ur_hash( const uint8_t* str, const uint8_t* end )
 }
 
 
-#define HASH_INSERT( atoms, avail, table, node, hash, index ) \
-    node = table + (hash % avail); \
-    if( node->head == 0xffff ) \
-        node->head = index; \
-    else { \
-        node = table + node->head; \
-        while( node->chain != 0xffff ) \
-            node = table + node->chain; \
-        node->chain = index; \
+static AtomHash* _makeAtomHash( uint32_t size )
+{
+    AtomHash* hash = (AtomHash*) memAlloc( sizeof(AtomHash) +
+                                           sizeof(uint32_t) * size );
+    if( hash )
+    {
+        hash->prev = 0;
+        hash->mask = size - 1;
+        memSet( hash->slot, 0, sizeof(uint32_t) * size );
     }
+    return hash;
+}
 
 
-static void _rebuildAtomHash( UBuffer* buf )
+static AtomNames* _makeAtomNames( AtomNames* prev, uint32_t size )
 {
-    AtomRec* table;
-    AtomRec* node;
-    AtomRec* it;
-    AtomRec* end;
-    UIndex avail;
+    AtomNames* chunk = (AtomNames*) memAlloc( sizeof(AtomNames) + size );
+    if( chunk )
+    {
+        chunk->prev  = prev;
+        chunk->used  = 0;
+        chunk->avail = size;
+    }
+    return chunk;
+}
 
-    table = ur_ptr(AtomRec, buf);
-    avail = ur_avail(buf);
 
-    // Clear lookup table.
+/*
+  Allocate atom tables.  The lookup table has at least twice as many slots
+  as atoms so that probe sequences stay short.
 
-    it  = table;
-    end = table + avail;
-    while( it != end )
+  \return Non-zero if successful.
+*/
+static int _initAtoms( UAtomTable* tab, const UEnvParameters* par )
+{
+    uint32_t limit = par->atomMax;
+    uint32_t size;
+    int segBits = ATOM_SEG_MIN;
+
+    if( limit < par->atomLimit )
+        limit = par->atomLimit;
+    if( limit >= UR_INVALID_ATOM )
+        limit = UR_INVALID_ATOM - 1;
+    while( (1u << segBits) < par->atomLimit )
+        ++segBits;
+
+    size = 64;
+    while( size < par->atomLimit * 2 )
+        size <<= 1;
+
+    tab->hash    = 0;
+    tab->names   = 0;
+    tab->used    = 0;
+    tab->limit   = limit;
+    tab->segBits = segBits;
+    tab->seg = (AtomRec**) memAlloc( sizeof(AtomRec*) *
+                                     ((limit >> segBits) + 1) );
+    if( ! tab->seg )
+        return 0;
+    memSet( tab->seg, 0, sizeof(AtomRec*) * ((limit >> segBits) + 1) );
+    tab->hash  = _makeAtomHash( size );
+    tab->names = _makeAtomNames( 0, par->atomNamesSize );
+    return tab->hash && tab->names;
+}
+
+
+static void _freeAtoms( UAtomTable* tab )
+{
+    AtomRec** it  = tab->seg;
+    AtomRec** end = it + (tab->limit >> tab->segBits) + 1;
+    AtomHash* hash;
+    AtomNames* chunk;
+
+    if( it )
     {
-        it->head  = 0xffff;
-        it->chain = 0xffff;
-        ++it;
+        for( ; it != end; ++it )
+        {
+            if( *it )
+                memFree( *it );
+        }
+        memFree( tab->seg );
+    }
+    while( (hash = tab->hash) )
+    {
+        tab->hash = hash->prev;
+        memFree( hash );
+    }
+    while( (chunk = tab->names) )
+    {
+        tab->names = chunk->prev;
+        memFree( chunk );
     }
+}
+
 
-    // Re-insert existing entries.
+/*
+  Search the lookup table for an atom.  This does not need to be locked.
 
-    it  = table;
-    end = table + buf->used;
-    while( it != end )
+  \param slot   Set to the table slot of the atom, or the empty slot where
+                it should be added.
+
+  \return Atom or UR_INVALID_ATOM if not found.
+*/
+static UAtom _findAtom( const UAtomTable* tab, const AtomHash* hash,
+                        const uint8_t* str, int len, uint32_t hashVal,
+                        const uint32_t** slot )
+{
+    const uint8_t* it;
+    const uint8_t* sp;
+    const uint8_t* end = str + len;
+    const AtomRec* node;
+    uint32_t i = hashVal & hash->mask;
+    uint32_t n;
+    int c, d;
+
+    while( (n = atomicLoadAcquire( hash->slot + i )) )
+    {
+        --n;
+        node = ATOM_REC( tab, n );
+        if( node->hash == hashVal && node->nameLen == (uint32_t) len )
+        {
+            sp = (const uint8_t*) node->name;
+            it = str;
+            while( it != end )
+            {
+#ifdef KEEP_CASE
+                c = *sp++;
+                d = *it++;
+                if( c == d )
+                    continue;
+                LOWERCASE( c );
+                LOWERCASE( d );
+                if( c != d )
+                    break;
+#else
+                if( *sp++ != *it++ )
+                    break;
+#endif
+            }
+            if( it == end )
+            {
+                *slot = hash->slot + i;
+                return n;
+            }
+        }
+        i = (i + 1) & hash->mask;
+    }
+    *slot = hash->slot + i;
+    return UR_INVALID_ATOM;
+}
+
+
+/*
+  Replace the lookup table with one twice the size.
+  This must be called inside LOCK_GLOBAL/UNLOCK_GLOBAL.
+*/
+static int _growAtomHash( UAtomTable* tab )
+{
+    AtomHash* old = tab->hash;
+    AtomHash* hash = _makeAtomHash( (old->mask + 1) * 2 );
+    uint32_t n, i;
+
+    if( ! hash )
+        return 0;
+    for( n = 0; n < tab->used; ++n )
     {
-        HASH_INSERT( buf, avail, table, node, it->hash, it - table )
-        ++it;
+        i = ATOM_REC( tab, n )->hash & hash->mask;
+        while( hash->slot[ i ] )
+            i = (i + 1) & hash->mask;
+        hash->slot[ i ] = n + 1;
     }
+    hash->prev = old;
+    atomicStorePtrRelease( &tab->hash, hash );
+    return 1;
 }
 
 
 /*
+  Copy name to the current name chunk, adding a new chunk if it is full.
   This must be called inside LOCK_GLOBAL/UNLOCK_GLOBAL.
 
+  \return Pointer to null terminated name or zero if out of memory.
+*/
+static char* _storeAtomName( UAtomTable* tab, const uint8_t* str, int len )
+{
+    AtomNames* chunk = tab->names;
+    char* cp;
+
+    if( (chunk->used + len + 1) > chunk->avail )
+    {
+        chunk = _makeAtomNames( chunk, chunk->avail * 2 );
+        if( ! chunk )
+            return 0;
+        tab->names = chunk;
+    }
+
+    cp = chunk->name + chunk->used;
+    chunk->used += len + 1;
+    memCpy( cp, str, len );
+#ifndef KEEP_CASE
+    {
+    char* lc;
+    for( lc = cp; lc != cp + len; ++lc )
+        LOWERCASE( *lc );
+    }
+#endif
+    cp[ len ] = '\0';
+    return cp;
+}
+
+
+/*
+  Add an atom if it is not already present.
+  This must be called inside LOCK_GLOBAL/UNLOCK_GLOBAL.
+
+  \param ut     If non-zero, then ur_error() is called when the atom tables
+                are full.
+
+  \return UR_INVALID_ATOM if atom tables are full.
+*/
+static UAtom _addAtom( UThread* ut, UAtomTable* tab,
+                       const uint8_t* str, int len, uint32_t hash )
+{
+    AtomRec* node;
+    AtomRec** seg;
+    const uint32_t* slot;
+    const char* name;
+    UAtom atom;
+
+    // Another thread may have added it since the unlocked search.
+    atom = _findAtom( tab, tab->hash, str, len, hash, &slot );
+    if( atom != UR_INVALID_ATOM )
+        return atom;
+
+    if( tab->used == tab->limit )
+    {
+        if( ut )
+            ur_error( ut, UR_ERR_INTERNAL, "Atom table is full" );
+        return UR_INVALID_ATOM;
+    }
+
+    seg = tab->seg + (tab->used >> tab->segBits);
+    if( ! *seg )
+        *seg = (AtomRec*) memAlloc( sizeof(AtomRec) << tab->segBits );
+    name = *seg ? _storeAtomName( tab, str, len ) : 0;
+    if( ! name )
+    {
+        if( ut )
+            ur_error( ut, UR_ERR_INTERNAL, "No memory for atom" );
+        return UR_INVALID_ATOM;
+    }
+
+    node = ATOM_REC( tab, tab->used );
+    node->hash    = hash;
+    node->nameLen = len;
+    node->name    = name;
+
+    // Publish the atom only after the record and name are complete.
+    atom = tab->used++;
+    if( tab->used * 2 > tab->hash->mask + 1 )
+    {
+        if( ! _growAtomHash( tab ) )
+            atomicStoreRelease( (uint32_t*) slot, atom + 1 );
+    }
+    else
+        atomicStoreRelease( (uint32_t*) slot, atom + 1 );
+
+    return atom;
+}
+
+
+/*
+  Get the atom of a word, adding it if needed.  LOCK_GLOBAL is only used
+  when the atom is new.
+
   \param ut     If non-zero, then ur_error() is called when the atom tables
                 are full.
 
   \return UR_INVALID_ATOM if atom tables are full.
 */
-static UAtom _internAtom( UThread* ut, UBuffer* atoms, UBuffer* names,
+static UAtom _internAtom( UThread* ut, UEnv* env,
                           const uint8_t* str, const uint8_t* end )
 {
-    uint8_t* cp;
-    const uint8_t* it;
-    const uint8_t* sp;
-    int c, d;
-    int len;
+    UAtomTable* tab = &env->atoms;
+    const uint32_t* slot;
     uint32_t hash;
-    UIndex   avail;
-    AtomRec* table;
-    AtomRec* node;
+    int len;
+    UAtom atom;
 
 #if 0
+    const uint8_t* sp;
     uint8_t rep[32];
-    cp = rep;
+    uint8_t* cp = rep;
     sp = str;
     while( sp != end )
         *cp++ = *sp++;
@@ -155,97 +416,133 @@ static UAtom _internAtom( UThread* ut, UBuffer* atoms, UBuffer* names,
     }
     hash = ur_hash( str, end );
 
-    table = ur_ptr(AtomRec, atoms);
-    avail = ur_avail(atoms);
+    atom = _findAtom( tab, atomicLoadPtrAcquire( &tab->hash ),
+                      str, len, hash, &slot );
+    if( atom != UR_INVALID_ATOM )
+        return atom;
+
+    LOCK_GLOBAL
+    atom = _addAtom( ut, tab, str, len, hash );
+    UNLOCK_GLOBAL
+
+    return atom;
+}
+
 
-    node = table + (hash % avail);
-    if( node->head == 0xffff )
+/*
+  Get the atoms of a list of names, each a byte count followed by the
+  characters.  Names which are already known are found without locking,
+  then any new ones are added under a single LOCK_GLOBAL.
+
+  \param ut     If non-zero, then ur_error() is called when the atom tables
+                are full.
+
+  \return Pointer past the last name, or zero if the list is malformed or
+          the atom tables are full.
+*/
+static const uint8_t* _internAtomList( UThread* ut, UEnv* env,
+                                       const uint8_t* it, const uint8_t* end,
+                                       int count, UAtom* atoms )
+{
+    UAtomTable* tab = &env->atoms;
+    const AtomHash* hash = atomicLoadPtrAcquire( &tab->hash );
+    const uint32_t* slot;
+    const uint8_t* start = it;
+    int missing = 0;
+    int i, len;
+
+    for( i = 0; i < count; ++i )
     {
-        node->head = atoms->used;
+        if( it == end )
+            return 0;
+        len = *it++;
+        if( ! len || len > MAX_WORD_LEN || len > end - it )
+            return 0;
+        atoms[i] = _findAtom( tab, hash, it, len, ur_hash( it, it + len ),
+                              &slot );
+        if( atoms[i] == UR_INVALID_ATOM )
+            ++missing;
+        it += len;
     }
-    else
+
+    if( missing )
     {
-        node = table + node->head;
-        while( 1 )
+        LOCK_GLOBAL
+        for( i = 0, it = start; i < count; ++i, it += len )
         {
-            if( node->nameLen == len )
+            len = *it++;
+            if( atoms[i] == UR_INVALID_ATOM )
             {
-                sp = names->ptr.b + node->nameIndex;
-                it = str;
-                while( it != end )
-                {
-#ifdef KEEP_CASE
-                    c = *sp++;
-                    d = *it++;
-                    if( c == d )
-                        continue;
-                    LOWERCASE( c );
-                    LOWERCASE( d );
-                    if( c != d )
-                        break;
-#else
-                    if( *sp++ != *it++ )
-                        break;
-#endif
-                }
-                if( it == end )
-                    goto done;
+                atoms[i] = _addAtom( ut, tab, it, len,
+                                     ur_hash( it, it + len ) );
+                if( atoms[i] == UR_INVALID_ATOM )
+                    break;
             }
-
-            if( node->chain == 0xffff )
-            {
-                node->chain = atoms->used;
-                break;
-            }
-            node = table + node->chain;
         }
+        UNLOCK_GLOBAL
+        if( i < count )
+            return 0;
     }
+    return it;
+}
 
-    // Nope, add new atom.
 
-    if( atoms->used == avail )
-    {
-        // Atom table size is fixed so read only access does not need to be
-        // locked.  When the table is full, we are finished.
-        if( ut )
-            ur_error( ut, UR_ERR_INTERNAL, "Atom table is full" );
-        return UR_INVALID_ATOM;
-    }
-    node = table + atoms->used;
-    ++atoms->used;
+/*
+  Add the atoms of an environment image.  The atoms already in the table
+  must match the start of the image.  Names are not copied, so the image
+  must remain until the atoms are freed.  This is only used before any
+  other threads are made, so no locking is done.
+
+  \return Non-zero if successful.
+*/
+static int _addImageAtoms( UAtomTable* tab, const uint8_t* image,
+                           const AtomImageRec* rec, uint32_t count )
+{
+    AtomRec* node;
+    AtomRec** seg;
+    AtomHash* hash;
+    uint32_t n, i;
 
-    node->hash      = hash;
-    node->nameIndex = names->used;
-    node->nameLen   = len;
+    if( count < tab->used || count > tab->limit )
+        return 0;
 
-#if 1
-    if( (names->used + len + 1) > ur_avail(names) )
+    for( n = 0; n < tab->used; ++n )
     {
-        if( ut )
-            ur_error( ut, UR_ERR_INTERNAL, "Atom name buffer is full" );
-        return UR_INVALID_ATOM;
+        node = ATOM_REC( tab, n );
+        if( node->hash != rec[n].hash || node->nameLen != rec[n].nameLen ||
+            memcmp( node->name, image + rec[n].name, node->nameLen ) )
+            return 0;
     }
-#else
-    ur_arrayReserve( names, sizeof(char), names->used + len + 1 );
-#endif
 
-    cp = names->ptr.b + names->used;
-    names->used += len + 1;
-    while( str != end )
+    while( (tab->hash->mask + 1) < count * 2 )
     {
-#ifdef KEEP_CASE
-        *cp++ = *str++;
-#else
-        c = *str++;
-        LOWERCASE( c );
-        *cp++ = c;
-#endif
+        if( ! _growAtomHash( tab ) )
+            return 0;
     }
-    *cp = '\0';
+    hash = tab->hash;
+
+    for( ; n < count; ++n )
+    {
+        seg = tab->seg + (n >> tab->segBits);
+        if( ! *seg )
+        {
+            *seg = (AtomRec*) memAlloc( sizeof(AtomRec) << tab->segBits );
+            if( ! *seg )
+                return 0;
+        }
 
-done:
+        node = ATOM_REC( tab, n );
+        node->hash    = rec[n].hash;
+        node->nameLen = rec[n].nameLen;
+        node->name    = (const char*) image + rec[n].name;
 
-    return node - table;
+        i = node->hash & hash->mask;
+        while( hash->slot[ i ] )
+            i = (i + 1) & hash->mask;
+        hash->slot[ i ] = n + 1;
+        tab->used = n + 1;
+    }
+    return 1;
 }
 
 
@@ -256,23 +553,14 @@ void dumpAtoms( UThread* ut )
 
     LOCK_GLOBAL
     {
-    const char* names = env->atomNames.ptr.c;
-    AtomRec* table = (AtomRec*) env->atomTable.ptr.v;
-    AtomRec* it  = table;
-    AtomRec* end = table + env->atomTable.used;
-
-#if __WORDSIZE == 64
-#define OFFINT  "%4ld"
-#else
-#define OFFINT  "%4d"
-#endif
+    const UAtomTable* tab = &env->atoms;
+    const AtomRec* rec;
+    uint32_t n;
 
-    while( it != end )
+    for( n = 0; n < tab->used; ++n )
     {
-        dprint( OFFINT " %08x %5d %5d %s\n", it - table, it->hash,
-                it->head, it->chain,
-                names + it->nameIndex );
-        ++it;
+        rec = ATOM_REC( tab, n );
+        dprint( "%4d %08x %s\n", n, rec->hash, rec->name );
     }
     }
     UNLOCK_GLOBAL
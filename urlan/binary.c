@@ -21,15 +21,34 @@
     type        UT_BINARY
     elemSize    Unused
     form        UR_BENC_*
-    flags       Unused
+    flags       UR_BIN_MAPPED, UR_BUF_BORROWED
     used        Number of bytes used
     ptr.b       Data
     ptr.i[-1]   Number of bytes available
+
+  A mapped binary is preceded by a private page which holds the available
+  count and the page size (at ((size_t*) ptr.b)[-2]), so it can be used
+  like any other binary.  The page also holds a reference count (see
+  ur_regionRefs) as the buffers from ur_unserializeBin() may share the map.
+
+  Buffers with UR_BUF_BORROWED use memory held by a mapped binary or by
+  ur_unserialize().  The memory is found from the offset at ptr.i[-2], and
+  the buffer is copied to memory of its own when it is modified.
 */
 
 
 #include "urlan.h"
 #include "os.h"
+#include "env.h"
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#ifndef MAP_ANONYMOUS
+#define MAP_ANONYMOUS   MAP_ANON
+#endif
+#endif
 
 
 #define FORWARD     sizeof(int32_t)
@@ -124,13 +143,178 @@ void ur_binFree( UBuffer* buf )
 {
     if( buf->ptr.b )
     {
-        memFree( buf->ptr.b - FORWARD );
+        if( buf->flags & UR_BIN_MAPPED )
+        {
+            ur_releaseRegion( buf->ptr.b );
+            buf->flags &= ~UR_BIN_MAPPED;
+        }
+        else if( buf->flags & UR_BUF_BORROWED )
+        {
+            ur_releaseBorrowed( buf->ptr.b );
+            buf->flags &= ~UR_BUF_BORROWED;
+        }
+        else
+            memFree( buf->ptr.b - FORWARD );
         buf->ptr.b = 0;
     }
     buf->used = 0;
 }
 
 
+/*
+  Copy binary memory (including the header before ptr) for an environment
+  image.  The copy has no space beyond the used bytes and is never mapped.
+
+  \param buf   Binary buffer with ptr set.
+  \param dest  Destination or zero to only get the size.
+  \param fwd   Set to the number of header bytes before ptr.
+
+  \return Number of bytes copied to dest.
+*/
+int ur_binImage( const UBuffer* buf, uint8_t* dest, int* fwd )
+{
+    *fwd = FORWARD;
+    if( dest )
+    {
+        ((int32_t*) dest)[0] = buf->used;
+        memCpy( dest + FORWARD, buf->ptr.b, buf->used );
+    }
+    return FORWARD + buf->used;
+}
+
+
+/**
+  Initialize binary to a read-only memory mapping of a file.
+
+  The binary cannot be modified (ur_bufferSeriesM() will throw an error)
+  and the mapping is released by ur_binFree() when the buffer is recycled.
+  The file must not be truncated while it is mapped.
+
+  Mapping is not available on Windows, where -1 is returned.
+
+  \param buf    Uninitialized buffer.
+  \param path   File name.
+  \param size   Number of bytes to map from the start of the file.
+                Must be greater than zero.
+
+  \return 1 if successful, 0 if the file could not be opened or mapped,
+          or -1 if mapping is not supported.  When 0 or -1 is returned,
+          buf is initialized as an empty binary.
+*/
+int ur_binMapFile( UBuffer* buf, const char* path, int size )
+{
+#ifdef _WIN32
+    (void) path;
+    (void) size;
+    ur_binInit( buf, 0 );
+    return -1;
+#else
+    uint8_t* base;
+    void* data;
+    size_t head;
+    int fd;
+
+    ur_binInit( buf, 0 );
+
+    fd = open( path, O_RDONLY );
+    if( fd < 0 )
+        return 0;
+
+    // Reserve a writable page for the header followed by the file data.
+    head = sysconf( _SC_PAGESIZE );
+    base = (uint8_t*) mmap( NULL, head + size, PROT_READ | PROT_WRITE,
+                            MAP_PRIVATE | MAP_ANONYMOUS, -1, 0 );
+    if( base == MAP_FAILED )
+        goto fail;
+    data = mmap( base + head, size, PROT_READ, MAP_PRIVATE | MAP_FIXED,
+                 fd, 0 );
+    if( data == MAP_FAILED )
+    {
+        munmap( base, head + size );
+        goto fail;
+    }
+    close( fd );
+#ifdef MADV_SEQUENTIAL
+    madvise( data, size, MADV_SEQUENTIAL );
+#endif
+
+    buf->flags |= UR_BIN_MAPPED;
+    buf->used  = size;
+    buf->ptr.b = base + head;
+    ur_avail(buf) = size;
+    ur_regionMapHead(buf->ptr.b) = head;
+    ur_regionRefs(buf->ptr.b) = 1;
+    return 1;
+
+fail:
+    close( fd );
+    return 0;
+#endif
+}
+
+
+/*
+  Release a reference to memory shared by a mapped binary or unserialized
+  buffers.  The memory is freed when the last reference is released.
+
+  \param data   Start of mapped binary or ur_unserialize() memory.
+*/
+void ur_releaseRegion( uint8_t* data )
+{
+    if( atomicAddFetch( &ur_regionRefs(data), -1 ) == 0 )
+    {
+#ifndef _WIN32
+        size_t head = ur_regionMapHead(data);
+        if( head )
+        {
+            munmap( data - head, head + ((int32_t*) data)[-1] );
+            return;
+        }
+#endif
+        memFree( data - UR_REGION_HEAD );
+    }
+}
+
+
+/*
+  Release the memory of a UR_BUF_BORROWED buffer.
+
+  \param mem    Buffer ptr.
+*/
+void ur_releaseBorrowed( uint8_t* mem )
+{
+    ur_releaseRegion( mem - ((uint32_t*) mem)[-2] );
+}
+
+
+/*
+  Copy the data of a UR_BUF_BORROWED buffer to memory of its own.
+
+  \param buf    Binary or array buffer.
+*/
+void ur_unborrow( UBuffer* buf )
+{
+    uint8_t* mem = buf->ptr.b;
+    uint32_t head = *((uint32_t*) buf);
+    UIndex used = buf->used;
+    int count = ur_avail(buf);
+
+    if( buf->elemSize )
+    {
+        ur_arrInit( buf, buf->elemSize, count );
+        count *= buf->elemSize;
+    }
+    else
+        ur_binInit( buf, count );
+    memCpy( buf->ptr.b, mem, count );
+    ur_releaseBorrowed( mem );
+
+    *((uint32_t*) buf) = head;
+    buf->flags &= ~UR_BUF_BORROWED;
+    buf->used = used;
+}
+
+
 /**
   Allocates enough memory to hold size bytes.
   buf->used is not changed.
@@ -152,7 +336,16 @@ void ur_binReserve( UBuffer* buf, int size )
     if( avail < size )
         avail = (size < 8) ? 8 : size;
 
-    if( buf->ptr.b )
+    if( buf->flags & UR_BUF_BORROWED )
+    {
+        // Copy on write; the borrowed memory cannot grow.
+        mem = (uint8_t*) memAlloc( avail + FORWARD );
+        assert( mem );
+        memCpy( mem + FORWARD, buf->ptr.b, ur_avail(buf) );
+        ur_releaseBorrowed( buf->ptr.b );
+        buf->flags &= ~UR_BUF_BORROWED;
+    }
+    else if( buf->ptr.b )
         mem = (uint8_t*) memRealloc( buf->ptr.b - FORWARD, avail + FORWARD );
     else
         mem = (uint8_t*) memAlloc( avail + FORWARD );
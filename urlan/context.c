@@ -25,6 +25,12 @@
     used        Number of words used (sorted + unsorted)
     ptr.cell    Cell values
     ptr.i[-1]   Number of words available
+    ptr.i[-2]   Hash index mask (only if available >= CTX_HASH_MIN)
+
+  The cells are followed by the UAtomEntry search table.  Contexts which
+  reserve at least CTX_HASH_MIN words also have an open-addressed hash index
+  of UAtomEntry slots after the search table.  The hash index is kept current
+  as words are appended, so these contexts are never sorted.
 */
 
 
@@ -35,6 +41,11 @@
 #define SEARCH_LEN      2
 #define ENTRIES(buf)    ((UAtomEntry*) (buf->ptr.cell + ur_avail(buf)))
 #define FORWARD         8
+#define CTX_HASH_MIN    64
+#define HASHED(buf)     (ur_avail(buf) >= CTX_HASH_MIN)
+#define HASH_TABLE(buf) (ENTRIES(buf) + ur_avail(buf))
+#define HASH_MASK(buf)  (buf)->ptr.i[-2]
+#define HASH_ATOM(a)    (((uint32_t) (a) * 0x9E3779B1) >> 7)
 
 
 typedef struct
@@ -125,6 +136,48 @@ UBuffer* ur_makeContextCell( UThread* ut, int size, UCell* cell )
 }
 
 
+/*
+  Return number of hash index slots for a context of avail words.
+*/
+static int _hashSize( int avail )
+{
+    int size = CTX_HASH_MIN * 2;
+    while( size < avail * 2 )
+        size <<= 1;
+    return size;
+}
+
+
+static void _hashInsert( UBuffer* ctx, UAtom atom, int wrdN )
+{
+    UAtomEntry* table = HASH_TABLE(ctx);
+    uint32_t mask = HASH_MASK(ctx);
+    uint32_t i = HASH_ATOM(atom) & mask;
+
+    while( table[i].atom != UR_INVALID_ATOM )
+        i = (i + 1) & mask;
+    table[i].atom  = atom;
+    table[i].index = wrdN;
+}
+
+
+/*
+  Rebuild the hash index from the search table.
+*/
+static void _ctxIndex( UBuffer* ctx )
+{
+    const UAtomEntry* it;
+    const UAtomEntry* end;
+
+    memSet( HASH_TABLE(ctx), 0xff, (HASH_MASK(ctx) + 1) * sizeof(UAtomEntry) );
+
+    it  = ENTRIES(ctx);
+    end = it + ctx->used;
+    for( ; it != end; ++it )
+        _hashInsert( ctx, it->atom, it->index );
+}
+
+
 /**
   Allocates enough memory to hold size words.
   buf->used is not changed.
@@ -135,8 +188,10 @@ UBuffer* ur_makeContextCell( UThread* ut, int size, UCell* cell )
 void ur_ctxReserve( UBuffer* buf, int size )
 {
     uint8_t* mem;
+    size_t bytes;
     int avail;
     int na;
+    int hashSize = 0;
 
     avail = ur_testAvail( buf );
     if( size <= avail )
@@ -147,8 +202,14 @@ void ur_ctxReserve( UBuffer* buf, int size )
     if( na < size )
         na = (size < 4) ? 4 : size;
 
-    mem = (uint8_t*) memAlloc( FORWARD +
-                               (sizeof(UAtomEntry) + sizeof(UCell)) * na  );
+    bytes = FORWARD + (sizeof(UAtomEntry) + sizeof(UCell)) * na;
+    if( na >= CTX_HASH_MIN )
+    {
+        hashSize = _hashSize( na );
+        bytes += hashSize * sizeof(UAtomEntry);
+    }
+
+    mem = (uint8_t*) memAlloc( bytes );
     assert( mem );
 
     if( buf->ptr.b )
@@ -165,6 +226,12 @@ void ur_ctxReserve( UBuffer* buf, int size )
 
     buf->ptr.b = mem + FORWARD;
     ur_avail(buf) = na;
+
+    if( hashSize )
+    {
+        HASH_MASK(buf) = hashSize - 1;
+        _ctxIndex( buf );
+    }
 }
 
 
@@ -178,7 +245,8 @@ void ur_ctxReserve( UBuffer* buf, int size )
   The cells from src are copied to dest before any new blocks are generated.
   This means that if dest is part of a UBuffer in the dataStore, the used
   member should be set to count before calling ur_deepCopyCells so that all
-  cells are held from garbage collection.
+  cells are held from garbage collection.  The buffer should also be held
+  (with ur_hold) for the generational collector.
 */
 void ur_deepCopyCells( UThread* ut, UCell* dest, const UCell* src, int count )
 {
@@ -195,13 +263,19 @@ void ur_deepCopyCells( UThread* ut, UCell* dest, const UCell* src, int count )
         int type = ur_type(dest);
         if( ur_isBlockType( type ) )
         {
+            UIndex hold;
             ur_genBuffers( ut, 1, &bufN );
             orig = ur_bufferSer( dest );
             copy = ur_buffer( bufN );
             ur_blkInit( copy, UT_BLOCK, orig->used );
             copy->used = orig->used;
             dest->series.buf = bufN;
+
+            // Hold the copy while its cells are replaced so that it is
+            // traced by every minor collection of the generational GC.
+            hold = ur_hold( bufN );
             ur_deepCopyCells( ut, copy->ptr.cell, orig->ptr.cell, orig->used );
+            ur_release( hold );
         }
         else if( type >= UT_BINARY )
         {
@@ -236,6 +310,8 @@ UBuffer* ur_ctxClone( UThread* ut, const UBuffer* src, UCell* cell )
         memCpy( ENTRIES(nc), srcEntries, size * sizeof(UAtomEntry) );
         CC(nc)->sorted = sorted;
         nc->used = size;
+        if( HASHED(nc) )
+            _ctxIndex( nc );
         ur_deepCopyCells( ut, nc->ptr.cell, srcCells, size );   // gc!
 
         nc = ur_buffer( cell->context.buf );        // Re-aquire
@@ -270,6 +346,8 @@ UBuffer* ur_ctxMirror( UThread* ut, const UBuffer* src, UCell* cell )
     memCpy( ENTRIES(nc), srcEntries, size * sizeof(UAtomEntry) );
     CC(nc)->sorted = sorted;
     nc->used = size;
+    if( size && HASHED(nc) )
+        _ctxIndex( nc );
     memCpy( nc->ptr.cell, srcCells, size * sizeof(UCell) );
 
     return nc;
@@ -328,6 +406,44 @@ void ur_ctxFree( UBuffer* buf )
 }
 
 
+/*
+  Copy context memory (including the header before ptr) for an environment
+  image.  The available size is kept as the hash index depends upon it, but
+  unused cells & entries are zeroed.
+
+  \param buf   Context buffer with ptr set.
+  \param dest  Destination or zero to only get the size.
+  \param fwd   Set to the number of header bytes before ptr.
+
+  \return Number of bytes copied to dest.
+*/
+int ur_ctxImage( const UBuffer* buf, uint8_t* dest, int* fwd )
+{
+    int avail = ur_avail(buf);
+    int hashSize = HASHED(buf) ? HASH_MASK(buf) + 1 : 0;
+    int size = FORWARD + (sizeof(UAtomEntry) + sizeof(UCell)) * avail +
+               sizeof(UAtomEntry) * hashSize;
+
+    *fwd = FORWARD;
+    if( dest )
+    {
+        UCell* cells = (UCell*) (dest + FORWARD);
+
+        memSet( dest, 0, size );
+        ((int32_t*) cells)[-1] = avail;
+        memCpy( cells, buf->ptr.cell, sizeof(UCell) * buf->used );
+        memCpy( cells + avail, ENTRIES(buf), sizeof(UAtomEntry) * buf->used );
+        if( hashSize )
+        {
+            ((int32_t*) cells)[-2] = HASH_MASK(buf);
+            memCpy( ((UAtomEntry*) (cells + avail)) + avail, HASH_TABLE(buf),
+                    sizeof(UAtomEntry) * hashSize );
+        }
+    }
+    return size;
+}
+
+
 /**
   Get word atoms in order.
 
@@ -406,6 +522,9 @@ int ur_ctxAppendWord( UBuffer* ctx, UAtom atom )
     went->atom  = atom;
     went->index = wrdN;
 
+    if( HASHED(ctx) )
+        _hashInsert( ctx, atom, wrdN );
+
     return wrdN;
 }
 
@@ -489,6 +608,8 @@ void ur_atomsSort( UAtomEntry* entries, int low, int high )
   Sort the internal context search table so ur_ctxLookup() is faster.
   If the context is already sorted then nothing is done.
   Each time new words are appended to the context it will become un-sorted.
+  Large contexts use a hash index rather than a sorted table and are not
+  modified.
 
   \param ctx    Initialized context buffer.
 
@@ -497,7 +618,7 @@ void ur_atomsSort( UAtomEntry* entries, int low, int high )
 UBuffer* ur_ctxSort( UBuffer* ctx )
 {
     int used = ctx->used;
-    if( used > SEARCH_LEN && CC(ctx)->sorted != used )
+    if( used > SEARCH_LEN && CC(ctx)->sorted != used && ! HASHED(ctx) )
     {
       //printf( "KR ctxSort %p %d,%d\n", (void*) ctx, used, CC(ctx)->sorted );
         ur_atomsSort( ENTRIES(ctx), 0, used - 1 );
@@ -510,7 +631,8 @@ UBuffer* ur_ctxSort( UBuffer* ctx )
 UBuffer* ur_ctxSortU( UBuffer* ctx, int unsorted )
 {
     int used = ctx->used;
-    if( used > SEARCH_LEN && (CC(ctx)->sorted + unsorted) < used )
+    if( used > SEARCH_LEN && (CC(ctx)->sorted + unsorted) < used &&
+        ! HASHED(ctx) )
     {
       //printf( "KR ctxSort %p %d,%d\n", (void*) ctx, used, CC(ctx)->sorted );
         ur_atomsSort( ENTRIES(ctx), 0, used - 1 );
@@ -540,7 +662,7 @@ const UBuffer* ur_sortedContext( UThread* ut, const UCell* cell )
     ctx = ur_isShared(n) ? ut->env->dataStore.ptr.buf - n
                          : ut->dataStore.ptr.buf + n;
     used = ctx->used;
-    if( used > SEARCH_LEN && CC(ctx)->sorted != used )
+    if( used > SEARCH_LEN && CC(ctx)->sorted != used && ! HASHED(ctx) )
     {
         if( ur_isShared(n) )
         {
@@ -571,6 +693,20 @@ int ur_ctxLookup( const UBuffer* ctx, UAtom atom )
     if( ! ctx->used )
         return -1;
 
+    if( HASHED(ctx) )
+    {
+        uint32_t mask = HASH_MASK(ctx);
+        uint32_t h = HASH_ATOM(atom) & mask;
+        went = HASH_TABLE(ctx);
+        while( went[h].atom != UR_INVALID_ATOM )
+        {
+            if( went[h].atom == atom )
+                return went[h].index;
+            h = (h + 1) & mask;
+        }
+        return -1;
+    }
+
     went = ENTRIES(ctx);
     sorted = CC(ctx)->sorted;
     i = ur_atomsSearch( went, sorted, atom );
@@ -601,7 +737,7 @@ void ur_bindCells( UThread* ut, UCell* it, UCell* end, const UBindTarget* bt )
 {
     int wrdN;
     int type;
-    int self = bt->self;
+    UAtom self = bt->self;
 
     for( ; it != end; ++it )
     {
@@ -635,6 +771,7 @@ void ur_bindCells( UThread* ut, UCell* it, UCell* end, const UBindTarget* bt )
                 if( ! ur_isShared(it->series.buf) )
                 {
                     UBuffer* blk = ur_buffer(it->series.buf);
+                    ur_gcWrite( it->series.buf );
                     ur_bindCells( ut, blk->ptr.cell,
                                       blk->ptr.cell + blk->used, bt );
                 }
@@ -684,6 +821,12 @@ void ur_bind( UThread* ut, UBuffer* blk, const UBuffer* ctx, int bindType )
     else
         bt.ctxN = UR_INVALID_BUF;
 
+    {
+    UIndex n = blk - ut->dataStore.ptr.buf;
+    if( n >= 0 && n < ut->dataStore.used )
+        ur_gcWrite( n );
+    }
+
     ur_bindCells( ut, blk->ptr.cell, blk->ptr.cell + blk->used, &bt );
 }
 
@@ -4583,4 +4583,162 @@ UDatatype dt_error =
 };
 
 
+//----------------------------------------------------------------------------
+// UT_MAP
+
+
+int map_make( UThread* ut, const UCell* from, UCell* res )
+{
+    if( ur_is(from, UT_INT) )
+    {
+        ur_makeMapCell( ut, ur_int(from), res );
+        return UR_OK;
+    }
+    else if( ur_is(from, UT_BLOCK) )
+    {
+        UBlockIter bi;
+        UBuffer* map = ur_makeMapCell( ut, 0, res );
+
+        ur_blkSlice( ut, &bi, from );
+        if( (bi.end - bi.it) & 1 )
+            return ur_error( ut, UR_ERR_SCRIPT,
+                             "make map! expected key/value pairs" );
+        ur_mapReserve( map, (bi.end - bi.it) / 2 );
+        for( ; bi.it != bi.end; bi.it += 2 )
+        {
+            if( ! ur_mapInsert( ut, map, bi.it, bi.it + 1 ) )
+                return UR_THROW;
+        }
+        return UR_OK;
+    }
+    else if( ur_is(from, UT_MAP) )
+    {
+        ur_mapClone( ut, from, res );
+        return UR_OK;
+    }
+    return ur_error( ut, UR_ERR_TYPE, "make map! expected int!/block!/map!" );
+}
+
+
+void map_copy( UThread* ut, const UCell* from, UCell* res )
+{
+    ur_mapClone( ut, from, res );
+}
+
+
+int map_compare( UThread* ut, const UCell* a, const UCell* b, int test )
+{
+    switch( test )
+    {
+        case UR_COMPARE_SAME:
+            return (a->series.buf == b->series.buf);
+
+        case UR_COMPARE_EQUAL:
+        case UR_COMPARE_EQUAL_CASE:
+            if( ur_type(a) != ur_type(b) )
+                break;
+            if( a->series.buf == b->series.buf )
+                return 1;
+        {
+            const UBuffer* bufA = ur_bufferSer(a);
+            const UBuffer* bufB = ur_bufferSer(b);
+            const UCell* it;
+            const UCell* end;
+            int i;
+
+            if( bufA->used != bufB->used )
+                break;
+            it  = bufA->ptr.cell;
+            end = it + bufA->used;
+            for( ; it != end; it += 2 )
+            {
+                i = ur_mapLookup( ut, bufB, it );
+                if( i < 0 )
+                    return 0;
+                if( test == UR_COMPARE_EQUAL_CASE ?
+                        ! ur_equalCase( ut, it + 1, ur_mapValue(bufB, i) ) :
+                        ! ur_equal( ut, it + 1, ur_mapValue(bufB, i) ) )
+                    return 0;
+            }
+        }
+            return 1;
+
+        case UR_COMPARE_ORDER:
+        case UR_COMPARE_ORDER_CASE:
+            break;
+    }
+    return 0;
+}
+
+
+const UCell* map_select( UThread* ut, const UCell* cell, const UCell* sel,
+                         UCell* tmp )
+{
+    const UBuffer* buf = ur_bufferSer(cell);
+    int i = ur_mapLookup( ut, buf, sel );
+    if( i >= 0 )
+        return ur_mapValue( buf, i );
+    ur_setId(tmp, UT_NONE);
+    return tmp;
+}
+
+
+static void map_print( UThread* ut, const UBuffer* buf, UBuffer* str,
+                       int depth )
+{
+    const UCell* it  = buf->ptr.cell;
+    const UCell* end = it + buf->used;
+
+    for( ; it != end; it += 2 )
+    {
+        ur_strAppendIndent( str, depth );
+        DT( ur_type(it) )->toString( ut, it, str, depth );
+        ur_strAppendChar( str, ' ' );
+        DT( ur_type(it + 1) )->toString( ut, it + 1, str, depth );
+        ur_strAppendChar( str, '\n' );
+    }
+}
+
+
+void map_toText( UThread* ut, const UCell* cell, UBuffer* str, int depth )
+{
+    const UBuffer* buf = ur_printRecurse( ut, cell, str );
+    if( buf )
+    {
+        map_print( ut, buf, str, depth );
+        ur_printRecurseEnd( cell, buf );
+    }
+}
+
+
+void map_toString( UThread* ut, const UCell* cell, UBuffer* str, int depth )
+{
+    const UBuffer* buf = ur_printRecurse( ut, cell, str );
+    if( buf )
+    {
+        if( buf->used )
+        {
+            ur_strAppendCStr( str, "make map! [\n" );
+            map_print( ut, buf, str, depth + 1 );
+            ur_strAppendIndent( str, depth );
+            ur_strAppendCStr( str, "]" );
+        }
+        else
+            ur_strAppendCStr( str, "make map! []" );
+        ur_printRecurseEnd( cell, buf );
+    }
+}
+
+
+UDatatype dt_map =
+{
+    "map!",
+    map_make,               map_make,               map_copy,
+    map_compare,            unset_operate,          map_select,
+    map_toString,           map_toText,
+    unset_recycle,          block_mark,             ur_mapFree,
+    block_markBuf,          block_toShared,         unset_bind
+};
+
+
 //EOF
@@ -78,6 +78,7 @@
 
 #include "datatypes.c"
 #include "atoms.c"
+#include "image.c"
 
 
 #define GEN_FREE    64
@@ -103,9 +104,18 @@ static void _threadInitStore( UThread* ut )
     ur_arrInit( &ut->dataStore, sizeof(UBuffer), INIT_BUF_COUNT );
     ur_arrInit( &ut->holds,     sizeof(UIndex),  16 );
     ur_binInit( &ut->gcBits, INIT_BUF_COUNT / 8 );
+    if( ut->env->gcMode == UR_GC_GENERATIONAL )
+    {
+        ur_binInit( &ut->gcOldBits, INIT_BUF_COUNT / 8 );
+        ur_arrInit( &ut->gcOldState, sizeof(UIndex) * 2, INIT_BUF_COUNT );
+        ur_arrInit( &ut->gcOldList,  sizeof(UIndex), 0 );
+        ur_arrInit( &ut->gcYoung,    sizeof(UIndex), 0 );
+        ut->gcStats.oldLimit = 0;   // First collection is a full one.
+    }
     ut->freeBufCount = 0;
     ut->freeBufList = -1;
     ut->wordCell = 0;
+    ut->gcPolicy = ut->env->gcPolicy;
 
     // Buffer index zero denotes an invalid buffer (UR_INVALID_BUF),
     // so remove it from general use.  This will be our stack of errors.
@@ -179,8 +189,13 @@ static void _threadFree( UThread* ut )
 {
     ut->env->threadFunc( ut, UR_THREAD_FREE );
     _destroyDataStore( ut->env, &ut->dataStore );
+    ur_parseFreeCache( ut );
     ur_arrFree( &ut->holds );
     ur_binFree( &ut->gcBits );
+    ur_binFree( &ut->gcOldBits );
+    ur_arrFree( &ut->gcOldState );
+    ur_arrFree( &ut->gcOldList );
+    ur_arrFree( &ut->gcYoung );
     memFree( ut );
 }
 
@@ -266,15 +281,13 @@ static void _addDT( UEnv* env, int id, const UDatatype* dt )
         const char* end = dt->name;
         while( *end != '\0' )
             ++end;
-        _internAtom( 0, &env->atomTable, &env->atomNames,
-                     (uint8_t*) dt->name, (uint8_t*)end );
+        _internAtom( 0, env, (uint8_t*) dt->name, (uint8_t*) end );
     }
     else
     {
         reserved[ sizeof(reserved) - 3 ] = '0' + (id / 10);
         reserved[ sizeof(reserved) - 2 ] = '0' + (id % 10);
-        _internAtom( 0, &env->atomTable, &env->atomNames,
-                     reserved, reserved + (sizeof(reserved) - 1) );
+        _internAtom( 0, env, reserved, reserved + (sizeof(reserved) - 1) );
     }
     env->types[ id ] = dt;
 }
@@ -282,6 +295,7 @@ static void _addDT( UEnv* env, int id, const UDatatype* dt )
 
 extern UDatatype dt_coord;
 extern USeriesType dt_vector;
+extern void vector_initKernels();
 #if CONFIG_TIMECODE
 extern UDatatype dt_timecode;
 #endif
@@ -304,11 +318,21 @@ UEnvParameters* ur_envParam( UEnvParameters* par )
     par->atomNamesSize = 2048 * 12;
 #endif
 
+#ifdef CONFIG_ATOM32
+    par->atomMax       = 0x1000000;
+#else
+    par->atomMax       = par->atomLimit;
+#endif
+
     par->envSize       = sizeof(UEnv);
     par->threadSize    = sizeof(UThread);
     par->dtCount       = 0;
     par->dtTable       = 0;
     par->threadMethod  = _nopThreadFunc;
+    par->gcMode        = UR_GC_FULL;
+    par->gcFreeMin     = 20;
+    par->gcGrowth      = 50;
+    par->gcHeapLimit   = 0;
 
     return par;
 }
@@ -320,7 +344,7 @@ UEnvParameters* ur_envParam( UEnvParameters* par )
   \deprecated       ur_makeEnvP() should be used instead of this function.
 
   \param atomLimit  Maximum number of atoms.
-                    Memory usage is ((12 + 12) * atomLimit) bytes.
+                    Memory usage is ((16 + 12) * atomLimit) bytes.
   \param dtTable    Array of pointers to user defined datatypes.
                     Pass zero if dtCount is zero.
   \param dtCount    Number of datatypes in dtTable.
@@ -386,16 +410,25 @@ UThread* ur_makeEnvP( const UEnvParameters* par )
 
     ur_arrInit( &env->dataStore, sizeof(UBuffer), 0 );
 
-    ur_binInit( &env->atomNames, par->atomNamesSize );
-    ur_arrInit( &env->atomTable, sizeof(AtomRec), par->atomLimit );
-    _rebuildAtomHash( &env->atomTable );
+    if( ! _initAtoms( &env->atoms, par ) )
+    {
+        _freeAtoms( &env->atoms );
+        memFree( env );
+        return 0;
+    }
 
     env->typeCount = UT_BI_COUNT + par->dtCount;
 
     env->threadSize = par->threadSize;
     env->threadFunc = par->threadMethod;
+    env->gcMode     = par->gcMode;
+    env->gcPolicy.freeMin   = par->gcFreeMin;
+    env->gcPolicy.growth    = par->gcGrowth;
+    env->gcPolicy.heapLimit = (uint64_t) par->gcHeapLimit * 1024;
 
     env->threads = 0;
+    env->image = 0;
+    env->imageSize = 0;
 
     if( mutexInitF( env->mutex ) )
     {
@@ -450,6 +483,7 @@ UThread* ur_makeEnvP( const UEnvParameters* par )
 
     addDT( UT_CONTEXT,  &dt_context );
     addDT( UT_ERROR,    &dt_error );
+    addDT( UT_MAP,      &dt_map );
 
     i = UT_BI_COUNT;
     if( par->dtCount )
@@ -465,6 +499,8 @@ UThread* ur_makeEnvP( const UEnvParameters* par )
     for( ; i < UT_MAX; ++i )
         addDT( i, 0 );
 
+    vector_initKernels();
+
 
     ut = _threadMake( env );
     if( ! ut )
@@ -533,10 +569,13 @@ void ur_freeEnv( UThread* ut )
     mutexFree( env->mutex );
 
 
-    _destroyDataStore( env, &env->dataStore );
+    if( env->image )
+        ur_arrFree( &env->dataStore );  // Buffer data is in the image.
+    else
+        _destroyDataStore( env, &env->dataStore );
 
-    ur_binFree( &env->atomNames );
-    ur_arrFree( &env->atomTable );
+    _freeAtoms( &env->atoms );
+    _unmapImage( env );
 
     memFree( env );
 }
@@ -562,18 +601,22 @@ void ur_freezeEnv( UThread* ut )
 
     env->threadFunc( ut, UR_THREAD_FREEZE );
 
-    ur_recycle( ut );
+    ur_recycleFull( ut );
 
     env->dataStore = ut->dataStore;
     ur_arrFree( &ut->holds );
     ur_binFree( &ut->gcBits );
+    ur_binFree( &ut->gcOldBits );
+    ur_arrFree( &ut->gcOldState );
+    ur_arrFree( &ut->gcOldList );
+    ur_arrFree( &ut->gcYoung );
 
 
     // Point all bindings & data store references to the shared environment.
     {
 #define BLOCK_MASK \
     ((1 << UT_BLOCK) | (1 << UT_PAREN) | (1 << UT_CONTEXT) | \
-     (1 << UT_PATH) | (1 << UT_LITPATH) | (1 << UT_SETPATH))
+     (1 << UT_PATH) | (1 << UT_LITPATH) | (1 << UT_SETPATH) | (1 << UT_MAP))
 
     UBuffer* it  = env->dataStore.ptr.buf;
     UBuffer* end = it + env->dataStore.used;
@@ -632,15 +675,7 @@ int ur_datatypeCount( UThread* ut )
 */
 UAtom ur_internAtom( UThread* ut, const char* it, const char* end )
 {
-    UAtom atom;
-    UEnv* env = ut->env;
-
-    LOCK_GLOBAL
-    atom = _internAtom( ut, &env->atomTable, &env->atomNames,
-                        (uint8_t*) it, (uint8_t*) end );
-    UNLOCK_GLOBAL
-
-    return atom;
+    return _internAtom( ut, ut->env, (uint8_t*) it, (uint8_t*) end );
 }
 
 
@@ -655,32 +690,92 @@ UAtom ur_internAtom( UThread* ut, const char* it, const char* end )
 UAtom* ur_internAtoms( UThread* ut, const char* words, UAtom* atoms )
 {
     UEnv* env = ut->env;
-    UBuffer* table = &env->atomTable;
-    UBuffer* names = &env->atomNames;
     const char* cp = words;
     const char* end;
 
-
-    LOCK_GLOBAL
-
     while( *cp )
     {
         cp = str_skipWhite( cp );
         end = str_toWhite( cp );
-        *atoms++ = _internAtom( 0, table, names, (uint8_t*)cp, (uint8_t*)end );
+        *atoms++ = _internAtom( 0, env, (uint8_t*) cp, (uint8_t*) end );
         cp = end;
     }
 
-    UNLOCK_GLOBAL
-
     return atoms;
 }
 
 
+/**
+  Add a list of atoms to the shared environment.
+
+  This is faster than ur_internAtoms() when many of the names are new, as
+  the environment is only locked once for all of them.
+
+  \param names  List of names, each a byte count (1 to 64) followed by
+                the characters of the name.
+  \param end    End of the list.
+  \param count  Number of names in the list.
+  \param atoms  Return area for count atoms.
+
+  \return Pointer past the last name, or zero if the list is malformed or
+          the atom table is full.
+*/
+const uint8_t* ur_internAtomList( UThread* ut, const uint8_t* names,
+                                  const uint8_t* end, int count, UAtom* atoms )
+{
+    return _internAtomList( ut, ut->env, names, end, count, atoms );
+}
+
+
+/*
+  Add buffers id to id + count - 1 to the young generation.
+*/
+static void _appendYoung( UThread* ut, UIndex id, int count )
+{
+    UBuffer* young = &ut->gcYoung;
+    UIndex* it;
+    UIndex* end;
+
+    ur_arrReserve( young, young->used + count );
+    it = young->ptr.i + young->used;
+    end = it + count;
+    while( it != end )
+        *it++ = id++;
+    young->used += count;
+}
+
+
+/*
+  Return the number of buffers to add to the dataStore after a recycle,
+  as set by the thread gcPolicy.
+*/
+static int _growthCount( UThread* ut )
+{
+    const UGCPolicy* pol = &ut->gcPolicy;
+    const UGCStats* st = &ut->gcStats;
+    int64_t total = (int64_t) st->markedCount + st->sweptCount;
+
+    if( ! pol->growth || ! total ||
+        (int64_t) st->sweptCount * 100 >= total * pol->freeMin )
+        return 0;
+
+    if( pol->heapLimit && st->liveBytes >= pol->heapLimit )
+        return 0;
+
+    return (int) ((int64_t) ut->dataStore.used * pol->growth / 100);
+}
+
+
 /**
   Generate new buffers in dataStore.
   This may trigger the garbage collector.
 
+  If a collection frees less than UGCPolicy::freeMin percent of the buffers
+  it examined, then the dataStore is grown by UGCPolicy::growth percent so
+  that collections are not run on every allocation.  Growth stops when the
+  data used by the buffers kept by the collector (UGCStats::liveBytes)
+  reaches UGCPolicy::heapLimit bytes (if non-zero).
+
   The new buffers are completely unintialized, so the caller must make them
   valid before the next garbage recycle.
 
@@ -701,23 +796,30 @@ void ur_genBuffers( UThread* ut, int count, UIndex* index )
 #ifdef GEN_FREE
         int newCount = count + GEN_FREE;
 #else
-#define newCount    count
+        int newCount = count;
 #endif
+        int extra;
+
         ur_recycle( ut );
-        if( ut->freeBufCount < newCount )
+        extra = _growthCount( ut );
+        if( extra || ut->freeBufCount < newCount )
         {
             int id;
             int end;
 
+            newCount += extra;
             ur_arrReserve( store, store->used + newCount );
             id = store->used;
             end = id + count;
+            if( ut->env->gcMode == UR_GC_GENERATIONAL )
+                _appendYoung( ut, id, count );
             while( id < end )
                 *index++ = id++;
-#ifdef GEN_FREE
+
+            // Put the remainder on the free list.
             next = store->ptr.buf + id;
-            ut->freeBufCount += GEN_FREE;
-            end += GEN_FREE;
+            ut->freeBufCount += newCount - count;
+            end = store->used + newCount;
             while( id < end )
             {
                 next->type  = UT_UNSET;
@@ -726,7 +828,6 @@ void ur_genBuffers( UThread* ut, int count, UIndex* index )
                 ++next;
                 ut->freeBufList = id++;
             }
-#endif
             store->used += newCount;
             return;
         }
@@ -749,6 +850,14 @@ void ur_genBuffers( UThread* ut, int count, UIndex* index )
         ut->freeBufList = next->used;
     }
     ut->freeBufCount -= count;
+
+    if( ut->env->gcMode == UR_GC_GENERATIONAL )
+    {
+        UBuffer* young = &ut->gcYoung;
+        ur_arrReserve( young, young->used + count );
+        memCpy( young->ptr.i + young->used, index, count * sizeof(UIndex) );
+        young->used += count;
+    }
 }
 
 
@@ -763,9 +872,9 @@ void ur_genBuffers( UThread* ut, int count, UIndex* index )
 */
 void ur_destroyBuffer( UThread* ut, UBuffer* buf )
 {
+    UIndex n = buf - ut->dataStore.ptr.buf;
 #if 0
-    printf( "ur_destroyBuffer %ld %s\n",
-            buf - ut->dataStore.ptr.buf, ut->types[buf->type]->name );
+    printf( "ur_destroyBuffer %d %s\n", n, ut->types[buf->type]->name );
 #endif
     ut->types[ buf->type ]->destroy( buf );
 
@@ -774,7 +883,11 @@ void ur_destroyBuffer( UThread* ut, UBuffer* buf )
 
     // Link to free list.
     buf->used = ut->freeBufList;
-    ut->freeBufList = buf - ut->dataStore.ptr.buf;
+    ut->freeBufList = n;
+
+    // Next use of the buffer will be in the young generation.
+    if( n < ut->gcOldState.used )
+        ut->gcOldBits.ptr.b[ n >> 3 ] &= ~(1 << (n & 7));
 
     ++ut->freeBufCount;
 }
@@ -990,6 +1103,196 @@ int ur_equalCase( UThread* ut, const UCell* a, const UCell* b )
 }
 
 
+static inline uint32_t _hashMix( uint32_t h, uint32_t v )
+{
+    h ^= v;
+    h *= 0x01000193;
+    return h ^ (h >> 15);
+}
+
+
+static uint32_t _hashInt( int64_t n )
+{
+    return _hashMix( _hashMix( 0x811c9dc5, (uint32_t) n ),
+                     (uint32_t) (n >> 32) );
+}
+
+
+static uint32_t _hashBytes( uint32_t h, const uint8_t* it, const uint8_t* end )
+{
+    for( ; it != end; ++it )
+        h = (h ^ *it) * 0x01000193;
+    return h;
+}
+
+
+/*
+  Decimals are equal if they differ by no more than FLOAT_EPSILON, so the
+  value is hashed as the nearest integer (matching int! & char!) and a
+  second key is returned if a value within twice the epsilon rounds to
+  the neighboring integer.
+*/
+static int _hashDecimal( double d, uint32_t* keys )
+{
+#define HASH_EPS    (FLOAT_EPSILON * 2.0)
+#define ROUND(d)    ((int64_t) ((d) < 0.0 ? (d) - 0.5 : (d) + 0.5))
+    int64_t k, lo, hi;
+
+    if( ! (d > -9.0e18 && d < 9.0e18) )
+    {
+        // Huge values & NaN are only equal to themselves.
+        keys[0] = _hashBytes( 0, (const uint8_t*) &d,
+                              (const uint8_t*) (&d + 1) );
+        return 1;
+    }
+
+    k  = ROUND( d );
+    lo = ROUND( d - HASH_EPS );
+    hi = ROUND( d + HASH_EPS );
+    keys[0] = _hashInt( k );
+    if( lo != k )
+    {
+        keys[1] = _hashInt( lo );
+        return 2;
+    }
+    if( hi != k )
+    {
+        keys[1] = _hashInt( hi );
+        return 2;
+    }
+    return 1;
+}
+
+
+/**
+  Compute hash keys for a cell which agree with ur_equal().
+
+  Equal cells share at least one key.  The first key should be used to
+  store the cell in a hash table, but the cell must be looked up under each
+  of the returned keys.  Currently only a decimal! near the boundary of its
+  hash bucket returns a second key.
+
+  \param cell   Cell to hash.
+  \param keys   Array of at least two hash values.
+
+  \return Number of keys set (1 or 2), or zero if the cell cannot be hashed
+          (a datatype! holding multiple types).
+*/
+int ur_hashCell( UThread* ut, const UCell* cell, uint32_t* keys )
+{
+    int type = ur_type(cell);
+    uint32_t h;
+
+    switch( type )
+    {
+        case UT_DATATYPE:
+            if( ur_datatype(cell) >= UT_MAX )
+                return 0;
+            // Equal to a word with the same atom as the type name.
+            h = _hashMix( UT_WORD, ur_datatype(cell) );
+            break;
+
+        case UT_LOGIC:
+            h = _hashMix( type, ur_int(cell) );
+            break;
+
+        case UT_CHAR:
+        case UT_INT:
+            h = _hashInt( ur_int(cell) );
+            break;
+
+        case UT_DECIMAL:
+        case UT_TIME:
+        case UT_DATE:
+            return _hashDecimal( ur_decimal(cell), keys );
+
+        case UT_COORD:
+            h = _hashBytes( type, (const uint8_t*) cell->coord.n,
+                            (const uint8_t*) (cell->coord.n + cell->coord.len) );
+            break;
+
+        case UT_VEC3:
+        {
+            float xyz[3];
+            // Adding zero turns -0.0 into 0.0, which compare equal.
+            xyz[0] = cell->vec3.xyz[0] + 0.0f;
+            xyz[1] = cell->vec3.xyz[1] + 0.0f;
+            xyz[2] = cell->vec3.xyz[2] + 0.0f;
+            h = _hashBytes( type, (const uint8_t*) xyz,
+                            (const uint8_t*) (xyz + 3) );
+        }
+            break;
+
+        case UT_WORD:
+        case UT_LITWORD:
+        case UT_SETWORD:
+        case UT_GETWORD:
+        case UT_OPTION:
+            h = _hashMix( UT_WORD, ur_atom(cell) );
+            break;
+
+        case UT_BINARY:
+        case UT_VECTOR:
+        {
+            USeriesIter si;
+            int size;
+            ur_seriesSlice( ut, &si, cell );
+            size = si.buf->elemSize;
+            // Only vectors of the same form are equal.
+            h = _hashBytes( _hashMix( type, (type == UT_VECTOR) ?
+                                            si.buf->form : 0 ),
+                            si.buf->ptr.b + si.it * size,
+                            si.buf->ptr.b + si.end * size );
+        }
+            break;
+
+        case UT_STRING:
+        case UT_FILE:
+        {
+            USeriesIter si;
+            ur_seriesSlice( ut, &si, cell );
+            h = UT_STRING;
+            if( ur_strIsUcs2(si.buf) )
+            {
+                const uint16_t* it = si.buf->ptr.u16 + si.it;
+                const uint16_t* end = si.buf->ptr.u16 + si.end;
+                for( ; it != end; ++it )
+                    h = (h ^ ur_charLowercase( *it )) * 0x01000193;
+            }
+            else
+            {
+                const uint8_t* it = si.buf->ptr.b + si.it;
+                const uint8_t* end = si.buf->ptr.b + si.end;
+                for( ; it != end; ++it )
+                    h = (h ^ ur_charLowercase( *it )) * 0x01000193;
+            }
+        }
+            break;
+
+        case UT_BLOCK:
+        case UT_PAREN:
+        case UT_PATH:
+        case UT_LITPATH:
+        case UT_SETPATH:
+        {
+            // Elements may be decimals, so only the size is used.
+            UBlockIter bi;
+            ur_blkSlice( ut, &bi, cell );
+            h = _hashMix( type, bi.end - bi.it );
+        }
+            break;
+
+        default:
+            // Other types are never equal to a different type.
+            h = _hashMix( 0, type );
+            break;
+    }
+
+    keys[0] = h;
+    return 1;
+}
+
+
 /**
   \return 1, 0, or -1, if cell a is greater than, equal to, or less than
           cell b.
@@ -1100,6 +1403,7 @@ UCell* ur_wordCellM( UThread* ut, const UCell* cell )
             return 0;
 
         case UR_BIND_THREAD:
+            ur_gcWrite( cell->word.ctx );
             return (ut->dataStore.ptr.buf + cell->word.ctx)->ptr.cell +
                    cell->word.index;
 
@@ -1206,10 +1510,13 @@ const UBuffer* ur_bufferSeries( const UThread* ut, const UCell* cell )
   \param cell   Pointer to valid series or bound word cell.
 
   \return Pointer to buffer referenced by cell->series.buf.  If the buffer
-          is in shared storage then an error is generated and zero is returned.
+          is in shared storage or is a mapped binary then an error is
+          generated and zero is returned.  A buffer which uses unserialized
+          data in place (UR_BUF_BORROWED) is first given a copy of its own.
 */
 UBuffer* ur_bufferSeriesM( UThread* ut, const UCell* cell )
 {
+    UBuffer* buf;
     UIndex n = cell->series.buf;
     if( ur_isShared(n) )
     {
@@ -1217,7 +1524,19 @@ UBuffer* ur_bufferSeriesM( UThread* ut, const UCell* cell )
                   ur_atomCStr( ut, ut->env->dataStore.ptr.buf[-n].type ) );
         return 0;
     }
-    return ut->dataStore.ptr.buf + n;
+    buf = ut->dataStore.ptr.buf + n;
+    if( (buf->flags & (UR_BIN_MAPPED | UR_BUF_BORROWED)) &&
+        ur_isSeriesType( buf->type ) )
+    {
+        if( buf->flags & UR_BIN_MAPPED )
+        {
+            ur_error( ut, UR_ERR_SCRIPT, "Cannot modify mapped binary!" );
+            return 0;
+        }
+        ur_unborrow( buf );     // Copy on write.
+    }
+    ur_gcWrite( n );
+    return buf;
 }
 
 
@@ -1263,7 +1582,8 @@ void dumpBuf( UThread* ut, UIndex bufN )
 {
     UBuffer* buf = ur_isShared(bufN) ? (ut->env->dataStore.ptr.buf - bufN)
                                      : ur_buffer(bufN);
-    if( ur_isSeriesType(buf->type) || (buf->type == UT_CONTEXT) )
+    if( ur_isSeriesType(buf->type) || (buf->type == UT_CONTEXT) ||
+        (buf->type == UT_MAP) )
     {
         UBuffer str;
         UCell cell;
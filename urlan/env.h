@@ -28,19 +28,49 @@
 #define UNLOCK_GLOBAL   mutexUnlock( env->mutex );
 
 
+typedef struct
+{
+    struct AtomRec**  seg;      // Record segments of (1 << segBits) atoms.
+    struct AtomHash*  hash;     // Lookup table; replaced when grown.
+    struct AtomNames* names;    // Name storage chunks.
+    uint32_t used;              // Number of atoms.
+    uint32_t limit;             // Maximum number of atoms.
+    uint32_t segBits;
+}
+UAtomTable;
+
+
 struct UEnv
 {
     OSMutex     mutex;
     UBuffer     dataStore;
-    UBuffer     atomNames;
-    UBuffer     atomTable;
+    UAtomTable  atoms;
     uint16_t    typeCount;
-    uint16_t    _pad0;
+    uint16_t    gcMode;
     uint32_t    threadSize;
     void (*threadFunc)( UThread*, enum UThreadMethod );
     UThread*    threads;    // Protected by mutex.
+    UGCPolicy   gcPolicy;   // Initial policy of each thread.
     const UDatatype* types[ UT_MAX ];
+    uint8_t*    image;      // Mapped environment image holding dataStore.
+    size_t      imageSize;
 };
 
 
+void ur_parseFreeCache( UThread* );
+int  ur_arrImage( const UBuffer*, uint8_t* dest, int* fwd );
+int  ur_binImage( const UBuffer*, uint8_t* dest, int* fwd );
+int  ur_ctxImage( const UBuffer*, uint8_t* dest, int* fwd );
+int  ur_mapImage( const UBuffer*, uint8_t* dest, int* fwd );
+void ur_releaseRegion( uint8_t* data );
+void ur_releaseBorrowed( uint8_t* mem );
+void ur_unborrow( UBuffer* );
+
+// Memory shared by a mapped binary or the UR_BUF_BORROWED buffers of
+// ur_unserialize() is preceded by a header with these members.
+#define UR_REGION_HEAD          32
+#define ur_regionRefs(data)     ((int32_t*) (data))[-6]
+#define ur_regionMapHead(data)  ((size_t*) (data))[-2]
+
+
 #endif  /*EOF*/
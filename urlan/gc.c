@@ -18,8 +18,7 @@
 */
 
 
-#include "urlan.h"
-#include "os.h"
+#include "env.h"
 
 
 #ifdef DEBUG
@@ -32,13 +31,11 @@
 #endif
 
 
-//#define bitIsSet(array,n)    (array[(n)>>3] & 1<<((n)&7))
+#define bitIsSet(array,n)    (array[(n)>>3] & 1<<((n)&7))
 #define setBit(array,n)      (array[(n)>>3] |= 1<<((n)&7))
 
 
 #ifdef GC_REPORT
-#include "env.h"
-
 void ur_gcReport( const UBuffer* store, UThread* ut )
 {
     static const char datatypeChar[] = ".!nlcidDty+3w'::ob0s%v[(/|<CeFfp~~~~~";
@@ -127,18 +124,203 @@ static void _recyclePhase( UThread* ut, int phase )
 }
 
 
-/**
-  Perform garbage collection on thread dataStore.
+extern double ur_now();
 
-  This is a precise, tracing, mark-sweep collector.
-  If starts with held buffers and the datatypes trace any buffers they
-  reference.
 
-  Any UBuffer pointers to the thread dataStore must be considered invalid
-  after this call.  Note that while the buffer structures may move, the data
-  that they point to (the UBuffer::ptr member) will not change.
+/*
+  Generational collector state for each old buffer.
+
+  Buffers which have just been promoted or changed are traced for a few
+  minor collections because C code often appends an unset cell to a block
+  and then sets it after generating a new buffer.
 */
-void ur_recycle( UThread* ut )
+typedef struct
+{
+    UIndex  used;       // Buffer used member at last collection or GC_DIRTY.
+    int32_t retrace;    // Number of minor collections to trace buffer in.
+}
+GCOldState;
+
+#define GC_DIRTY    -1  // Set by ur_gcWrite().
+#define GC_RETRACE  2
+
+
+/*
+  Mark young buffers referenced by old buffers which have been changed or
+  promoted recently.
+*/
+static void _markRemembered( UThread* ut )
+{
+    void (*markBuf)( UThread*, UBuffer* );
+    UBuffer* buf;
+    UBuffer* bufStart = ut->dataStore.ptr.buf;
+    const uint8_t* oldBits = ut->gcOldBits.ptr.b;
+    GCOldState* state = (GCOldState*) ut->gcOldState.ptr.v;
+    GCOldState* st;
+    UIndex* it  = ut->gcOldList.ptr.i;
+    UIndex* end = it + ut->gcOldList.used;
+
+    for( ; it != end; ++it )
+    {
+        if( ! bitIsSet( oldBits, *it ) )
+            continue;               // Destroyed by ur_destroyBuffer().
+        buf = bufStart + *it;
+        st = state + *it;
+        if( st->used != buf->used )
+        {
+            st->used = buf->used;
+            st->retrace = GC_RETRACE;
+        }
+        else if( st->retrace )
+            --st->retrace;
+        else
+            continue;
+
+        markBuf = ut->types[ buf->type ]->markBuf;
+        if( markBuf )
+            markBuf( ut, buf );
+    }
+}
+
+
+/*
+  Add buffer to the old generation.
+*/
+static void _promote( UThread* ut, UIndex n, const UBuffer* buf )
+{
+    GCOldState* st = ((GCOldState*) ut->gcOldState.ptr.v) + n;
+
+    setBit( ut->gcOldBits.ptr.b, n );
+    st->used    = buf->used;
+    st->retrace = GC_RETRACE;
+
+    // Only buffers which reference other buffers need to be traced.
+    if( ut->types[ buf->type ]->markBuf )
+        ur_arrAppendInt32( &ut->gcOldList, n );
+}
+
+
+/*
+  Resize the generational collector arrays to cover the whole dataStore.
+*/
+static void _reserveOld( UThread* ut )
+{
+    UBuffer* bits = &ut->gcOldBits;
+    int byteSize = ut->gcBits.used;
+
+    if( bits->used < byteSize )
+    {
+        ur_binReserve( bits, byteSize );
+        memSet( bits->ptr.b + bits->used, 0, byteSize - bits->used );
+        bits->used = byteSize;
+    }
+
+    ur_arrReserve( &ut->gcOldState, ut->dataStore.used );
+    ut->gcOldState.used = ut->dataStore.used;
+}
+
+
+/*
+  Return number of bytes allocated for buffer data.
+  Only the memory of series, contexts, and maps is known.
+*/
+static uint64_t _bufferBytes( const UBuffer* buf )
+{
+    if( ! buf->ptr.v )
+        return 0;
+    if( ur_isSeriesType( buf->type ) )
+    {
+        if( buf->type == UT_BINARY || buf->type == UT_BITSET )
+            return ur_avail(buf);
+        return (uint64_t) ur_avail(buf) * buf->elemSize;
+    }
+    if( buf->type == UT_CONTEXT )
+        return (uint64_t) ur_avail(buf) * (sizeof(UAtomEntry) + sizeof(UCell));
+    if( buf->type == UT_MAP )
+        return (uint64_t) ur_avail(buf) * (sizeof(UCell) + 8);
+    return 0;
+}
+
+
+/*
+  Rebuild the old generation after a full collection.
+*/
+static void _promoteAll( UThread* ut )
+{
+    const UBuffer* it  = ut->dataStore.ptr.buf;
+    const UBuffer* end = it + ut->dataStore.used;
+    uint64_t bytes = 0;
+    UIndex n = 0;
+
+    _reserveOld( ut );
+    memSet( ut->gcOldBits.ptr.b, 0, ut->gcOldBits.used );
+    ut->gcOldList.used = 0;
+    ut->gcYoung.used = 0;
+
+    // After the sweep any buffer which is not free has been marked.
+    for( ; it != end; ++it, ++n )
+    {
+        if( it->type != UT_UNSET )
+        {
+            _promote( ut, n, it );
+            bytes += _bufferBytes( it );
+        }
+    }
+    ut->gcStats.liveBytes = bytes;
+
+    ut->gcStats.oldCount = n = ut->dataStore.used - ut->freeBufCount;
+    ut->gcStats.oldLimit = (n < 512) ? 1024 : n * 2;
+}
+
+
+/*
+  Sweep buffers generated since the last collection and promote those
+  which are still used.
+*/
+static void _sweepYoung( UThread* ut )
+{
+    UBuffer* buf;
+    UBuffer* bufStart = ut->dataStore.ptr.buf;
+    const uint8_t* markBits = ut->gcBits.ptr.b;
+    const uint8_t* oldBits;
+    UIndex* it  = ut->gcYoung.ptr.i;
+    UIndex* end = it + ut->gcYoung.used;
+    UIndex n;
+    int32_t marked = 0;
+    uint64_t bytes = 0;
+
+    _reserveOld( ut );
+    oldBits = ut->gcOldBits.ptr.b;
+
+    for( ; it != end; ++it )
+    {
+        n = *it;
+        buf = bufStart + n;
+        if( buf->type == UT_UNSET || bitIsSet( oldBits, n ) )
+            continue;           // Already destroyed or listed twice.
+        if( bitIsSet( markBits, n ) )
+        {
+            _promote( ut, n, buf );
+            bytes += _bufferBytes( buf );
+            ++marked;
+        }
+        else
+            ur_destroyBuffer( ut, buf );
+    }
+    ut->gcYoung.used = 0;
+    ut->gcStats.oldCount += marked;
+    ut->gcStats.markedCount = marked;
+
+    // Changes to old buffers are not seen until the next full collection.
+    ut->gcStats.liveBytes += bytes;
+}
+
+
+/*
+  \param minor     If non-zero, only buffers generated since the last
+                    collection are traced and swept.
+*/
+static void _recycle( UThread* ut, int minor )
 {
     int byteSize;
     int mask;
@@ -147,6 +329,8 @@ void ur_recycle( UThread* ut )
     UBuffer* bufStart = ut->dataStore.ptr.buf;
     const UDatatype** datatypes = ut->types;
     UBuffer* gcBits = &ut->gcBits;
+    int32_t freeCount = ut->freeBufCount;
+    double pause = ur_now();
 
 #ifdef GC_TIME
     //clock_t t1, t1e;
@@ -169,13 +353,21 @@ void ur_recycle( UThread* ut )
     _recyclePhase( ut, UR_RECYCLE_MARK );
 
 
-    // Mark all buffers as unused.
+    // Mark all buffers as unused, or only the young ones for a minor
+    // collection.
 
     byteSize = (ut->dataStore.used + 7) / 8;
     ur_binReserve(gcBits, byteSize);
     gcBits->used = byteSize;
     markBits = gcBits->ptr.b;
-    memSet(markBits, 0, byteSize);
+    if( minor )
+    {
+        int oldSize = ut->gcOldBits.used;
+        memCpy( markBits, ut->gcOldBits.ptr.b, oldSize );
+        memSet( markBits + oldSize, 0, byteSize - oldSize );
+    }
+    else
+        memSet(markBits, 0, byteSize);
 
 
     // Mark held buffers as used.
@@ -196,7 +388,11 @@ void ur_recycle( UThread* ut )
         byte = markBits + (bufN >> 3);
         mask = 1 << (bufN & 7);
         if( *byte & mask )
-            continue;
+        {
+            // Held buffers are modified freely so they are always traced.
+            if( ! minor )
+                continue;
+        }
         *byte |= mask;
 
         buf = bufStart + bufN;
@@ -206,6 +402,9 @@ void ur_recycle( UThread* ut )
     }
     }
 
+    if( minor )
+        _markRemembered( ut );
+
 
 #define MARK_FREE
 #ifdef MARK_FREE
@@ -224,6 +423,12 @@ void ur_recycle( UThread* ut )
 
     _recyclePhase( ut, UR_RECYCLE_SWEEP );
 
+    if( minor )
+    {
+        _sweepYoung( ut );
+        goto sweep_done;
+    }
+
     // Sweep unused buffers.
     {
     int padBits;
@@ -276,6 +481,25 @@ void ur_recycle( UThread* ut )
     }
     }
 
+    ut->gcStats.markedCount = ut->dataStore.used - ut->freeBufCount;
+    if( ut->env->gcMode == UR_GC_GENERATIONAL )
+        _promoteAll( ut );
+    else if( ut->gcPolicy.heapLimit )
+    {
+        const UBuffer* it  = ut->dataStore.ptr.buf;
+        const UBuffer* end = it + ut->dataStore.used;
+        uint64_t bytes = 0;
+
+        for( ; it != end; ++it )
+        {
+            if( it->type != UT_UNSET )
+                bytes += _bufferBytes( it );
+        }
+        ut->gcStats.liveBytes = bytes;
+    }
+
+sweep_done:
+
 
 #ifdef GC_TIME
     //t1e = clock() - t1;
@@ -288,6 +512,130 @@ void ur_recycle( UThread* ut )
 #ifdef GC_REPORT
     ur_gcReport( &ut->dataStore, ut );
 #endif
+
+    {
+    UGCStats* st = &ut->gcStats;
+    pause = ur_now() - pause;
+    if( minor )
+    {
+        ++st->minorCount;
+        st->minorPause += pause;
+    }
+    else
+    {
+        ++st->majorCount;
+        st->majorPause += pause;
+    }
+    if( pause > st->maxPause )
+        st->maxPause = pause;
+    st->lastPause = pause;
+    st->sweptCount = ut->freeBufCount - freeCount;
+    st->sweptTotal += st->sweptCount;
+    }
+}
+
+
+/**
+  Perform garbage collection on thread dataStore.
+
+  This is a precise, tracing, mark-sweep collector.
+  If starts with held buffers and the datatypes trace any buffers they
+  reference.
+
+  If the environment was created with UEnvParameters::gcMode set to
+  UR_GC_GENERATIONAL, then buffers which survive a collection are moved
+  to an old generation.  Until the old generation doubles in size only the
+  young buffers are swept, and the old buffers are only traced if they are
+  held or have changed (see ur_gcWrite()).
+
+  Any UBuffer pointers to the thread dataStore must be considered invalid
+  after this call.  Note that while the buffer structures may move, the data
+  that they point to (the UBuffer::ptr member) will not change.
+*/
+void ur_recycle( UThread* ut )
+{
+    _recycle( ut, ut->env->gcMode == UR_GC_GENERATIONAL &&
+                  ut->gcStats.oldCount < ut->gcStats.oldLimit );
+}
+
+
+/**
+  Perform a full garbage collection on thread dataStore.
+
+  This is the same as ur_recycle() when the environment gcMode is
+  UR_GC_FULL.  In generational mode all buffers are traced and swept.
+*/
+void ur_recycleFull( UThread* ut )
+{
+    _recycle( ut, 0 );
+}
+
+
+/**
+  Get garbage collector statistics.
+
+  The counters are kept by ur_recycle() at little cost.  The
+  UGCStats::bufferCount & UGCStats::freeCount members are set when this
+  function is called.
+
+  If typeBytes is not zero then the thread dataStore is scanned to total
+  the memory used by buffers of each datatype.  Only the data memory of
+  series, contexts, and maps is known; buffers of other types add nothing.
+
+  \param typeBytes     Array of UT_MAX byte counts to fill or zero.
+
+  \return Pointer to statistics which are valid until the next recycle.
+*/
+const UGCStats* ur_gcStats( UThread* ut, uint64_t* typeBytes )
+{
+    UGCStats* st = &ut->gcStats;
+
+    st->bufferCount = ut->dataStore.used;
+    st->freeCount   = ut->freeBufCount;
+
+    if( typeBytes )
+    {
+        const UBuffer* it  = ut->dataStore.ptr.buf;
+        const UBuffer* end = it + ut->dataStore.used;
+
+        memSet( typeBytes, 0, sizeof(uint64_t) * UT_MAX );
+        for( ; it != end; ++it )
+        {
+            if( it->type != UT_UNSET )
+                typeBytes[ it->type ] += _bufferBytes( it );
+        }
+    }
+    return st;
+}
+
+
+/**
+  \def ur_gcWrite
+  Notify the generational collector that a buffer is being modified.
+
+  This must be called before storing a reference to another buffer in a
+  thread buffer when the buffer used member does not change.  It is done by
+  ur_bufferSerM(), ur_wordCellM(), and ur_bind(), and does nothing if the
+  environment gcMode is UR_GC_FULL.
+
+  A new buffer which is filled in place after other buffers are generated
+  (such as a nested block being copied) should be held with ur_hold() until
+  it is referenced.
+
+  \param n     Buffer index in thread dataStore (not shared).
+*/
+
+
+/**
+  Flag a buffer as changed for the generational collector.
+  This is called by ur_gcWrite() once it has checked that bufN is tracked.
+
+  \param bufN  Buffer index in thread dataStore which is less than
+               ut->gcOldState.used.
+*/
+void ur_gcWriteBuffer( UThread* ut, UIndex bufN )
+{
+    ((GCOldState*) ut->gcOldState.ptr.v)[ bufN ].used = GC_DIRTY;
 }
 
 
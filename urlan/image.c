@@ -0,0 +1,446 @@
+/*
+  Copyright 2026 Karl Robillard
+
+  This file is part of the Urlan datatype system.
+
+  Urlan is free software: you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Urlan is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with Urlan.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+/*
+  Environment images
+
+  An image holds the atoms and shared dataStore of a frozen environment so
+  that a new environment can be made by mapping a file rather than by
+  making and evaluating all the startup data again.
+
+  Image layout:
+    ImageHead
+    AtomImageRec[ atomCount ]
+    Atom names (null terminated)
+    UBuffer[ bufCount ]     (ptr is an image offset or zero)
+    Buffer data             (each starts on a 16 byte boundary)
+
+  Buffer data is stored just as it is in memory, including any header before
+  ptr, so that the UBuffer ptr can point directly into the mapping.  The file
+  is mapped copy-on-write and only pages holding cells with pointers (such as
+  C function cells) need to be modified when it is loaded.
+
+  Images can only be used by the same build of the program which made them.
+  The header layout values and UEnvImageMethods::check guard against this.
+*/
+
+
+#include <stdio.h>
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+
+#define IMAGE_MAGIC     0x49457255      // "UrEI"
+#define IMAGE_VERSION   1
+#define IMAGE_ALIGN     16
+
+#define IMAGE_CELL_MASK \
+    ((1 << UT_BLOCK) | (1 << UT_PAREN) | (1 << UT_CONTEXT) | \
+     (1 << UT_PATH) | (1 << UT_LITPATH) | (1 << UT_SETPATH) | (1 << UT_MAP))
+
+
+typedef struct
+{
+    uint32_t magic;
+    uint8_t  version;
+    uint8_t  cellSize;
+    uint8_t  bufferSize;
+    uint8_t  atomSize;
+    uint32_t pointerSize;
+    uint32_t check;
+    uint32_t typeCount;
+    uint32_t atomCount;
+    uint32_t bufCount;
+    uint32_t atomOffset;
+    uint32_t bufOffset;
+    uint32_t size;
+}
+ImageHead;
+
+
+static void _imageHead( ImageHead* head, const UEnv* env, uint32_t check )
+{
+    memSet( head, 0, sizeof(ImageHead) );
+    head->magic       = IMAGE_MAGIC;
+    head->version     = IMAGE_VERSION;
+    head->cellSize    = sizeof(UCell);
+    head->bufferSize  = sizeof(UBuffer);
+    head->atomSize    = sizeof(UAtom);
+    head->pointerSize = sizeof(void*);
+    head->check       = check;
+    head->typeCount   = env->typeCount;
+}
+
+
+static void _imageAlign( UBuffer* bin )
+{
+    int used = (bin->used + IMAGE_ALIGN - 1) & ~(IMAGE_ALIGN - 1);
+    ur_binReserve( bin, used );
+    memSet( bin->ptr.b + bin->used, 0, used - bin->used );
+    bin->used = used;
+}
+
+
+/*
+  Copy buffer data for an image.
+
+  \param dest   Destination or zero to only get the size.
+  \param fwd    Set to the number of header bytes before UBuffer::ptr.
+
+  \return Number of bytes or -1 if the buffer cannot be stored.
+*/
+static int _bufferImage( const UEnvImageMethods* im, const UBuffer* buf,
+                         uint8_t* dest, int* fwd )
+{
+    switch( buf->type )
+    {
+        case UT_BINARY:
+        case UT_BITSET:
+            return ur_binImage( buf, dest, fwd );
+
+        case UT_STRING:
+        case UT_FILE:
+        case UT_VECTOR:
+        case UT_BLOCK:
+        case UT_PAREN:
+        case UT_PATH:
+        case UT_LITPATH:
+        case UT_SETPATH:
+            return ur_arrImage( buf, dest, fwd );
+
+        case UT_CONTEXT:
+            return ur_ctxImage( buf, dest, fwd );
+
+        case UT_MAP:
+            return ur_mapImage( buf, dest, fwd );
+    }
+    if( buf->type >= UT_BI_COUNT && im && im->bufferImage )
+        return im->bufferImage( im->user, buf, dest, fwd );
+    return -1;
+}
+
+
+/*
+  Call UEnvImageMethods::cellImage on the cells of a buffer which are of
+  types not known to Urlan.
+
+  \return Non-zero if successful.
+*/
+static int _relocCells( const UEnvImageMethods* im, const UBuffer* buf,
+                        UCell* it, int load )
+{
+    UCell* end;
+
+    if( ! (IMAGE_CELL_MASK & (1 << buf->type)) )
+        return 1;
+    for( end = it + buf->used; it != end; ++it )
+    {
+        if( ur_type(it) >= UT_BI_COUNT )
+        {
+            if( ! im || ! im->cellImage || ! im->cellImage( im->user, it, load ) )
+                return 0;
+        }
+    }
+    return 1;
+}
+
+
+/**
+  Write the shared environment to an image file.
+
+  The environment must have been frozen with ur_freezeEnv().  An image
+  can only be loaded by the same build of the program which saved it.
+
+  \param file   Image file name.
+  \param im     Methods to handle datatypes not known to Urlan.
+                This may be zero if there are none.
+
+  \return UR_OK/UR_THROW
+*/
+int ur_saveEnvImage( UThread* ut, const char* file, const UEnvImageMethods* im )
+{
+    const UEnv* env = ut->env;
+    const UAtomTable* tab = &env->atoms;
+    const AtomRec* rec;
+    const UBuffer* buf;
+    UBuffer img;
+    UBuffer* brec;
+    ImageHead* head;
+    AtomImageRec* arec;
+    const char* err;
+    FILE* fp;
+    uint32_t n;
+    uint32_t bufOffset;
+    int size, fwd;
+    int ok;
+
+
+    if( ! env->dataStore.used )
+        return ur_error( ut, UR_ERR_SCRIPT, "Environment is not frozen" );
+
+    ur_binInit( &img, 64 * 1024 );
+    ur_binReserve( &img, sizeof(ImageHead) + tab->used * sizeof(AtomImageRec) );
+    img.used = sizeof(ImageHead) + tab->used * sizeof(AtomImageRec);
+
+    // Atoms.
+    for( n = 0; n < tab->used; ++n )
+    {
+        rec = ATOM_REC( tab, n );
+        arec = ((AtomImageRec*) (img.ptr.b + sizeof(ImageHead))) + n;
+        arec->hash    = rec->hash;
+        arec->nameLen = rec->nameLen;
+        arec->name    = img.used;
+        ur_binAppendData( &img, (const uint8_t*) rec->name, rec->nameLen + 1 );
+    }
+
+    // Buffer records.
+    _imageAlign( &img );
+    bufOffset = img.used;
+    size = env->dataStore.used * sizeof(UBuffer);
+    ur_binReserve( &img, img.used + size );
+    memCpy( img.ptr.b + img.used, env->dataStore.ptr.buf, size );
+    img.used += size;
+
+    // Buffer data.
+    buf = env->dataStore.ptr.buf;
+    for( n = 0; n < (uint32_t) env->dataStore.used; ++n, ++buf )
+    {
+        brec = ((UBuffer*) (img.ptr.b + bufOffset)) + n;
+        if( buf->type == UT_UNSET || ! buf->ptr.v )
+        {
+            brec->ptr.v = 0;
+            continue;
+        }
+
+        size = _bufferImage( im, buf, 0, &fwd );
+        if( size < 0 )
+        {
+            err = "Cannot save %s buffer in environment image";
+            goto fail;
+        }
+        _imageAlign( &img );
+        ur_binReserve( &img, img.used + size );
+        _bufferImage( im, buf, img.ptr.b + img.used, &fwd );
+        if( ! _relocCells( im, buf, (UCell*) (img.ptr.b + img.used + fwd), 0 ) )
+        {
+            err = "Cannot save %s cell in environment image";
+            goto fail;
+        }
+
+        brec = ((UBuffer*) (img.ptr.b + bufOffset)) + n;
+        brec->ptr.v = (void*) (uintptr_t) (img.used + fwd);
+        if( ur_isSeriesType( buf->type ) )
+            brec->flags &= ~(UR_BIN_MAPPED | UR_BUF_BORROWED);
+        img.used += size;
+    }
+
+    head = (ImageHead*) img.ptr.b;
+    _imageHead( head, env, im ? im->check : 0 );
+    head->atomCount  = tab->used;
+    head->bufCount   = env->dataStore.used;
+    head->atomOffset = sizeof(ImageHead);
+    head->bufOffset  = bufOffset;
+    head->size       = img.used;
+
+    fp = fopen( file, "wb" );
+    if( ! fp )
+    {
+        ur_binFree( &img );
+        return ur_error( ut, UR_ERR_ACCESS, "Could not open %s", file );
+    }
+    ok = (fwrite( img.ptr.b, 1, img.used, fp ) == (size_t) img.used);
+    if( fclose( fp ) )
+        ok = 0;
+    ur_binFree( &img );
+    if( ! ok )
+        return ur_error( ut, UR_ERR_ACCESS, "Could not write %s", file );
+    return UR_OK;
+
+fail:
+    ur_binFree( &img );
+    return ur_error( ut, UR_ERR_SCRIPT, err, ur_atomCStr( ut, buf->type ) );
+}
+
+
+/*
+  Map an image file into memory copy-on-write.
+
+  \return Non-zero if successful.
+*/
+static int _mapImage( UEnv* env, const char* file )
+{
+#ifdef _WIN32
+    FILE* fp;
+    long size;
+    int ok = 0;
+
+    fp = fopen( file, "rb" );
+    if( ! fp )
+        return 0;
+    if( fseek( fp, 0, SEEK_END ) == 0 && (size = ftell( fp )) > 0 )
+    {
+        rewind( fp );
+        env->image = (uint8_t*) memAlloc( size );
+        if( env->image )
+        {
+            env->imageSize = size;
+            ok = (fread( env->image, 1, size, fp ) == (size_t) size);
+        }
+    }
+    fclose( fp );
+    return ok;
+#else
+    struct stat info;
+    void* mem;
+    int fd;
+
+    fd = open( file, O_RDONLY );
+    if( fd < 0 )
+        return 0;
+    if( fstat( fd, &info ) || info.st_size <= 0 )
+    {
+        close( fd );
+        return 0;
+    }
+    mem = mmap( NULL, info.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE,
+                fd, 0 );
+    close( fd );
+    if( mem == MAP_FAILED )
+        return 0;
+    env->image     = (uint8_t*) mem;
+    env->imageSize = info.st_size;
+    return 1;
+#endif
+}
+
+
+static void _unmapImage( UEnv* env )
+{
+    if( env->image )
+    {
+#ifdef _WIN32
+        memFree( env->image );
+#else
+        munmap( env->image, env->imageSize );
+#endif
+        env->image = 0;
+        env->imageSize = 0;
+    }
+}
+
+
+static int _validImage( const UEnv* env, const ImageHead* head,
+                        const UEnvImageMethods* im )
+{
+    ImageHead expect;
+
+    if( env->imageSize < sizeof(ImageHead) )
+        return 0;
+    _imageHead( &expect, env, im ? im->check : 0 );
+    if( head->magic       != expect.magic       ||
+        head->version     != expect.version     ||
+        head->cellSize    != expect.cellSize    ||
+        head->bufferSize  != expect.bufferSize  ||
+        head->atomSize    != expect.atomSize    ||
+        head->pointerSize != expect.pointerSize ||
+        head->check       != expect.check       ||
+        head->typeCount   != expect.typeCount )
+        return 0;
+    if( head->size != env->imageSize || head->bufCount < 2 ||
+        head->atomOffset + head->atomCount * sizeof(AtomImageRec) >
+            head->bufOffset ||
+        head->bufOffset + head->bufCount * sizeof(UBuffer) > head->size )
+        return 0;
+    return 1;
+}
+
+
+/**
+  Make the shared environment from an image file written by
+  ur_saveEnvImage().  This is done instead of ur_freezeEnv() on a new
+  environment which has the same datatypes as the one which saved the image.
+
+  The image is mapped into memory (copy-on-write) and the shared buffers
+  point directly into it.  The image is released by ur_freeEnv().
+  If an error is thrown the environment is unusable and must be freed.
+
+  \param ut     UThread created with ur_makeEnv().
+  \param file   Image file name.
+  \param im     Methods to handle datatypes not known to Urlan.
+                This must match those passed to ur_saveEnvImage().
+
+  \return UR_OK/UR_THROW
+*/
+int ur_loadEnvImage( UThread* ut, const char* file, const UEnvImageMethods* im )
+{
+    UEnv* env = ut->env;
+    const ImageHead* head;
+    UBuffer* it;
+    UBuffer* end;
+    size_t off;
+
+    if( env->dataStore.used || env->image )
+        return ur_error( ut, UR_ERR_SCRIPT, "Environment is already frozen" );
+
+    if( ! _mapImage( env, file ) )
+        return ur_error( ut, UR_ERR_ACCESS, "Could not map image %s", file );
+
+    head = (const ImageHead*) env->image;
+    if( ! _validImage( env, head, im ) )
+        return ur_error( ut, UR_ERR_SCRIPT, "Invalid environment image %s",
+                         file );
+
+    if( ! _addImageAtoms( &env->atoms, env->image,
+                (const AtomImageRec*) (env->image + head->atomOffset),
+                head->atomCount ) )
+        return ur_error( ut, UR_ERR_SCRIPT, "Image %s atoms do not match",
+                         file );
+
+    ur_arrReserve( &env->dataStore, head->bufCount );
+    memCpy( env->dataStore.ptr.buf, env->image + head->bufOffset,
+            head->bufCount * sizeof(UBuffer) );
+
+    it  = env->dataStore.ptr.buf;
+    end = it + head->bufCount;
+    for( ; it != end; ++it )
+    {
+        if( it->ptr.v )
+        {
+            off = (uintptr_t) it->ptr.v;
+            if( off >= head->size )
+                goto invalid;
+            it->ptr.b = env->image + off;
+            if( ! _relocCells( im, it, it->ptr.cell, 1 ) )
+                goto invalid;
+        }
+    }
+    env->dataStore.used = head->bufCount;
+    return UR_OK;
+
+invalid:
+    return ur_error( ut, UR_ERR_SCRIPT, "Invalid environment image %s", file );
+}
+
+
+/*EOF*/
@@ -0,0 +1,492 @@
+/*
+  Copyright 2026 Karl Robillard
+
+  This file is part of the Urlan datatype system.
+
+  Urlan is free software: you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Urlan is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with Urlan.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/*
+  UBuffer members:
+    type        UT_MAP
+    elemSize    Recursion marker
+    form        Unused
+    flags       Unused
+    used        Number of cells used (two per key/value entry)
+    ptr.cell    Key & value cells
+    ptr.i[-1]   Number of cells available
+
+  The cells hold the entries in insertion order (key then value), so maps
+  are marked, made shared, and serialized just like blocks.  The cells are
+  followed by an open-addressed (linear probing) hash index with one MapSlot
+  per available cell, so the index is never more than half full.  The
+  number of cells available is always a power of two.
+
+  Removing an entry moves the last entry into its place.
+*/
+
+
+#include "env.h"
+#include "mem_util.h"
+
+
+typedef struct
+{
+    uint32_t hash;      // First key from ur_hashCell().
+    int32_t  index;     // Entry number or -1 if the slot is empty.
+}
+MapSlot;
+
+#define FORWARD         8
+#define MAP_AVAIL_MIN   8
+#define SLOTS(buf)      ((MapSlot*) ((buf)->ptr.cell + ur_avail(buf)))
+#define SLOT_MASK(buf)  (ur_avail(buf) - 1)
+
+
+/** \defgroup dt_map Datatype Map
+  \ingroup urlan
+  Maps are hash tables of key/value pairs.
+
+  Any value accepted by ur_hashCell() may be used as a key, and keys are
+  matched with ur_equal().  Series keys are not copied, so a string must not
+  be changed while it is used as a key.
+  @{
+*/
+
+/** \def ur_mapKey
+  Get pointer to key UCell of map entry.
+*/
+/** \def ur_mapValue
+  Get pointer to value UCell of map entry.
+*/
+/** \def ur_mapSize
+  Get number of entries in map.
+*/
+
+
+/**
+  Generate and initialize a single map.
+
+  If you need multiple buffers then ur_genBuffers() should be used.
+
+  \param size   Number of entries to reserve.
+
+  \return Buffer id of map.
+*/
+UIndex ur_makeMap( UThread* ut, int size )
+{
+    UIndex bufN;
+    ur_genBuffers( ut, 1, &bufN );
+    ur_mapInit( ur_buffer( bufN ), size );
+    return bufN;
+}
+
+
+/**
+  Generate a single map and set cell to reference it.
+
+  If you need multiple buffers then ur_genBuffers() should be used.
+
+  \param size   Number of entries to reserve.
+  \param cell   Cell to initialize.
+
+  \return Pointer to map buffer.
+*/
+UBuffer* ur_makeMapCell( UThread* ut, int size, UCell* cell )
+{
+    UBuffer* buf;
+    UIndex bufN;
+
+    ur_genBuffers( ut, 1, &bufN );
+    buf = ur_buffer( bufN );
+    ur_mapInit( buf, size );
+
+    ur_setId( cell, UT_MAP );
+    ur_setSeries( cell, bufN, 0 );
+
+    return buf;
+}
+
+
+/**
+  Initialize map buffer.
+
+  \param size   Number of entries to reserve.
+*/
+void ur_mapInit( UBuffer* buf, int size )
+{
+    buf->type     = UT_MAP;
+    buf->elemSize = 0;
+    buf->form     = 0;
+    buf->flags    = 0;
+    buf->used     = 0;
+    buf->ptr.v    = 0;
+
+    if( size > 0 )
+        ur_mapReserve( buf, size );
+}
+
+
+static void _slotInsert( MapSlot* slots, uint32_t mask, uint32_t hash,
+                         int32_t index )
+{
+    uint32_t i = hash & mask;
+    while( slots[i].index >= 0 )
+        i = (i + 1) & mask;
+    slots[i].hash  = hash;
+    slots[i].index = index;
+}
+
+
+/**
+  Allocates enough memory to hold size entries.
+  The buf->used member is not changed.
+
+  \param buf    Initialized map buffer.
+  \param size   Total number of entries.
+*/
+void ur_mapReserve( UBuffer* buf, int size )
+{
+    UCell* mem;
+    MapSlot* slots;
+    MapSlot* it;
+    MapSlot* end;
+    int avail = ur_testAvail( buf );
+    int na;
+
+    size *= 2;
+    if( size <= avail )
+        return;
+
+    na = MAP_AVAIL_MIN;
+    while( na < size )
+        na *= 2;
+
+    mem = (UCell*) memAlloc( FORWARD +
+                             na * (sizeof(UCell) + sizeof(MapSlot)) );
+    assert( mem );
+    mem = (UCell*) (((char*) mem) + FORWARD);
+    ((int32_t*) mem)[-1] = na;
+
+    slots = (MapSlot*) (mem + na);
+    memSet( slots, 0xff, na * sizeof(MapSlot) );
+
+    if( buf->ptr.v )
+    {
+        memCpy( mem, buf->ptr.cell, buf->used * sizeof(UCell) );
+
+        it  = SLOTS(buf);
+        end = it + avail;
+        for( ; it != end; ++it )
+        {
+            if( it->index >= 0 )
+                _slotInsert( slots, na - 1, it->hash, it->index );
+        }
+        memFree( buf->ptr.b - FORWARD );
+    }
+
+    buf->ptr.cell = mem;
+}
+
+
+/**
+  Free map data.
+
+  buf->ptr and buf->used are set to zero.
+*/
+void ur_mapFree( UBuffer* buf )
+{
+    if( buf->ptr.v )
+    {
+        memFree( buf->ptr.b - FORWARD );
+        buf->ptr.v = 0;
+    }
+    buf->used = 0;
+}
+
+
+/*
+  Copy map memory (including the header before ptr) for an environment
+  image.  Unused cells are zeroed.
+
+  \param buf   Map buffer with ptr set.
+  \param dest  Destination or zero to only get the size.
+  \param fwd   Set to the number of header bytes before ptr.
+
+  \return Number of bytes copied to dest.
+*/
+int ur_mapImage( const UBuffer* buf, uint8_t* dest, int* fwd )
+{
+    int avail = ur_avail(buf);
+    int size = FORWARD + avail * (sizeof(UCell) + sizeof(MapSlot));
+
+    *fwd = FORWARD;
+    if( dest )
+    {
+        UCell* cells = (UCell*) (dest + FORWARD);
+
+        memSet( dest, 0, size );
+        ((int32_t*) cells)[-1] = avail;
+        memCpy( cells, buf->ptr.cell, sizeof(UCell) * buf->used );
+        memCpy( cells + avail, SLOTS(buf), sizeof(MapSlot) * avail );
+    }
+    return size;
+}
+
+
+/**
+  Remove all entries from map.
+*/
+void ur_mapClear( UBuffer* buf )
+{
+    if( buf->ptr.v )
+        memSet( SLOTS(buf), 0xff, ur_avail(buf) * sizeof(MapSlot) );
+    buf->used = 0;
+}
+
+
+/*
+  Return slot index of key or -1 if not found.
+*/
+static int _slotLookup( UThread* ut, const UBuffer* buf, const UCell* key,
+                        const uint32_t* keys, int nk )
+{
+    const MapSlot* slots;
+    uint32_t mask;
+    uint32_t i;
+    int k;
+
+    if( ! buf->used )
+        return -1;
+
+    slots = SLOTS(buf);
+    mask  = SLOT_MASK(buf);
+    for( k = 0; k < nk; ++k )
+    {
+        for( i = keys[k] & mask; slots[i].index >= 0; i = (i + 1) & mask )
+        {
+            if( slots[i].hash == keys[k] &&
+                ur_equal( ut, key, ur_mapKey(buf, slots[i].index) ) )
+                return i;
+        }
+    }
+    return -1;
+}
+
+
+/**
+  Find entry with key.
+
+  \param buf    Initialized map buffer.
+  \param key    Key to look for.
+
+  \return Entry index or -1 if key is not found.
+*/
+int ur_mapLookup( UThread* ut, const UBuffer* buf, const UCell* key )
+{
+    uint32_t keys[2];
+    int nk;
+    int i;
+
+    if( (nk = ur_hashCell( ut, key, keys )) )
+    {
+        if( (i = _slotLookup( ut, buf, key, keys, nk )) >= 0 )
+            return SLOTS(buf)[ i ].index;
+    }
+    return -1;
+}
+
+
+/**
+  Set the value of a key, adding a new entry if the key is not found.
+
+  \param buf    Initialized map buffer.
+  \param key    Key.
+  \param val    Value.
+
+  \return UR_OK or UR_THROW if the key cannot be hashed.
+*/
+int ur_mapInsert( UThread* ut, UBuffer* buf, const UCell* key,
+                  const UCell* val )
+{
+    UCell* cell;
+    uint32_t keys[2];
+    int nk;
+    int i;
+
+    if( ! (nk = ur_hashCell( ut, key, keys )) )
+        return ur_error( ut, UR_ERR_TYPE, "map! key cannot be hashed" );
+
+    if( (i = _slotLookup( ut, buf, key, keys, nk )) >= 0 )
+    {
+        *ur_mapValue( buf, SLOTS(buf)[ i ].index ) = *val;
+        return UR_OK;
+    }
+
+    if( buf->used + 2 > ur_testAvail(buf) )
+    {
+        // Key & value may reference our cells which are about to move.
+        UCell tmp[2];
+        tmp[0] = *key;
+        tmp[1] = *val;
+        ur_mapReserve( buf, buf->used / 2 + 1 );
+        cell = buf->ptr.cell + buf->used;
+        cell[0] = tmp[0];
+        cell[1] = tmp[1];
+    }
+    else
+    {
+        cell = buf->ptr.cell + buf->used;
+        cell[0] = *key;
+        cell[1] = *val;
+    }
+
+    _slotInsert( SLOTS(buf), SLOT_MASK(buf), keys[0], buf->used / 2 );
+    buf->used += 2;
+    return UR_OK;
+}
+
+
+/*
+  Empty slot i and move any following slots of the probe chain back.
+*/
+static void _slotDelete( MapSlot* slots, uint32_t mask, uint32_t i )
+{
+    uint32_t j = i;
+    uint32_t home;
+
+    for(;;)
+    {
+        j = (j + 1) & mask;
+        if( slots[j].index < 0 )
+            break;
+        home = slots[j].hash & mask;
+        // Keep slot j if its home is cyclically in (i, j].
+        if( (i <= j) ? (i < home && home <= j) : (i < home || home <= j) )
+            continue;
+        slots[i] = slots[j];
+        i = j;
+    }
+    slots[i].index = -1;
+}
+
+
+/**
+  Remove entry with key.
+
+  The last entry is moved to the position of the removed one.
+
+  \param buf    Initialized map buffer.
+  \param key    Key to remove.
+
+  \return Non-zero if the key was found and removed.
+*/
+int ur_mapRemove( UThread* ut, UBuffer* buf, const UCell* key )
+{
+    MapSlot* slots;
+    uint32_t mask;
+    uint32_t keys[2];
+    uint32_t i;
+    int32_t entry, last;
+    int nk;
+    int si;
+
+    if( ! (nk = ur_hashCell( ut, key, keys )) )
+        return 0;
+    if( (si = _slotLookup( ut, buf, key, keys, nk )) < 0 )
+        return 0;
+
+    slots = SLOTS(buf);
+    mask  = SLOT_MASK(buf);
+    entry = slots[ si ].index;
+    _slotDelete( slots, mask, si );
+
+    last = buf->used / 2 - 1;
+    if( entry != last )
+    {
+        // Re-point the slot of the last entry before moving it.  If the key
+        // was changed after insertion this will scan the whole index.
+        const UCell* lkey = ur_mapKey( buf, last );
+        i = ur_hashCell( ut, lkey, keys ) ? (keys[0] & mask) : 0;
+        while( slots[i].index != last )
+            i = (i + 1) & mask;
+        slots[i].index = entry;
+
+        memCpy( ur_mapKey( buf, entry ), lkey, 2 * sizeof(UCell) );
+    }
+    buf->used -= 2;
+    return 1;
+}
+
+
+/**
+  Rebuild the hash index from the keys.
+
+  This must be called if entries are set without ur_mapInsert() (such as
+  when a map is unserialized).
+*/
+void ur_mapRehash( UThread* ut, UBuffer* buf )
+{
+    MapSlot* slots;
+    uint32_t mask;
+    uint32_t keys[2];
+    int i, n;
+
+    if( ! buf->ptr.v )
+        return;
+    slots = SLOTS(buf);
+    mask  = SLOT_MASK(buf);
+    memSet( slots, 0xff, ur_avail(buf) * sizeof(MapSlot) );
+
+    n = buf->used / 2;
+    for( i = 0; i < n; ++i )
+    {
+        if( ! ur_hashCell( ut, ur_mapKey(buf, i), keys ) )
+            keys[0] = 0;
+        _slotInsert( slots, mask, keys[0], i );
+    }
+}
+
+
+/**
+  Make a copy of a map.
+
+  \param src    Map to copy.  This may be in the shared environment.
+  \param cell   Cell to initialize.
+
+  \return Pointer to new map buffer.
+*/
+UBuffer* ur_mapClone( UThread* ut, const UCell* src, UCell* cell )
+{
+    UBuffer* buf;
+    const UBuffer* sbuf;
+    int avail;
+
+    buf = ur_makeMapCell( ut, 0, cell );
+    sbuf = ur_bufferSer( src );     // Re-aquire after ur_makeMapCell.
+    if( sbuf->used )
+    {
+        avail = ur_avail(sbuf);
+        ur_mapReserve( buf, avail / 2 );
+        memCpy( buf->ptr.cell, sbuf->ptr.cell,
+                avail * (sizeof(UCell) + sizeof(MapSlot)) );
+        buf->used = sbuf->used;
+    }
+    return buf;
+}
+
+
+/** @} */
+
+
+//EOF
@@ -49,6 +49,16 @@ typedef CONDITION_VARIABLE  OSCond;
 #define condWaitF(cond,mh)  (! SleepConditionVariableCS(&cond,&mh,INFINITE))
 #define condSignal(cond)    WakeConditionVariable(&cond)
 
+// Volatile access has acquire/release semantics with MSVC on x86.
+#define atomicLoadAcquire(ptr)      (*(volatile uint32_t*) (ptr))
+#define atomicStoreRelease(ptr,n) \
+    InterlockedExchange((volatile LONG*) (ptr), (LONG) (n))
+#define atomicLoadPtrAcquire(ptr)   (*(void* volatile*) (ptr))
+#define atomicStorePtrRelease(ptr,p) \
+    InterlockedExchangePointer((PVOID volatile*) (ptr), (p))
+#define atomicAddFetch(ptr,n) \
+    (InterlockedExchangeAdd((volatile LONG*) (ptr), (LONG) (n)) + (n))
+
 #else
 
 #include <pthread.h>
@@ -69,6 +79,12 @@ typedef pthread_cond_t      OSCond;
 #define condWaitF(cond,mh)  pthread_cond_wait(&cond,&mh)
 #define condSignal(cond)    pthread_cond_signal(&cond)
 
+#define atomicLoadAcquire(ptr)      __atomic_load_n(ptr, __ATOMIC_ACQUIRE)
+#define atomicStoreRelease(ptr,n)   __atomic_store_n(ptr, n, __ATOMIC_RELEASE)
+#define atomicLoadPtrAcquire(ptr)   __atomic_load_n(ptr, __ATOMIC_ACQUIRE)
+#define atomicStorePtrRelease(ptr,p) __atomic_store_n(ptr, p, __ATOMIC_RELEASE)
+#define atomicAddFetch(ptr,n)       __atomic_add_fetch(ptr, n, __ATOMIC_ACQ_REL)
+
 #endif
 
 
@@ -18,7 +18,7 @@
 */
 
 
-#include "urlan.h"
+#include "env.h"
 #include "urlan_atoms.h"
 #include "mem_util.h"
 
@@ -47,10 +47,495 @@ typedef struct
     int      exception;
     int      matchCase;
     int      ucs2;
+    struct RuleCache* cache;
 }
 StringParser;
 
 
+/*
+  Compiled Rules
+
+  Each rule block is compiled into a RuleProg the first time it is parsed.
+  The program holds the cell index where each alternative begins, so a
+  failed alternative jumps directly to the next one, and the set of
+  characters which can start a match of each alternative.  An alternative
+  whose first character is not in its set is skipped without descending
+  into its rules.  The first character sets are only built from literal
+  char!, string!, binary!, bitset! & block! values.  Rule words are still
+  looked up as they are matched, so changing the value of a word (even
+  from a paren) works as before.  Alternatives which may match without
+  consuming input or which begin with set-words, get-words, or parens are
+  always tried.
+
+  Programs are cached per thread by the address & size of their cells in a
+  small set-associative table, so a block and the sub-rules it uses can
+  be held at the same time.
+  A program keeps a copy of the rule cells along with the first characters
+  of the strings, bitsets & blocks it depends upon.  These are checked once
+  per ur_parseString() call and again after each paren is evaluated, and if
+  the rules have changed then the block is compiled again.
+*/
+
+#define RULE_CACHE_SIZE 256     // Must be a power of two.
+#define RULE_CACHE_WAYS 4       // Slots searched for each block.
+#define ALT_ANY         0x01    // First character cannot be predicted.
+#define DEP_EMPTY       0xffffffff
+#define DEP_ANY         0xfffffffe
+
+typedef struct
+{
+    uint32_t start;             // Cell index of first rule.
+    uint32_t flags;
+    uint8_t  first[ 32 ];       // Starting characters with /case.
+    uint8_t  firstNC[ 32 ];     // Starting characters without /case.
+}
+RuleAlt;
+
+typedef struct
+{
+    uint32_t cell;              // Index of string!/bitset!/block! cell.
+    uint32_t key;               // Value from _ruleDepKey().
+}
+RuleDep;
+
+typedef struct RuleProg RuleProg;
+
+struct RuleProg
+{
+    const UCell* cells;         // Cache key.
+    uint32_t count;             // Cache key.
+    uint32_t checked;           // Cache epoch when last validated.
+    uint32_t unionKey;          // Hash of all.first for parent RuleDep.
+    uint32_t active;            // Number of _parseStr() calls using this.
+    uint32_t compiling;
+    uint32_t altCount;
+    uint32_t depCount;
+    uint32_t* altOf;            // Alternative number of each cell.
+    RuleAlt* alts;
+    RuleDep* deps;
+    UCell* copy;                // Copy of cells to detect changes.
+    RuleAlt all;                // Union of alts.
+};
+
+struct RuleCache
+{
+    uint32_t epoch;
+    uint32_t victim;
+    RuleProg* prog[ RULE_CACHE_SIZE ];
+};
+
+
+static RuleProg* _ruleProg( UThread*, struct RuleCache*, const UCell*,
+                            uint32_t count );
+
+
+static void _ruleProgFree( RuleProg* prog )
+{
+    memFree( prog->copy );
+    memFree( prog );
+}
+
+
+/*
+  Free the compiled rules of a thread.
+*/
+void ur_parseFreeCache( UThread* ut )
+{
+    struct RuleCache* cache = (struct RuleCache*) ut->parseCache;
+    if( cache )
+    {
+        int i;
+        for( i = 0; i < RULE_CACHE_SIZE; ++i )
+        {
+            if( cache->prog[i] )
+                _ruleProgFree( cache->prog[i] );
+        }
+        memFree( cache );
+        ut->parseCache = NULL;
+    }
+}
+
+
+static uint32_t _hashBits( const uint8_t* it, int len, uint32_t h )
+{
+    while( len-- )
+        h = (h ^ *it++) * 16777619;
+    return h;
+}
+
+
+static void _setChar( RuleAlt* ra, int c )
+{
+    if( c < 256 )
+    {
+        ra->first[ c >> 3 ]   |= 1 << (c & 7);
+        ra->firstNC[ c >> 3 ] |= 1 << (c & 7);
+    }
+}
+
+
+/*
+  Return a key which changes if the first characters matched by the
+  string!, binary!, bitset!, or block! cell change.
+*/
+static uint32_t _ruleDepKey( UThread* ut, struct RuleCache* cache,
+                             const UCell* cell )
+{
+    switch( ur_type(cell) )
+    {
+        case UT_BINARY:
+        case UT_STRING:
+        {
+            USeriesIter si;
+            ur_seriesSlice( ut, &si, cell );
+            if( si.it >= si.end )
+                return DEP_EMPTY;
+            return (si.buf->type == UT_BINARY) ? si.buf->ptr.b[ si.it ]
+                                               : ur_strChar( si.buf, si.it );
+        }
+        case UT_BITSET:
+        {
+            const UBuffer* bin = ur_bufferSer( cell );
+            int len = (bin->used < 32) ? bin->used : 32;
+            return _hashBits( bin->ptr.b, len, 2166136261u ^ len );
+        }
+        case UT_BLOCK:
+        {
+            UBlockIter bi;
+            RuleProg* child;
+            ur_blkSlice( ut, &bi, cell );
+            child = _ruleProg( ut, cache, bi.it, bi.end - bi.it );
+            if( ! child || child->compiling || (child->all.flags & ALT_ANY) )
+                return DEP_ANY;
+            return child->unionKey;
+        }
+    }
+    return DEP_ANY;
+}
+
+
+/*
+  Add the first characters matched by a rule value to ra.
+
+  \return Non-zero if the characters are known.
+*/
+static int _ruleTermFirst( UThread* ut, struct RuleCache* cache,
+                           RuleProg* prog, uint32_t n, RuleAlt* ra )
+{
+    const UCell* cell = prog->cells + n;
+    RuleDep* dep;
+    int i;
+
+    switch( ur_type(cell) )
+    {
+        case UT_CHAR:
+            // The char is held in prog->copy so no RuleDep is needed.
+            if( ur_int(cell) >= 0 )
+                _setChar( ra, ur_int(cell) );
+            return 1;
+
+        case UT_BINARY:
+        case UT_STRING:
+        {
+            USeriesIter si;
+            int c, lc;
+
+            ur_seriesSlice( ut, &si, cell );
+            if( si.it < si.end )
+            {
+                c = (si.buf->type == UT_BINARY) ? si.buf->ptr.b[ si.it ]
+                                                : ur_strChar( si.buf, si.it );
+                if( c < 256 )
+                    ra->first[ c >> 3 ] |= 1 << (c & 7);
+                lc = ur_charLowercase( c );
+                for( i = 0; i < 256; ++i )
+                {
+                    if( ur_charLowercase( i ) == lc )
+                        ra->firstNC[ i >> 3 ] |= 1 << (i & 7);
+                }
+            }
+        }
+            break;
+
+        case UT_BITSET:
+        {
+            const UBuffer* bin = ur_bufferSer( cell );
+            for( i = 0; i < 32; ++i )
+            {
+                // Bits past the end are unknown, so allow them.
+                int bits = (i < bin->used) ? bin->ptr.b[ i ] : 0xff;
+                ra->first[ i ]   |= bits;
+                ra->firstNC[ i ] |= bits;
+            }
+        }
+            break;
+
+        case UT_BLOCK:
+        {
+            UBlockIter bi;
+            RuleProg* child;
+
+            ur_blkSlice( ut, &bi, cell );
+            child = _ruleProg( ut, cache, bi.it, bi.end - bi.it );
+            if( ! child || child->compiling || (child->all.flags & ALT_ANY) )
+                return 0;
+            for( i = 0; i < 32; ++i )
+            {
+                ra->first[ i ]   |= child->all.first[ i ];
+                ra->firstNC[ i ] |= child->all.firstNC[ i ];
+            }
+        }
+            break;
+
+        default:
+            return 0;
+    }
+
+    dep = prog->deps + prog->depCount++;
+    dep->cell = n;
+    dep->key  = _ruleDepKey( ut, cache, cell );
+    return 1;
+}
+
+
+/*
+  Set the first characters of the alternative which begins at cell n and
+  ends before cell end.
+
+  \return Non-zero if the characters are known.
+*/
+static int _ruleAltFirst( UThread* ut, struct RuleCache* cache,
+                          RuleProg* prog, uint32_t n, uint32_t end,
+                          RuleAlt* ra )
+{
+    const UCell* cell;
+
+    if( n >= end )
+        return 0;       // Empty alternative always matches.
+    cell = prog->cells + n;
+
+    switch( ur_type(cell) )
+    {
+        case UT_WORD:
+            if( ur_atom(cell) == UR_ATOM_SOME && n + 1 < end )
+                return _ruleTermFirst( ut, cache, prog, n + 1, ra );
+            break;
+
+        case UT_INT:
+            if( ur_int(cell) < 1 || ++n >= end )
+                break;
+            cell = prog->cells + n;
+            if( ur_is(cell, UT_INT) )
+            {
+                if( ++n >= end )
+                    break;
+            }
+            else if( ur_is(cell, UT_WORD) && ur_atom(cell) == UR_ATOM_SKIP )
+                break;
+            return _ruleTermFirst( ut, cache, prog, n, ra );
+
+        case UT_CHAR:
+        case UT_BINARY:
+        case UT_STRING:
+        case UT_BITSET:
+        case UT_BLOCK:
+            return _ruleTermFirst( ut, cache, prog, n, ra );
+    }
+    return 0;
+}
+
+
+static RuleProg* _ruleCompile( UThread* ut, struct RuleCache* cache,
+                               RuleProg** slot,
+                               const UCell* cells, uint32_t count )
+{
+    RuleProg* prog;
+    RuleAlt* ra;
+    uint32_t altCount = 1;
+    uint32_t i, n, end;
+
+    for( i = 0; i < count; ++i )
+    {
+        if( ur_is(cells + i, UT_WORD) && ur_atom(cells + i) == UR_ATOM_BAR )
+            ++altCount;
+    }
+
+    prog = (RuleProg*) memAlloc( sizeof(RuleProg) );
+    prog->copy  = (UCell*) memAlloc( count * (sizeof(UCell) +
+                                              sizeof(RuleDep) +
+                                              sizeof(uint32_t)) +
+                                     altCount * sizeof(RuleAlt) );
+    prog->alts  = (RuleAlt*) (prog->copy + count);
+    prog->deps  = (RuleDep*) (prog->alts + altCount);
+    prog->altOf = (uint32_t*) (prog->deps + count);
+    memCpy( prog->copy, cells, count * sizeof(UCell) );
+
+    prog->cells     = cells;
+    prog->count     = count;
+    prog->checked   = cache->epoch;
+    prog->active    = 0;
+    prog->compiling = 1;
+    prog->altCount  = altCount;
+    prog->depCount  = 0;
+    memSet( prog->alts, 0, altCount * sizeof(RuleAlt) );
+    memSet( &prog->all, 0, sizeof(RuleAlt) );
+
+    for( i = n = 0; i < count; ++i )
+    {
+        prog->altOf[ i ] = n;
+        if( ur_is(cells + i, UT_WORD) && ur_atom(cells + i) == UR_ATOM_BAR )
+            prog->alts[ ++n ].start = i + 1;
+    }
+
+    // Store in cache before compiling any child blocks so that a block
+    // which contains itself is not compiled again.
+    *slot = prog;
+
+    for( n = 0; n < altCount; ++n )
+    {
+        ra = prog->alts + n;
+        end = (n + 1 < altCount) ? prog->alts[ n + 1 ].start - 1 : count;
+        if( ! _ruleAltFirst( ut, cache, prog, ra->start, end, ra ) )
+            ra->flags |= ALT_ANY;
+
+        prog->all.flags |= ra->flags;
+        for( i = 0; i < 32; ++i )
+        {
+            prog->all.first[ i ]   |= ra->first[ i ];
+            prog->all.firstNC[ i ] |= ra->firstNC[ i ];
+        }
+    }
+    prog->unionKey = _hashBits( prog->all.first, 64, 2166136261u );
+    prog->compiling = 0;
+    return prog;
+}
+
+
+/*
+  Check that the cells & dependencies of a program have not changed.
+*/
+static int _ruleValid( UThread* ut, struct RuleCache* cache, RuleProg* prog )
+{
+    const RuleDep* it;
+    const RuleDep* end;
+
+    if( prog->checked == cache->epoch )
+        return 1;
+    if( memcmp( prog->copy, prog->cells, prog->count * sizeof(UCell) ) )
+        return 0;
+
+    prog->checked = cache->epoch;   // Set now to stop any recursion.
+    it  = prog->deps;
+    end = it + prog->depCount;
+    for( ; it != end; ++it )
+    {
+        if( _ruleDepKey( ut, cache, prog->cells + it->cell ) != it->key )
+        {
+            prog->checked = cache->epoch - 1;
+            return 0;
+        }
+    }
+    return 1;
+}
+
+
+/*
+  Get the compiled program for rule cells.
+
+  \return Program pointer or NULL if the program is in use and cannot be
+          replaced.
+*/
+static RuleProg* _ruleProg( UThread* ut, struct RuleCache* cache,
+                            const UCell* cells, uint32_t count )
+{
+    RuleProg** set;
+    RuleProg** slot = NULL;
+    RuleProg* prog;
+    uint32_t h;
+    int i;
+
+    h = (uint32_t) ((uintptr_t) cells / sizeof(UCell)) * 2654435761u + count;
+    set = cache->prog + ((h >> 16) & (RULE_CACHE_SIZE - RULE_CACHE_WAYS));
+
+    for( i = 0; i < RULE_CACHE_WAYS; ++i )
+    {
+        prog = set[ i ];
+        if( ! prog )
+        {
+            if( ! slot )
+                slot = set + i;
+        }
+        else if( prog->cells == cells && prog->count == count )
+        {
+            if( _ruleValid( ut, cache, prog ) )
+                return prog;
+            if( prog->active || prog->compiling )
+                return NULL;
+            slot = set + i;
+            goto replace;
+        }
+    }
+
+    if( ! slot )
+    {
+        // Evict a program which is not in use.
+        for( i = 0; i < RULE_CACHE_WAYS; ++i )
+        {
+            slot = set + (cache->victim++ & (RULE_CACHE_WAYS - 1));
+            prog = *slot;
+            if( ! prog->active && ! prog->compiling )
+                goto replace;
+        }
+        return NULL;
+    }
+    return _ruleCompile( ut, cache, slot, cells, count );
+
+replace:
+    _ruleProgFree( *slot );
+    *slot = NULL;
+    return _ruleCompile( ut, cache, slot, cells, count );
+}
+
+
+/*
+  Return the first alternative from alt onward which may match at pos,
+  or prog->altCount if none can.
+*/
+static uint32_t _ruleAltNext( const RuleProg* prog, const StringParser* pe,
+                              UIndex pos, uint32_t alt )
+{
+    const RuleAlt* ra;
+    const uint8_t* set;
+    int c;
+
+    if( pe->ucs2 )
+        return alt;
+
+    c = (pos < pe->inputEnd) ? pe->str->ptr.b[ pos ] : -1;
+    if( ! (prog->all.flags & ALT_ANY) )
+    {
+        // Check the union of all alternatives first.
+        set = pe->matchCase ? prog->all.first : prog->all.firstNC;
+        if( c < 0 || ! bitIsSet( set, c ) )
+            return prog->altCount;
+    }
+
+    for( ; alt < prog->altCount; ++alt )
+    {
+        ra = prog->alts + alt;
+        if( ra->flags & ALT_ANY )
+            break;
+        if( c >= 0 )
+        {
+            set = pe->matchCase ? ra->first : ra->firstNC;
+            if( bitIsSet( set, c ) )
+                break;
+        }
+    }
+    return alt;
+}
+
+
 /*
   Return number of characters advanced.
 */
@@ -137,19 +622,34 @@ SCAN_BITSET(uint16_t)
     if( ! cell ) \
         goto parse_err;
 
+static const UCell* _parseRules( UThread*, StringParser*,
+                                 const UCell* rit, const UCell* rend,
+                                 UIndex* spos );
+
 /*
   Returns zero if matching rule not found or exception occured.
 */
 static const UCell* _parseStr( UThread* ut, StringParser* pe,
+                               RuleProg* prog,
                                const UCell* rit, const UCell* rend,
                                UIndex* spos )
 {
     const UCell* tval;
+    const UCell* rstart = rit;
     int32_t repMin;
     int32_t repMax;
+    uint32_t alt;
     UBuffer* istr = pe->str;
     UIndex pos = *spos;
 
+    if( prog )
+    {
+        alt = _ruleAltNext( prog, pe, pos, 0 );
+        if( alt >= prog->altCount )
+            return 0;
+        rit = rstart + prog->alts[ alt ].start;
+    }
+
 
 match:
 
@@ -365,7 +865,7 @@ match_block:
                 UBlockIter bi;
                 UIndex rblkN = tval->series.buf;
                 ur_blkSlice( ut, &bi, tval );
-                tval = _parseStr( ut, pe, bi.it, bi.end, &pos );
+                tval = _parseRules( ut, pe, bi.it, bi.end, &pos );
                 istr = pe->str;
                 if( ! tval )
                 {
@@ -387,6 +887,12 @@ match_block:
                 if( UR_OK != pe->eval( ut, rit ) )
                     goto parse_err;
 
+                // The paren may have changed any rule, so the cached
+                // programs must be validated again before use.
+                ++pe->cache->epoch;
+                if( prog && ! _ruleValid( ut, pe->cache, prog ) )
+                    prog = NULL;
+
                 /* Re-acquire pointer & check if input modified. */
                 istr = pe->str = ur_buffer( pe->inputBuf );
                 if( pe->sliced )
@@ -545,7 +1051,7 @@ repeat:
                 {
                     if( pos >= pe->inputEnd )
                         break;
-                    if( ! _parseStr( ut, pe, bli.it, bli.end, &pos ) )
+                    if( ! _parseRules( ut, pe, bli.it, bli.end, &pos ) )
                     {
                         if( pe->exception == PARSE_EX_ERROR )
                         {
@@ -578,6 +1084,20 @@ repeat:
 
 failed:
 
+    if( prog )
+    {
+        // Goto next alternative which can match.
+        alt = (rit < rend) ? prog->altOf[ rit - rstart ] + 1 : prog->altCount;
+        pos = *spos;
+        alt = _ruleAltNext( prog, pe, pos, alt );
+        if( alt < prog->altCount )
+        {
+            rit = rstart + prog->alts[ alt ].start;
+            goto match;
+        }
+        return 0;
+    }
+
     // Goto next rule; search for '|'.
 
     for( ; rit != rend; ++rit )
@@ -601,6 +1121,22 @@ parse_err:
 }
 
 
+static const UCell* _parseRules( UThread* ut, StringParser* pe,
+                                 const UCell* rit, const UCell* rend,
+                                 UIndex* spos )
+{
+    RuleProg* prog = _ruleProg( ut, pe->cache, rit, rend - rit );
+    if( prog )
+    {
+        ++prog->active;
+        rit = _parseStr( ut, pe, prog, rit, rend, spos );
+        --prog->active;
+        return rit;
+    }
+    return _parseStr( ut, pe, NULL, rit, rend, spos );
+}
+
+
 /** \defgroup urlan_dsl  Domain Languages
   \ingroup urlan
   These are small, special purpose evaluators.
@@ -641,9 +1177,17 @@ int ur_parseString( UThread* ut, UBuffer* str, UIndex start, UIndex end,
     p.matchCase = matchCase ? UR_FIND_CASE : 0;
     p.ucs2      = (str->type == UT_STRING) && ur_strIsUcs2(str);
 
+    if( ! ut->parseCache )
+    {
+        ut->parseCache = memAlloc( sizeof(struct RuleCache) );
+        memSet( ut->parseCache, 0, sizeof(struct RuleCache) );
+    }
+    p.cache = ut->parseCache;
+    ++p.cache->epoch;
+
     *parsePos = start;
-    _parseStr( ut, &p, ruleBlk->ptr.cell,
-                       ruleBlk->ptr.cell + ruleBlk->used, parsePos );
+    _parseRules( ut, &p, ruleBlk->ptr.cell,
+                         ruleBlk->ptr.cell + ruleBlk->used, parsePos );
     return (p.exception == PARSE_EX_ERROR) ? UR_THROW : UR_OK;
 }
 
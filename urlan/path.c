@@ -129,6 +129,8 @@ int ur_setPath( UThread* ut, const UCell* path, const UCell* src )
     UBlockIterM bi;
     UBuffer* buf;
     UCell* node = 0;
+    const UCell* key;
+    int t;
 
     ur_blkSliceM( ut, &bi, path );
 
@@ -139,8 +141,8 @@ int ur_setPath( UThread* ut, const UCell* path, const UCell* src )
             case UT_INT:
                 if( node )
                 {
-                    int t = ur_type(node);
                     int index = ur_int(bi.it) - 1;
+                    t = ur_type(node);
                     if( ur_isBlockType(t) )
                     {
                         if( ! (buf = ur_bufferSerM(node)) )
@@ -171,6 +173,8 @@ int ur_setPath( UThread* ut, const UCell* path, const UCell* src )
                     {
                         return coord_poke( ut, node, index, src );
                     }
+                    else if( t == UT_MAP )
+                        goto map_node;
                 }
                 goto err;
 
@@ -195,6 +199,20 @@ int ur_setPath( UThread* ut, const UCell* path, const UCell* src )
                         if( ! node )
                             goto err;
                     }
+                    else if( ur_is(node, UT_MAP) )
+                    {
+map_node:
+                        key = bi.it;
+map_key:
+                        if( ! (buf = ur_bufferSerM(node)) )
+                            return UR_THROW;
+                        if( bi.it + 1 == bi.end )
+                            return ur_mapInsert( ut, buf, key, src );
+                        t = ur_mapLookup( ut, buf, key );
+                        if( t < 0 )
+                            goto err;
+                        node = ur_mapValue( buf, t );
+                    }
                     else
                         goto err;
                 }
@@ -212,7 +230,13 @@ int ur_setPath( UThread* ut, const UCell* path, const UCell* src )
                 break;
 
             case UT_GETWORD:
-                //break;
+                if( node && ur_is(node, UT_MAP) )
+                {
+                    if( ! (key = ur_wordCell( ut, bi.it )) )
+                        return UR_THROW;
+                    goto map_key;
+                }
+                goto err;
 
             default:
                 goto err;
@@ -47,6 +47,7 @@ shlib %urlan [
         %path.c
         %string.c
         %context.c
+        %map.c
         %gc.c
         %serialize.c
         %tokenize.c
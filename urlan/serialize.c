@@ -20,10 +20,44 @@
 
 #include "urlan.h"
 #include "os.h"
+#include "env.h"
+#include "urlan_atoms.h"
 
 
 /*
-    Example serialized data for [1 "hello" [a plan]]
+  Serialized data format, version 2 ("BOR2")
+
+  All values are in the native byte order of the writer, and every section
+  is aligned to 16 bytes from the start of the data.  Payloads are preceded
+  by their length so that string, binary, vector, and block data can be
+  used in place by the buffers of ur_unserialize().
+
+    SerialHead      Header (32 bytes).
+    SerialBuf       Buffer record (16 bytes) followed by its payload.
+    ...             Next record.  The first buffer is the root block.
+    Atoms           Names, each a byte count followed by the characters.
+
+  Payloads by buffer type:
+
+    binary!, bitset!, string!, file!, vector!   Elements.
+    block!, paren!, path!, ...                  Cells.
+    map!                                        Cells (key/value pairs).
+    context!                                    Word atom numbers (uint32_t)
+                                                padded to 16 bytes, then
+                                                the value cells.
+
+  Cells are stored as UCells with any unused members zeroed.  Atoms and
+  buffer references are numbers in the serialized atom & buffer lists.
+  Words are unbound unless bound to a thread context (UR_BIND_THREAD).
+
+  A stream (see ur_serialWrite) is a series of these, one per value, where
+  the root block holds just that value.  Each only lists the atoms which
+  are new to the stream; atom numbers below SerialHead.atomBase refer to
+  those of the previous values.  Buffers are never shared between values.
+
+
+  Version 1 data ("BOR1") is packed and is only read.  An example for
+  [1 "hello" [a plan]]:
 
     424F5231        ; "BOR1"
     00000026        ; Atoms string offset
@@ -47,19 +81,49 @@
 
 typedef struct
 {
-    UBuffer atomMap;
-    UBuffer bufMap;
-    UBuffer ctxAtoms;   // Temporary buffer for ur_ctxWordAtoms().
+    char     magic[4];      // "BOR2"
+    uint16_t order;         // SER_ORDER in the byte order of the writer.
+    uint8_t  version;
+    uint8_t  atomSize;      // sizeof(UAtom)
+    uint32_t size;          // Total bytes.
+    uint32_t bufCount;
+    uint32_t atomCount;
+    uint32_t atomOffset;
+    uint32_t atomBase;      // Number of the first atom listed.
+    uint32_t _pad;
 }
-Serializer;
+SerialHead;
 
 
 typedef struct
 {
-    UIndex bufN;
-    //UIndex offset;
+    uint8_t  type;
+    uint8_t  form;
+    uint8_t  elemSize;
+    uint8_t  _pad;
+    uint32_t bytes;         // Payload size.
+    uint32_t offset;        // Payload position (ptr.i[-2] when borrowed).
+    uint32_t used;          // Element count (ptr.i[-1] when borrowed).
 }
-BufferIndex;
+SerialBuf;
+
+
+#define SER_VERSION     1
+#define SER_ORDER       0x0102
+#define SER_NO_BUF      0xffffffff
+#define SER_ALIGN(n)    (((n) + 15) & ~15)
+
+
+/*
+  USerialWriter members:
+
+    atomMap     Atoms in serialized order.
+    atomHash    Positions in atomMap + 1, or zero if empty.
+    bufMap      Buffer ids in serialized order.
+    bufHash     Positions in bufMap + 1, or zero if empty.
+    ctxAtoms    Temporary buffer for ur_ctxWordAtoms().
+*/
+typedef USerialWriter   Serializer;
 
 
 enum SeriesRange
@@ -70,368 +134,407 @@ enum SeriesRange
 };
 
 
-/*
-  Add atom to map if it's not present.
-
-  Returns atom index in serialized data.
-*/
-static int _mapAtom( Serializer* ser, UAtom atom )
+static void _initKeyMap( UBuffer* list, UBuffer* hash )
 {
-    UBuffer* map = &ser->atomMap;
-    UAtom* it  = map->ptr.u16;
-    UAtom* end = it + map->used;
-
-    for( ; it != end; ++it )
-    {
-        if( *it == atom )
-            return it - map->ptr.u16;
-    }
-
-    ur_arrReserve( map, map->used + 1 );
-    map->ptr.u16[ map->used++ ] = atom;
-    return map->used - 1;
+    ur_arrInit( list, sizeof(uint32_t), 0 );
+    ur_arrInit( hash, sizeof(uint32_t), 64 );
+    memSet( hash->ptr.u32, 0, 64 * sizeof(uint32_t) );
+    hash->used = 64;
 }
 
 
 /*
-  Add buffer to map if it's not present.
-
-  Returns buffer index in serialized data.
+  Empty the list, shrinking the hash table if a large value was seen.
 */
-static int _mapBuffer( Serializer* ser, UIndex bufN )
+static void _resetKeyMap( UBuffer* list, UBuffer* hash )
 {
-#define mapBegin    ur_ptr(BufferIndex, map)
-    UBuffer* map = &ser->bufMap;
-    BufferIndex* it  = mapBegin;
-    BufferIndex* end = it + map->used;
-
-    for( ; it != end; ++it )
-    {
-        if( it->bufN == bufN )
-            return it - mapBegin;
-    }
-
-    ur_arrExpand1( BufferIndex, map, it );
-    it->bufN = bufN;
-    //it->offset = 0;
-    return it - mapBegin;
+    list->used = 0;
+    if( hash->used > 1024 )
+        hash->used = 64;
+    memSet( hash->ptr.u32, 0, hash->used * sizeof(uint32_t) );
 }
 
 
-static inline uint32_t _zigZag32( int32_t n )
-{
-    return (n < 0) ? (((uint32_t)(-n)) << 1) - 1 : ((uint32_t) n) << 1;
-}
-
+#define _hashKey(key)   ((key) * 2654435761u)
 
-static inline int32_t _undoZigZag32( uint32_t n )
+static void _rehashKeys( const UBuffer* list, UBuffer* hash )
 {
-    return (n & 1) ? -(n >> 1) - 1 : n >> 1;
-}
-
+    uint32_t mask = hash->used - 1;
+    uint32_t i, k;
 
-static void _pokeU32( uint8_t* bp, uint32_t n )
-{
-    *bp++ = n >> 24;
-    *bp++ = n >> 16;
-    *bp++ = n >>  8;
-    *bp   = n;
+    memSet( hash->ptr.u32, 0, hash->used * sizeof(uint32_t) );
+    for( k = 0; k < (uint32_t) list->used; ++k )
+    {
+        i = _hashKey( list->ptr.u32[ k ] ) & mask;
+        while( hash->ptr.u32[ i ] )
+            i = (i + 1) & mask;
+        hash->ptr.u32[ i ] = k + 1;
+    }
 }
 
+/*
+  Get the position of key in list, appending it if it is not present.
 
-static void _pushU32( UBuffer* bin, uint32_t n )
+  Returns position of key in the serialized list.
+*/
+static uint32_t _mapKey( UBuffer* list, UBuffer* hash, uint32_t key )
 {
-    uint8_t* bp = bin->ptr.b + bin->used;
+    uint32_t mask = hash->used - 1;
+    uint32_t i = _hashKey(key) & mask;
+    uint32_t n;
+
+    while( (n = hash->ptr.u32[ i ]) )
+    {
+        if( list->ptr.u32[ n - 1 ] == key )
+            return n - 1;
+        i = (i + 1) & mask;
+    }
 
-    *bp++ = n >> 24;
-    *bp++ = n >> 16;
-    *bp++ = n >>  8;
-    *bp   = n;
+    n = list->used;
+    ur_arrReserve( list, n + 1 );
+    list->ptr.u32[ list->used++ ] = key;
+    hash->ptr.u32[ i ] = n + 1;
 
-    bin->used += 4;
+    if( list->used * 2 > hash->used )
+    {
+        // Double the table size & re-insert all the keys.
+        ur_arrReserve( hash, hash->used * 2 );
+        hash->used *= 2;
+        _rehashKeys( list, hash );
+    }
+    return n;
 }
 
 
-static void _pushU64( UBuffer* bin, uint64_t* src )
-{
-#ifdef __BIG_ENDIAN__
-    uint8_t* bp = bin->ptr.b + bin->used;
-    uint8_t* sp = (uint8_t*) src;
-    *bp++ = sp[7];
-    *bp++ = sp[6];
-    *bp++ = sp[5];
-    *bp++ = sp[4];
-    *bp++ = sp[3];
-    *bp++ = sp[2];
-    *bp++ = sp[1];
-    *bp   = sp[0];
-#else
-    memCpy( bin->ptr.b + bin->used, src, 8 );
-#endif
-    bin->used += 8;
-}
+#define _mapAtom(ser,atom) \
+    _mapKey( &(ser)->atomMap, &(ser)->atomHash, atom )
+#define _mapBuffer(ser,bufN) \
+    _mapKey( &(ser)->bufMap, &(ser)->bufHash, (uint32_t) (bufN) )
 
 
-enum Pack32Count
+/*
+  Set dst to the serialized form of cell src.
+
+  Return zero if successful or unknown data type.
+*/
+static int _packCell( Serializer* ser, UCell* dst, const UCell* src )
 {
-    PACK_1   = 0,
-    PACK_2   = 0x40,
-    PACK_3   = 0x80,
-    PACK_5   = 0xc0,
-    PACK_ANY = 0xc0
-};
+    int type = ur_type(src);
 
+    memSet( dst, 0, sizeof(UCell) );
+    dst->id.type  = type;
+    dst->id.flags = src->id.flags & ~UR_FLAG_PRINT_RECURSION;
 
-static void _packU32( UBuffer* bin, uint32_t n )
-{
-    uint8_t* bp = bin->ptr.b + bin->used;
-    if( n <= 0x3f )
+    switch( type )
     {
-        *bp++ = n;
-    }
-    else
+    case UT_UNSET:
+    case UT_NONE:
+        break;
+
+    case UT_DATATYPE:
+        dst->datatype.n     = src->datatype.n;
+        dst->datatype.mask0 = src->datatype.mask0;
+        dst->datatype.mask1 = src->datatype.mask1;
+        dst->datatype.mask2 = src->datatype.mask2;
+        break;
+
+    case UT_LOGIC:
+    case UT_CHAR:
+    case UT_INT:
+        ur_int(dst) = ur_int(src);
+        break;
+
+    case UT_DECIMAL:
+    case UT_TIME:
+    case UT_DATE:
+        ur_decimal(dst) = ur_decimal(src);
+        break;
+
+    case UT_BIGNUM:
+        *dst = *src;        // Limbs fill the cell after the flags.
+        break;
+
+    case UT_COORD:
+    case UT_TIMECODE:
     {
-        if( n <= 0x3fff )
+        int i, len = 4;
+        if( type == UT_COORD )
         {
-            *bp++ = PACK_2 | (n >> 8);
+            len = src->coord.len;
+            if( len > UR_COORD_MAX )
+                return type;
+            dst->coord.len = len;
         }
-        else
+        for( i = 0; i < len; ++i )
+            dst->coord.n[ i ] = src->coord.n[ i ];
+    }
+        break;
+
+    case UT_VEC3:
+        dst->vec3.xyz[0] = src->vec3.xyz[0];
+        dst->vec3.xyz[1] = src->vec3.xyz[1];
+        dst->vec3.xyz[2] = src->vec3.xyz[2];
+        break;
+
+    case UT_WORD:
+    case UT_LITWORD:
+    case UT_SETWORD:
+    case UT_GETWORD:
+    case UT_OPTION:
+        dst->word.ctx = SER_NO_BUF;
+        switch( ur_binding(src) )
         {
-            if( n <= 0x3fffff )
-            {
-                *bp++ = PACK_3 | (n >> 16);
-            }
-            else
-            {
-                *bp++ = PACK_5;
-                *bp++ = n >> 24;
-                *bp++ = n >> 16;
-            }
-            *bp++ = n >> 8;
+            case UR_BIND_THREAD:
+            case UR_BIND_ENV:
+                // Avoiding global contexts (BUF_THREAD_CTX) for now.
+                if( src->word.ctx > 1 || src->word.ctx < -1 )
+                {
+                    ur_binding(dst) = UR_BIND_THREAD;
+                    dst->word.ctx = _mapBuffer( ser, src->word.ctx );
+                    dst->word.index = src->word.index;
+                }
+                break;
         }
-        *bp++ = n;
+        ur_atom(dst) = _mapAtom( ser, ur_atom(src) );
+        break;
+
+    case UT_BINARY:
+    case UT_BITSET:
+    case UT_STRING:
+    case UT_FILE:
+    case UT_VECTOR:
+    case UT_BLOCK:
+    case UT_PAREN:
+    case UT_PATH:
+    case UT_LITPATH:
+    case UT_SETPATH:
+        dst->series.buf = _mapBuffer( ser, src->series.buf );
+        dst->series.it  = src->series.it;
+        dst->series.end = src->series.end;
+        break;
+
+    case UT_CONTEXT:
+    case UT_MAP:
+        dst->series.buf = _mapBuffer( ser, src->series.buf );
+        dst->series.end = -1;
+        break;
+
+    case UT_ERROR:
+        dst->error.exType = src->error.exType;
+        dst->error.messageStr = (src->error.messageStr == UR_INVALID_BUF) ?
+            SER_NO_BUF : _mapBuffer( ser, src->error.messageStr );
+        dst->error.traceBlk = (src->error.traceBlk == UR_INVALID_BUF) ?
+            SER_NO_BUF : _mapBuffer( ser, src->error.traceBlk );
+        break;
+
+    default:
+        return type;
     }
-    bin->used = bp - bin->ptr.b;
+    return 0;
 }
 
 
-#define push8(N)    bin->ptr.b[ bin->used++ ] = N
-#define pushU32(N)  _pushU32( bin, N )
-#define packU32(N)  _packU32( bin, N )
-#define packS32(N)  _packU32( bin, _zigZag32(N) )
-
 /*
+  Append serialized cells to bin, which must have space reserved for them.
+
   Return zero if successful or unknown data type.
 */
-static int _serializeBlock( Serializer* ser, UBuffer* bin, const UBuffer* blk )
+static int _serializeCells( Serializer* ser, UBuffer* bin,
+                            const UCell* it, const UCell* end )
 {
-    UBlockIter bi;
-
-    bi.it  = blk->ptr.cell;
-    bi.end = bi.it + blk->used;
+    UCell tmp;
+    uint8_t* out = bin->ptr.b + bin->used;
+    int type;
 
-    ur_foreach( bi ) 
+    // Binary data is only 4 byte aligned so cells are packed on the stack.
+    for( ; it != end; ++it, out += sizeof(UCell) )
     {
-        int type = ur_type(bi.it);
-
-        ur_binReserve( bin, bin->used + 12 );
-        push8( type | ur_flags(bi.it, UR_FLAG_SOL) );
-
-        switch( type )
-        {
-        case UT_UNSET:
-            break;
+        if( (type = _packCell( ser, &tmp, it )) )
+            return type;
+        memCpy( out, &tmp, sizeof(UCell) );
+    }
+    bin->used = out - bin->ptr.b;
+    return 0;
+}
 
-        case UT_DATATYPE:
-            push8( ur_datatype(bi.it) );
-            if( ur_datatype(bi.it) == UT_TYPEMASK )
-            {
-                pushU32( bi.it->datatype.mask0 );  // High bits often set.
-                packU32( bi.it->datatype.mask1 );  // High bits seldom set.
-            }
-            break;
 
-        case UT_NONE:
-            break;
+/*
+  Append the serialized form of a block to bin.
 
-        case UT_LOGIC:
-        case UT_CHAR:
-            packU32( ur_int(bi.it) );
-            break;
+  \param blkN   Root block, or UR_INVALID_BUF to use val.
+  \param val    If blkN is UR_INVALID_BUF, the root is a block holding just
+                this value.
 
-        case UT_INT:
-            // UR_FLAG_INT_HEX
-            packS32( ur_int(bi.it) );
-            break;
+  If an error occurs then bin and the writer atoms are left unchanged.
 
-        case UT_DECIMAL:
-        case UT_BIGNUM:
-        case UT_TIME:
-        case UT_DATE:
-            _pushU64( bin, (uint64_t*) &ur_decimal(bi.it) );
-            break;
+  \return UR_OK/UR_THROW
+*/
+static int _serializeFrame( UThread* ut, Serializer* ser, UBuffer* bin,
+                            UIndex blkN, const UCell* val )
+{
+    SerialHead* head;
+    SerialBuf* rec;
+    const UBuffer* buf;
+    UBuffer root;
+    UIndex start = bin->used;
+    uint32_t atomBase = ser->atomMap.used;
+    uint32_t bytes;
+    uint32_t i;
+    int btype;
 
-        case UT_COORD:
-            push8( bi.it->coord.len );
-        {
-            const int16_t* np = bi.it->coord.n;
-            const int16_t* nend = np + bi.it->coord.len;
-            while( np != nend )
-                packS32( *np++ );
-        }
-            break;
+#define FRAME_POS   ((uint32_t) (bin->used - start))
+#define FRAME_PAD \
+    while( FRAME_POS & 15 ) \
+        bin->ptr.b[ bin->used++ ] = 0
 
-        case UT_VEC3:
-        {
-            uint32_t* np = (uint32_t*) bi.it->vec3.xyz;
-            packU32( np[0] );
-            packU32( np[1] );
-            packU32( np[2] );
-        }
-            break;
+    memSet( &root, 0, sizeof(UBuffer) );
+    root.type     = UT_BLOCK;
+    root.used     = 1;
+    root.ptr.cell = (UCell*) val;
 
-#ifdef CONFIG_TIMECODE
-        case UT_TIMECODE:
-            push8( ur_flags(bi.it, UR_FLAG_TIMECODE_DF) );
-        {
-            const int16_t* np = bi.it->coord.n;
-            const int16_t* nend = np + 4;
-            while( np != nend )
-                packS32( *np++ );
-        }
-            break;
-#endif
+    ur_binReserve( bin, start + 256 );
+    memSet( bin->ptr.b + start, 0, sizeof(SerialHead) );
+    bin->used += sizeof(SerialHead);
+    _resetKeyMap( &ser->bufMap, &ser->bufHash );
+    _mapBuffer( ser, blkN );
 
-        case UT_WORD:
-        case UT_LITWORD:
-        case UT_SETWORD:
-        case UT_GETWORD:
-        case UT_OPTION:
-            //printf( "KR word.ctx %d\n", bi.it->word.ctx );
-            switch( ur_binding(bi.it) )
-            {
-                case UR_BIND_THREAD:
-                case UR_BIND_ENV:
-                    // Avoiding global contexts (BUF_THREAD_CTX) for now.
-                    if( bi.it->word.ctx > 1 || bi.it->word.ctx < -1 )
-                    {
-                        push8( UR_BIND_THREAD /*ur_binding(bi.it)*/ );
-                        packU32( _mapBuffer( ser, bi.it->word.ctx ) );
-                        packU32( bi.it->word.index );
-                        break;
-                    }
-                    // Fall through...
+    // NOTE: ser->bufMap changes inside the loop as new buffers are seen.
 
-                default:
-                    push8( UR_BIND_UNBOUND );
-                    break;
-            }
-            packU32( _mapAtom( ser, ur_atom(bi.it) ) );
-            break;
+    for( i = 0; i < (uint32_t) ser->bufMap.used; ++i )
+    {
+        blkN = (UIndex) ser->bufMap.ptr.u32[ i ];
+        buf = (blkN == UR_INVALID_BUF) ? &root : ur_buffer( blkN );
 
+        switch( buf->type )
+        {
         case UT_BINARY:
         case UT_BITSET:
+            bytes = buf->used;
+            break;
+
         case UT_STRING:
         case UT_FILE:
         case UT_VECTOR:
+            bytes = buf->used * buf->elemSize;
+            break;
+
         case UT_BLOCK:
         case UT_PAREN:
         case UT_PATH:
         case UT_LITPATH:
         case UT_SETPATH:
-            packU32( _mapBuffer( ser, bi.it->series.buf ) );
-            if( ur_isSliced( bi.it ) )
-            {
-                push8( SERIES_SLICE );
-                packU32( bi.it->series.it );
-                packU32( bi.it->series.end );
-            }
-            else if( bi.it->series.it > 0 )
-            {
-                push8( SERIES_ITER );
-                packU32( bi.it->series.it );
-            }
-            else
-            {
-                push8( SERIES_ALL );
-            }
+        case UT_MAP:
+            bytes = buf->used * sizeof(UCell);
             break;
 
         case UT_CONTEXT:
-            packU32( _mapBuffer( ser, bi.it->context.buf ) );
-            break;
-
-        case UT_ERROR:
+            bytes = SER_ALIGN(buf->used * sizeof(uint32_t)) +
+                    buf->used * sizeof(UCell);
             break;
 
         default:
-            return type;
+            ur_error( ut, UR_ERR_SCRIPT,
+                      "Invalid serialized buffer type (%d)", buf->type );
+            goto fail;
         }
-    }
-    return 0;
-}
 
+        ur_binReserve( bin, start + SER_ALIGN(FRAME_POS) +
+                            sizeof(SerialBuf) + bytes );
+        FRAME_PAD;
 
-#ifdef __BIG_ENDIAN__
-static void _binAppendSwap2( UBuffer* bin, uint16_t* it, int count )
-{
-    uint8_t* dest;
-    uint16_t* end = it + count;
-    int size = count * 2;
+        rec = (SerialBuf*) (bin->ptr.b + bin->used);
+        rec->type     = buf->type;
+        rec->form     = buf->form;
+        rec->elemSize = buf->elemSize ? buf->elemSize : 1;
+        rec->_pad     = 0;
+        rec->bytes    = bytes;
+        rec->offset   = FRAME_POS + sizeof(SerialBuf);
+        rec->used     = buf->used;
+        bin->used += sizeof(SerialBuf);
 
-    ur_binReserve( bin, bin->used + size );
-    dest = bin->ptr.b + bin->used;
-    bin->used += size;
-    while( it != end )
-    {
-        *dest++ = *it >> 8;
-        *dest++ = *it++;
-    }
-}
+        if( ! buf->used )
+            continue;
 
+        switch( buf->type )
+        {
+        case UT_BINARY:
+        case UT_BITSET:
+        case UT_STRING:
+        case UT_FILE:
+        case UT_VECTOR:
+            memCpy( bin->ptr.b + bin->used, buf->ptr.b, bytes );
+            bin->used += bytes;
+            break;
 
-static void _binAppendSwap4( UBuffer* bin, uint32_t* it, int count )
-{
-    uint8_t* dest;
-    uint32_t* end = it + count;
-    int size = count * 4;
+        case UT_CONTEXT:
+        {
+            // Words
+            uint32_t* ap = (uint32_t*) (bin->ptr.b + bin->used);
+            int ai;
+            ur_arrReserve( &ser->ctxAtoms, buf->used );
+            ur_ctxWordAtoms( buf, ser->ctxAtoms.ptr.atom );
+            for( ai = 0; ai < buf->used; ++ai )
+                *ap++ = _mapAtom( ser, ser->ctxAtoms.ptr.atom[ai] );
+            bin->used += buf->used * sizeof(uint32_t);
+            FRAME_PAD;
+        }
+            // Fall through...
 
-    ur_binReserve( bin, bin->used + size );
-    dest = bin->ptr.b + bin->used;
-    bin->used += size;
-    while( it != end )
-    {
-        *dest++ = *it >> 24;
-        *dest++ = *it >> 16;
-        *dest++ = *it >> 8;
-        *dest++ = *it++;
+        default:    // Values
+            if( (btype = _serializeCells( ser, bin, buf->ptr.cell,
+                                          buf->ptr.cell + buf->used )) )
+            {
+                ur_error( ut, UR_ERR_SCRIPT,
+                          "Cannot serialize data type %d", btype );
+                goto fail;
+            }
+            break;
+        }
     }
-}
 
-
-static void _memCpySwap2(uint8_t* dest, const uint8_t* src, uint32_t elemCount)
-{
-    while( elemCount-- )
+    // Atoms new to this frame.
     {
-        *dest++ = src[1];
-        *dest++ = src[0];
-        src += 2;
+        const uint32_t* it  = ser->atomMap.ptr.u32 + atomBase;
+        const uint32_t* end = ser->atomMap.ptr.u32 + ser->atomMap.used;
+        const char* str;
+        uint32_t atomOffset;
+        int len;
+
+        atomOffset = SER_ALIGN(FRAME_POS);
+        ur_binReserve( bin, start + atomOffset + (end - it) * 65 );
+        FRAME_PAD;
+        for( ; it != end; ++it )
+        {
+            str = ur_atomCStr( ut, *it );
+            len = strLen( str );
+            bin->ptr.b[ bin->used++ ] = len;
+            memCpy( bin->ptr.b + bin->used, str, len );
+            bin->used += len;
+        }
+
+        head = (SerialHead*) (bin->ptr.b + start);
+        memCpy( head->magic, "BOR2", 4 );
+        head->order      = SER_ORDER;
+        head->version    = SER_VERSION;
+        head->atomSize   = sizeof(UAtom);
+        head->size       = FRAME_POS;
+        head->bufCount   = ser->bufMap.used;
+        head->atomCount  = ser->atomMap.used - atomBase;
+        head->atomOffset = atomOffset;
+        head->atomBase   = atomBase;
     }
-}
+    return UR_OK;
 
+fail:
 
-static void _memCpySwap4(uint8_t* dest, const uint8_t* src, uint32_t elemCount)
-{
-    while( elemCount-- )
+    bin->used = start;
+    if( (uint32_t) ser->atomMap.used != atomBase )
     {
-        *dest++ = src[3];
-        *dest++ = src[2];
-        *dest++ = src[1];
-        *dest++ = src[0];
-        src += 4;
+        ser->atomMap.used = atomBase;
+        _rehashKeys( &ser->atomMap, &ser->atomHash );
     }
+    return UR_THROW;
 }
-#endif
 
 
 /**
@@ -446,149 +549,111 @@ int ur_serialize( UThread* ut, UIndex blkN, UCell* res )
 {
     Serializer ser;
     UBuffer* bin;
-    int ok = UR_OK;
-    int btype;
-
-    ur_arrInit( &ser.atomMap, sizeof(UAtom), 0 );
-    ur_arrInit( &ser.bufMap, sizeof(BufferIndex), 0 );
-    ur_arrInit( &ser.ctxAtoms, sizeof(UAtom), 0 );
+    int ok;
 
+    ur_serialWriterInit( &ser );
     bin = ur_makeBinaryCell( ut, 256, res );
-    ur_binAppendData( bin, (const uint8_t*) "BOR1", 4 );
-    _pushU32( bin, 0 );     // Reserve atoms offset.
-    _pushU32( bin, 0 );     // Reserve buffer count.
-    _mapBuffer( &ser, blkN );
-
-    {
-        const BufferIndex* it;
-        const UBuffer* buf;
-        int i;
-
-        // NOTE: ser.bufMap changes inside the loop as new buffers are seen.
-
-        for( i = 0; i < ser.bufMap.used; ++i )
-        {
-            it = ((BufferIndex*) ser.bufMap.ptr.v) + i;
-            buf = ur_bufferE( it->bufN );
-
-            ur_binReserve( bin, bin->used + 7 );
-
-            switch( buf->type )
-            {
-            case UT_BINARY:
-            case UT_BITSET:
-                push8( buf->type );
-                packU32( buf->used );
-                if( buf->used )
-                    ur_binAppendData( bin, buf->ptr.b, buf->used );
-                break;
-
-            case UT_STRING:
-            case UT_FILE:
-            case UT_VECTOR:
-                push8( buf->type );
-                push8( buf->form );
-                packU32( buf->used );
-                if( buf->used )
-                {
-#ifdef __BIG_ENDIAN__
-                    switch( buf->elemSize )
-                    {
-                        case 2:
-                            _binAppendSwap2( bin, buf->ptr.u16, buf->used );
-                            break;
-                        case 4:
-                            _binAppendSwap4( bin, buf->ptr.u32, buf->used );
-                            break;
-                        default:
-                            ur_binAppendData( bin, buf->ptr.b,
-                                              buf->elemSize * buf->used );
-                            break;
-                    }
-#else
-                    ur_binAppendData( bin, buf->ptr.b,
-                                      buf->elemSize * buf->used );
-#endif
-                }
-                break;
+    ok = _serializeFrame( ut, &ser, bin, blkN, 0 );
+    ur_serialWriterFree( &ser );
+    return ok;
+}
 
-            case UT_BLOCK:
-            case UT_PAREN:
-            case UT_PATH:
-            case UT_LITPATH:
-            case UT_SETPATH:
-                push8( buf->type );
-                packU32( buf->used );
-                if( buf->used )
-                {
-                    if( (btype = _serializeBlock( &ser, bin, buf )) )
-                        goto bad_type;
-                }
-                break;
 
-            case UT_CONTEXT:
-                push8( buf->type );
-                packU32( buf->used );
-                if( buf->used )
-                {
-                    // Words
-                    int ai;
-                    ur_binReserve( bin, bin->used + (buf->used * 3) );
-                    ur_arrReserve( &ser.ctxAtoms, buf->used );
-                    ur_ctxWordAtoms( buf, ser.ctxAtoms.ptr.u16 );
-                    for( ai = 0; ai < buf->used; ++ai )
-                        packU32( _mapAtom( &ser, ser.ctxAtoms.ptr.u16[ai] ) );
-
-                    // Values
-                    if( (btype = _serializeBlock( &ser, bin, buf )) )
-                        goto bad_type;
-                }
-                break;
+/**
+  Initialize serial stream writer.
 
-            default:
-                ok = ur_error( ut, UR_ERR_SCRIPT,
-                        "Invalid serialized buffer type (%d)", buf->type );
-                goto cleanup;
-            }
-        }
-    }
+  \sa ur_serialWrite, ur_serialWriterFree
+*/
+void ur_serialWriterInit( USerialWriter* ser )
+{
+    _initKeyMap( &ser->atomMap, &ser->atomHash );
+    _initKeyMap( &ser->bufMap, &ser->bufHash );
+    ur_arrInit( &ser->ctxAtoms, sizeof(UAtom), 0 );
+}
 
-    if( ser.atomMap.used )
-    {
-        const UAtom* it  = ser.atomMap.ptr.u16;
-        const UAtom* end = it + ser.atomMap.used;
-        const char* str;
-#define replaceLast(B,C)  B->ptr.b[ B->used - 1 ] = C
 
-        _pokeU32( bin->ptr.b + 4, bin->used );      // Atoms offset.
-        while( it != end )
-        {
-            str = ur_atomCStr( ut, *it++ );
-            ur_binAppendData( bin, (const uint8_t*) str, strLen(str) + 1 );
-            replaceLast( bin, ' ' );
-        }
-        replaceLast( bin, '\0' );
-    }
+/**
+  Free serial stream writer memory.
+*/
+void ur_serialWriterFree( USerialWriter* ser )
+{
+    ur_arrFree( &ser->atomMap );
+    ur_arrFree( &ser->atomHash );
+    ur_arrFree( &ser->bufMap );
+    ur_arrFree( &ser->bufHash );
+    ur_arrFree( &ser->ctxAtoms );
+}
 
-    _pokeU32( bin->ptr.b + 8, ser.bufMap.used );    // Buffer count.
 
-cleanup:
+/**
+  Serialize the next value of a stream.
 
-    ur_arrFree( &ser.atomMap );
-    ur_arrFree( &ser.bufMap );
-    ur_arrFree( &ser.ctxAtoms );
-    return ok;
+  The value and everything it references is appended to bin in the same
+  format as ur_serialize(), except that only atoms not already written by
+  this writer are included.  The serialized values must be read in order
+  with ur_serialRead().  The writer only remembers atoms, so a long stream
+  can be emitted with bin emptied after each value.
 
-bad_type:
+  \param  val   Value to serialize.
+  \param  bin   Binary buffer to append to.
 
-    ok = ur_error( ut, UR_ERR_SCRIPT, "Cannot serialize data type %d", btype );
-    goto cleanup;
+  \return UR_OK/UR_THROW
+*/
+int ur_serialWrite( UThread* ut, USerialWriter* ser, const UCell* val,
+                    UBuffer* bin )
+{
+    return _serializeFrame( ut, ser, bin, UR_INVALID_BUF, val );
 }
 
 
 /*--------------------------------------------------------------------------*/
+/*
+  Version 1 reader.
+*/
+
+
+enum Pack32Count
+{
+    PACK_1   = 0,
+    PACK_2   = 0x40,
+    PACK_3   = 0x80,
+    PACK_5   = 0xc0,
+    PACK_ANY = 0xc0
+};
+
+
+static inline int32_t _undoZigZag32( uint32_t n )
+{
+    return (n & 1) ? -(n >> 1) - 1 : n >> 1;
+}
+
+
+#ifdef __BIG_ENDIAN__
+static void _memCpySwap2(uint8_t* dest, const uint8_t* src, uint32_t elemCount)
+{
+    while( elemCount-- )
+    {
+        *dest++ = src[1];
+        *dest++ = src[0];
+        src += 2;
+    }
+}
+
+
+static void _memCpySwap4(uint8_t* dest, const uint8_t* src, uint32_t elemCount)
+{
+    while( elemCount-- )
+    {
+        *dest++ = src[3];
+        *dest++ = src[2];
+        *dest++ = src[1];
+        *dest++ = src[0];
+        src += 4;
+    }
+}
+#endif
+
 
-
 typedef struct
 {
     const uint8_t* it;
@@ -663,9 +728,12 @@ static uint32_t _unpackU32( BinaryIter* bi )
 #define unpackS32(N)    N = _undoZigZag32( _unpackU32(bi) )
 
 /*
+  The input must be followed by BOR1_PAD bytes so that a value which runs
+  past the end can be read before it is rejected.
+
   Returns non-zero if successful
 */
-static int _unserializeBlock( UAtom* atoms, UIndex* ids,
+static int _unserializeBlock( const UBuffer* atoms, const UBuffer* ids,
                               BinaryIter* bi, UBuffer* blk )
 {
     UCell* cell = blk->ptr.cell;
@@ -680,7 +748,7 @@ static int _unserializeBlock( UAtom* atoms, UIndex* ids,
 
         n = *bi->it++;
         type = n & 0x7f;
-        if( type > UT_ERROR )
+        if( type > UT_MAP )
             return 0;
 
         ur_setId( cell, type );
@@ -694,6 +762,9 @@ static int _unserializeBlock( UAtom* atoms, UIndex* ids,
 
         case UT_DATATYPE:
             pull8( ur_datatype(cell) );
+            if( ur_datatype(cell) >= UT_MAX &&
+                ur_datatype(cell) != UT_TYPEMASK )
+                return 0;
             if( ur_datatype(cell) == UT_TYPEMASK )
             {
                 pullU32( cell->datatype.mask0 );
@@ -722,6 +793,8 @@ static int _unserializeBlock( UAtom* atoms, UIndex* ids,
 
         case UT_COORD:
             pull8( cell->coord.len );
+            if( cell->coord.len > UR_COORD_MAX )
+                return 0;
         {
             int16_t* np = cell->coord.n;
             int16_t* nend = np + cell->coord.len;
@@ -763,7 +836,9 @@ static int _unserializeBlock( UAtom* atoms, UIndex* ids,
             {
                 ur_binding(cell) = UR_BIND_THREAD;
                 unpackU32( n );
-                cell->word.ctx = ids[ n ];
+                if( (uint32_t) n >= (uint32_t) ids->used )
+                    return 0;
+                cell->word.ctx = ids->ptr.i[ n ];
                 unpackU32( cell->word.index );
             }
             else
@@ -772,7 +847,9 @@ static int _unserializeBlock( UAtom* atoms, UIndex* ids,
                 cell->word.ctx = UR_INVALID_BUF;
             }
             unpackU32( n );
-            ur_atom(cell) = atoms[ n ];
+            if( (uint32_t) n >= (uint32_t) atoms->used )
+                return 0;
+            ur_atom(cell) = atoms->ptr.atom[ n ];
             break;
 
         case UT_BINARY:
@@ -786,7 +863,9 @@ static int _unserializeBlock( UAtom* atoms, UIndex* ids,
         case UT_LITPATH:
         case UT_SETPATH:
             unpackU32( n );
-            ur_setSeries( cell, ids[ n ], 0 );
+            if( (uint32_t) n >= (uint32_t) ids->used )
+                return 0;
+            ur_setSeries( cell, ids->ptr.i[ n ], 0 );
 
             pull8( n );
             if( n > SERIES_ALL )
@@ -800,11 +879,17 @@ static int _unserializeBlock( UAtom* atoms, UIndex* ids,
             break;
 
         case UT_CONTEXT:
+        case UT_MAP:
             unpackU32( n );
-            ur_setSeries( cell, ids[ n ], 0 );
+            if( (uint32_t) n >= (uint32_t) ids->used )
+                return 0;
+            ur_setSeries( cell, ids->ptr.i[ n ], 0 );
             break;
 
         case UT_ERROR:
+            // The message & trace buffers are not stored.
+            cell->error.messageStr = UR_INVALID_BUF;
+            cell->error.traceBlk   = UR_INVALID_BUF;
             break;
 
         default:
@@ -817,61 +902,151 @@ static int _unserializeBlock( UAtom* atoms, UIndex* ids,
 
 int ur_serializedHeader( const uint8_t* data, int len )
 {
-    if( len > 12 )
+    if( len > 12 && data[0] == 'B' && data[1] == 'O' && data[2] == 'R' )
     {
-        return data[0] == 'B' && data[1] == 'O' && data[2] == 'R' &&
-               data[3] == '1' && data[12] == UT_BLOCK;
+        if( data[3] == '1' )
+            return data[12] == UT_BLOCK;
+        if( data[3] == '2' && len > (int) sizeof(SerialHead) )
+            return data[ sizeof(SerialHead) ] == UT_BLOCK;
     }
     return 0;
 }
 
 
-/**
-  Unserialize binary.
+/*
+  Return the buffer type which a series cell of the given type references.
+*/
+static int _bufClass( int type )
+{
+    if( type == UT_BITSET )
+        return UT_BINARY;
+    if( ur_isStringType( type ) )
+        return UT_STRING;
+    if( ur_isBlockType( type ) )
+        return UT_BLOCK;
+    return type;
+}
 
-  \param  start     Pointer to serialized binary.
-  \param  end       Pointer to end of binary.
-  \param  res       Cell to be set to new output block.
 
-  \return UR_OK/UR_THROW
+/*
+  Return non-zero if the buffer references of the unserialized version 1
+  block cells are valid.  This can only be done once all buffers are made.
 */
-int ur_unserialize( UThread* ut, const uint8_t* start, const uint8_t* end,
-                    UCell* res )
+static int _validRefs1( UThread* ut, const UBuffer* blk )
+{
+    const UBuffer* buf;
+    const UCell* it  = blk->ptr.cell;
+    const UCell* end = it + blk->used;
+    int type;
+
+    for( ; it != end; ++it )
+    {
+        type = ur_type(it);
+        if( ur_isWordType( type ) )
+        {
+            if( ur_binding(it) == UR_BIND_THREAD )
+            {
+                buf = ur_buffer( it->word.ctx );
+                if( buf->type != UT_CONTEXT ||
+                    it->word.index >= (uint32_t) buf->used )
+                    return 0;
+            }
+        }
+        else if( ur_isSeriesType( type ) || type == UT_CONTEXT ||
+                 type == UT_MAP )
+        {
+            buf = ur_buffer( it->series.buf );
+            if( _bufClass( buf->type ) != _bufClass( type ) )
+                return 0;
+        }
+    }
+    return 1;
+}
+
+
+#define BOR1_PAD    64
+
+/*
+  Unserialize version 1 data.
+
+  The data is copied to a padded buffer so that the unchecked reads of a
+  single value can run past the end before the position is checked.
+*/
+static int _unserialize1( UThread* ut, const uint8_t* start,
+                          const uint8_t* end, UCell* res )
 {
     BinaryIter bi;
     UBuffer atoms;
     UBuffer ids;
     UBuffer* buf;
+    uint8_t* data;
+    const char* msg = 0;
+    size_t len = end - start;
     int i;
     int n;
-    int type;
-    int used;
+    int type = 0;
+    uint32_t used;
     int ok = UR_OK;
 
 
-    if( ! ur_serializedHeader( start, end - start ) )
+    if( len < 13 || memcmp( start, "BOR1", 4 ) || start[12] != UT_BLOCK )
         return ur_error( ut, UR_ERR_SCRIPT, "Invalid serialized data header" );
 
-    bi.it  = start + 4;
-    bi.end = end;
-    n = _pullU32(&bi);
-    ur_arrInit( &atoms, sizeof(UAtom), n );
-    if( n )
+    data = (uint8_t*) memAlloc( len + BOR1_PAD );
+    if( ! data )
+        return ur_error( ut, UR_ERR_INTERNAL, "Could not alloc unserialize" );
+    memCpy( data, start, len );
+    memSet( data + len, 0, BOR1_PAD );
+
+    bi.it  = data + 4;
+    bi.end = data + len;
+    used = _pullU32(&bi);
+    if( used < 13 || used > len )
+    {
+        memFree( data );
+        return ur_error( ut, UR_ERR_SCRIPT, "Invalid serialized data header" );
+    }
+    ur_arrInit( &atoms, sizeof(UAtom), len - used + 1 );
+    if( used < len )
     {
-        start += n;
-        ur_internAtoms( ut, (const char*) start, atoms.ptr.u16 ); 
-        bi.end = start;
+        UAtom* ait;
+        UAtom* aend = ur_internAtoms( ut, (const char*) data + used,
+                                     atoms.ptr.atom );
+        for( ait = atoms.ptr.atom; ait != aend; ++ait )
+        {
+            if( *ait == UR_INVALID_ATOM )
+            {
+                ur_arrFree( &atoms );
+                memFree( data );
+                return ur_error( ut, UR_ERR_SCRIPT,
+                                 "Invalid serialized atoms" );
+            }
+        }
+        atoms.used = aend - atoms.ptr.atom;
+        bi.end = data + used;
     }
 
     n = _pullU32(&bi);
+    if( n < 1 || n > bi.end - bi.it )
+    {
+        ur_arrFree( &atoms );
+        memFree( data );
+        return ur_error( ut, UR_ERR_SCRIPT, "Invalid serialized buffer count" );
+    }
     ur_arrInit( &ids, sizeof(UIndex), n );
+    ids.used = n;
     ur_genBuffers( ut, n, ids.ptr.i );
 
+    // Any errors are reported after the cleanup below, as ur_error() can
+    // recycle the buffers which have not yet been initialized.
+
+#define REMAIN  (size_t) (bi.end - bi.it)
+
     for( i = 0; i < n; ++i )
     {
         if( bi.it >= bi.end )
         {
-            ur_error( ut, UR_ERR_SCRIPT, "Unexpected end of serialized data" );
+            msg = "Unexpected end of serialized data";
             goto fail;
         }
 
@@ -882,6 +1057,8 @@ int ur_unserialize( UThread* ut, const uint8_t* start, const uint8_t* end,
         case UT_BINARY:
         case UT_BITSET:
             used = _unpackU32(&bi);
+            if( bi.it > bi.end || used > REMAIN )
+                goto fail_end;
 
             buf = ur_buffer( ids.ptr.i[ i ] );
             ur_binInit( buf, used );
@@ -899,6 +1076,10 @@ int ur_unserialize( UThread* ut, const uint8_t* start, const uint8_t* end,
         {
             int form = *bi.it++;
             used = _unpackU32(&bi);
+            if( form >= UR_ENC_COUNT )
+                goto fail_type;
+            if( bi.it > bi.end || used > REMAIN )
+                goto fail_end;
 
             buf = ur_buffer( ids.ptr.i[ i ] );
             ur_strInit( buf, form, used );
@@ -906,6 +1087,8 @@ int ur_unserialize( UThread* ut, const uint8_t* start, const uint8_t* end,
             {
                 buf->used = used;
                 used *= buf->elemSize;
+                if( used > REMAIN )
+                    goto fail_inited;
                 memCpy( buf->ptr.v, bi.it, used );
                 bi.it += used;
             }
@@ -916,12 +1099,18 @@ int ur_unserialize( UThread* ut, const uint8_t* start, const uint8_t* end,
         {
             int form = *bi.it++;
             used = _unpackU32(&bi);
+            if( form < UR_ATOM_I8 || form > UR_ATOM_F64 )
+                goto fail_type;
+            if( bi.it > bi.end || used > REMAIN )
+                goto fail_end;
 
             buf = ur_buffer( ids.ptr.i[ i ] );
             ur_vecInit( buf, form, 0, used );
             if( used )
             {
                 buf->used = used;
+                if( used * buf->elemSize > REMAIN )
+                    goto fail_inited;
 #ifdef __BIG_ENDIAN__
                 switch( buf->elemSize )
                 {
@@ -953,6 +1142,8 @@ int ur_unserialize( UThread* ut, const uint8_t* start, const uint8_t* end,
         case UT_LITPATH:
         case UT_SETPATH:
             used = _unpackU32(&bi);
+            if( bi.it > bi.end || used > REMAIN )
+                goto fail_end;
 
             buf = ur_buffer( ids.ptr.i[ i ] );
             ur_blkInit( buf, type, used );
@@ -960,32 +1151,29 @@ int ur_unserialize( UThread* ut, const uint8_t* start, const uint8_t* end,
             {
 unser_block:
                 buf->used = used;
-                if( ! _unserializeBlock( atoms.ptr.u16, ids.ptr.i, &bi, buf ) )
-                {
-                    buf->used = 0;
-                    ur_error( ut, UR_ERR_SCRIPT, "Invalid serialized block" );
-                    goto fail;
-                }
+                if( ! _unserializeBlock( &atoms, &ids, &bi, buf ) ||
+                    bi.it > bi.end )
+                    goto fail_block;
             }
             break;
 
         case UT_CONTEXT:
             used = _unpackU32(&bi);
+            if( bi.it > bi.end || used > REMAIN )
+                goto fail_end;
 
             buf = ur_buffer( ids.ptr.i[ i ] );
             ur_ctxInit( buf, used );
             if( used )
             {
-#define ENTRIES(buf)    ((UAtomEntry*) (buf->ptr.cell + ur_avail(buf)))
-                int ai;
-                uint32_t an;
-                UAtomEntry* ent = ENTRIES(buf);
+                uint32_t ai, an;
 
-                for( ai = 0; ai < used; ++ai, ++ent )
+                for( ai = 0; ai < used; ++ai )
                 {
                     an = _unpackU32(&bi);
-                    ent->atom  = atoms.ptr.u16[ an ];
-                    ent->index = ai;
+                    if( bi.it > bi.end || an >= (uint32_t) atoms.used )
+                        goto fail_block;
+                    ur_ctxAppendWord( buf, atoms.ptr.atom[ an ] );
                 }
 
                 ur_ctxSort( buf );
@@ -993,19 +1181,72 @@ unser_block:
             }
             break;
 
+        case UT_MAP:
+            used = _unpackU32(&bi);
+            if( used & 1 )
+            {
+                msg = "Invalid serialized map";
+                goto fail;
+            }
+            if( bi.it > bi.end || used > REMAIN )
+                goto fail_end;
+
+            buf = ur_buffer( ids.ptr.i[ i ] );
+            ur_mapInit( buf, used / 2 );
+            if( used )
+                goto unser_block;
+            break;
+
         default:
-            ur_error( ut, UR_ERR_SCRIPT,
-                      "Invalid serialized buffer type (%d)", type );
-            goto fail;
+            goto fail_type;
         }
     }
 
+#undef REMAIN
+
+    for( i = 0; i < n; ++i )
+    {
+        buf = ur_buffer( ids.ptr.i[ i ] );
+        if( ur_isBlockType( buf->type ) || buf->type == UT_CONTEXT ||
+            buf->type == UT_MAP )
+        {
+            if( ! _validRefs1( ut, buf ) )
+            {
+                msg = "Invalid serialized block";
+                i = n;
+                goto fail;
+            }
+        }
+    }
+
+    // Map keys can only be hashed once all the buffers are filled in.
+    for( i = 0; i < n; ++i )
+    {
+        buf = ur_buffer( ids.ptr.i[ i ] );
+        if( buf->type == UT_MAP )
+            ur_mapRehash( ut, buf );
+    }
+
     ur_setId( res, UT_BLOCK );
     ur_setSeries( res, ids.ptr.i[0], 0 );
     goto cleanup;
 
+fail_type:
+    msg = "Invalid serialized buffer type (%d)";
+    goto fail;
+
+fail_end:
+    msg = "Unexpected end of serialized data";
+    goto fail;
+
+fail_block:
+    msg = "Invalid serialized block";
+fail_inited:
+    if( ! msg )
+        msg = "Unexpected end of serialized data";
+    buf->used = 0;
+    ++i;
 fail:
-
     // Initialize any unset buffers to something.
     for( ; i < n; ++i )
         ur_binInit( ur_buffer( ids.ptr.i[ i ] ), 0 );
@@ -1015,8 +1256,595 @@ cleanup:
 
     ur_arrFree( &atoms );
     ur_arrFree( &ids );
+    memFree( data );
+    if( msg )
+        ur_error( ut, UR_ERR_SCRIPT, msg, type );
+    return ok;
+}
+
+
+/*--------------------------------------------------------------------------*/
+/*
+  Version 2 reader.
+
+  The data is copied once to memory shared by the buffers made, and the
+  string, binary, vector, and block buffers use it in place (with the
+  UR_BUF_BORROWED flag) until they are modified.  When the data is in a
+  mapped binary only the string, binary, and vector data is used in place.
+*/
+
+
+typedef struct
+{
+    const UAtom* atoms;
+    const SerialBuf** recs;
+    const UIndex* ids;
+    uint32_t atomCount;
+    uint32_t bufCount;
+}
+Unserializer;
+
+
+/*
+  Convert a serialized buffer reference to a buffer id.
+
+  Returns non-zero if successful.
+*/
+static int _fixRef( const Unserializer* us, UIndex* ref, int type, int none )
+{
+    uint32_t n = (uint32_t) *ref;
+    if( n >= us->bufCount )
+    {
+        if( none && n == SER_NO_BUF )
+        {
+            *ref = UR_INVALID_BUF;
+            return 1;
+        }
+        return 0;
+    }
+    if( _bufClass( us->recs[ n ]->type ) != type )
+        return 0;
+    *ref = us->ids[ n ];
+    return 1;
+}
+
+
+/*
+  Convert atom & buffer references of serialized cells.
+
+  Returns non-zero if successful.
+*/
+static int _fixCells( const Unserializer* us, UCell* it, UCell* end )
+{
+    const SerialBuf* rec;
+    uint32_t n;
+    int type;
+
+    for( ; it != end; ++it )
+    {
+        type = ur_type(it);
+        switch( type )
+        {
+        case UT_UNSET:
+        case UT_NONE:
+        case UT_LOGIC:
+        case UT_CHAR:
+        case UT_INT:
+        case UT_DECIMAL:
+        case UT_BIGNUM:
+        case UT_TIME:
+        case UT_DATE:
+        case UT_VEC3:
+#ifdef CONFIG_TIMECODE
+        case UT_TIMECODE:
+#endif
+            break;
+
+        case UT_DATATYPE:
+            if( ur_datatype(it) >= UT_MAX && ur_datatype(it) != UT_TYPEMASK )
+                return 0;
+            break;
+
+        case UT_COORD:
+            if( it->coord.len > UR_COORD_MAX )
+                return 0;
+            break;
+
+        case UT_WORD:
+        case UT_LITWORD:
+        case UT_SETWORD:
+        case UT_GETWORD:
+        case UT_OPTION:
+            n = ur_atom(it);
+            if( n >= us->atomCount )
+                return 0;
+            ur_atom(it) = us->atoms[ n ];
+
+            n = (uint32_t) it->word.ctx;
+            if( ur_binding(it) == UR_BIND_THREAD )
+            {
+                if( n >= us->bufCount )
+                    return 0;
+                rec = us->recs[ n ];
+                if( rec->type != UT_CONTEXT || it->word.index >= rec->used )
+                    return 0;
+                it->word.ctx = us->ids[ n ];
+            }
+            else if( ur_binding(it) == UR_BIND_UNBOUND && n == SER_NO_BUF )
+                it->word.ctx = UR_INVALID_BUF;
+            else
+                return 0;
+            break;
+
+        case UT_BINARY:
+        case UT_BITSET:
+        case UT_STRING:
+        case UT_FILE:
+        case UT_VECTOR:
+        case UT_BLOCK:
+        case UT_PAREN:
+        case UT_PATH:
+        case UT_LITPATH:
+        case UT_SETPATH:
+        case UT_CONTEXT:
+        case UT_MAP:
+            if( ! _fixRef( us, &it->series.buf, _bufClass( type ), 0 ) )
+                return 0;
+            break;
+
+        case UT_ERROR:
+            if( ! _fixRef( us, &it->error.messageStr, UT_STRING, 1 ) ||
+                ! _fixRef( us, &it->error.traceBlk, UT_BLOCK, 1 ) )
+                return 0;
+            break;
+
+        default:
+            return 0;
+        }
+    }
+    return 1;
+}
+
+
+static const uint8_t _vecElemSize[] = { 1, 1, 2, 2, 4, 4, 4, 8 };
+
+/*
+  Check that a buffer record payload matches its type and element count.
+
+  Returns non-zero if valid.
+*/
+static int _validRecord( const SerialBuf* rec )
+{
+    uint64_t bytes;
+
+    switch( rec->type )
+    {
+    case UT_BINARY:
+    case UT_BITSET:
+        bytes = rec->used;
+        break;
+
+    case UT_STRING:
+    case UT_FILE:
+        if( rec->form >= UR_ENC_COUNT ||
+            rec->elemSize != ((rec->form == UR_ENC_UCS2) ? 2 : 1) )
+            return 0;
+        bytes = (uint64_t) rec->used * rec->elemSize;
+        break;
+
+    case UT_VECTOR:
+        if( rec->form < UR_ATOM_I8 || rec->form > UR_ATOM_F64 ||
+            rec->elemSize != _vecElemSize[ rec->form - UR_ATOM_I8 ] )
+            return 0;
+        bytes = (uint64_t) rec->used * rec->elemSize;
+        break;
+
+    case UT_MAP:
+        if( rec->used & 1 )
+            return 0;
+        // Fall through...
+
+    case UT_BLOCK:
+    case UT_PAREN:
+    case UT_PATH:
+    case UT_LITPATH:
+    case UT_SETPATH:
+        bytes = (uint64_t) rec->used * sizeof(UCell);
+        break;
+
+    case UT_CONTEXT:
+        bytes = SER_ALIGN((uint64_t) rec->used * sizeof(uint32_t)) +
+                (uint64_t) rec->used * sizeof(UCell);
+        break;
+
+    default:
+        return 0;
+    }
+    return bytes == rec->bytes && rec->used <= 0x7fffffff;
+}
+
+
+/*
+  Check for a valid version 2 header.
+
+  \param head   Set to a copy of the header.
+
+  \return 1 if data has a valid version 2 header, -1 if it is not
+          version 2 data, or UR_THROW if it is invalid.
+*/
+static int _serialHead( UThread* ut, const uint8_t* data, size_t len,
+                        SerialHead* head )
+{
+    if( len < sizeof(SerialHead) + sizeof(SerialBuf) ||
+        memcmp( data, "BOR2", 4 ) )
+        return -1;
+
+    // The data may not be aligned in a binary.
+    memCpy( head, data, sizeof(SerialHead) );
+    if( head->order != SER_ORDER )
+        return ur_error( ut, UR_ERR_SCRIPT,
+                         "Serialized data has a different byte order" );
+    if( head->version != SER_VERSION || head->atomSize != sizeof(UAtom) )
+        return ur_error( ut, UR_ERR_SCRIPT,
+                         "Serialized data version %d is not supported",
+                         head->version );
+    if( head->size > len || head->atomOffset > head->size ||
+        head->atomOffset < sizeof(SerialHead) + sizeof(SerialBuf) ||
+        ! head->bufCount ||
+        head->bufCount > (head->atomOffset - sizeof(SerialHead)) / 16 ||
+        head->atomCount > (head->size - head->atomOffset) / 2 ||
+        data[ sizeof(SerialHead) ] != UT_BLOCK )
+        return ur_error( ut, UR_ERR_SCRIPT, "Invalid serialized data header" );
+    return 1;
+}
+
+
+/*
+  Unserialize version 2 data.
+
+  \param data   Shared memory holding the data (see ur_regionRefs).
+  \param mapped Non-zero if data is a mapped binary, which must not be
+                changed.  Otherwise data is private memory from
+                _unserializeCopy() which is freed if no buffers use it.
+  \param atoms  Atoms of any previous stream values.  The new atoms are
+                appended.
+*/
+static int _unserialize2( UThread* ut, uint8_t* data, const SerialHead* head,
+                          int mapped, UBuffer* atoms, UCell* res )
+{
+    Unserializer us;
+    UBuffer recs;
+    UBuffer ids;
+    UBuffer* buf;
+    const SerialBuf* rec;
+    UCell* cells;
+    uint32_t pos;
+    uint32_t i;
+    uint32_t n = head->bufCount;
+    int32_t borrowed = 0;
+    int invalidBlock = 0;
+    int ok = UR_OK;
+
+
+    ur_arrInit( &recs, sizeof(SerialBuf*), n );
+    ur_arrInit( &ids, sizeof(UIndex), 0 );
+
+    if( head->atomBase != (uint32_t) atoms->used )
+    {
+        ok = ur_error( ut, UR_ERR_SCRIPT,
+                       "Serialized data is not the next stream value" );
+        goto cleanup;
+    }
+    if( head->atomCount )
+    {
+        ur_arrReserve( atoms, atoms->used + head->atomCount );
+        if( ! ur_internAtomList( ut, data + head->atomOffset,
+                                 data + head->size, head->atomCount,
+                                 atoms->ptr.atom + atoms->used ) )
+        {
+            ok = ur_error( ut, UR_ERR_SCRIPT, "Invalid serialized atoms" );
+            goto cleanup;
+        }
+        atoms->used += head->atomCount;
+    }
+
+    // Check all the records before making any buffers.
+    pos = sizeof(SerialHead);
+    for( i = 0; i < n; ++i )
+    {
+        rec = (const SerialBuf*) (data + pos);
+        if( pos + sizeof(SerialBuf) > head->atomOffset ||
+            rec->offset != pos + sizeof(SerialBuf) ||
+            rec->bytes > head->atomOffset - rec->offset ||
+            ! _validRecord( rec ) )
+        {
+            ok = ur_error( ut, UR_ERR_SCRIPT, "Invalid serialized buffer" );
+            goto cleanup;
+        }
+        ((const SerialBuf**) recs.ptr.v)[ i ] = rec;
+        pos = SER_ALIGN(rec->offset + rec->bytes);
+    }
+
+    ur_arrReserve( &ids, n );
+    ur_genBuffers( ut, n, ids.ptr.i );
+
+    us.atoms     = atoms->ptr.atom;
+    us.recs      = (const SerialBuf**) recs.ptr.v;
+    us.ids       = ids.ptr.i;
+    us.atomCount = atoms->used;
+    us.bufCount  = n;
+
+    for( i = 0; i < n; ++i )
+    {
+        rec = us.recs[ i ];
+        cells = (UCell*) (data + rec->offset);
+        buf = ur_buffer( ids.ptr.i[ i ] );
+
+        switch( rec->type )
+        {
+        case UT_BINARY:
+        case UT_BITSET:
+            ur_binInit( buf, 0 );
+            buf->type = rec->type;
+            goto borrow;
+
+        case UT_STRING:
+        case UT_FILE:
+            ur_strInit( buf, rec->form, 0 );
+            buf->type = rec->type;
+            goto borrow;
+
+        case UT_VECTOR:
+            ur_vecInit( buf, rec->form, rec->elemSize, 0 );
+borrow:
+            if( rec->used )
+            {
+                buf->flags |= UR_BUF_BORROWED;
+                buf->used   = rec->used;
+                buf->ptr.v  = cells;
+                ++borrowed;
+            }
+            break;
+
+        case UT_BLOCK:
+        case UT_PAREN:
+        case UT_PATH:
+        case UT_LITPATH:
+        case UT_SETPATH:
+            if( mapped )
+            {
+                ur_blkInit( buf, rec->type, rec->used );
+                goto copy_cells;
+            }
+            if( ! _fixCells( &us, cells, cells + rec->used ) )
+                goto invalid;
+            ur_blkInit( buf, rec->type, 0 );
+            goto borrow;
+
+        case UT_CONTEXT:
+            ur_ctxInit( buf, rec->used );
+            if( rec->used )
+            {
+                const uint32_t* ap = (const uint32_t*) cells;
+                uint32_t ai;
+
+                for( ai = 0; ai < rec->used; ++ai )
+                {
+                    if( ap[ ai ] >= us.atomCount )
+                        goto invalid_buf;
+                    ur_ctxAppendWord( buf, us.atoms[ ap[ai] ] );
+                }
+                ur_ctxSort( buf );
+                cells = (UCell*) (data + rec->offset +
+                                  SER_ALIGN(rec->used * sizeof(uint32_t)));
+                goto copy_cells;
+            }
+            break;
+
+        case UT_MAP:
+            ur_mapInit( buf, rec->used / 2 );
+copy_cells:
+            if( rec->used )
+            {
+                memCpy( buf->ptr.cell, cells, rec->used * sizeof(UCell) );
+                buf->used = rec->used;
+                if( ! _fixCells( &us, buf->ptr.cell,
+                                 buf->ptr.cell + rec->used ) )
+                    goto invalid_buf;
+            }
+            break;
+        }
+    }
+
+    // Map keys can only be hashed once all the buffers are filled in.
+    for( i = 0; i < n; ++i )
+    {
+        buf = ur_buffer( ids.ptr.i[ i ] );
+        if( buf->type == UT_MAP )
+            ur_mapRehash( ut, buf );
+    }
+
+    ur_setId( res, UT_BLOCK );
+    ur_setSeries( res, ids.ptr.i[0], 0 );
+    goto cleanup;
+
+invalid_buf:
+
+    buf->used = 0;
+    ++i;
+
+invalid:
+
+    // Initialize any unset buffers to something.  The error is only
+    // generated once all the buffers and the region count are valid, as
+    // ur_error() can recycle them.
+    for( ; i < n; ++i )
+        ur_binInit( ur_buffer( ids.ptr.i[ i ] ), 0 );
+    ok = UR_THROW;
+    invalidBlock = 1;
+
+cleanup:
+
+    ur_arrFree( &recs );
+    ur_arrFree( &ids );
+
+    if( mapped )
+    {
+        if( borrowed )
+            atomicAddFetch( &ur_regionRefs(data), borrowed );
+    }
+    else
+    {
+        // No other thread can see the memory until this returns.
+        ur_regionRefs(data) = borrowed + 1;
+        ur_releaseRegion( data );
+    }
+
+    if( invalidBlock )
+        ur_error( ut, UR_ERR_SCRIPT, "Invalid serialized block" );
+    return ok;
+}
+
+
+/*
+  Unserialize version 2 data from a private copy which the buffers can use
+  in place.
+*/
+static int _unserializeCopy( UThread* ut, const uint8_t* start,
+                             const SerialHead* head, UBuffer* atoms,
+                             UCell* res )
+{
+    uint8_t* data = (uint8_t*) memAlloc( UR_REGION_HEAD + head->size );
+    if( ! data )
+        return ur_error( ut, UR_ERR_INTERNAL, "No memory for unserialize" );
+    data += UR_REGION_HEAD;
+    ur_regionMapHead(data) = 0;
+    memCpy( data, start, head->size );
+    return _unserialize2( ut, data, head, 0, atoms, res );
+}
+
+
+/**
+  Unserialize binary.
+
+  \param  start     Pointer to serialized binary.
+  \param  end       Pointer to end of binary.
+  \param  res       Cell to be set to new output block.
+
+  \return UR_OK/UR_THROW
+*/
+int ur_unserialize( UThread* ut, const uint8_t* start, const uint8_t* end,
+                    UCell* res )
+{
+    SerialHead head;
+    UBuffer atoms;
+    int ok;
+
+    ok = _serialHead( ut, start, end - start, &head );
+    if( ok < 0 )
+        return _unserialize1( ut, start, end, res );
+    if( ok == UR_THROW )
+        return UR_THROW;
+
+    ur_arrInit( &atoms, sizeof(UAtom), 0 );
+    ok = _unserializeCopy( ut, start, &head, &atoms, res );
+    ur_arrFree( &atoms );
     return ok;
 }
 
 
+/**
+  Unserialize the contents of a binary buffer.
+
+  If the binary is mapped (see ur_binMapFile) then string, binary, and
+  vector data is used directly from the map, which then remains until those
+  series are modified or recycled.  Otherwise this is the same as calling
+  ur_unserialize() for all of the binary.
+
+  \param  binN      Binary buffer.
+  \param  res       Cell to be set to new output block.
+
+  \return UR_OK/UR_THROW
+*/
+int ur_unserializeBin( UThread* ut, UIndex binN, UCell* res )
+{
+    const UBuffer* bin = ur_buffer( binN );
+    if( bin->flags & UR_BIN_MAPPED )
+    {
+        SerialHead head;
+        int ok = _serialHead( ut, bin->ptr.b, bin->used, &head );
+        if( ok > 0 )
+        {
+            UBuffer atoms;
+            ur_arrInit( &atoms, sizeof(UAtom), 0 );
+            ok = _unserialize2( ut, bin->ptr.b, &head, 1, &atoms, res );
+            ur_arrFree( &atoms );
+            return ok;
+        }
+        if( ok == UR_THROW )
+            return UR_THROW;
+    }
+    return ur_unserialize( ut, bin->ptr.b, bin->ptr.b + bin->used, res );
+}
+
+
+/**
+  Initialize serial stream reader.
+
+  \sa ur_serialRead, ur_serialReaderFree
+*/
+void ur_serialReaderInit( USerialReader* rd )
+{
+    ur_arrInit( &rd->atoms, sizeof(UAtom), 0 );
+}
+
+
+/**
+  Free serial stream reader memory.
+*/
+void ur_serialReaderFree( USerialReader* rd )
+{
+    ur_arrFree( &rd->atoms );
+}
+
+
+/**
+  Unserialize the next value of a stream made by ur_serialWrite().
+
+  \param  start     Start of serialized input.
+  \param  end       End of input.
+  \param  res       Set to a new block holding the value.
+
+  \return Number of input bytes used, or zero if the input does not hold
+          all of the value.  If the input is invalid then an error is
+          generated with ur_error() and -1 is returned.
+*/
+int ur_serialRead( UThread* ut, USerialReader* rd, const uint8_t* start,
+                   const uint8_t* end, UCell* res )
+{
+    SerialHead head;
+    size_t len = end - start;
+    int ok;
+
+    if( len < sizeof(SerialHead) )
+        return 0;
+
+    // Wait for the rest of anything which looks like a valid value.
+    memCpy( &head, start, sizeof(SerialHead) );
+    if( head.size > len && head.order == SER_ORDER &&
+        ! memcmp( head.magic, "BOR2", 4 ) )
+        return 0;
+
+    ok = _serialHead( ut, start, len, &head );
+    if( ok < 0 )
+        ur_error( ut, UR_ERR_SCRIPT, "Invalid serialized stream" );
+    if( ok <= 0 )
+        return -1;
+
+    if( ! _unserializeCopy( ut, start, &head, &rd->atoms, res ) )
+        return -1;
+    return head.size;
+}
+
+
 //EOF
@@ -33,6 +33,10 @@
 #include "os.h"
 #include "mem_util.h"
 
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
 #include "ucs2_case.c"
 
 
@@ -260,6 +264,27 @@ UIndex ur_makeStringUtf8( UThread* ut, const uint8_t* it, const uint8_t* end )
 
     while( it != end )
     {
+#ifdef __SSE2__
+        // Copy ASCII characters 16 at a time up to any non-ASCII or caret.
+        while( (end - it) >= 16 )
+        {
+            __m128i v = _mm_loadu_si128( (const __m128i*) it );
+            int special = _mm_movemask_epi8( v ) | _mm_movemask_epi8(
+                            _mm_cmpeq_epi8( v, _mm_set1_epi8('^') ) );
+            _mm_storeu_si128( (__m128i*) out, v );
+            if( special )
+            {
+                special = __builtin_ctz( special );
+                it  += special;
+                out += special;
+                break;
+            }
+            it  += 16;
+            out += 16;
+        }
+        if( it == end )
+            break;
+#endif
         ch = *it++;
         if( ch > 0x7f )
         {
@@ -1126,38 +1151,113 @@ void ur_strUppercase( UBuffer* buf, UIndex start, UIndex send )
 }
 
 
+// Lowercase character; ur_charLowercase() without the call for Latin-1.
+#define LC8(c)  _lowerLatin1[ c ]
+#define LC(c)   (((c) < 256) ? (int) _lowerLatin1[ c ] : ur_charLowercase(c))
+
+
+/*
+  Return the other Latin-1 character which lowercases to lc (or lc itself
+  if there is none).  This is used to scan 8-bit text for both cases of a
+  character at once.
+*/
+static int _upperLatin1( int lc )
+{
+    int uc = ur_charUppercase( lc );
+    return (uc < 256 && LC8(uc) == lc) ? uc : lc;
+}
+
+
 /*
   Returns pointer to val or zero if val not found.
+  val must be lowercase.
 */
-#define FIND_LC(T) \
-const T* find_lc_ ## T( const T* it, const T* end, T val ) { \
-    while( it != end ) { \
-        if( ur_charLowercase(*it) == val ) \
-            return it; \
-        ++it; \
-    } \
-    return 0; \
+const uint8_t* find_lc_uint8_t( const uint8_t* it, const uint8_t* end,
+                                uint8_t val )
+{
+#ifdef __SSE2__
+    __m128i vlo = _mm_set1_epi8( val );
+    __m128i vup = _mm_set1_epi8( _upperLatin1( val ) );
+    __m128i v;
+    int mask;
+
+    while( (end - it) >= 16 )
+    {
+        v = _mm_loadu_si128( (const __m128i*) it );
+        mask = _mm_movemask_epi8( _mm_or_si128( _mm_cmpeq_epi8( v, vlo ),
+                                                _mm_cmpeq_epi8( v, vup ) ) );
+        if( mask )
+            return it + __builtin_ctz( mask );
+        it += 16;
+    }
+#endif
+    while( it != end )
+    {
+        if( LC8(*it) == val )
+            return it;
+        ++it;
+    }
+    return 0;
 }
 
-FIND_LC(uint8_t)
-FIND_LC(uint16_t)
+
+const uint16_t* find_lc_uint16_t( const uint16_t* it, const uint16_t* end,
+                                  uint16_t val )
+{
+    while( it != end )
+    {
+        if( LC(*it) == val )
+            return it;
+        ++it;
+    }
+    return 0;
+}
 
 
 /*
   Returns pointer to val or zero if val not found.
+  val must be lowercase.
 */
-#define FIND_LC_LAST(T) \
-const T* find_lc_last_ ## T( const T* it, const T* end, T val ) { \
-    while( it != end ) { \
-        --end; \
-        if( ur_charLowercase(*end) == val ) \
-            return end; \
-    } \
-    return 0; \
+const uint8_t* find_lc_last_uint8_t( const uint8_t* it, const uint8_t* end,
+                                     uint8_t val )
+{
+#ifdef __SSE2__
+    __m128i vlo = _mm_set1_epi8( val );
+    __m128i vup = _mm_set1_epi8( _upperLatin1( val ) );
+    __m128i v;
+    int mask;
+
+    while( (end - it) >= 16 )
+    {
+        end -= 16;
+        v = _mm_loadu_si128( (const __m128i*) end );
+        mask = _mm_movemask_epi8( _mm_or_si128( _mm_cmpeq_epi8( v, vlo ),
+                                                _mm_cmpeq_epi8( v, vup ) ) );
+        if( mask )
+            return end + (31 - __builtin_clz( mask ));
+    }
+#endif
+    while( it != end )
+    {
+        --end;
+        if( LC8(*end) == val )
+            return end;
+    }
+    return 0;
 }
 
-FIND_LC_LAST(uint8_t)
-FIND_LC_LAST(uint16_t)
+
+const uint16_t* find_lc_last_uint16_t( const uint16_t* it,
+                                       const uint16_t* end, uint16_t val )
+{
+    while( it != end )
+    {
+        --end;
+        if( LC(*end) == val )
+            return end;
+    }
+    return 0;
+}
 
 
 /**
@@ -1201,6 +1301,8 @@ UIndex ur_strFindChar( const UBuffer* str, UIndex start, UIndex end, int ch,
         const uint8_t* (*func)( const uint8_t*, const uint8_t*, uint8_t );
         const uint8_t* it;
 
+        if( ch > 255 && (matchCase || ur_charLowercase( ch ) > 255) )
+            return -1;
         if( matchCase )
         {
             func = (opt & UR_FIND_LAST) ? find_last_uint8_t
@@ -1292,29 +1394,82 @@ UIndex ur_strFindCharsRev( const UBuffer* str, UIndex start, UIndex end,
 
 /*
   Returns first occurance of pattern or 0 if it is not found.
+
+  Like find_pattern_*(), candidates are found by checking the first and
+  last pattern characters, and long patterns use Boyer-Moore-Horspool.
 */
 #define FIND_PATTERN_IC(N,T,P) \
 const T* find_pattern_ic_ ## N( const T* it, const T* end, \
         const P* pit, const P* pend ) { \
-    int pfirst = ur_charLowercase(*pit++); \
-    while( it != end ) { \
-        if( ur_charLowercase(*it) == pfirst ) { \
-            const T* in = it + 1; \
-            const P* p  = pit; \
-            while( p != pend && in != end ) { \
-                if( ur_charLowercase(*in) != ur_charLowercase(*p) ) \
+    const T* last; \
+    int m = pend - pit; \
+    int i; \
+    int pfirst, plast; \
+    if( m < 1 || m > end - it ) \
+        return 0; \
+    pfirst = LC( pit[0] ); \
+    plast  = LC( pit[m - 1] ); \
+    FIND_PATTERN_IC_FAST(N) \
+    last = end - m; \
+    for( ; it <= last; ++it ) { \
+        if( LC(*it) == pfirst && LC(it[m - 1]) == plast ) { \
+            for( i = 1; i < m - 1; ++i ) \
+                if( LC(it[i]) != LC(pit[i]) ) \
                     break; \
-                ++in; \
-                ++p; \
-            } \
-            if( p == pend ) \
+            if( i >= m - 1 ) \
                 return it; \
         } \
-        ++it; \
     } \
     return 0; \
 }
 
+#define FIND_PATTERN_IC_FAST(N)     FIND_PATTERN_IC_FAST_ ## N
+#define FIND_PATTERN_IC_FAST_16
+#define FIND_PATTERN_IC_FAST_16_8
+#define FIND_PATTERN_IC_FAST_8 \
+    if( m >= HORSPOOL_MIN_PATTERN && end - it >= HORSPOOL_MIN_INPUT ) \
+        return find_horspool_8( it, end, pit, pend, _lowerLatin1 ); \
+    FIND_PATTERN_IC_SIMD
+#define FIND_PATTERN_IC_FAST_8_16 \
+    if( pfirst > 255 || plast > 255 ) \
+        return 0; \
+    FIND_PATTERN_IC_SIMD
+
+#ifdef __SSE2__
+#define FIND_PATTERN_IC_SIMD \
+    { \
+    __m128i f0 = _mm_set1_epi8( pfirst ); \
+    __m128i f1 = _mm_set1_epi8( _upperLatin1( pfirst ) ); \
+    __m128i l0 = _mm_set1_epi8( plast ); \
+    __m128i l1 = _mm_set1_epi8( _upperLatin1( plast ) ); \
+    __m128i v; \
+    int mask, mlast, n; \
+    while( end - it >= m - 1 + 16 ) { \
+        v = _mm_loadu_si128( (const __m128i*) it ); \
+        mask = _mm_movemask_epi8( _mm_or_si128( _mm_cmpeq_epi8( v, f0 ), \
+                                                _mm_cmpeq_epi8( v, f1 ) ) ); \
+        if( mask ) { \
+            v = _mm_loadu_si128( (const __m128i*) (it + m - 1) ); \
+            mlast = _mm_movemask_epi8( _mm_or_si128( \
+                        _mm_cmpeq_epi8( v, l0 ), _mm_cmpeq_epi8( v, l1 ) ) ); \
+            mask &= mlast; \
+        } \
+        while( mask ) { \
+            n = __builtin_ctz( mask ); \
+            for( i = 1; i < m - 1; ++i ) \
+                if( LC8(it[n + i]) != LC(pit[i]) ) \
+                    break; \
+            if( i >= m - 1 ) \
+                return it + n; \
+            mask &= mask - 1; \
+        } \
+        it += 16; \
+    } \
+    }
+#else
+#define FIND_PATTERN_IC_SIMD
+#endif
+
 FIND_PATTERN_IC(8,uint8_t,uint8_t)
 FIND_PATTERN_IC(16,uint16_t,uint16_t)
 FIND_PATTERN_IC(8_16,uint8_t,uint16_t)
@@ -1410,7 +1565,7 @@ const P* match_pattern_ic_ ## N( const T* it, const T* end, \
     while( pit != pend ) { \
         if( it == end ) \
             return pit; \
-        if( ur_charLowercase(*it) != ur_charLowercase(*pit) ) \
+        if( LC(*it) != LC(*pit) ) \
             return pit; \
         ++it; \
         ++pit; \
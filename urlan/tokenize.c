@@ -25,6 +25,10 @@
 #include "mem_util.h"
 #include "os.h"
 
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
 #ifdef _MSC_VER
 #define inline  __inline
 #endif
@@ -568,6 +572,81 @@ static UCell* _tokenizePath( UThread* ut, UBuffer* blk,
 #define SCAN_END    }
 
 
+#ifdef __SSE2__
+#define SCAN_SIMD   16
+#define vcmpeq(v,c) _mm_cmpeq_epi8(v, _mm_set1_epi8(c))
+#endif
+
+/*
+  Find the first of the characters a, b, or c.
+
+  \param lines  The number of newlines before the found character is added
+                to this.
+
+  Returns pointer to the found character or end.
+*/
+static const char* scanTo( const char* it, const char* end, int a, int b,
+                           int c, int* lines )
+{
+    int ch;
+    int lineCount = 0;
+
+#ifdef SCAN_SIMD
+    for( ; (end - it) >= SCAN_SIMD; it += SCAN_SIMD )
+    {
+        __m128i v = _mm_loadu_si128( (const __m128i*) it );
+        int stop = _mm_movemask_epi8( _mm_or_si128( _mm_or_si128(
+                        vcmpeq(v, a), vcmpeq(v, b) ), vcmpeq(v, c) ) );
+        int nl = _mm_movemask_epi8( vcmpeq(v, '\n') );
+        if( stop )
+        {
+            stop = __builtin_ctz( stop );
+            *lines += lineCount +
+                      __builtin_popcount( nl & ((1 << stop) - 1) );
+            return it + stop;
+        }
+        lineCount += __builtin_popcount( nl );
+    }
+#endif
+
+    SCAN_LOOP
+        if( ch == a || ch == b || ch == c )
+            break;
+        if( ch == '\n' )
+            ++lineCount;
+    SCAN_END
+
+    *lines += lineCount;
+    return it;
+}
+
+
+/*
+  Returns pointer to the first character which is not a space or tab.
+*/
+static const char* skipBlanks( const char* it, const char* end )
+{
+    int ch;
+
+#ifdef SCAN_SIMD
+    for( ; (end - it) >= SCAN_SIMD; it += SCAN_SIMD )
+    {
+        __m128i v = _mm_loadu_si128( (const __m128i*) it );
+        int blank = _mm_movemask_epi8( _mm_or_si128( vcmpeq(v, ' '),
+                                                     vcmpeq(v, '\t') ) );
+        if( blank != 0xffff )
+            return it + __builtin_ctz( ~blank );
+    }
+#endif
+
+    SCAN_LOOP
+        if( ch != ' ' && ch != '\t' )
+            break;
+    SCAN_END
+    return it;
+}
+
+
 /*
    Skips over C-style block comments, which may be nested.
 
@@ -585,6 +664,14 @@ static const char* blockComment( const char* it, const char* end, int* lines )
 
 
     SCAN_LOOP
+        if( ! mode )
+        {
+            it = scanTo( it, end, '*', '/', '/', &lineCount );
+            if( it == end )
+                break;
+            ch = *it;
+        }
+
         if( ch == '\n' )
         {
             ++lineCount;
@@ -763,28 +850,43 @@ UIndex ur_tokenize( UThread* ut, const char* it, const char* end, UCell* res )
 }
 
 
-UIndex ur_tokenizeType( UThread* ut, int inputEncoding,
-                        const char* it, const char* end, UCell* res )
+/*
+  Append values to tok->blkN.
+
+  If partial is non-zero then the input may end in the middle of a value.
+  Any top-level value which is not complete when the end is reached is
+  removed from the block and *pos is set to where it starts.  Otherwise
+  *pos is set to end.
+
+  Returns non-zero if successful or zero if a syntax error was found.
+*/
+static int _tokenize( UThread* ut, UTokenizer* tok, const char* it,
+                      const char* end, int partial, const char** pos )
 {
 #define STACK   stack.ptr.i
 #define BLOCK   ur_buffer( STACK[ stack.used - 1 ] )
     UBuffer stack;
     UIndex hold;
-    UIndex blkN;
     UCell* cell;
     const char* token;
     const char* errorMsg;
+    const char* safe = it;
+    int inputEncoding = tok->encoding;
     int ch;
     int mode;
-    int sol = 0;
-    int lines = 0;
+    int ok = 1;
+    int sol = tok->sol;
+    int lines = tok->lines;
+    int safeSol = sol;
+    int safeLines = lines;
+    UIndex safeUsed;
 
 
-    blkN = ur_makeBlock( ut, 0 );
-    hold = ur_hold( blkN );
+    hold = ur_hold( tok->blkN );
+    safeUsed = ur_buffer( tok->blkN )->used;
 
     ur_arrInit( &stack, sizeof(UIndex), 32 );
-    ur_arrAppendInt32( &stack, blkN );
+    ur_arrAppendInt32( &stack, tok->blkN );
 
 start:
 
@@ -792,9 +894,19 @@ start:
         if( ch > 126 )
             goto invalid_char;
 
+        if( partial && stack.used == 1 )
+        {
+            // Remember where the last complete top-level value ends.
+            safe      = it;
+            safeSol   = sol;
+            safeLines = lines;
+            safeUsed  = BLOCK->used;
+        }
+
         switch( firstCharOp[ ch ] )
         {
             case SKIP:
+                it = skipBlanks( it + 1, end ) - 1;
                 break;
 
             case NL:
@@ -804,10 +916,9 @@ newline:
                 break;
 
             case COM_L:
-                SCAN_LOOP
-                    if( ch == '\n' )
-                        goto newline;
-                SCAN_END
+                it = scanTo( it, end, '\n', '\n', '\n', &lines );
+                if( it != end )
+                    goto newline;
                 goto finish;
 
             case COM_B:
@@ -871,6 +982,7 @@ invalid_bin:
                             syntaxError( "Invalid binary" );
                         }
                     SCAN_END
+                    goto invalid_bin;
                 }
                 else if( *it == '[' )
                 {
@@ -960,7 +1072,10 @@ vector_newline:
                 if( ch == '{' )
                 {
                     int nested = 0;
-                    SCAN_LOOP
+                    while( (it = scanTo( it, end, '^', '{', '}', &lines ))
+                           != end )
+                    {
+                        ch = *it;
                         if( ch == '^' )
                         {
                             if( ++it == end )
@@ -970,30 +1085,30 @@ vector_newline:
                         {
                             ++nested;
                         }
-                        else if( ch == '}' )
+                        else
                         {
                             if( nested )
                                 --nested;
                             else
                                 goto string_end;
                         }
-                        else if( ch == '\n' )
-                            ++lines;
-                    SCAN_END
+                        ++it;
+                    }
                 }
                 else // if( ch == '"' )
                 {
-                    SCAN_LOOP
-                        if( ch == '^' )
-                        {
-                            if( ++it == end )
-                                break;
-                        }
+                    while( (it = scanTo( it, end, '^', '"', '\n', &lines ))
+                           != end )
+                    {
+                        ch = *it;
                         if( ch == '"' )
                             goto string_end;
                         if( ch == '\n' )
                             break;
-                    SCAN_END
+                        if( ++it == end )
+                            break;
+                        ++it;
+                    }
                 }
                 syntaxError( "String not terminated" );
 string_end:
@@ -1233,7 +1348,7 @@ alpha:
                     }
                     cell = ur_blkAppendNew( BLOCK, UT_SETWORD );
                     mode = ur_internAtom( ut, token, it );
-                    if( mode == UR_INVALID_ATOM )
+                    if( (UAtom) mode == UR_INVALID_ATOM )
                         goto error;
                     ur_setWordUnbound( cell, mode );
                     ++it;
@@ -1243,7 +1358,7 @@ alpha:
 word:
                     cell = ur_blkAppendNew( BLOCK, mode );
                     mode = ur_internAtom( ut, token, it );
-                    if( mode == UR_INVALID_ATOM )
+                    if( (UAtom) mode == UR_INVALID_ATOM )
                         goto error;
                     ur_setWordUnbound( cell, mode );
                 }
@@ -1263,6 +1378,9 @@ word:
 
 finish:
 
+    if( partial )
+        goto partial_end;
+
     if( stack.used > 1 )
     {
         syntaxError( "Block or paren not closed" );
@@ -1270,16 +1388,30 @@ finish:
 
     //ur_bindDefault( ut, blkN );   // Assumes languge?
 
+    tok->sol   = sol;
+    tok->lines = lines;
+    *pos = end;
+
 cleanup:
 
     ur_release( hold );
     ur_arrFree( &stack );
-    if( blkN )
+    return ok;
+
+partial_end:
+
+    {
+    UBuffer* blk = ur_buffer( tok->blkN );
+    if( blk->used != safeUsed )
     {
-        ur_setId( res, UT_BLOCK );
-        ur_setSeries( res, blkN, 0 );
+        blk->used = safeUsed;
+        ur_gcWrite( tok->blkN );
     }
-    return blkN;
+    }
+    tok->sol   = safeSol;
+    tok->lines = safeLines;
+    *pos = safe;
+    goto cleanup;
 
 set_sol:
 
@@ -1298,11 +1430,15 @@ invalid_char:
 
 error_msg:
 
+    if( partial && it == end )
+        goto partial_end;
     ur_error( ut, UR_ERR_SYNTAX, "%s (line %d)", errorMsg, lines + 1 );
     goto error;
 
 error_token:
 
+    if( partial && it == end )
+        goto partial_end;
     {
     UBuffer etok;
     ur_binInit( &etok, 0 );
@@ -1313,9 +1449,152 @@ error_token:
 
 error:
 
-    blkN = 0;
+    ok = 0;
     goto cleanup;
 }
 
 
+UIndex ur_tokenizeType( UThread* ut, int inputEncoding,
+                        const char* it, const char* end, UCell* res )
+{
+    UTokenizer tok;
+
+    tok.blkN     = ur_makeBlock( ut, 0 );
+    tok.encoding = inputEncoding;
+    tok.lines    = 0;
+    tok.sol      = 0;
+
+    if( ! _tokenize( ut, &tok, it, end, 0, &it ) )
+        return 0;
+
+    ur_setId( res, UT_BLOCK );
+    ur_setSeries( res, tok.blkN, 0 );
+    return tok.blkN;
+}
+
+
+/**
+  \ingroup urlan_core
+
+  Initialize a tokenizer which converts text supplied in pieces into values.
+  This allows large inputs to be loaded as they are read without holding all
+  of the text in memory.
+
+  The caller must keep the block referenced until the tokenizer is freed.
+
+  \param inputEncoding  UR_ENC_UTF8 or UR_ENC_LATIN1.
+  \param blkN   Block which top-level values are appended to.
+
+  \sa ur_tokenizerFeed, ur_tokenizerEnd, ur_tokenizerFree
+*/
+void ur_tokenizerInit( UTokenizer* tok, int inputEncoding, UIndex blkN )
+{
+    ur_binInit( &tok->text, 0 );
+    tok->blkN     = blkN;
+    tok->encoding = inputEncoding;
+    tok->lines    = 0;
+    tok->sol      = 0;
+    tok->retryLen = 0;
+}
+
+
+/**
+  \ingroup urlan_core
+
+  Free tokenizer memory.
+*/
+void ur_tokenizerFree( UTokenizer* tok )
+{
+    ur_binFree( &tok->text );
+}
+
+
+/**
+  \ingroup urlan_core
+
+  Tokenize the next piece of input.
+
+  Top-level values are appended to the block as soon as they are complete.
+  The text of any value which continues past the end of the input is kept
+  by the tokenizer until more input is given.
+
+  \param it     Start of input.
+  \param end    End of input.
+
+  \return Number of values appended to the block.  If a syntax error is found,
+          then an error is generated with ur_error() and -1 is returned.
+*/
+int ur_tokenizerFeed( UThread* ut, UTokenizer* tok, const char* it,
+                      const char* end )
+{
+    UBuffer* text = &tok->text;
+    const char* cut;
+    const char* pos;
+    int used = ur_buffer( tok->blkN )->used;
+    int ch;
+
+    if( text->used )
+    {
+        ur_binAppendData( text, (const uint8_t*) it, end - it );
+        it  = text->ptr.c;
+        end = it + text->used;
+    }
+
+    // Values can only end at whitespace, so stop before any partial token.
+    for( cut = end; cut != it; --cut )
+    {
+        ch = ((const uint8_t*) cut)[-1];
+        if( IS_WHITE(ch) )
+            break;
+    }
+
+    // A long value (such as a large block) is only rescanned each time the
+    // pending text doubles in size.
+    if( (cut - it) > tok->retryLen )
+    {
+        if( ! _tokenize( ut, tok, it, cut, 1, &pos ) )
+            return -1;
+        if( ur_buffer( tok->blkN )->used == used )
+            tok->retryLen = (cut - pos) * 2;
+        else
+            tok->retryLen = 0;
+    }
+    else
+        pos = it;
+
+    if( text->used )
+        ur_binErase( text, 0, pos - text->ptr.c );
+    else
+        ur_binAppendData( text, (const uint8_t*) pos, end - pos );
+
+    return ur_buffer( tok->blkN )->used - used;
+}
+
+
+/**
+  \ingroup urlan_core
+
+  Tokenize any input remaining after the last ur_tokenizerFeed() call.
+
+  \return Number of values appended to the block.  If a syntax error is found,
+          then an error is generated with ur_error() and -1 is returned.
+*/
+int ur_tokenizerEnd( UThread* ut, UTokenizer* tok )
+{
+    UBuffer* text = &tok->text;
+    const char* pos;
+    int used = ur_buffer( tok->blkN )->used;
+
+    if( text->used )
+    {
+        int ok = _tokenize( ut, tok, text->ptr.c, text->ptr.c + text->used,
+                            0, &pos );
+        text->used = 0;
+        if( ! ok )
+            return -1;
+    }
+    return ur_buffer( tok->blkN )->used - used;
+}
+
+
 //EOF
@@ -20,8 +20,10 @@
 // UT_VECTOR
 
 
+#include <math.h>
 #include "urlan.h"
 #include "urlan_atoms.h"
+#include "bignum.h"
 #include "unset.h"
 #include "os.h"
 #include "mem_util.h"
@@ -836,6 +838,584 @@ int vector_find( UThread* ut, const USeriesIter* si, const UCell* val, int opt )
 }
 
 
+//----------------------------------------------------------------------------
+// Arithmetic, reductions, & comparison masks
+
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define VECTOR_X86
+#endif
+
+#define VEC_FORMS       6
+#define VK_MASK_CHUNK   64
+
+// Integer math is done unsigned so that overflow wraps like the int! type.
+#define VK_IADD(T,x,y)  (T) ((uint32_t) (x) + (uint32_t) (y))
+#define VK_ISUB(T,x,y)  (T) ((uint32_t) (x) - (uint32_t) (y))
+#define VK_IMUL(T,x,y)  (T) ((uint32_t) (x) * (uint32_t) (y))
+#define VK_IDIV(T,x,y)  (T) ((int64_t) (x) / (y))
+#define VK_IMOD(T,x,y)  (T) ((int64_t) (x) % (y))
+#define VK_AND(T,x,y)   (T) ((x) & (y))
+#define VK_OR(T,x,y)    (T) ((x) | (y))
+#define VK_XOR(T,x,y)   (T) ((x) ^ (y))
+#define VK_FADD(T,x,y)  ((x) + (y))
+#define VK_FSUB(T,x,y)  ((x) - (y))
+#define VK_FMUL(T,x,y)  ((x) * (y))
+#define VK_FDIV(T,x,y)  ((x) / (y))
+#define VK_FMOD(T,x,y)  (T) fmod( x, y )
+
+typedef union
+{
+    int64_t i;
+    double  d;
+}
+VecAccum;
+
+typedef union
+{
+    int16_t  i16;
+    uint16_t u16;
+    int32_t  i;
+    uint32_t u32;
+    float    f;
+    double   d;
+}
+VecScalar;
+
+typedef void (*VecBinFunc)( void*, const void*, const void*, int );
+typedef void (*VecFoldFunc)( const void*, const void*, int, VecAccum* );
+typedef void (*VecMaskFunc)( uint8_t*, const void*, const void*, int );
+
+typedef struct
+{
+    VecBinFunc  vv[ VEC_FORMS ][ UR_OP_XOR + 1 ];   // vector op vector
+    VecBinFunc  vs[ VEC_FORMS ][ UR_OP_XOR + 1 ];   // vector op scalar
+    VecBinFunc  sv[ VEC_FORMS ][ UR_OP_XOR + 1 ];   // scalar op vector
+    VecFoldFunc fold[ VEC_FORMS ][ UR_VFOLD_DOT + 1 ];
+    VecMaskFunc maskV[ VEC_FORMS ][ UR_VCMP_GE + 1 ];
+    VecMaskFunc maskS[ VEC_FORMS ][ UR_VCMP_GE + 1 ];
+}
+VecKernels;
+
+static VecKernels _vecKernels;
+
+
+/*
+  Pack n comparison results (each 0 or 1) into bits.
+*/
+static inline void vk_packBits( uint8_t* bits, const uint8_t* t, int n )
+{
+    uint64_t x;
+    int i, k;
+
+    for( i = 0; i < n; i += 8 )
+    {
+        x = 0;
+        for( k = 0; k < 8 && i + k < n; ++k )
+            x |= (uint64_t) t[i + k] << (k * 8);
+        // Gather the low bit of each byte into the top byte.
+        *bits++ = (uint8_t) ((x * 0x0102040810204080ULL) >> 56);
+    }
+}
+
+
+#define KATTR
+#define KN(name)    name##_base
+#include "vector_kern.c"
+#undef KATTR
+#undef KN
+
+#ifdef VECTOR_X86
+#define KATTR       __attribute__((target("avx2")))
+#define KN(name)    name##_avx2
+#include "vector_kern.c"
+#undef KATTR
+#undef KN
+#endif
+
+
+/*
+  Select the kernels for this CPU.
+  This is called by ur_makeEnvP() before any threads exist.
+*/
+void vector_initKernels()
+{
+    if( _vecKernels.vv[0][0] )
+        return;
+#ifdef VECTOR_X86
+    __builtin_cpu_init();
+    if( __builtin_cpu_supports( "avx2" ) )
+    {
+        vk_setKernels_avx2( &_vecKernels );
+        return;
+    }
+#endif
+    vk_setKernels_base( &_vecKernels );
+}
+
+
+#define vecFormIndex(f)     ((f) - UR_VEC_I16)
+#define vecFormValid(f)     ((f) >= UR_VEC_I16 && (f) <= UR_VEC_F64)
+#define vecFormInt(f)       ((f) < UR_VEC_F32)
+#define vecElem(buf,n)      ((const uint8_t*) (buf)->ptr.v + (n)*(buf)->elemSize)
+
+
+static double vec_getD( const UBuffer* buf, UIndex n )
+{
+    switch( buf->form )
+    {
+        case UR_VEC_I16: return buf->ptr.i16[ n ];
+        case UR_VEC_U16: return buf->ptr.u16[ n ];
+        case UR_VEC_I32: return buf->ptr.i[ n ];
+        case UR_VEC_U32: return buf->ptr.u32[ n ];
+        case UR_VEC_F32: return buf->ptr.f[ n ];
+        default:         return buf->ptr.d[ n ];
+    }
+}
+
+
+static void vec_setD( UBuffer* buf, UIndex n, double d )
+{
+    int64_t i = 0;
+
+    if( vecFormInt( buf->form ) && d > -9.2e18 && d < 9.2e18 )
+        i = (int64_t) d;
+
+    switch( buf->form )
+    {
+        case UR_VEC_I16: buf->ptr.i16[ n ] = (int16_t) i; break;
+        case UR_VEC_U16: buf->ptr.u16[ n ] = (uint16_t) i; break;
+        case UR_VEC_I32: buf->ptr.i[ n ]   = (int32_t) i; break;
+        case UR_VEC_U32: buf->ptr.u32[ n ] = (uint32_t) i; break;
+        case UR_VEC_F32: buf->ptr.f[ n ]   = (float) d; break;
+        default:         buf->ptr.d[ n ]   = d; break;
+    }
+}
+
+
+/*
+  Convert an int!/char!/decimal! cell to the element type of form.
+
+  \return Non-zero if the value is exactly representable, zero if it must be
+          handled as a double or -1 if the cell is not a number.
+*/
+static int vec_scalar( const UCell* cell, int form, VecScalar* sv,
+                       double* dp )
+{
+    int type = ur_type(cell);
+    int32_t n;
+
+    if( type == UT_DECIMAL )
+    {
+        *dp = ur_decimal(cell);
+        if( form == UR_VEC_F32 )
+            sv->f = (float) *dp;
+        else if( form == UR_VEC_F64 )
+            sv->d = *dp;
+        else
+            return 0;
+        return 1;
+    }
+    if( (type != UT_INT) && (type != UT_CHAR) )
+        return -1;
+
+    n = ur_int(cell);
+    *dp = (double) n;
+    switch( form )
+    {
+        case UR_VEC_I16:
+            sv->i16 = (int16_t) n;
+            return sv->i16 == n;
+        case UR_VEC_U16:
+            sv->u16 = (uint16_t) n;
+            return sv->u16 == n;
+        case UR_VEC_I32:
+            sv->i = n;
+            break;
+        case UR_VEC_U32:
+            sv->u32 = (uint32_t) n;
+            return n >= 0;
+        case UR_VEC_F32:
+            sv->f = (float) n;
+            break;
+        default:
+            sv->d = (double) n;
+            break;
+    }
+    return 1;
+}
+
+
+static int vec_hasZero( const UBuffer* buf, UIndex it, int len )
+{
+    UIndex end = it + len;
+    for( ; it != end; ++it )
+    {
+        if( vec_getD( buf, it ) == 0.0 )
+            return 1;
+    }
+    return 0;
+}
+
+
+static void vec_setInt64( UCell* cell, int64_t n )
+{
+    if( n > INT32_MAX || n < INT32_MIN )
+    {
+        ur_setId(cell, UT_BIGNUM);
+        bignum_setl( cell, n );
+    }
+    else
+    {
+        ur_setId(cell, UT_INT);
+        ur_int(cell) = (int32_t) n;
+    }
+}
+
+
+#define vecFormError   "vector! math expected i16/u16/i32/u32/f32/f64"
+
+
+/*
+  Operate on vectors with mixed element types (or an integer vector with a
+  decimal! value) by converting each element to double.
+*/
+static int vec_operateD( UThread* ut, UBuffer* rbuf,
+                         const UBuffer* abuf, UIndex ai,
+                         const UBuffer* bbuf, UIndex bi,
+                         double sn, int swap, int len, int op )
+{
+    double x, y;
+    int i;
+    int isInt = vecFormInt( rbuf->form );
+
+    for( i = 0; i < len; ++i )
+    {
+        x = vec_getD( abuf, ai + i );
+        y = bbuf ? vec_getD( bbuf, bi + i ) : sn;
+        if( swap )
+        {
+            double t = x;
+            x = y;
+            y = t;
+        }
+        switch( op )
+        {
+            case UR_OP_ADD: x += y; break;
+            case UR_OP_SUB: x -= y; break;
+            case UR_OP_MUL: x *= y; break;
+            case UR_OP_DIV:
+            case UR_OP_MOD:
+                // The quotient is truncated by vec_setD() for integer forms.
+                if( isInt && y == 0.0 )
+                    return ur_error( ut, UR_ERR_SCRIPT,
+                                     "vector! divide by zero" );
+                x = (op == UR_OP_DIV) ? x / y : fmod( x, y );
+                break;
+            case UR_OP_AND: x = (double) ((int64_t) x & (int64_t) y); break;
+            case UR_OP_OR:  x = (double) ((int64_t) x | (int64_t) y); break;
+            case UR_OP_XOR: x = (double) ((int64_t) x ^ (int64_t) y); break;
+        }
+        vec_setD( rbuf, i, x );
+    }
+    return UR_OK;
+}
+
+
+/*
+  The result is a new vector with the element type of the vector argument
+  and the length of the shorter series.  If both are vectors then the
+  element type of the first is used, unless only one is f32/f64 in which
+  case the result is the floating point type (f64 if either is f64).
+  Division of integer vectors by zero is an error, while f32 & f64 vectors
+  follow IEEE rules.
+*/
+int vector_operate( UThread* ut, const UCell* a, const UCell* b, UCell* res,
+                    int op )
+{
+    UCell vc;
+    UCell sc;
+    USeriesIter ai;
+    USeriesIter bi;
+    UBuffer* rbuf;
+    const UBuffer* abuf;
+    VecScalar sv;
+    double sn = 0.0;
+    int form, len, swap, exact;
+
+    if( op < UR_OP_ADD || op > UR_OP_XOR )
+        return unset_operate( ut, a, b, res, op );
+
+    // Copy the arguments as res may be one of them.
+    swap = ! ur_is(a, UT_VECTOR);
+    vc = swap ? *b : *a;
+    sc = swap ? *a : *b;
+
+    ur_seriesSlice( ut, &ai, &vc );
+    form = ai.buf->form;
+    if( ! vecFormValid( form ) )
+        return ur_error( ut, UR_ERR_TYPE, vecFormError );
+    len = ai.end - ai.it;
+
+    if( ur_is(&sc, UT_VECTOR) )
+    {
+        ur_seriesSlice( ut, &bi, &sc );
+        if( ! vecFormValid( bi.buf->form ) )
+            return ur_error( ut, UR_ERR_TYPE, vecFormError );
+        if( len > bi.end - bi.it )
+            len = bi.end - bi.it;
+        exact = (bi.buf->form == form);
+        if( ! exact && ! vecFormInt( bi.buf->form ) )
+        {
+            if( vecFormInt( form ) || bi.buf->form == UR_VEC_F64 )
+                form = bi.buf->form;
+        }
+        if( exact && vecFormInt( form ) &&
+            (op == UR_OP_DIV || op == UR_OP_MOD) &&
+            vec_hasZero( bi.buf, bi.it, len ) )
+            goto div_by_zero;
+    }
+    else
+    {
+        exact = vec_scalar( &sc, form, &sv, &sn );
+        if( exact < 0 )
+            return ur_error( ut, UR_ERR_TYPE,
+                        "vector! operator expected char!/int!/decimal!/vector!" );
+        if( exact && vecFormInt( form ) &&
+            (op == UR_OP_DIV || op == UR_OP_MOD) )
+        {
+            if( swap ? vec_hasZero( ai.buf, ai.it, len ) : (sn == 0.0) )
+                goto div_by_zero;
+        }
+        bi.buf = 0;
+        bi.it = 0;
+    }
+
+    if( op >= UR_OP_AND && ! vecFormInt( form ) )
+        return ur_error( ut, UR_ERR_TYPE,
+                         "vector! and/or/xor expected integer vector" );
+
+    rbuf = ur_makeVectorCell( ut, form, len, res );     // Invalidates ai.buf.
+    rbuf->used = len;
+    abuf = ur_bufferSer( &vc );
+
+    if( ! exact )
+    {
+        if( ur_is(&sc, UT_VECTOR) )
+            return vec_operateD( ut, rbuf, abuf, ai.it, ur_bufferSer( &sc ),
+                                 bi.it, 0.0, 0, len, op );
+        return vec_operateD( ut, rbuf, abuf, ai.it, 0, 0, sn, swap, len, op );
+    }
+
+    if( ur_is(&sc, UT_VECTOR) )
+        _vecKernels.vv[ vecFormIndex(form) ][ op ]( rbuf->ptr.v,
+                vecElem( abuf, ai.it ),
+                vecElem( ur_bufferSer( &sc ), bi.it ), len );
+    else if( swap )
+        _vecKernels.sv[ vecFormIndex(form) ][ op ]( rbuf->ptr.v,
+                vecElem( abuf, ai.it ), &sv, len );
+    else
+        _vecKernels.vs[ vecFormIndex(form) ][ op ]( rbuf->ptr.v,
+                vecElem( abuf, ai.it ), &sv, len );
+    return UR_OK;
+
+div_by_zero:
+
+    return ur_error( ut, UR_ERR_SCRIPT, "vector! divide by zero" );
+}
+
+
+/**
+  Reduce a vector to a single number.
+
+  Sums of integer vectors are int! (or bignum! if they exceed 32 bits),
+  while f32 & f64 vectors and all means produce a decimal!.  The minimum,
+  maximum, and mean of an empty vector is none!.
+
+  \param op     UR_VFOLD_SUM, UR_VFOLD_MIN, UR_VFOLD_MAX, UR_VFOLD_MEAN,
+                or UR_VFOLD_DOT.
+  \param vec    Vector to reduce.
+  \param vecB   Second vector for UR_VFOLD_DOT.  The dot product uses the
+                length of the shorter vector.
+  \param res    Result cell.
+
+  \return UR_OK/UR_THROW
+*/
+int ur_vecFold( UThread* ut, int op, const UCell* vec, const UCell* vecB,
+                UCell* res )
+{
+    USeriesIter si;
+    USeriesIter bi;
+    VecAccum acc;
+    int form, len;
+
+    ur_seriesSlice( ut, &si, vec );
+    form = si.buf->form;
+    if( ! vecFormValid( form ) )
+        return ur_error( ut, UR_ERR_TYPE, vecFormError );
+    len = si.end - si.it;
+
+    if( op == UR_VFOLD_DOT )
+    {
+        ur_seriesSlice( ut, &bi, vecB );
+        if( ! vecFormValid( bi.buf->form ) )
+            return ur_error( ut, UR_ERR_TYPE, vecFormError );
+        if( len > bi.end - bi.it )
+            len = bi.end - bi.it;
+
+        if( bi.buf->form != form )
+        {
+            double sum = 0.0;
+            int i;
+            for( i = 0; i < len; ++i )
+                sum += vec_getD( si.buf, si.it + i ) *
+                       vec_getD( bi.buf, bi.it + i );
+            ur_setId(res, UT_DECIMAL);
+            ur_decimal(res) = sum;
+            return UR_OK;
+        }
+    }
+    else if( op == UR_VFOLD_MEAN )
+    {
+        op = UR_VFOLD_SUM;
+        if( ! len )
+            goto empty;
+        _vecKernels.fold[ vecFormIndex(form) ][ op ]( vecElem( si.buf, si.it ),
+                                                      0, len, &acc );
+        ur_setId(res, UT_DECIMAL);
+        ur_decimal(res) = (vecFormInt( form ) ? (double) acc.i : acc.d) / len;
+        return UR_OK;
+    }
+    else if( op < UR_VFOLD_SUM || op > UR_VFOLD_MAX )
+        return ur_error( ut, UR_ERR_SCRIPT, "Invalid vector! fold operation" );
+
+    if( len )
+    {
+        _vecKernels.fold[ vecFormIndex(form) ][ op ]( vecElem( si.buf, si.it ),
+                (op == UR_VFOLD_DOT) ? vecElem( bi.buf, bi.it ) : 0,
+                len, &acc );
+    }
+    else if( op == UR_VFOLD_MIN || op == UR_VFOLD_MAX )
+    {
+        goto empty;
+    }
+    else
+    {
+        memSet( &acc, 0, sizeof(acc) );
+    }
+
+    if( vecFormInt( form ) )
+    {
+        vec_setInt64( res, acc.i );
+    }
+    else
+    {
+        ur_setId(res, UT_DECIMAL);
+        ur_decimal(res) = acc.d;
+    }
+    return UR_OK;
+
+empty:
+
+    ur_setId(res, UT_NONE);
+    return UR_OK;
+}
+
+
+/**
+  Compare each vector element with a number or the corresponding element
+  of another vector.
+
+  \param cmp    UR_VCMP_EQ, UR_VCMP_LT, UR_VCMP_GT, UR_VCMP_LE, or
+                UR_VCMP_GE.
+  \param vec    Vector to test.
+  \param val    Number or vector to compare against.
+  \param res    Result cell.  This is set to a bitset! with a bit set for
+                each element where the comparison is true.
+
+  \return UR_OK/UR_THROW
+*/
+int ur_vecMask( UThread* ut, int cmp, const UCell* vec, const UCell* val,
+                UCell* res )
+{
+    UCell vc;
+    UCell sc;
+    USeriesIter si;
+    USeriesIter bi;
+    UBuffer* bits;
+    const UBuffer* abuf;
+    const UBuffer* bbuf;
+    VecScalar sv;
+    double sn = 0.0;
+    int form, len, exact;
+
+    if( cmp < UR_VCMP_EQ || cmp > UR_VCMP_GE )
+        return ur_error( ut, UR_ERR_SCRIPT, "Invalid vector! comparison" );
+
+    vc = *vec;
+    sc = *val;
+
+    ur_seriesSlice( ut, &si, &vc );
+    form = si.buf->form;
+    if( ! vecFormValid( form ) )
+        return ur_error( ut, UR_ERR_TYPE, vecFormError );
+    len = si.end - si.it;
+
+    if( ur_is(&sc, UT_VECTOR) )
+    {
+        ur_seriesSlice( ut, &bi, &sc );
+        if( ! vecFormValid( bi.buf->form ) )
+            return ur_error( ut, UR_ERR_TYPE, vecFormError );
+        if( len > bi.end - bi.it )
+            len = bi.end - bi.it;
+        exact = (bi.buf->form == form);
+    }
+    else
+    {
+        exact = vec_scalar( &sc, form, &sv, &sn );
+        if( exact < 0 )
+            return ur_error( ut, UR_ERR_TYPE,
+                        "vector! mask expected char!/int!/decimal!/vector!" );
+        bi.it = 0;
+    }
+
+    bits = ur_makeBitsetCell( ut, len, res );   // Invalidates si.buf.
+    abuf = ur_bufferSer( &vc );
+    bbuf = ur_is(&sc, UT_VECTOR) ? ur_bufferSer( &sc ) : 0;
+
+    if( exact )
+    {
+        if( bbuf )
+            _vecKernels.maskV[ vecFormIndex(form) ][ cmp ]( bits->ptr.b,
+                    vecElem( abuf, si.it ), vecElem( bbuf, bi.it ), len );
+        else
+            _vecKernels.maskS[ vecFormIndex(form) ][ cmp ]( bits->ptr.b,
+                    vecElem( abuf, si.it ), &sv, len );
+    }
+    else
+    {
+        double x, y;
+        int i, t = 0;
+        for( i = 0; i < len; ++i )
+        {
+            x = vec_getD( abuf, si.it + i );
+            y = bbuf ? vec_getD( bbuf, bi.it + i ) : sn;
+            switch( cmp )
+            {
+                case UR_VCMP_EQ: t = (x == y); break;
+                case UR_VCMP_LT: t = (x <  y); break;
+                case UR_VCMP_GT: t = (x >  y); break;
+                case UR_VCMP_LE: t = (x <= y); break;
+                case UR_VCMP_GE: t = (x >= y); break;
+            }
+            if( t )
+                bits->ptr.b[ i >> 3 ] |= 1 << (i & 7);
+        }
+    }
+    return UR_OK;
+}
+
+
 extern void binary_mark( UThread* ut, UCell* cell );
 extern void binary_toShared( UCell* cell );
 
@@ -845,7 +1425,7 @@ USeriesType dt_vector =
     {
     "vector!",
     vector_make,            vector_convert,         vector_copy,
-    vector_compare,         unset_operate,          vector_select,
+    vector_compare,         vector_operate,          vector_select,
     vector_toString,        vector_toString,
     unset_recycle,          binary_mark,            ur_arrFree,
     unset_markBuf,          binary_toShared,        unset_bind
@@ -0,0 +1,332 @@
+/*
+  Copyright 2026 Karl Robillard
+
+  This file is part of the Urlan datatype system.
+
+  Urlan is free software: you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Urlan is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with Urlan.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/*
+  Element-wise vector! kernels.
+
+  This file is included by vector.c once for each instruction set, with
+  KN(name) defined to decorate the function names and KATTR set to the
+  target attribute.  The loops are written so the compiler can vectorize
+  them; the float reductions use eight explicit accumulators so that the
+  summation order (and thus the result) is the same for every target.
+*/
+
+
+//----------------------------------------------------------------------------
+// Arithmetic & logic
+
+
+#define VK_BIN(op,tag,T,EXPR) \
+static KATTR void KN(vv_##op##_##tag)( void* rp, const void* ap, \
+                                       const void* bp, int n ) { \
+    T* r = (T*) rp; \
+    const T* a = (const T*) ap; \
+    const T* b = (const T*) bp; \
+    int i; \
+    for( i = 0; i < n; ++i ) \
+        r[i] = EXPR(T, a[i], b[i]); \
+} \
+static KATTR void KN(vs_##op##_##tag)( void* rp, const void* ap, \
+                                       const void* bp, int n ) { \
+    T* r = (T*) rp; \
+    const T* a = (const T*) ap; \
+    const T s = *(const T*) bp; \
+    int i; \
+    for( i = 0; i < n; ++i ) \
+        r[i] = EXPR(T, a[i], s); \
+} \
+static KATTR void KN(sv_##op##_##tag)( void* rp, const void* ap, \
+                                       const void* bp, int n ) { \
+    T* r = (T*) rp; \
+    const T* a = (const T*) ap; \
+    const T s = *(const T*) bp; \
+    int i; \
+    for( i = 0; i < n; ++i ) \
+        r[i] = EXPR(T, s, a[i]); \
+}
+
+#define VK_INT_OPS(tag,T) \
+    VK_BIN(add,tag,T,VK_IADD) \
+    VK_BIN(sub,tag,T,VK_ISUB) \
+    VK_BIN(mul,tag,T,VK_IMUL) \
+    VK_BIN(div,tag,T,VK_IDIV) \
+    VK_BIN(mod,tag,T,VK_IMOD) \
+    VK_BIN(and,tag,T,VK_AND) \
+    VK_BIN(or, tag,T,VK_OR) \
+    VK_BIN(xor,tag,T,VK_XOR)
+
+#define VK_FLOAT_OPS(tag,T) \
+    VK_BIN(add,tag,T,VK_FADD) \
+    VK_BIN(sub,tag,T,VK_FSUB) \
+    VK_BIN(mul,tag,T,VK_FMUL) \
+    VK_BIN(div,tag,T,VK_FDIV) \
+    VK_BIN(mod,tag,T,VK_FMOD)
+
+VK_INT_OPS(i16, int16_t)
+VK_INT_OPS(u16, uint16_t)
+VK_INT_OPS(i32, int32_t)
+VK_INT_OPS(u32, uint32_t)
+VK_FLOAT_OPS(f32, float)
+VK_FLOAT_OPS(f64, double)
+
+
+//----------------------------------------------------------------------------
+// Reductions
+
+
+#define VK_FOLD_INT(tag,T,ACC) \
+static KATTR void KN(sum_##tag)( const void* ap, const void* bp, int n, \
+                                 VecAccum* out ) { \
+    const T* a = (const T*) ap; \
+    ACC acc = 0; \
+    int i; \
+    (void) bp; \
+    for( i = 0; i < n; ++i ) \
+        acc += a[i]; \
+    out->i = (int64_t) acc; \
+} \
+static KATTR void KN(min_##tag)( const void* ap, const void* bp, int n, \
+                                 VecAccum* out ) { \
+    const T* a = (const T*) ap; \
+    T m = a[0]; \
+    int i; \
+    (void) bp; \
+    for( i = 1; i < n; ++i ) \
+        m = (a[i] < m) ? a[i] : m; \
+    out->i = m; \
+} \
+static KATTR void KN(max_##tag)( const void* ap, const void* bp, int n, \
+                                 VecAccum* out ) { \
+    const T* a = (const T*) ap; \
+    T m = a[0]; \
+    int i; \
+    (void) bp; \
+    for( i = 1; i < n; ++i ) \
+        m = (a[i] > m) ? a[i] : m; \
+    out->i = m; \
+} \
+static KATTR void KN(dot_##tag)( const void* ap, const void* bp, int n, \
+                                 VecAccum* out ) { \
+    const T* a = (const T*) ap; \
+    const T* b = (const T*) bp; \
+    ACC acc = 0; \
+    int i; \
+    for( i = 0; i < n; ++i ) \
+        acc += (ACC) a[i] * b[i]; \
+    out->i = (int64_t) acc; \
+}
+
+#define VK_LANES    8
+
+#define VK_FOLD_LANES(INIT,STEP,COMBINE) \
+    for( j = 0; j < VK_LANES; ++j ) \
+        acc[j] = INIT; \
+    for( i = 0; i + VK_LANES <= n; i += VK_LANES ) { \
+        for( j = 0; j < VK_LANES; ++j ) \
+            STEP(acc[j], i + j); \
+    } \
+    for( j = 0; i < n; ++i, ++j ) \
+        STEP(acc[j], i); \
+    for( j = 1; j < VK_LANES; ++j ) \
+        COMBINE(acc[0], acc[j]);
+
+#define VK_STEP_SUM(A,k)    A += a[k]
+#define VK_STEP_MIN(A,k)    A = (a[k] < A) ? a[k] : A
+#define VK_STEP_MAX(A,k)    A = (a[k] > A) ? a[k] : A
+#define VK_STEP_DOT(A,k)    A += (double) a[k] * b[k]
+#define VK_ADD_TO(A,B)      A += B
+#define VK_MIN_TO(A,B)      A = (B < A) ? B : A
+#define VK_MAX_TO(A,B)      A = (B > A) ? B : A
+
+#define VK_FOLD_FLOAT(tag,T) \
+static KATTR void KN(sum_##tag)( const void* ap, const void* bp, int n, \
+                                 VecAccum* out ) { \
+    const T* a = (const T*) ap; \
+    double acc[ VK_LANES ]; \
+    int i, j; \
+    (void) bp; \
+    VK_FOLD_LANES(0.0, VK_STEP_SUM, VK_ADD_TO) \
+    out->d = acc[0]; \
+} \
+static KATTR void KN(min_##tag)( const void* ap, const void* bp, int n, \
+                                 VecAccum* out ) { \
+    const T* a = (const T*) ap; \
+    T acc[ VK_LANES ]; \
+    int i, j; \
+    (void) bp; \
+    VK_FOLD_LANES(a[0], VK_STEP_MIN, VK_MIN_TO) \
+    out->d = acc[0]; \
+} \
+static KATTR void KN(max_##tag)( const void* ap, const void* bp, int n, \
+                                 VecAccum* out ) { \
+    const T* a = (const T*) ap; \
+    T acc[ VK_LANES ]; \
+    int i, j; \
+    (void) bp; \
+    VK_FOLD_LANES(a[0], VK_STEP_MAX, VK_MAX_TO) \
+    out->d = acc[0]; \
+} \
+static KATTR void KN(dot_##tag)( const void* ap, const void* bp, int n, \
+                                 VecAccum* out ) { \
+    const T* a = (const T*) ap; \
+    const T* b = (const T*) bp; \
+    double acc[ VK_LANES ]; \
+    int i, j; \
+    VK_FOLD_LANES(0.0, VK_STEP_DOT, VK_ADD_TO) \
+    out->d = acc[0]; \
+}
+
+VK_FOLD_INT(i16, int16_t, int64_t)
+VK_FOLD_INT(u16, uint16_t, int64_t)
+VK_FOLD_INT(i32, int32_t, int64_t)
+VK_FOLD_INT(u32, uint32_t, uint64_t)
+VK_FOLD_FLOAT(f32, float)
+VK_FOLD_FLOAT(f64, double)
+
+
+//----------------------------------------------------------------------------
+// Comparison masks
+
+
+#define VK_MASK(cmp,tag,T,OP) \
+static KATTR void KN(mv_##cmp##_##tag)( uint8_t* bits, const void* ap, \
+                                        const void* bp, int n ) { \
+    const T* a = (const T*) ap; \
+    const T* b = (const T*) bp; \
+    uint8_t t[ VK_MASK_CHUNK ]; \
+    int i, k, c; \
+    for( i = 0; i < n; i += VK_MASK_CHUNK ) { \
+        c = (n - i < VK_MASK_CHUNK) ? n - i : VK_MASK_CHUNK; \
+        for( k = 0; k < c; ++k ) \
+            t[k] = a[i + k] OP b[i + k]; \
+        vk_packBits( bits + i / 8, t, c ); \
+    } \
+} \
+static KATTR void KN(ms_##cmp##_##tag)( uint8_t* bits, const void* ap, \
+                                        const void* bp, int n ) { \
+    const T* a = (const T*) ap; \
+    const T s = *(const T*) bp; \
+    uint8_t t[ VK_MASK_CHUNK ]; \
+    int i, k, c; \
+    for( i = 0; i < n; i += VK_MASK_CHUNK ) { \
+        c = (n - i < VK_MASK_CHUNK) ? n - i : VK_MASK_CHUNK; \
+        for( k = 0; k < c; ++k ) \
+            t[k] = a[i + k] OP s; \
+        vk_packBits( bits + i / 8, t, c ); \
+    } \
+}
+
+#define VK_MASKS(tag,T) \
+    VK_MASK(eq,tag,T,==) \
+    VK_MASK(lt,tag,T,<) \
+    VK_MASK(gt,tag,T,>) \
+    VK_MASK(le,tag,T,<=) \
+    VK_MASK(ge,tag,T,>=)
+
+VK_MASKS(i16, int16_t)
+VK_MASKS(u16, uint16_t)
+VK_MASKS(i32, int32_t)
+VK_MASKS(u32, uint32_t)
+VK_MASKS(f32, float)
+VK_MASKS(f64, double)
+
+
+//----------------------------------------------------------------------------
+
+
+#define VK_SET_BIN(fi,tag,ops) \
+    kt->vv[fi][UR_OP_ADD] = KN(vv_add_##tag); \
+    kt->vv[fi][UR_OP_SUB] = KN(vv_sub_##tag); \
+    kt->vv[fi][UR_OP_MUL] = KN(vv_mul_##tag); \
+    kt->vv[fi][UR_OP_DIV] = KN(vv_div_##tag); \
+    kt->vv[fi][UR_OP_MOD] = KN(vv_mod_##tag); \
+    kt->vs[fi][UR_OP_ADD] = KN(vs_add_##tag); \
+    kt->vs[fi][UR_OP_SUB] = KN(vs_sub_##tag); \
+    kt->vs[fi][UR_OP_MUL] = KN(vs_mul_##tag); \
+    kt->vs[fi][UR_OP_DIV] = KN(vs_div_##tag); \
+    kt->vs[fi][UR_OP_MOD] = KN(vs_mod_##tag); \
+    kt->sv[fi][UR_OP_ADD] = KN(sv_add_##tag); \
+    kt->sv[fi][UR_OP_SUB] = KN(sv_sub_##tag); \
+    kt->sv[fi][UR_OP_MUL] = KN(sv_mul_##tag); \
+    kt->sv[fi][UR_OP_DIV] = KN(sv_div_##tag); \
+    kt->sv[fi][UR_OP_MOD] = KN(sv_mod_##tag); \
+    ops(fi,tag)
+
+#define VK_SET_LOGIC(fi,tag) \
+    kt->vv[fi][UR_OP_AND] = KN(vv_and_##tag); \
+    kt->vv[fi][UR_OP_OR]  = KN(vv_or_##tag); \
+    kt->vv[fi][UR_OP_XOR] = KN(vv_xor_##tag); \
+    kt->vs[fi][UR_OP_AND] = KN(vs_and_##tag); \
+    kt->vs[fi][UR_OP_OR]  = KN(vs_or_##tag); \
+    kt->vs[fi][UR_OP_XOR] = KN(vs_xor_##tag); \
+    kt->sv[fi][UR_OP_AND] = KN(sv_and_##tag); \
+    kt->sv[fi][UR_OP_OR]  = KN(sv_or_##tag); \
+    kt->sv[fi][UR_OP_XOR] = KN(sv_xor_##tag);
+
+#define VK_SET_NO_LOGIC(fi,tag)
+
+#define VK_SET_FOLD(fi,tag) \
+    kt->fold[fi][UR_VFOLD_SUM] = KN(sum_##tag); \
+    kt->fold[fi][UR_VFOLD_MIN] = KN(min_##tag); \
+    kt->fold[fi][UR_VFOLD_MAX] = KN(max_##tag); \
+    kt->fold[fi][UR_VFOLD_DOT] = KN(dot_##tag); \
+    kt->maskV[fi][UR_VCMP_EQ] = KN(mv_eq_##tag); \
+    kt->maskV[fi][UR_VCMP_LT] = KN(mv_lt_##tag); \
+    kt->maskV[fi][UR_VCMP_GT] = KN(mv_gt_##tag); \
+    kt->maskV[fi][UR_VCMP_LE] = KN(mv_le_##tag); \
+    kt->maskV[fi][UR_VCMP_GE] = KN(mv_ge_##tag); \
+    kt->maskS[fi][UR_VCMP_EQ] = KN(ms_eq_##tag); \
+    kt->maskS[fi][UR_VCMP_LT] = KN(ms_lt_##tag); \
+    kt->maskS[fi][UR_VCMP_GT] = KN(ms_gt_##tag); \
+    kt->maskS[fi][UR_VCMP_LE] = KN(ms_le_##tag); \
+    kt->maskS[fi][UR_VCMP_GE] = KN(ms_ge_##tag);
+
+static void KN(vk_setKernels)( VecKernels* kt )
+{
+    memSet( kt, 0, sizeof(VecKernels) );
+
+    VK_SET_BIN( 0, i16, VK_SET_LOGIC )
+    VK_SET_BIN( 1, u16, VK_SET_LOGIC )
+    VK_SET_BIN( 2, i32, VK_SET_LOGIC )
+    VK_SET_BIN( 3, u32, VK_SET_LOGIC )
+    VK_SET_BIN( 4, f32, VK_SET_NO_LOGIC )
+    VK_SET_BIN( 5, f64, VK_SET_NO_LOGIC )
+
+    VK_SET_FOLD( 0, i16 )
+    VK_SET_FOLD( 1, u16 )
+    VK_SET_FOLD( 2, i32 )
+    VK_SET_FOLD( 3, u32 )
+    VK_SET_FOLD( 4, f32 )
+    VK_SET_FOLD( 5, f64 )
+}
+
+
+#undef VK_BIN
+#undef VK_INT_OPS
+#undef VK_FLOAT_OPS
+#undef VK_FOLD_INT
+#undef VK_FOLD_FLOAT
+#undef VK_MASK
+#undef VK_MASKS
+#undef VK_SET_BIN
+#undef VK_SET_LOGIC
+#undef VK_SET_NO_LOGIC
+#undef VK_SET_FOLD
+
+
+//EOF